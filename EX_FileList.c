@@ -43,6 +43,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "hash.h"
 #include "fs.h"
 #include "vfs.h"
+#include "demo_index.h"
 
 
 // column width
@@ -1567,6 +1568,7 @@ void FL_Draw(filelist_t *fl, int x, int y, int w, int h)
 	int listsize, pos, interline, inter_up, inter_dn, rowh;
 	char line[1024];
 	char sname[MAX_PATH] = {0}, ssize[COL_SIZE+1] = {0}, sdate[COL_DATE+1] = {0}, stime[COL_TIME+1] = {0};
+	char sdemo[256] = {0};
 
 	// Check if it's time for us to reset the search.
 	// (FL_SEARCH_TIMEOUT seconds after the user entered the last char in the search term)
@@ -1914,6 +1916,10 @@ void FL_Draw(filelist_t *fl, int x, int y, int w, int h)
 			strlcpy (sname, line + 1, min(pos, sizeof(sname)));
             strlcpy (stime, time, sizeof(stime));
             snprintf (sdate, sizeof(sdate), "%02d-%02d-%02d", entry->time.wYear % 100, entry->time.wMonth, entry->time.wDay);
+
+			// Map, length and players for demos.
+			if (!entry->is_directory)
+				DemoIndex_Describe (entry->name, sdemo, sizeof(sdemo));
         }
     }
 
@@ -1945,6 +1951,11 @@ void FL_Draw(filelist_t *fl, int x, int y, int w, int h)
                 UI_Print_Center(x, y + h - rowh - inter_up, w, line, true);
             }
         }
+        else if (sdemo[0])
+        {
+            snprintf(line, sizeof(line), "%s \x8f %s", ssize, sdemo);
+            UI_Print_Center(x, y + h - rowh - inter_up, w, line, false);
+        }
         else
         {
             snprintf(line, sizeof(line), "%s \x8f modified: %s %s", ssize, sdate, stime);
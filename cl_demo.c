@@ -38,6 +38,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "version.h"
 #include "demo_controls.h"
 #include "mvd_utils.h"
+#include "demo_index.h"
 #ifndef CLIENTONLY
 #include "server.h"
 #endif
@@ -1569,13 +1570,267 @@ int CL_Demo_Read(void *buf, int size, qbool peek)
 	return need;
 }
 
+//
+// Demo read-ahead.
+//
+// A thread reads the demo file into a ring of demo_readahead kilobytes ahead of
+// the playback position, so file I/O doesn't stall the frame. It is started by
+// the first read and paused before anything else uses playbackfile, then
+// pointed at the new position. The thread lives until the client quits and
+// sleeps on a semaphore while it's paused or the ring is full.
+// demo_readahead_status has the fill level of the ring in percent and the
+// number of underruns, the times playback had to wait for the thread.
+//
+
+#define READAHEAD_CHUNK		(32 * 1024)
+
+cvar_t demo_readahead = {"demo_readahead", "512"};
+cvar_t demo_readahead_status = {"demo_readahead_status", "", CVAR_ROM};
+
+typedef struct readahead_s
+{
+	vfsfile_t		*file;
+	byte			*ring;
+	int				size;
+	int				written, read;		// Bytes put into and taken out of the ring since the start.
+	int				eof;
+	int				pause;				// Set by playback, the thread posts paused once it stopped reading.
+	int				waiting;			// The thread waits for wake because the ring is full.
+	unsigned long	startpos;			// File offset the thread started at.
+	sem_t			wake, paused;
+} readahead_t;
+
+static readahead_t readahead;
+static qbool readahead_thread = false;		// The thread has been created.
+static qbool readahead_running = false;
+static int readahead_underruns = 0;
+static double readahead_statustime = 0;
+
+//
+// Whether a demo file can be played through the read-ahead thread.
+//
+static qbool CL_Demo_ReadAheadAllowed(vfsfile_t *file)
+{
+#ifdef SYS_ATOMICS
+	// The thread is pointed at another offset when seeking.
+	return demo_readahead.integer > 0 && file && !file->seekingisabadplan && cls.mvdplayback != QTV_PLAYBACK;
+#else
+	return false;
+#endif
+}
+
+static DWORD WINAPI CL_Demo_ReadAhead_Thread(void *param)
+{
+	readahead_t *ra = (readahead_t *) param;
+	qbool paused = false;
+	vfserrno_t err;
+	int written, space, chunk, r;
+
+	for (;;)
+	{
+		// wake may be posted more often than needed, everything is checked again after it.
+		if (Sys_AtomicLoad(&ra->pause))
+		{
+			if (!paused)
+			{
+				paused = true;
+				Sys_SemPost(&ra->paused);
+			}
+			Sys_SemWait(&ra->wake);
+			continue;
+		}
+		paused = false;
+
+		if (Sys_AtomicLoad(&ra->eof))
+		{
+			Sys_SemWait(&ra->wake);
+			continue;
+		}
+
+		// Only this thread changes written.
+		written = ra->written;
+		space = ra->size - (written - Sys_AtomicLoad(&ra->read));
+
+		if (space <= 0)
+		{
+			// Look again after saying so, playback may have just made room.
+			Sys_AtomicStore(&ra->waiting, 1);
+			if (ra->size - (written - Sys_AtomicLoad(&ra->read)) <= 0)
+				Sys_SemWait(&ra->wake);
+			Sys_AtomicStore(&ra->waiting, 0);
+			continue;
+		}
+
+		chunk = min(min(space, ra->size - written % ra->size), READAHEAD_CHUNK);
+		r = VFS_READ(ra->file, ra->ring + written % ra->size, chunk, &err);
+
+		if (r <= 0)
+		{
+			Sys_AtomicStore(&ra->eof, 1);
+			continue;
+		}
+
+		Sys_AtomicStore(&ra->written, written + r);
+	}
+
+	return 0;
+}
+
+static qbool CL_Demo_ReadAhead_Start(void)
+{
+	int size = demo_readahead.integer * 1024;
+
+	if (!CL_Demo_ReadAheadAllowed(playbackfile))
+		return false;
+
+	if (!readahead_thread)
+	{
+		if (Sys_SemInit(&readahead.wake, 0, 0x7fffffff))
+			return false;
+
+		if (Sys_SemInit(&readahead.paused, 0, 1))
+		{
+			Sys_SemDestroy(&readahead.wake);
+			return false;
+		}
+	}
+
+	// The thread is paused or not there yet, it doesn't touch any of this.
+	if (readahead.size != size)
+	{
+		Q_free(readahead.ring);
+		readahead.ring = (byte *) Q_malloc(size);
+		readahead.size = size;
+	}
+
+	readahead.file = playbackfile;
+	readahead.startpos = VFS_TELL(playbackfile);
+	readahead.written = readahead.read = 0;
+	readahead.eof = readahead.waiting = 0;
+	Sys_AtomicStore(&readahead.pause, 0);
+
+	if (readahead_thread)
+	{
+		Sys_SemPost(&readahead.wake);
+	}
+	else if (Sys_CreateThread(CL_Demo_ReadAhead_Thread, &readahead))
+	{
+		readahead_thread = true;
+	}
+	else
+	{
+		Sys_SemDestroy(&readahead.wake);
+		Sys_SemDestroy(&readahead.paused);
+		return false;
+	}
+
+	readahead_running = true;
+
+	return true;
+}
+
+//
+// Pauses the read-ahead thread and leaves playbackfile at the playback position.
+//
+static void CL_Demo_ReadAhead_Stop(void)
+{
+	if (!readahead_running)
+		return;
+
+	Sys_AtomicStore(&readahead.pause, 1);
+	Sys_SemPost(&readahead.wake);
+	Sys_SemWait(&readahead.paused);
+	readahead_running = false;
+
+	VFS_SEEK(playbackfile, readahead.startpos + readahead.read, SEEK_SET);
+}
+
+//
+// Takes size bytes from the ring, waiting for the thread if it's behind.
+// Returns less only at the end of the file.
+//
+static int CL_Demo_ReadAhead_Read(byte *buf, int size)
+{
+	int total = 0, avail, pos, n;
+	qbool waited = false;
+
+	while (total < size)
+	{
+		// Look at eof first, written is final once it's set.
+		int eof = Sys_AtomicLoad(&readahead.eof);
+
+		avail = Sys_AtomicLoad(&readahead.written) - readahead.read;
+
+		if (avail <= 0)
+		{
+			if (eof)
+			{
+				pb_eof = true;
+				break;
+			}
+
+			// Waiting for the first data after a (re)start isn't an underrun.
+			if (!waited && readahead.read)
+				readahead_underruns++;
+
+			// The thread may have missed the room made by the last read.
+			if (Sys_AtomicCAS(&readahead.waiting, 1, 0))
+				Sys_SemPost(&readahead.wake);
+
+			waited = true;
+			Sys_MSleep(1);
+			continue;
+		}
+
+		pos = readahead.read % readahead.size;
+		n = min(min(size - total, avail), readahead.size - pos);
+		memcpy(buf + total, readahead.ring + pos, n);
+		total += n;
+
+		Sys_AtomicStore(&readahead.read, readahead.read + n);
+
+		if (Sys_AtomicCAS(&readahead.waiting, 1, 0))
+			Sys_SemPost(&readahead.wake);
+	}
+
+	return total;
+}
+
+//
+// Updates demo_readahead_status twice a second.
+//
+static void CL_Demo_ReadAhead_Status(void)
+{
+	int fill;
+
+	if (!readahead_running || fabs(cls.realtime - readahead_statustime) < 0.5)
+		return;
+
+	readahead_statustime = cls.realtime;
+	fill = (int) (100.0 * (Sys_AtomicLoad(&readahead.written) - readahead.read) / readahead.size);
+	Cvar_ForceSet(&demo_readahead_status, va("%d%% %d", fill, readahead_underruns));
+}
+
+//
+// Position of the playback in the demo file, not counting what's in pb_buf.
+//
+static unsigned long CL_Demo_Tell(void)
+{
+	return readahead_running ? readahead.startpos + readahead.read : VFS_TELL(playbackfile);
+}
+
 //
 // Reads a chunk of data from the playback file and returns the number of bytes read.
 //
 static int pb_raw_read(void *buf, int size)
 {
 	vfserrno_t err;
-	int r = VFS_READ(playbackfile, buf, size, &err);
+	int r;
+
+	if (size > 0 && (readahead_running || CL_Demo_ReadAhead_Start()))
+		return CL_Demo_ReadAhead_Read(buf, size);
+
+	r = VFS_READ(playbackfile, buf, size, &err);
 
 	// Size > 0 mean detect EOF only if we actually trying read some data.
 	if (size > 0 && !r && err == VFSERR_EOF)
@@ -1603,6 +1858,8 @@ qbool pb_ensure(void)
 	// Try to fill the entire buffer with demo data.
 	pb_cnt += pb_raw_read(pb_buf + pb_cnt, max(0, (int)sizeof(pb_buf) - pb_cnt));
 
+	CL_Demo_ReadAhead_Status();
+
 	if (pb_cnt == (int)sizeof(pb_buf) || pb_eof)
 		return true; // Return true if we have full buffer or get EOF.
 
@@ -1875,6 +2132,395 @@ static qbool CL_DemoShouldWeReadNextMessage(float demotime)
 	return true;
 }
 
+//=============================================================================
+//								DEMO INDEX
+//=============================================================================
+
+//
+// The index of the demo being played (see demo_index.c). It gives the length
+// of the demo and the times of the frags, deaths, item pickups and stat changes,
+// so demo_jump_status and demo_events don't need to play through the demo.
+//
+
+static demoindex_t *demo_playback_index = NULL;
+
+//
+// Where the demo file is on disk, looked for in the same order as CL_Play_f does it.
+//
+static qbool CL_Demo_IndexPath(const char *name, char *ospath, int ospathsize)
+{
+	struct stat st;
+
+	if (!strncmp(name, "../", 3) || !strncmp(name, "..\\", 3))
+	{
+		// A truncated path would be somebody else's sidecar.
+		if (snprintf(ospath, ospathsize, "%s/%s", com_basedir, name + 3) >= ospathsize)
+			return false;
+		return !stat(ospath, &st);
+	}
+
+	// In a pak or a zip there is nowhere to save the index.
+	if (FS_FileSource(name, ospath, ospathsize))
+		return ospath[0] != 0;
+
+	if (snprintf(ospath, ospathsize, "%s/%s", CL_DemoDirectory(), name) < ospathsize && !stat(ospath, &st))
+		return true;
+
+	if (strlcpy(ospath, name, ospathsize) >= ospathsize)
+		return false;
+	return !stat(ospath, &st);
+}
+
+//
+// Indexes the demo that is about to be played, playbackfile is at its start.
+//
+static void CL_Demo_IndexPlayback(void)
+{
+	char ospath[MAX_OSPATH];
+
+	if (demo_playback_index || !demo_index.integer || !playbackfile || playbackfile->seekingisabadplan)
+		return;
+
+	demo_playback_index = DemoIndex_Get(playbackfile, CL_Demo_IndexPath(cls.demoname, ospath, sizeof(ospath)) ? ospath : NULL, cls.mvdplayback);
+}
+
+static void CL_Demo_FreeIndex(void)
+{
+	DemoIndex_Free(demo_playback_index);
+	demo_playback_index = NULL;
+}
+
+//
+// Lists the events of the demo being played from the current time on.
+//
+static void CL_Demo_Events_f(void)
+{
+	static char *typenames[DEMOEVENT_MAX] = {"frag", "death", "powerup", "item", "stat"};
+	demoindex_t *idx = demo_playback_index;
+	demoevent_t *ev;
+	int i, j, type = -1, count = 0;
+
+	if (!cls.demoplayback || !idx)
+	{
+		Com_Printf("Error: not playing an indexed demo\n");
+		return;
+	}
+
+	if (Cmd_Argc() > 1)
+	{
+		for (type = 0; type < DEMOEVENT_STAT; type++)
+			if (!strcasecmp(Cmd_Argv(1), typenames[type]))
+				break;
+
+		if (type == DEMOEVENT_STAT)
+		{
+			Com_Printf("Usage: %s [frag|death|powerup|item]\n", Cmd_Argv(0));
+			return;
+		}
+	}
+
+	Com_Printf("%s: %s, %d:%02d, %d events%s\n", COM_SkipPath(cls.demoname), idx->mapname,
+		(int) idx->duration / 60, (int) idx->duration % 60, idx->numevents, idx->complete ? "" : " (incomplete)");
+
+	for (i = 0; i < idx->numplayers; i++)
+	{
+		if (!idx->players[i].spectator)
+			Com_Printf("  %-16s %-8s %4d frags\n", idx->players[i].name, idx->players[i].team, idx->players[i].frags);
+	}
+
+	for (i = DemoIndex_FindEvent(idx, cls.demotime); i < idx->numevents && count < 50; i++)
+	{
+		ev = &idx->events[i];
+
+		if (ev->type == DEMOEVENT_STAT || (type >= 0 && ev->type != type))
+			continue;
+
+		j = (int) (ev->time - demostarttime);
+		Com_Printf("  %2d:%02d %-7s %-16s", j / 60, j % 60, typenames[ev->type],
+			ev->player < MAX_CLIENTS ? cl.players[ev->player].name : "");
+
+		if (ev->type == DEMOEVENT_FRAG)
+			Com_Printf(" %d\n", ev->value);
+		else if (ev->type == DEMOEVENT_POWERUP || ev->type == DEMOEVENT_ITEM)
+			Com_Printf(" %s\n", DemoIndex_ItemName(ev->value));
+		else
+			Com_Printf("\n");
+
+		count++;
+	}
+}
+
+//=============================================================================
+//								DEMO KEYFRAMES
+//=============================================================================
+
+//
+// While a demo plays, the client state is saved every demo_keyframe_interval
+// seconds together with the position in the demo file. Seeking backwards then
+// restores the last keyframe before the destination and seeks forward from there,
+// instead of restarting the demo from the beginning.
+//
+// Keyframes are dropped when the map changes. When they take more than
+// demo_keyframe_memory megabytes, every other one is thrown away and the
+// interval is doubled.
+//
+
+cvar_t demo_keyframe_interval = {"demo_keyframe_interval", "10"};
+cvar_t demo_keyframe_memory = {"demo_keyframe_memory", "64"};		// MB, 0 disables keyframes
+
+static demo_keyframe_t *demo_keyframes = NULL;	// Newest first.
+static int demo_keyframes_size = 0;
+static double demo_keyframe_spacing = 1;		// Doubled each time the keyframes are thinned out.
+
+typedef struct keyframe_cursor_s
+{
+	byte	*data;		// NULL when only getting the size.
+	int		pos;
+	qbool	restore;
+} keyframe_cursor_t;
+
+static void CL_Keyframe_Copy(keyframe_cursor_t *c, void *state, int len)
+{
+	if (c->data)
+	{
+		if (c->restore)
+			memcpy(state, c->data + c->pos, len);
+		else
+			memcpy(c->data + c->pos, state, len);
+	}
+
+	c->pos += len;
+}
+
+#define KEYFRAME_VAR(c, v) CL_Keyframe_Copy((c), &(v), sizeof(v))
+
+//
+// Saves or restores everything a keyframe holds.
+//
+static void CL_Keyframe_State(keyframe_cursor_t *c)
+{
+	packet_entities_t *pe;
+	byte *p = (byte *) &cl;
+	int i;
+
+	// All of cl, but only the entities in use in each frame.
+	// num_entities comes before the entities, so it is restored by the time it's used.
+	for (i = 0; i < UPDATE_BACKUP; i++)
+	{
+		pe = &cl.frames[i].packet_entities;
+		CL_Keyframe_Copy(c, p, (byte *) pe->entities - p);
+		CL_Keyframe_Copy(c, pe->entities, bound(0, pe->num_entities, MAX_MVD_PACKET_ENTITIES) * sizeof(entity_state_t));
+		p = (byte *) (pe->entities + MAX_MVD_PACKET_ENTITIES);
+	}
+	CL_Keyframe_Copy(c, p, (byte *) (&cl + 1) - p);
+
+	KEYFRAME_VAR(c, cl_entities);
+	KEYFRAME_VAR(c, cl_lightstyle);
+
+	KEYFRAME_VAR(c, cls.netchan.incoming_sequence);
+	KEYFRAME_VAR(c, cls.netchan.incoming_acknowledged);
+	KEYFRAME_VAR(c, cls.netchan.incoming_reliable_acknowledged);
+	KEYFRAME_VAR(c, cls.netchan.incoming_reliable_sequence);
+	KEYFRAME_VAR(c, cls.netchan.outgoing_sequence);
+	KEYFRAME_VAR(c, cls.netchan.reliable_sequence);
+	KEYFRAME_VAR(c, cls.netchan.last_reliable_sequence);
+	KEYFRAME_VAR(c, cls.lastto);
+	KEYFRAME_VAR(c, cls.lasttype);
+
+	KEYFRAME_VAR(c, prevtime);
+	KEYFRAME_VAR(c, olddemotime);
+	KEYFRAME_VAR(c, nextdemotime);
+	KEYFRAME_VAR(c, playback_recordtime);
+
+	c->pos += MVD_Stats_Keyframe(c->data ? c->data + c->pos : NULL, c->restore);
+}
+
+static void CL_Demo_FreeKeyframe(demo_keyframe_t *kf)
+{
+	demo_keyframes_size -= kf->size;
+	Q_free(kf->data);
+	Q_free(kf);
+}
+
+void CL_Demo_ClearKeyframes(void)
+{
+	demo_keyframe_t *kf;
+
+	while ((kf = demo_keyframes))
+	{
+		demo_keyframes = kf->prev;
+		CL_Demo_FreeKeyframe(kf);
+	}
+
+	demo_keyframe_spacing = 1;
+}
+
+//
+// Keyframes need a file we can seek in.
+//
+static qbool CL_Demo_KeyframesAllowed(void)
+{
+	return demo_keyframe_memory.value > 0 && playbackfile && cls.demoplayback
+		&& cls.mvdplayback != QTV_PLAYBACK && !cls.nqdemoplayback && !cls.timedemo;
+}
+
+//
+// Keeps the newest keyframe and every other one before it.
+//
+static void CL_Demo_ThinKeyframes(void)
+{
+	demo_keyframe_t *kf, *drop;
+
+	for (kf = demo_keyframes; kf && (drop = kf->prev); kf = kf->prev)
+	{
+		kf->prev = drop->prev;
+		CL_Demo_FreeKeyframe(drop);
+	}
+
+	demo_keyframe_spacing *= 2;
+}
+
+//
+// Called between demo messages, saves a keyframe when it's time for one.
+//
+static void CL_Demo_AddKeyframe(void)
+{
+	keyframe_cursor_t c = {NULL, 0, false};
+	demo_keyframe_t *kf;
+	double time = max(prevtime, nextdemotime);
+
+	if (!CL_Demo_KeyframesAllowed() || cls.state != ca_active || cls.demorewinding)
+		return;
+
+	if (demo_keyframes && time < demo_keyframes->timestamp + max(1, demo_keyframe_interval.value) * demo_keyframe_spacing)
+		return;
+
+	// Get the size, then save.
+	CL_Keyframe_State(&c);
+
+	kf = (demo_keyframe_t *) Q_malloc(sizeof(demo_keyframe_t));
+	kf->size = c.pos;
+	kf->data = (byte *) Q_malloc(kf->size);
+
+	c.data = kf->data;
+	c.pos = 0;
+	CL_Keyframe_State(&c);
+
+	kf->filepos = CL_Demo_Tell() - pb_cnt;
+	kf->timestamp = time;
+	kf->prev = demo_keyframes;
+	demo_keyframes = kf;
+	demo_keyframes_size += kf->size;
+
+	while (demo_keyframes_size > demo_keyframe_memory.value * 1024 * 1024 && demo_keyframes->prev)
+		CL_Demo_ThinKeyframes();
+}
+
+//
+// Goes back to the last keyframe at or before the given demo time.
+// Returns false if there is none, then the demo has to be restarted.
+//
+static qbool CL_Demo_RestoreKeyframe(double time)
+{
+	keyframe_cursor_t c = {NULL, 0, true};
+	demo_keyframe_t *kf;
+	int paused = cl.paused;
+
+	if (!CL_Demo_KeyframesAllowed())
+		return false;
+
+	for (kf = demo_keyframes; kf && kf->timestamp > time; kf = kf->prev)
+		;
+
+	if (!kf)
+		return false;
+
+	CL_Demo_ReadAhead_Stop();
+
+	if (VFS_SEEK(playbackfile, kf->filepos, SEEK_SET))
+		return false;
+
+	c.data = kf->data;
+	CL_Keyframe_State(&c);
+
+	// The user may have paused the demo since.
+	cl.paused = (cl.paused & ~PAUSED_DEMO) | (paused & PAUSED_DEMO);
+
+	CL_Demo_PB_Init(NULL, 0);
+
+	// Effects and temporary entities live in cl.time, which just went back.
+	CL_ClearTEnts();
+	memset(cl_dlights, 0, sizeof(cl_dlights));
+	R_InitParticles();
+
+	// Keep tracking the same player.
+	Cam_Lock(spec_track);
+
+	return true;
+}
+
+//=============================================================================
+//								DEMO SEEKING
+//=============================================================================
+
+//
+// While seeking, every message up to the destination is parsed in a single
+// frame. Only the state needed to resume playback is kept up to date, effects,
+// sounds and HUD messages are skipped (see cl_parse.c and cl_tent.c), and the
+// MVD hooks run once per demo frame instead of once per message.
+//
+
+cvar_t demo_seek_report = {"demo_seek_report", "0"};
+
+static double demo_seek_walltime = 0;			// When the seek started.
+static double demo_seek_fromtime = -1;			// The first demo time parsed, -1 until then.
+static double demo_seek_lastframe = -1;			// Demo time the MVD hooks last ran at.
+static double demo_seek_speed = 0;				// Demo seconds per second of the last seek.
+
+static void CL_Demo_SeekStart (void)
+{
+	demo_seek_walltime = Sys_DoubleTime();
+	demo_seek_fromtime = -1;
+	demo_seek_lastframe = -1;
+}
+
+//
+// Called for each message while seeking, with the time of that message.
+//
+static void CL_Demo_SeekFrame (double demotime)
+{
+	double tmp;
+
+	if (demo_seek_fromtime < 0)
+		demo_seek_fromtime = demotime;
+
+	// Keep MVD features such as itemsclock up-to-date.
+	if (!cls.mvdplayback || demotime == demo_seek_lastframe)
+		return;
+
+	demo_seek_lastframe = demotime;
+
+	tmp = cls.demotime;
+	cls.demotime = demotime;
+	MVD_Interpolate();
+	MVD_Seekhook();
+	cls.demotime = tmp;
+}
+
+static void CL_Demo_SeekDone (double demotime)
+{
+	double wall = Sys_DoubleTime() - demo_seek_walltime;
+	double covered = (demo_seek_fromtime < 0) ? 0 : demotime - demo_seek_fromtime;
+
+	// Solid entities are not updated while seeking, prediction needs them now.
+	CL_SetSolidEntities();
+
+	demo_seek_speed = (wall > 0) ? covered / wall : 0;
+
+	if (demo_seek_report.integer)
+		Com_Printf("Seek: %.1f demo seconds in %.3f seconds (%.0f demo seconds per second)\n", covered, wall, demo_seek_speed);
+}
+
 //
 // When a demo is playing back, all NET_SendMessages are skipped, and NET_GetMessages are read from the demo file.
 // Whenever cl.time gets past the last received message, another message is read from the demo file.
@@ -1943,9 +2589,12 @@ qbool CL_GetDemoMessage (void)
 	if (!cls.mvdplayback || cls.mvdplayback != QTV_PLAYBACK) 
 	{
 		// If we're seeking and our seek destination is in the past we need to rewind.
-		if (cls.demoseeking && !cls.demorewinding && (cls.demotime < nextdemotime))
+		// Go back to the last keyframe before it if we have one, then seek forward as usual.
+		if (cls.demoseeking && !cls.demorewinding && (cls.demotime < nextdemotime)
+			&& !CL_Demo_RestoreKeyframe(cls.demotime))
 		{
 			// Restart playback from the start of the file and then demo seek to the rewind spot.
+			CL_Demo_ReadAhead_Stop();
 			VFS_SEEK(playbackfile, 0, SEEK_SET);
 
 			// We need to save track information.
@@ -1995,6 +2644,8 @@ qbool CL_GetDemoMessage (void)
 	// from the demo file and pass it on to the net channel.
 	while (true)
 	{
+		CL_Demo_AddKeyframe();
+
 		// Make sure we have enough data in the buffer.
 		if (!pb_ensure())
 			return false;
@@ -2006,14 +2657,8 @@ qbool CL_GetDemoMessage (void)
 		if (cls.demoseeking && demotime > prevtime)
 			cl.gametime += demotime - prevtime;
 
-		// Keep MVD features such as itemsclock up-to-date during seeking
-		if (cls.demoseeking) {
-			double tmp = cls.demotime;
-			cls.demotime = demotime;
-			MVD_Interpolate();
-			MVD_Mainhook();
-			cls.demotime = tmp;
-		}
+		if (cls.demoseeking)
+			CL_Demo_SeekFrame(demotime);
 
 		if (cls.demoseeking == DST_SEEKING_STATUS)
 			CL_Demo_Jump_Status_Check();
@@ -2026,6 +2671,7 @@ qbool CL_GetDemoMessage (void)
 		if (cls.demoseeking && cls.demotime <= demotime)
 		{
 			cls.demoseeking = DST_SEEKING_NONE;
+			CL_Demo_SeekDone(demotime);
 
 			if (cls.demorewinding)
 			{
@@ -3146,28 +3792,157 @@ static int CL_GetUnpackedDemoPath (char *play_path, char *unpacked_path, int unp
 #endif // WITH_VFS_ARCHIVE_LOADING
 #endif // WITH_ZIP
 
-void CL_Demo_DumpBenchmarkResult(int frames, float timet)
+//
+// Timedemo results.
+//
+// Every frame of a timedemo is timed, and so is the time spent in each of the
+// parts of timedemo_part_t. When the demo ends the frame times are reported as
+// min, 1st, 50th and 99th percentile and max, and appended to timedemo.log,
+// timedemo.csv or timedemo.json in the log dir depending on demo_benchmarkformat.
+// The times are taken on the CPU, the renderer parts don't wait for the GPU.
+//
+
+cvar_t demo_benchmarkformat = {"demo_benchmarkformat", "xml"};	// xml, csv or json
+cvar_t demo_benchmarkframes = {"demo_benchmarkframes", "0"};	// Also save every frame time to timedemo_frames.csv
+
+static char *timedemo_partnames[TDP_MAX] = {"parse", "link", "predict", "world", "models", "particles", "hud", "sound"};
+
+typedef struct timedemo_result_s
+{
+	int		frames;
+	double	time;
+	double	min, p1, p50, p99, max;		// Frame times in ms.
+	double	parts[TDP_MAX];				// ms per frame.
+	char	date[32];
+} timedemo_result_t;
+
+static float *timedemo_frametimes = NULL;	// ms
+static int timedemo_numframes = 0;
+static int timedemo_maxframes = 0;
+static double timedemo_lastframe = 0;
+static double timedemo_parts[TDP_MAX];
+
+static void CL_TimeDemo_Reset(void)
+{
+	timedemo_numframes = 0;
+	timedemo_lastframe = 0;
+	memset(timedemo_parts, 0, sizeof(timedemo_parts));
+}
+
+//
+// Returns the time to pass to CL_TimeDemo_PartEnd, 0 when not timing.
+//
+double CL_TimeDemo_PartStart(void)
+{
+	return (cls.timedemo && cls.td_starttime) ? Sys_DoubleTime() : 0;
+}
+
+void CL_TimeDemo_PartEnd(timedemo_part_t part, double start)
+{
+	if (start)
+		timedemo_parts[part] += Sys_DoubleTime() - start;
+}
+
+//
+// Called at the end of each client frame.
+//
+void CL_TimeDemo_Frame(void)
+{
+	double now;
+
+	if (!cls.timedemo || !cls.td_starttime)
+		return;
+
+	now = Sys_DoubleTime();
+
+	if (timedemo_lastframe)
+	{
+		if (timedemo_numframes == timedemo_maxframes)
+		{
+			timedemo_maxframes = max(1024, timedemo_maxframes * 2);
+			timedemo_frametimes = (float *) Q_realloc(timedemo_frametimes, timedemo_maxframes * sizeof(float));
+		}
+
+		timedemo_frametimes[timedemo_numframes++] = (now - timedemo_lastframe) * 1000;
+	}
+
+	timedemo_lastframe = now;
+}
+
+static int CL_TimeDemo_CompareFrames(const void *a, const void *b)
+{
+	float x = *(const float *) a, y = *(const float *) b;
+
+	return (x > y) - (x < y);
+}
+
+static void CL_TimeDemo_Result(timedemo_result_t *r, int frames, double timet)
 {
-	char logfile[MAX_PATH];
-	char datebuf[32];
-	FILE* f;
 	time_t t = time(&t);
 	struct tm *ptm = localtime(&t);
-	int width = 0, height = 0; 
+	float *sorted;
+	int i, n = timedemo_numframes;
+
+	memset(r, 0, sizeof(*r));
+	r->frames = frames;
+	r->time = timet;
+
+	if (ptm)
+		strftime(r->date, sizeof(r->date) - 1, "%Y-%m-%dT%H:%M:%S", ptm);
+
+	if (n)
+	{
+		sorted = (float *) Q_malloc(n * sizeof(float));
+		memcpy(sorted, timedemo_frametimes, n * sizeof(float));
+		qsort(sorted, n, sizeof(float), CL_TimeDemo_CompareFrames);
+
+		r->min = sorted[0];
+		r->p1 = sorted[(int) (0.01 * (n - 1) + 0.5)];
+		r->p50 = sorted[(int) (0.50 * (n - 1) + 0.5)];
+		r->p99 = sorted[(int) (0.99 * (n - 1) + 0.5)];
+		r->max = sorted[n - 1];
+
+		Q_free(sorted);
+	}
+
+	for (i = 0; i < TDP_MAX; i++)
+		r->parts[i] = frames > 0 ? timedemo_parts[i] * 1000 / frames : 0;
+}
+
+static void CL_TimeDemo_PrintResult(timedemo_result_t *r)
+{
+	int i;
 
-	snprintf(logfile, sizeof(logfile), "%s/timedemo.log", FS_LegacyDir(log_dir.string));
-	f = fopen(logfile, "a");
-	if (!f) {
+	Com_Printf("frame ms: min %.2f  p1 %.2f  p50 %.2f  p99 %.2f  max %.2f\n", r->min, r->p1, r->p50, r->p99, r->max);
+
+	Com_Printf("ms/frame:");
+	for (i = 0; i < TDP_MAX; i++)
+		Com_Printf(" %s %.2f", timedemo_partnames[i], r->parts[i]);
+	Com_Printf("\n");
+}
+
+static FILE *CL_TimeDemo_OpenLog(const char *filename, const char *mode)
+{
+	char logfile[MAX_PATH];
+	FILE *f;
+
+	snprintf(logfile, sizeof(logfile), "%s/%s", FS_LegacyDir(log_dir.string), filename);
+	if (!(f = fopen(logfile, mode)))
 		Com_Printf("Can't open %s to dump timedemo result\n", logfile);
+
+	return f;
+}
+
+static void CL_Demo_DumpBenchmarkXML(timedemo_result_t *r)
+{
+	FILE* f;
+	int i, width = 0, height = 0; 
+
+	if (!(f = CL_TimeDemo_OpenLog("timedemo.log", "a")))
 		return;
-	}
 
 	fputs("<timedemo date=\"", f);
-	if (ptm)
-		strftime (datebuf, sizeof(datebuf) - 1, "%Y-%m-%dT%H:%M:%S", ptm);
-	else
-		*datebuf = '\0';
-	fputs(datebuf, f); fputs("\">\n", f);
+	fputs(r->date, f); fputs("\">\n", f);
 
 	fputs(va("\t<system>\n\t\t<os>%s</os>\n\t\t<hardware>%s</hardware>\n\t</system>\n", QW_PLATFORM, SYSINFO_GetString()), f);
 
@@ -3180,13 +3955,147 @@ void CL_Demo_DumpBenchmarkResult(int frames, float timet)
 
 	fputs(va("\t<demo><name>%s</name></demo>\n", cls.demoname), f);
 
-	fputs(va("\t<result frames=\"%i\" time=\"PT%fS\" fps=\"%f\"/>\n", frames, timet, frames/timet), f);
+	fputs(va("\t<result frames=\"%i\" time=\"PT%fS\" fps=\"%f\"/>\n", r->frames, r->time, r->frames/r->time), f);
+
+	fputs(va("\t<frametime min=\"%f\" p1=\"%f\" p50=\"%f\" p99=\"%f\" max=\"%f\"/>\n", r->min, r->p1, r->p50, r->p99, r->max), f);
+
+	fputs("\t<parts", f);
+	for (i = 0; i < TDP_MAX; i++)
+		fputs(va(" %s=\"%f\"", timedemo_partnames[i], r->parts[i]), f);
+	fputs("/>\n", f);
 	
 	fputs("</timedemo>\n", f);
 
 	fclose(f);
 }
 
+static void CL_TimeDemo_CSVString(FILE *f, const char *s)
+{
+	fputc('"', f);
+	for (; *s; s++)
+	{
+		if (*s == '"')
+			fputc('"', f);
+		fputc(*s, f);
+	}
+	fputs("\",", f);
+}
+
+//
+// One line per run, with a header when the file is new.
+//
+static void CL_Demo_DumpBenchmarkCSV(timedemo_result_t *r)
+{
+	FILE *f;
+	int i;
+
+	if (!(f = CL_TimeDemo_OpenLog("timedemo.csv", "a")))
+		return;
+
+	fseek(f, 0, SEEK_END);
+	if (!ftell(f))
+	{
+		fputs("date,version,os,configuration,rendering,hardware,demo,frames,time,fps,min,p1,p50,p99,max", f);
+		for (i = 0; i < TDP_MAX; i++)
+			fprintf(f, ",%s", timedemo_partnames[i]);
+		fputs("\n", f);
+	}
+
+	CL_TimeDemo_CSVString(f, r->date);
+	CL_TimeDemo_CSVString(f, VersionString());
+	CL_TimeDemo_CSVString(f, QW_PLATFORM);
+	CL_TimeDemo_CSVString(f, QW_CONFIGURATION);
+	CL_TimeDemo_CSVString(f, QW_RENDERER);
+	CL_TimeDemo_CSVString(f, SYSINFO_GetString());
+	CL_TimeDemo_CSVString(f, cls.demoname);
+	fprintf(f, "%d,%f,%f,%f,%f,%f,%f,%f", r->frames, r->time, r->frames / r->time, r->min, r->p1, r->p50, r->p99, r->max);
+	for (i = 0; i < TDP_MAX; i++)
+		fprintf(f, ",%f", r->parts[i]);
+	fputs("\n", f);
+
+	fclose(f);
+}
+
+static void CL_TimeDemo_JSONString(FILE *f, const char *key, const char *s)
+{
+	fprintf(f, "\"%s\": \"", key);
+	for (; *s; s++)
+	{
+		if (*s == '"' || *s == '\\')
+			fprintf(f, "\\%c", *s);
+		else if ((byte) *s < 32 || (byte) *s > 126)
+			fprintf(f, "\\u%04x", (byte) *s);
+		else
+			fputc(*s, f);
+	}
+	fputs("\", ", f);
+}
+
+//
+// One JSON object per line and run.
+//
+static void CL_Demo_DumpBenchmarkJSON(timedemo_result_t *r)
+{
+	FILE *f;
+	int i;
+
+	if (!(f = CL_TimeDemo_OpenLog("timedemo.json", "a")))
+		return;
+
+	fputs("{", f);
+	CL_TimeDemo_JSONString(f, "date", r->date);
+	CL_TimeDemo_JSONString(f, "version", VersionString());
+	CL_TimeDemo_JSONString(f, "os", QW_PLATFORM);
+	CL_TimeDemo_JSONString(f, "configuration", QW_CONFIGURATION);
+	CL_TimeDemo_JSONString(f, "rendering", QW_RENDERER);
+	CL_TimeDemo_JSONString(f, "hardware", SYSINFO_GetString());
+	CL_TimeDemo_JSONString(f, "demo", cls.demoname);
+	fprintf(f, "\"frames\": %d, \"time\": %f, \"fps\": %f, ", r->frames, r->time, r->frames / r->time);
+	fprintf(f, "\"frametime\": {\"min\": %f, \"p1\": %f, \"p50\": %f, \"p99\": %f, \"max\": %f}, ", r->min, r->p1, r->p50, r->p99, r->max);
+	fputs("\"parts\": {", f);
+	for (i = 0; i < TDP_MAX; i++)
+		fprintf(f, "%s\"%s\": %f", i ? ", " : "", timedemo_partnames[i], r->parts[i]);
+	fputs("}}\n", f);
+
+	fclose(f);
+}
+
+static void CL_Demo_DumpBenchmarkFrames(void)
+{
+	FILE *f;
+	int i;
+
+	if (!(f = CL_TimeDemo_OpenLog("timedemo_frames.csv", "w")))
+		return;
+
+	fputs("frame,ms\n", f);
+	for (i = 0; i < timedemo_numframes; i++)
+		fprintf(f, "%d,%f\n", i, timedemo_frametimes[i]);
+
+	fclose(f);
+}
+
+void CL_Demo_DumpBenchmarkResult(int frames, float timet)
+{
+	timedemo_result_t r;
+
+	CL_TimeDemo_Result(&r, frames, timet);
+	CL_TimeDemo_PrintResult(&r);
+
+	if (!demo_benchmarkdumps.integer)
+		return;
+
+	if (!strcasecmp(demo_benchmarkformat.string, "csv"))
+		CL_Demo_DumpBenchmarkCSV(&r);
+	else if (!strcasecmp(demo_benchmarkformat.string, "json"))
+		CL_Demo_DumpBenchmarkJSON(&r);
+	else
+		CL_Demo_DumpBenchmarkXML(&r);
+
+	if (demo_benchmarkframes.integer)
+		CL_Demo_DumpBenchmarkFrames();
+}
+
 //
 // Stops demo playback.
 //
@@ -3204,6 +4113,10 @@ void CL_StopPlayback (void)
 		Movie_Stop();
 
 	// Close the playback file.
+	CL_Demo_ReadAhead_Stop();
+	readahead_underruns = 0;
+	Cvar_ForceSet(&demo_readahead_status, "");
+
 	if (playbackfile)
 		VFS_CLOSE(playbackfile);
 
@@ -3240,8 +4153,7 @@ void CL_StopPlayback (void)
 		if (time <= 0)
 			time = 1;
 		Com_Printf ("%i frames %5.1f seconds %5.1f fps\n", frames, time, frames / time);
-		if (demo_benchmarkdumps.integer)
-			CL_Demo_DumpBenchmarkResult(frames, time);
+		CL_Demo_DumpBenchmarkResult(frames, time);
 	}
 
 	// Go to the next demo in the demo playlist.
@@ -3254,6 +4166,8 @@ void CL_StopPlayback (void)
 	// Reset demoseeking and such.
 	cls.demoseeking = DST_SEEKING_NONE;
 	cls.demorewinding = false;
+	CL_Demo_ClearKeyframes();
+	CL_Demo_FreeIndex();
 
 	TP_ExecTrigger("f_demoend");
 }
@@ -3515,10 +4429,19 @@ static void CL_DemoPlaybackInit(void)
 	}
 	else
 	{
-		// Calculate the demo time.
+		// Calculate the demo time, the index has it if we can make one.
 		double start = Sys_DoubleTime();
-		demo_time_length = CL_CalculateDemoTime(playbackfile);
-		Com_DPrintf("Demo probe took %f seconds.\n", Sys_DoubleTime() - start);
+
+		CL_Demo_IndexPlayback();
+		if (demo_playback_index)
+		{
+			demo_time_length = demo_playback_index->duration;
+		}
+		else
+		{
+			demo_time_length = CL_CalculateDemoTime(playbackfile);
+			Com_DPrintf("Demo probe took %f seconds.\n", Sys_DoubleTime() - start);
+		}
 	}
 
 	// Setup the netchan and state.
@@ -3686,8 +4609,8 @@ void CL_Play_f (void)
 	}
 	#endif // WITH_VFS_ARCHIVE_LOADING else
 
-	// Read the file completely into memory
-	if (playbackfile) 
+	// Read the file completely into memory, unless the read-ahead thread streams it.
+	if (playbackfile && !CL_Demo_ReadAheadAllowed(playbackfile)) 
 	{
 		size_t len;
 		void *buf;
@@ -3756,6 +4679,7 @@ void CL_TimeDemo_f (void)
 	// so all the loading time doesn't get counted.
 
 	cls.timedemo = true;
+	CL_TimeDemo_Reset();
 	cls.td_starttime = 0;
 	cls.td_startframe = cls.framecount;
 	cls.td_lastframe = -1;		// Get a new message this frame.
@@ -4147,6 +5071,7 @@ void CL_QTVPlay (vfsfile_t *newf, void *buf, int buflen)
 
 	// Close the old playback file just in case, and
 	// open the "network file" for QTV playback.
+	CL_Demo_ReadAhead_Stop();
 	if (playbackfile)
 		VFS_CLOSE(playbackfile);
 	playbackfile = newf;
@@ -4645,34 +5570,34 @@ static void CL_Demo_Jump_Status_Condition_Negate (demoseekingstatus_condition_t
 	}
 }
 
-static qbool CL_Demo_Jump_Status_Match (demoseekingstatus_condition_t *condition)
+static qbool CL_Demo_Jump_Status_Match (demoseekingstatus_condition_t *condition, int *stats)
 {
-	if (condition->or && CL_Demo_Jump_Status_Match(condition->or))
+	if (condition->or && CL_Demo_Jump_Status_Match(condition->or, stats))
 		return true;
 
 	switch (condition->type) {
 		case DEMOSEEKINGSTATUS_MATCH_EQUAL:
-			if (cl.stats[condition->stat] != condition->value)
+			if (stats[condition->stat] != condition->value)
 				return false;
 			break;
 		case DEMOSEEKINGSTATUS_MATCH_NOT_EQUAL:
-			if (cl.stats[condition->stat] == condition->value)
+			if (stats[condition->stat] == condition->value)
 				return false;
 			break;
 		case DEMOSEEKINGSTATUS_MATCH_LESS_THAN:
-			if (cl.stats[condition->stat] >= condition->value)
+			if (stats[condition->stat] >= condition->value)
 				return false;
 			break;
 		case DEMOSEEKINGSTATUS_MATCH_GREATER_THAN:
-			if (cl.stats[condition->stat] <= condition->value)
+			if (stats[condition->stat] <= condition->value)
 				return false;
 			break;
 		case DEMOSEEKINGSTATUS_MATCH_BIT_ON:
-			if (!(cl.stats[condition->stat] & condition->value))
+			if (!(stats[condition->stat] & condition->value))
 				return false;
 			break;
 		case DEMOSEEKINGSTATUS_MATCH_BIT_OFF:
-			if (cl.stats[condition->stat] & condition->value)
+			if (stats[condition->stat] & condition->value)
 				return false;
 			break;
 		default:
@@ -4681,7 +5606,7 @@ static qbool CL_Demo_Jump_Status_Match (demoseekingstatus_condition_t *condition
 	}
 
 	if (condition->and != NULL) {
-		return CL_Demo_Jump_Status_Match(condition->and);
+		return CL_Demo_Jump_Status_Match(condition->and, stats);
 	} else {
 		return true;
 	}
@@ -4689,7 +5614,7 @@ static qbool CL_Demo_Jump_Status_Match (demoseekingstatus_condition_t *condition
 
 static void CL_Demo_Jump_Status_Check (void)
 {
-	if (CL_Demo_Jump_Status_Match(cls.demoseekingstatus.conditions)) {
+	if (CL_Demo_Jump_Status_Match(cls.demoseekingstatus.conditions, cl.stats)) {
 		if (cls.demoseekingstatus.non_matching_found) {
 			CL_Demo_Jump_Status_Free(cls.demoseekingstatus.conditions);
 			cls.demoseekingstatus.conditions = NULL;
@@ -4700,6 +5625,50 @@ static void CL_Demo_Jump_Status_Check (void)
 	}
 }
 
+//
+// Finds where the conditions are met in the demo index, instead of playing through the demo.
+// The stat changes of the tracked player are applied to the current stats until they match.
+//
+static void CL_Demo_Jump_Status_Indexed (void)
+{
+	demoindex_t *idx = demo_playback_index;
+	demoevent_t *ev;
+	int stats[MAX_CL_STATS];
+	int i, player = cls.mvdplayback ? Cam_TrackNum() : idx->pov;
+	qbool non_matching_found;
+
+	memcpy(stats, cl.stats, sizeof(stats));
+	non_matching_found = !CL_Demo_Jump_Status_Match(cls.demoseekingstatus.conditions, stats);
+
+	for (i = DemoIndex_FindEvent(idx, cls.demotime); i < idx->numevents; i++)
+	{
+		ev = &idx->events[i];
+
+		if (ev->type == DEMOEVENT_STAT && ev->player == player)
+			stats[ev->stat] = ev->value;
+
+		// Only look at the stats once all the changes made at the same time are in.
+		if (i + 1 < idx->numevents && idx->events[i + 1].time == ev->time)
+			continue;
+
+		if (!CL_Demo_Jump_Status_Match(cls.demoseekingstatus.conditions, stats))
+			non_matching_found = true;
+		else if (non_matching_found)
+			break;
+	}
+
+	CL_Demo_Jump_Status_Free(cls.demoseekingstatus.conditions);
+	cls.demoseekingstatus.conditions = NULL;
+
+	if (i == idx->numevents)
+	{
+		Com_Printf("Conditions not met in the rest of the demo\n");
+		return;
+	}
+
+	CL_Demo_Jump(idx->events[i].time + 0.0005 - demostarttime, 0, DST_SEEKING_NORMAL);
+}
+
 static int CL_Demo_Jump_Status_Parse_Weapon (const char *arg)
 {
 	if (!strcasecmp("axe", arg)) {
@@ -4857,6 +5826,12 @@ static void CL_Demo_Jump_Status_f (void)
 		or = false;
 	}
 
+	// MVDs have the stats of all the players, but only the tracked one can be searched.
+	if (demo_playback_index && demo_playback_index->complete && (!cls.mvdplayback || Cam_TrackNum() >= 0)) {
+		CL_Demo_Jump_Status_Indexed();
+		return;
+	}
+
 	CL_Demo_Jump(99999, 0, DST_SEEKING_STATUS);
 }
 
@@ -4869,6 +5844,13 @@ void CL_Demo_Jump(double seconds, int relative, demoseekingtype_t seeking)
 	// Calculate the new demo time we want to jump to.
 	double newdemotime = relative ? (cls.demotime + (relative * seconds)) : (demostarttime + seconds);
 
+	// Jumping past the end would just end the demo, stop at the last message instead.
+	if (seeking == DST_SEEKING_NORMAL && demo_playback_index && demo_playback_index->complete
+		&& newdemotime > demo_playback_index->endtime)
+	{
+		newdemotime = max(cls.demotime, demo_playback_index->endtime);
+	}
+
 	// We need to rewind.
 	if (newdemotime < cls.demotime)
 	{
@@ -4879,6 +5861,7 @@ void CL_Demo_Jump(double seconds, int relative, demoseekingtype_t seeking)
 	cls.demotime = newdemotime;
 
 	cls.demoseeking = seeking;
+	CL_Demo_SeekStart();
 }
 
 double Demo_GetSpeed(void)
@@ -4973,6 +5956,7 @@ void CL_Demo_Init(void)
 	Cmd_AddCommand ("qtvlist", CL_QTVList_f);
 	Cmd_AddCommand ("qtvdemolist", CL_QTVList_f);
 	Cmd_AddCommand ("qtvreconnect", CL_QTVReconnect_f);
+	Cmd_AddCommand ("demo_events", CL_Demo_Events_f);
 
 	Cvar_SetCurrentGroup(CVAR_GROUP_DEMO);
 #ifdef _WIN32
@@ -4980,6 +5964,14 @@ void CL_Demo_Init(void)
 #endif
 	Cvar_Register(&demo_dir);
 	Cvar_Register(&demo_benchmarkdumps);
+	Cvar_Register(&demo_benchmarkformat);
+	Cvar_Register(&demo_benchmarkframes);
+	Cvar_Register(&demo_keyframe_interval);
+	Cvar_Register(&demo_keyframe_memory);
+	Cvar_Register(&demo_index);
+	Cvar_Register(&demo_seek_report);
+	Cvar_Register(&demo_readahead);
+	Cvar_Register(&demo_readahead_status);
 	Cvar_Register(&cl_startupdemo);
 
 	Cvar_ResetCurrentGroup();
@@ -1213,6 +1213,9 @@ void CL_ClearState (void)
 
 	CL_ClearPredict();
 
+	// Demo keyframes are only good for the map they were taken on.
+	CL_Demo_ClearKeyframes();
+
 	// Wipe the entire cl structure.
 	memset(&cl, 0, sizeof(cl));
 
@@ -2218,6 +2221,7 @@ void CL_Frame (double time)
 	static double extratime = 0.001;
 	double minframetime;
 	static double	extraphysframetime;	//#fps
+	double td;
 
 	extern cvar_t r_lerpframes;
 	extern cvar_t gl_clear;
@@ -2343,6 +2347,7 @@ void CL_Frame (double time)
 			SV_Frame(cls.frametime);
 
 		// fetch results from server
+		td = CL_TimeDemo_PartStart();
 		CL_ReadPackets();
 
 		TP_UpdateSkins();
@@ -2357,6 +2362,7 @@ void CL_Frame (double time)
 				StatsGrid_Gather();
 			}
 		}
+		CL_TimeDemo_PartEnd(TDP_PARSE, td);
 
 		// process stuffed commands
 		Cbuf_ExecuteEx(&cbuf_svc);
@@ -2388,6 +2394,7 @@ void CL_Frame (double time)
 				SV_Frame (physframetime);
 
 			// Fetch results from server
+			td = CL_TimeDemo_PartStart();
 			CL_ReadPackets();
 
 			TP_UpdateSkins();
@@ -2403,6 +2410,7 @@ void CL_Frame (double time)
 					StatsGrid_Gather();
 				}
 			}
+			CL_TimeDemo_PartEnd(TDP_PARSE, td);
 
 			// process stuffed commands
 			Cbuf_ExecuteEx(&cbuf_svc);
@@ -2470,6 +2478,8 @@ void CL_Frame (double time)
 		}
 		Cam_SetViewPlayer();
 
+		td = CL_TimeDemo_PartStart();
+
 		// Set up prediction for other players
 		if (setup_player_prediction)
 		{
@@ -2485,8 +2495,12 @@ void CL_Frame (double time)
 			CL_SetUpPlayerPrediction(true);
 		}
 
+		CL_TimeDemo_PartEnd(TDP_PREDICT, td);
+
 		// build a refresh entity list
+		td = CL_TimeDemo_PartStart();
 		CL_EmitEntities();
+		CL_TimeDemo_PartEnd(TDP_LINK, td);
 	}
 
 	//
@@ -2526,6 +2540,7 @@ void CL_Frame (double time)
 	CL_DecayLights();
 
 	// update audio
+	td = CL_TimeDemo_PartStart();
 	if ((CURRVIEW == 2 && cl_multiview.value && cls.mvdplayback) || (!cls.mvdplayback || cl_multiview.value < 2))
 	{
 		if (cls.state == ca_active)
@@ -2552,6 +2567,7 @@ void CL_Frame (double time)
 
 		CDAudio_Update();
 	}
+	CL_TimeDemo_PartEnd(TDP_SOUND, td);
 
 	MT_Frame();
 
@@ -2562,6 +2578,8 @@ void CL_Frame (double time)
 
 	cls.framecount++;
 
+	CL_TimeDemo_Frame();
+
 	fps_count++;
 
 	CL_CalcFPS();
@@ -2353,7 +2353,8 @@ static void FlushString (const wchar *s, int level, qbool team, int offset)
 
 	s0 = wcs2str (s);
 	f = strstr (s0, name.string);
-	CL_SearchForReTriggers (s0, 1<<level); // re_triggers, s0 not modified
+	if (!cls.demoseeking)
+		CL_SearchForReTriggers (s0, 1<<level); // re_triggers, s0 not modified
 
 	// Highlighting on && nickname found && it's not our own text (nickname not close to the beginning)
 	if (con_highlight.value && f && ((f - s0) > 1)) 
@@ -2407,6 +2408,10 @@ static void FlushString (const wchar *s, int level, qbool team, int offset)
 	if (team)
 		level = 4;
 
+	// Don't fire message triggers for everything skipped over when seeking.
+	if (cls.demoseeking)
+		return;
+
 	TP_SearchForMsgTriggers ((const char *)wcs2str(s + offset), level);
 }
 
@@ -2723,7 +2728,7 @@ void CL_ParsePrint ()
             chat_sound_vol = con_sound_other_volume.value;
         }
 		
-		if (chat_sound_vol > 0) 
+		if (chat_sound_vol > 0 && !cls.demoseeking) 
 		{
             S_LocalSoundWithVol(chat_sound_file, chat_sound_vol);
 		}
@@ -3608,5 +3613,7 @@ void CL_ParseServerMessage (void)
 			CL_WriteDemoMessage (&cls.demomessage);
 	}
 
-	CL_SetSolidEntities ();
+	// When seeking this is done once the seek is over.
+	if (!cls.demoseeking)
+		CL_SetSolidEntities ();
 }
@@ -3362,6 +3362,7 @@ void SCR_UpdateScreen (void)
 {
 	static hud_t *hud_netstats = NULL;
 	extern qbool Minimized;
+	double td;
 
 	if (hud_netstats == NULL) // first time
 		hud_netstats = HUD_Find("net");
@@ -3466,7 +3467,9 @@ void SCR_UpdateScreen (void)
 		Cvar_SetValue(hud_netstats->show, temp);
 	}
 
+	td = CL_TimeDemo_PartStart();
 	SCR_DrawElements();
+	CL_TimeDemo_PartEnd(TDP_HUD, td);
 
 	// For multiview:
 	// If we apply the brightness on each update
@@ -170,7 +170,8 @@ typedef struct demo_keyframe_s
 	unsigned long			filepos;	// The position in the demo file where the keyframe can be found.
 	double					timestamp;	// The time stamp in question.
 	struct demo_keyframe_s	*prev;
-	// TODO : Add any state information needed to reproduce this frame.
+	int						size;
+	byte					*data;		// The client state, see CL_Keyframe_State.
 } demo_keyframe_t;
 
 typedef struct 
@@ -694,6 +695,7 @@ void CL_WriteDemoMessage (sizebuf_t *msg);
 void CL_WriteDemoEntities (void);
 void CL_WriteServerdata (sizebuf_t *msg);
 void CL_StopPlayback (void);
+void CL_Demo_ClearKeyframes (void);
 void CL_Stop_f (void);
 void CL_CheckQizmoCompletion(void);
 void CL_Demo_Jump(double seconds, int relative, demoseekingtype_t seeking);
@@ -701,6 +703,24 @@ void CL_Demo_Init(void);
 double Demo_GetSpeed(void);
 qbool CL_IsDemoExtension(const char *filename);
 
+// Where the time of a timedemo frame goes.
+typedef enum timedemo_part_e
+{
+	TDP_PARSE,			// Reading and parsing demo messages.
+	TDP_LINK,			// Building the entity list.
+	TDP_PREDICT,
+	TDP_WORLD,
+	TDP_MODELS,			// Alias, brush and sprite entities.
+	TDP_PARTICLES,
+	TDP_HUD,
+	TDP_SOUND,			// Mixing.
+	TDP_MAX
+} timedemo_part_t;
+
+double CL_TimeDemo_PartStart(void);
+void CL_TimeDemo_PartEnd(timedemo_part_t part, double start);
+void CL_TimeDemo_Frame(void);
+
 void CL_AutoRecord_StopMatch(void);
 void CL_AutoRecord_CancelMatch(void);
 void CL_AutoRecord_StartMatch(char *demoname);
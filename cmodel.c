@@ -61,6 +61,17 @@ static int			numnodes;
 static dclipnode_t	*map_clipnodes;
 static int			numclipnodes;
 
+// a clipnode together with its plane, so traces touch one small struct per node
+typedef struct packedclipnode_s
+{
+	vec3_t		normal;
+	float		dist;
+	int			type;
+	int			children[2];	// negative numbers are contents
+} packedclipnode_t;
+
+static packedclipnode_t	*map_packednodes;	// parallel to map_clipnodes
+
 static cleaf_t		*map_leafs;
 static int			numleafs;
 static int			visleafs;
@@ -90,6 +101,7 @@ HULL BOXES
 static hull_t		box_hull;
 static dclipnode_t	box_clipnodes[6];
 static mplane_t		box_planes[6];
+static packedclipnode_t	box_packed[6];
 
 /*
 ** CM_InitBoxHull
@@ -104,6 +116,7 @@ static void CM_InitBoxHull (void)
 
 	box_hull.clipnodes = box_clipnodes;
 	box_hull.planes = box_planes;
+	box_hull.packed = box_packed;
 	box_hull.firstclipnode = 0;
 	box_hull.lastclipnode = 5;
 
@@ -114,6 +127,11 @@ static void CM_InitBoxHull (void)
 		box_clipnodes[i].children[side^1] = (i != 5) ? (i + 1) : CONTENTS_SOLID;
 		box_planes[i].type = i>>1;
 		box_planes[i].normal[i>>1] = 1;
+
+		box_packed[i].children[0] = box_clipnodes[i].children[0];
+		box_packed[i].children[1] = box_clipnodes[i].children[1];
+		box_packed[i].type = i>>1;
+		box_packed[i].normal[i>>1] = 1;
 	}
 }
 
@@ -132,13 +150,19 @@ hull_t *CM_HullForBox (vec3_t mins, vec3_t maxs)
 	box_planes[4].dist = maxs[2];
 	box_planes[5].dist = mins[2];
 
+	box_packed[0].dist = maxs[0];
+	box_packed[1].dist = mins[0];
+	box_packed[2].dist = maxs[1];
+	box_packed[3].dist = mins[1];
+	box_packed[4].dist = maxs[2];
+	box_packed[5].dist = mins[2];
+
 	return &box_hull;
 }
 
 int CM_HullPointContents (hull_t *hull, int num, vec3_t p)
 {
-	dclipnode_t *node;
-	mplane_t *plane;
+	packedclipnode_t *node;
 	float d;
 
 	while (num >= 0) {
@@ -149,10 +173,9 @@ int CM_HullPointContents (hull_t *hull, int num, vec3_t p)
 			Sys_Error ("CM_HullPointContents: bad node number");
 		}
 
-		node = hull->clipnodes + num;
-		plane = hull->planes + node->planenum;
+		node = hull->packed + num;
 
-		d = PlaneDiff (p, plane);
+		d = PlaneDiff (p, node);
 		num = (d < 0) ? node->children[1] : node->children[0];
 	}
 
@@ -179,131 +202,209 @@ typedef struct {
 	int leafcount;
 } hulltrace_local_t;
 
+// one level of the clipnode walk that crossed a plane
+typedef struct {
+	int			num;
+	int			stage;		// 0 = descending, 1 = near side pending, 2 = far side pending
+	int			nearside;
+	int			oldcheck;
+	float		p1f, p2f, midf;
+	float		t1, t2;
+	vec3_t		p1, p2, mid;
+} hulltrace_frame_t;
+
+#define	MAX_HULLTRACE_DEPTH	256
 
-//====================
-int RecursiveHullTrace (hulltrace_local_t *htl, int num, float p1f, float p2f, const vec3_t p1, const vec3_t p2)
+/*
+==================
+HullTrace
+
+Walks the packed clipnodes with an explicit stack. Nodes where the segment
+stays on one side are followed in place; only nodes the segment crosses take
+a stack frame, which is then revisited for the far side and the impact.
+Gives the same results as the old recursive walk.
+==================
+*/
+static int HullTrace (hulltrace_local_t *htl, const vec3_t start, const vec3_t end)
 {
-	mplane_t	*plane;
-	float		t1, t2;
-	dclipnode_t *node;
-	int			i;
-	int			nearside;
-	float		frac, midf;
-	vec3_t		mid;
-	int			check, oldcheck;
-	hull_t *hull = htl->hull;
-	trace_t *trace = &htl->trace;
-
-start:
-	if (num < 0) {
-		// this is a leaf node
-		htl->leafcount++;
-		if (num == CONTENTS_SOLID) {
-			if (htl->leafcount == 1)
-				trace->startsolid = true;
-			return TR_SOLID;
-		}
-		else {
-			if (num == CONTENTS_EMPTY)
-				trace->inopen = true;
+	hulltrace_frame_t	stack[MAX_HULLTRACE_DEPTH], *f, *child;
+	packedclipnode_t	*node;
+	float		t1, t2, frac;
+	int			i, num, depth, check;
+	hull_t		*hull = htl->hull;
+	trace_t		*trace = &htl->trace;
+
+	// only read for a crossed node, which the walk below has just set them for
+	t1 = t2 = 0;
+
+	f = &stack[0];
+	depth = 1;
+	f->num = hull->firstclipnode;
+	f->stage = 0;
+	f->p1f = 0;
+	f->p2f = 1;
+	VectorCopy (start, f->p1);
+	VectorCopy (end, f->p2);
+
+	while (1)
+	{
+		// follow the nodes the segment doesn't cross
+		num = f->num;
+		while (num >= 0)
+		{
+			// FIXME, check at load time
+			if (num < hull->firstclipnode || num > hull->lastclipnode)
+			{
+				if (map_halflife && num == hull->lastclipnode + 1)
+					break;
+				Sys_Error ("HullTrace: bad node number");
+			}
+
+			node = hull->packed + num;
+
+			if (node->type < 3) {
+				t1 = f->p1[node->type] - node->dist;
+				t2 = f->p2[node->type] - node->dist;
+			}
+			else {
+				t1 = DotProduct (node->normal, f->p1) - node->dist;
+				t2 = DotProduct (node->normal, f->p2) - node->dist;
+			}
+
+			if (t1 >= 0 && t2 >= 0)
+				num = node->children[0];	// go down the front side
+			else if (t1 < 0 && t2 < 0)
+				num = node->children[1];	// go down the back side
 			else
-				trace->inwater = true;
-			return TR_EMPTY;
+				break;
 		}
-	}
 
-	// FIXME, check at load time
-	if (num < hull->firstclipnode || num > hull->lastclipnode)
-	{
-		if (map_halflife && num == hull->lastclipnode + 1)
-			return TR_EMPTY;
-		Sys_Error ("RecursiveHullTrace: bad node number");
-	}
+		if (num >= 0 && num > hull->lastclipnode)
+		{
+			check = TR_EMPTY;	// half-life hull overflow
+		}
+		else if (num < 0)
+		{
+			// this is a leaf node
+			htl->leafcount++;
+			if (num == CONTENTS_SOLID) {
+				if (htl->leafcount == 1)
+					trace->startsolid = true;
+				check = TR_SOLID;
+			}
+			else {
+				if (num == CONTENTS_EMPTY)
+					trace->inopen = true;
+				else
+					trace->inwater = true;
+				check = TR_EMPTY;
+			}
+		}
+		else
+		{
+			// the segment crosses this node, find the intersection point
+			node = hull->packed + num;
+			f->num = num;
+			f->t1 = t1;
+			f->t2 = t2;
+
+			frac = t1 / (t1 - t2);
+			frac = bound (0, frac, 1);
+			f->midf = f->p1f + (f->p2f - f->p1f)*frac;
+			for (i = 0; i < 3; i++)
+				f->mid[i] = f->p1[i] + frac*(f->p2[i] - f->p1[i]);
+
+			// move up to the node
+			f->nearside = (t1 < t2) ? 1 : 0;
+			f->stage = 1;
+
+			if (depth == MAX_HULLTRACE_DEPTH)
+				Sys_Error ("HullTrace: stack overflow");
+
+			child = &stack[depth++];
+			child->num = node->children[f->nearside];
+			child->stage = 0;
+			child->p1f = f->p1f;
+			child->p2f = f->midf;
+			VectorCopy (f->p1, child->p1);
+			VectorCopy (f->mid, child->p2);
+			f = child;
+			continue;
+		}
 
-	node = hull->clipnodes + num;
+		// hand the result back up until a frame has a far side left to walk
+		while (1)
+		{
+			if (--depth == 0)
+				return check;
+			f = &stack[depth - 1];
+			node = hull->packed + f->num;
 
-	//
-	// find the point distances
-	//
-	plane = hull->planes + node->planenum;
+			if (f->stage == 1)
+			{
+				if (check == TR_BLOCKED)
+					continue;
 
-	if (plane->type < 3) {
-		t1 = p1[plane->type] - plane->dist;
-		t2 = p2[plane->type] - plane->dist;
-	}
-	else {
-		t1 = DotProduct (plane->normal, p1) - plane->dist;
-		t2 = DotProduct (plane->normal, p2) - plane->dist;
-	}
-	
-	// see which sides we need to consider
-	if (t1 >= 0 && t2 >= 0) {
-		num = node->children[0];	// go down the front side
-		goto start;
-	}
-	if (t1 < 0 && t2 < 0) {
-		num = node->children[1];	// go down the back side
-		goto start;
-	}
+				// if we started in solid, allow us to move out to an empty area
+				if (check == TR_SOLID && (trace->inopen || trace->inwater))
+					continue;
 
-	// find the intersection point
-	frac = t1 / (t1 - t2);
-	frac = bound (0, frac, 1);
-	midf = p1f + (p2f - p1f)*frac;
-	for (i = 0; i < 3; i++)
-		mid[i] = p1[i] + frac*(p2[i] - p1[i]);
-
-	// move up to the node
-	nearside = (t1 < t2) ? 1 : 0;
-	check = RecursiveHullTrace (htl, node->children[nearside], p1f, midf, p1, mid);
-	if (check == TR_BLOCKED)
-		return check;
-
-	// if we started in solid, allow us to move out to an empty area
-	if (check == TR_SOLID && (trace->inopen || trace->inwater))
-		return check;
-	oldcheck = check;
-
-	// go past the node
-	check = RecursiveHullTrace (htl, node->children[1 - nearside], midf, p2f, mid, p2);
-	if (check == TR_EMPTY || check == TR_BLOCKED)
-		return check;
-
-	if (oldcheck != TR_EMPTY)
-		return check;	// still in solid
-
-	// near side is empty, far side is solid
-	// this is the impact point
-	if (!nearside) {
-		VectorCopy (plane->normal, trace->plane.normal);
-		trace->plane.dist = plane->dist;
-	}
-	else {
-		VectorNegate (plane->normal, trace->plane.normal);
-		trace->plane.dist = -plane->dist;
-	}
+				// go past the node
+				f->oldcheck = check;
+				f->stage = 2;
+
+				child = &stack[depth++];
+				child->num = node->children[1 - f->nearside];
+				child->stage = 0;
+				child->p1f = f->midf;
+				child->p2f = f->p2f;
+				VectorCopy (f->mid, child->p1);
+				VectorCopy (f->p2, child->p2);
+				f = child;
+				break;
+			}
 
-// put the final point DIST_EPSILON pixels on the near side
-	if (t1 < t2)
-		frac = (t1 + DIST_EPSILON) / (t1 - t2);
-	else
-		frac = (t1 - DIST_EPSILON) / (t1 - t2);
-	frac = bound (0, frac, 1);
-	midf = p1f + (p2f - p1f)*frac;
-	for (i = 0; i < 3; i++)
-		mid[i] = p1[i] + frac*(p2[i] - p1[i]);
+			if (check == TR_EMPTY || check == TR_BLOCKED)
+				continue;
+
+			if (f->oldcheck != TR_EMPTY)
+				continue;	// still in solid
 
-	trace->fraction = midf;
-	VectorCopy (mid, trace->endpos);
+			// near side is empty, far side is solid
+			// this is the impact point
+			if (!f->nearside) {
+				VectorCopy (node->normal, trace->plane.normal);
+				trace->plane.dist = node->dist;
+			}
+			else {
+				VectorNegate (node->normal, trace->plane.normal);
+				trace->plane.dist = -node->dist;
+			}
 
-	return TR_BLOCKED;
+			// put the final point DIST_EPSILON pixels on the near side
+			if (f->t1 < f->t2)
+				frac = (f->t1 + DIST_EPSILON) / (f->t1 - f->t2);
+			else
+				frac = (f->t1 - DIST_EPSILON) / (f->t1 - f->t2);
+			frac = bound (0, frac, 1);
+			trace->fraction = f->p1f + (f->p2f - f->p1f)*frac;
+			for (i = 0; i < 3; i++)
+				trace->endpos[i] = f->p1[i] + frac*(f->p2[i] - f->p1[i]);
+
+			check = TR_BLOCKED;
+		}
+	}
 }
 
+static FILE *cm_tracefile;
+
+static void CM_RecordTrace (hull_t *hull, vec3_t start, vec3_t end);
+
 trace_t CM_HullTrace (hull_t *hull, vec3_t start, vec3_t end)
 {
 	int check;
 
-	// this structure is passed as a pointer to RecursiveHullTrace
+	// this structure is passed as a pointer to HullTrace
 	// so as not to use much stack but still be thread safe
 	hulltrace_local_t htl;
 	htl.hull = hull;
@@ -314,7 +415,10 @@ trace_t CM_HullTrace (hull_t *hull, vec3_t start, vec3_t end)
 	htl.trace.startsolid = false;
 	VectorCopy (end, htl.trace.endpos);
 
-	check = RecursiveHullTrace (&htl, hull->firstclipnode, 0, 1, start, end);
+	if (cm_tracefile)
+		CM_RecordTrace (hull, start, end);
+
+	check = HullTrace (&htl, start, end);
 
 	if (check == TR_SOLID) {
 		htl.trace.startsolid = htl.trace.allsolid = true;
@@ -328,6 +432,197 @@ trace_t CM_HullTrace (hull_t *hull, vec3_t start, vec3_t end)
 	return htl.trace;
 }
 
+/*
+===============================================================================
+
+TRACE CAPTURE AND REPLAY
+
+cm_tracerecord <file> writes every hull trace to a file until
+"cm_tracerecord stop", cm_tracebench <file> [passes] replays the file against
+the same map and reports traces per second.
+
+===============================================================================
+*/
+
+#define	TRACEFILE_ID	(('R'<<24)+('T'<<16)+('W'<<8)+'Q')
+
+typedef struct {
+	int		model;		// inline model number, -1 for a box hull
+	int		hull;
+	vec3_t	start, end;
+	vec3_t	mins, maxs;	// box hull only
+} tracerecord_t;
+
+static void CM_RecordTrace (hull_t *hull, vec3_t start, vec3_t end)
+{
+	tracerecord_t rec;
+
+	memset (&rec, 0, sizeof(rec));
+
+	if (hull == &box_hull)
+	{
+		rec.model = -1;
+		rec.mins[0] = box_planes[1].dist;
+		rec.maxs[0] = box_planes[0].dist;
+		rec.mins[1] = box_planes[3].dist;
+		rec.maxs[1] = box_planes[2].dist;
+		rec.mins[2] = box_planes[5].dist;
+		rec.maxs[2] = box_planes[4].dist;
+	}
+	else if ((byte *)hull >= (byte *)map_cmodels && (byte *)hull < (byte *)&map_cmodels[numcmodels])
+	{
+		rec.model = ((byte *)hull - (byte *)map_cmodels) / sizeof(cmodel_t);
+		rec.hull = hull - map_cmodels[rec.model].hulls;
+	}
+	else
+		return;		// not from the current map
+
+	VectorCopy (start, rec.start);
+	VectorCopy (end, rec.end);
+	fwrite (&rec, sizeof(rec), 1, cm_tracefile);
+}
+
+void CM_TraceRecord_f (void)
+{
+	int header[2];
+	char name[MAX_OSPATH];
+
+	if (Cmd_Argc () != 2)
+	{
+		Com_Printf ("Usage: %s <file | stop>\n", Cmd_Argv (0));
+		return;
+	}
+
+	if (!strcmp (Cmd_Argv (1), "stop"))
+	{
+		if (cm_tracefile)
+		{
+			fclose (cm_tracefile);
+			cm_tracefile = NULL;
+			Com_Printf ("Trace recording stopped\n");
+		}
+		return;
+	}
+
+	if (cm_tracefile)
+	{
+		Com_Printf ("Already recording traces\n");
+		return;
+	}
+
+	if (!map_name[0])
+	{
+		Com_Printf ("No map loaded\n");
+		return;
+	}
+
+	snprintf (name, sizeof(name), "%s/%s", com_gamedir, Cmd_Argv (1));
+	COM_ForceExtensionEx (name, ".trc", sizeof(name));
+
+	if (!(cm_tracefile = fopen (name, "wb")))
+	{
+		Com_Printf ("Couldn't open %s\n", name);
+		return;
+	}
+
+	header[0] = TRACEFILE_ID;
+	header[1] = map_checksum;
+	fwrite (header, sizeof(header), 1, cm_tracefile);
+
+	Com_Printf ("Recording traces to %s\n", name);
+}
+
+void CM_TraceBench_f (void)
+{
+	tracerecord_t *recs;
+	hull_t *hull;
+	trace_t trace;
+	int header[2], numrecs, passes, pass, i, blocked;
+	char name[MAX_OSPATH];
+	double start, time;
+	FILE *f;
+
+	if (Cmd_Argc () < 2)
+	{
+		Com_Printf ("Usage: %s <file> [passes]\n", Cmd_Argv (0));
+		return;
+	}
+
+	if (cm_tracefile)
+	{
+		Com_Printf ("Stop trace recording first\n");
+		return;
+	}
+
+	passes = Cmd_Argc () > 2 ? bound (1, atoi (Cmd_Argv (2)), 1000) : 10;
+
+	snprintf (name, sizeof(name), "%s/%s", com_gamedir, Cmd_Argv (1));
+	COM_ForceExtensionEx (name, ".trc", sizeof(name));
+
+	if (!(f = fopen (name, "rb")))
+	{
+		Com_Printf ("Couldn't open %s\n", name);
+		return;
+	}
+
+	if (fread (header, sizeof(header), 1, f) != 1 || header[0] != TRACEFILE_ID)
+	{
+		Com_Printf ("%s is not a trace file\n", name);
+		fclose (f);
+		return;
+	}
+
+	if (!map_name[0] || (unsigned int) header[1] != map_checksum)
+	{
+		Com_Printf ("%s was recorded on a different map\n", name);
+		fclose (f);
+		return;
+	}
+
+	fseek (f, 0, SEEK_END);
+	numrecs = (ftell (f) - sizeof(header)) / sizeof(tracerecord_t);
+	fseek (f, sizeof(header), SEEK_SET);
+
+	recs = (tracerecord_t *) Q_malloc (max (numrecs, 1) * sizeof(tracerecord_t));
+	numrecs = fread (recs, sizeof(tracerecord_t), numrecs, f);
+	fclose (f);
+
+	for (i = 0; i < numrecs; i++)
+	{
+		if (recs[i].model >= numcmodels || recs[i].model < -1
+			|| recs[i].hull < 0 || recs[i].hull >= MAX_MAP_HULLS)
+		{
+			Com_Printf ("%s is corrupt\n", name);
+			Q_free (recs);
+			return;
+		}
+	}
+
+	blocked = 0;
+	start = Sys_DoubleTime ();
+	for (pass = 0; pass < passes; pass++)
+	{
+		for (i = 0; i < numrecs; i++)
+		{
+			if (recs[i].model < 0)
+				hull = CM_HullForBox (recs[i].mins, recs[i].maxs);
+			else
+				hull = &map_cmodels[recs[i].model].hulls[recs[i].hull];
+
+			trace = CM_HullTrace (hull, recs[i].start, recs[i].end);
+			if (!pass && trace.fraction < 1)
+				blocked++;
+		}
+	}
+	time = Sys_DoubleTime () - start;
+
+	Com_Printf ("%d traces x %d passes in %.3f s, %d blocked\n", numrecs, passes, time, blocked);
+	if (time > 0)
+		Com_Printf ("%.0f traces/sec\n", numrecs * passes / time);
+
+	Q_free (recs);
+}
+
 
 //===========================================================================
 
@@ -415,11 +710,9 @@ crosses a waterline.
 =============================================================================
 */
 
-static int	fatbytes;
 static byte	fatpvs[MAX_MAP_LEAFS/8];
-static vec3_t	fatpvs_org;
 
-static void AddToFatPVS_r (cnode_t *node)
+static void AddToFatPVS_r (cnode_t *node, const vec3_t org, byte *fat, int fatbytes)
 {
 	int i;
 	float d;
@@ -434,25 +727,31 @@ static void AddToFatPVS_r (cnode_t *node)
 			{
 				pvs = CM_LeafPVS ( (cleaf_t *)node);
 				for (i=0 ; i<fatbytes ; i++)
-					fatpvs[i] |= pvs[i];
+					fat[i] |= pvs[i];
 			}
 			return;
 		}
 	
 		plane = node->plane;
-		d = DotProduct (fatpvs_org, plane->normal) - plane->dist;
+		d = DotProduct (org, plane->normal) - plane->dist;
 		if (d > 8)
 			node = node->children[0];
 		else if (d < -8)
 			node = node->children[1];
 		else
 		{ // go down both
-			AddToFatPVS_r (node->children[0]);
+			AddToFatPVS_r (node->children[0], org, fat, fatbytes);
 			node = node->children[1];
 		}
 	}
 }
 
+// number of meaningful bytes in a CM_FatPVS result
+int CM_FatPVSBytes (void)
+{
+	return (visleafs+31)>>3;
+}
+
 /*
 =============
 CM_FatPVS
@@ -463,12 +762,58 @@ given point.
 */
 byte *CM_FatPVS (vec3_t org)
 {
-	VectorCopy (org, fatpvs_org);
+	return CM_FatPVSTo (org, fatpvs);
+}
+
+/*
+=============
+CM_FatPVSTo
+
+Same as CM_FatPVS, but writes into the caller's buffer of at least
+MAX_MAP_LEAFS/8 bytes, so it can be used from several threads at once.
+=============
+*/
+byte *CM_FatPVSTo (vec3_t org, byte *out)
+{
+	int fatbytes = CM_FatPVSBytes ();
+
+	memset (out, 0, fatbytes);
+	AddToFatPVS_r (map_nodes, org, out, fatbytes);
+	return out;
+}
+
+/*
+=============
+CM_FatPVSLeaf
+
+Returns the leaf if everything within 8 units of the given point lies in one
+non-solid leaf, in which case the fat PVS is just that leaf's PVS row.
+Returns NULL otherwise.
+=============
+*/
+cleaf_t *CM_FatPVSLeaf (vec3_t org)
+{
+	cnode_t *node;
+	mplane_t *plane;
+	float d;
+
+	node = map_nodes;
+	while (node->contents >= 0)
+	{
+		plane = node->plane;
+		d = DotProduct (org, plane->normal) - plane->dist;
+		if (d > 8)
+			node = node->children[0];
+		else if (d < -8)
+			node = node->children[1];
+		else
+			return NULL;
+	}
+
+	if (node->contents == CONTENTS_SOLID)
+		return NULL;
 
-	fatbytes = (visleafs+31)>>3;
-	memset (fatpvs, 0, fatbytes);
-	AddToFatPVS_r (map_nodes);
-	return fatpvs;
+	return (cleaf_t *)node;
 }
 
 
@@ -602,6 +947,7 @@ static void CM_LoadSubmodels (lump_t *l)
 		for (j = 0; j < MAX_MAP_HULLS; j++) {
 			out->hulls[j].planes = map_planes;
 			out->hulls[j].clipnodes = map_clipnodes;
+			out->hulls[j].packed = map_packednodes;
 			out->hulls[j].firstclipnode = LittleLong (in->headnode[j]);
 			out->hulls[j].lastclipnode = numclipnodes - 1;
 		}
@@ -710,6 +1056,37 @@ static void CM_LoadLeafs (lump_t *l)
 
 }
 
+/*
+=================
+CM_PackClipnodes
+
+Copies the clipnodes with their planes into one array for tracing
+=================
+*/
+static packedclipnode_t *CM_PackClipnodes (dclipnode_t *in, int count)
+{
+	packedclipnode_t *out, *packed;
+	mplane_t *plane;
+	int i;
+
+	packed = out = Hunk_AllocName ( max (count, 1)*sizeof(*out), loadname);
+
+	for (i = 0; i < count; i++, out++, in++)
+	{
+		if (in->planenum < 0 || in->planenum >= numplanes)
+			Host_Error ("CM_LoadMap: bad planenum");
+
+		plane = map_planes + in->planenum;
+		VectorCopy (plane->normal, out->normal);
+		out->dist = plane->dist;
+		out->type = plane->type;
+		out->children[0] = in->children[0];
+		out->children[1] = in->children[1];
+	}
+
+	return packed;
+}
+
 /*
 =================
 CM_LoadClipnodes
@@ -737,6 +1114,8 @@ static void CM_LoadClipnodes (lump_t *l)
 		out->children[0] = LittleShort(in->children[0]);
 		out->children[1] = LittleShort(in->children[1]);
 	}
+
+	map_packednodes = CM_PackClipnodes (map_clipnodes, count);
 }
 
 /*
@@ -749,7 +1128,8 @@ Deplicate the drawing hull structure as a clipping hull
 static void CM_MakeHull0 (void)
 {
 	cnode_t *in, *child;
-	dclipnode_t *out;
+	dclipnode_t *out, *hull0;
+	packedclipnode_t *packed;
 	int i, j, count;
 
 	in = map_nodes;
@@ -761,6 +1141,7 @@ static void CM_MakeHull0 (void)
 		map_cmodels[i].hulls[0].clipnodes = out;
 		map_cmodels[i].hulls[0].lastclipnode = count - 1;
 	}
+	hull0 = out;
 
 	// build clipnodes from nodes
 	for (i = 0; i < count; i++, out++, in++)
@@ -772,6 +1153,10 @@ static void CM_MakeHull0 (void)
 			out->children[j] = (child->contents < 0) ? (child->contents) : (child - map_nodes);
 		}
 	}
+
+	packed = CM_PackClipnodes (hull0, count);
+	for (i = 0; i < numcmodels; i++)
+		map_cmodels[i].hulls[0].packed = packed;
 }
 
 /*
@@ -947,6 +1332,7 @@ void CM_InvalidateMap (void)
 	map_planes = NULL;
 	map_nodes = NULL;
 	map_clipnodes = NULL;
+	map_packednodes = NULL;
 	map_leafs = NULL;
 	map_pvs = NULL;
 	map_phs = NULL;
@@ -1048,4 +1434,7 @@ void CM_Init (void)
 {
 //	memset (map_novis, 0xff, sizeof(map_novis));
 	CM_InitBoxHull ();
+
+	Cmd_AddCommand ("cm_tracerecord", CM_TraceRecord_f);
+	Cmd_AddCommand ("cm_tracebench", CM_TraceBench_f);
 }
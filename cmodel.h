@@ -48,6 +48,7 @@ typedef struct {
 	int			lastclipnode;
 	vec3_t		clip_mins;
 	vec3_t		clip_maxs;
+	struct packedclipnode_s *packed;	// clipnodes with their planes, same numbering
 } hull_t;
 
 typedef struct {
@@ -77,12 +78,17 @@ typedef struct {
 hull_t *CM_HullForBox (vec3_t mins, vec3_t maxs);
 int CM_HullPointContents (hull_t *hull, int num, vec3_t p);
 trace_t CM_HullTrace (hull_t *hull, vec3_t start, vec3_t end);
+void CM_TraceRecord_f (void);
+void CM_TraceBench_f (void);
 struct cleaf_s *CM_PointInLeaf (const vec3_t p);
 int CM_Leafnum (const struct cleaf_s *leaf);
 int CM_LeafAmbientLevel (const struct cleaf_s *leaf, int ambient_channel);
 byte *CM_LeafPVS (const struct cleaf_s *leaf);
 byte *CM_LeafPHS (const struct cleaf_s *leaf); // only for the server
 byte *CM_FatPVS (vec3_t org);
+byte *CM_FatPVSTo (vec3_t org, byte *out);
+int CM_FatPVSBytes (void);
+struct cleaf_s *CM_FatPVSLeaf (vec3_t org);
 int CM_FindTouchedLeafs (const vec3_t mins, const vec3_t maxs, int leafs[], int maxleafs, int headnode, int *topnode);
 char *CM_EntityString (void);
 int CM_NumInlineModels (void);
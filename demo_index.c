@@ -0,0 +1,613 @@
+/*
+Copyright (C) 2007 ezQuake team
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+//
+// Demo index sidecar files.
+//
+// The index is made by running the headless parser over the demo once.
+// On disk it is a little endian header followed by the players and the
+// events. The demo size and modification time are kept in
+// the header, an index that doesn't match its demo anymore is made again.
+//
+
+#include <sys/stat.h>
+#include "quakedef.h"
+#include "demo_index.h"
+
+#define DEMOINDEX_MAGIC			(('Q'<<0) + ('D'<<8) + ('I'<<16) + ('X'<<24))
+#define DEMOINDEX_VERSION		2		// 1 had a seek table.
+#define DEMOINDEX_EXTENSION		".idx"
+
+#define DEMOINDEX_HEADERSIZE	(10 * 4 + MAX_QPATH + 64 + 2 * 4)
+#define DEMOINDEX_PLAYERSIZE	(4 + 2 * MAX_SCOREBOARDNAME)
+#define DEMOINDEX_EVENTSIZE		12
+
+cvar_t demo_index = {"demo_index", "1"};	// 0 = probe demos as before, 1 = use and save indexes, 2 = don't save
+
+//=============================================================================
+//								BUILDING
+//=============================================================================
+
+static void DemoIndex_OnBlock (demoparser_t *p)
+{
+	demoindex_t *idx = (demoindex_t *) p->userdata;
+
+	if (p->blocks == 1)
+		idx->starttime = p->time;
+	idx->endtime = p->time;
+}
+
+static void DemoIndex_OnEvent (demoparser_t *p, demoevent_t *event)
+{
+	demoindex_t *idx = (demoindex_t *) p->userdata;
+
+	if (idx->numevents == idx->maxevents)
+	{
+		idx->maxevents = idx->maxevents ? idx->maxevents * 2 : 4096;
+		idx->events = (demoevent_t *) Q_realloc (idx->events, idx->maxevents * sizeof(demoevent_t));
+	}
+
+	idx->events[idx->numevents++] = *event;
+}
+
+//
+// Parses the demo from the current position. Doesn't print anything, it may run in a thread.
+//
+demoindex_t *DemoIndex_Build (vfsfile_t *file, qbool mvd)
+{
+	demoindex_t *idx = (demoindex_t *) Q_malloc (sizeof(demoindex_t));
+	demoparser_t *p = DemoParse_New (file, mvd);
+	demoparse_player_t *pl;
+	int i;
+
+	p->userdata = idx;
+	p->OnBlock = DemoIndex_OnBlock;
+	p->OnEvent = DemoIndex_OnEvent;
+
+	idx->mvd = mvd;
+	idx->complete = DemoParse_Run (p) && !p->badmessages;
+	idx->duration = p->duration;
+	idx->pov = p->playernum;
+	strlcpy (idx->mapname, p->mapname, sizeof(idx->mapname));
+	strlcpy (idx->levelname, p->levelname, sizeof(idx->levelname));
+
+	for (i = 0; i < MAX_CLIENTS; i++)
+	{
+		pl = &p->players[i];
+		if (!pl->active)
+			continue;
+
+		idx->players[idx->numplayers].slot = i;
+		idx->players[idx->numplayers].spectator = pl->spectator;
+		idx->players[idx->numplayers].frags = pl->frags;
+		strlcpy (idx->players[idx->numplayers].name, pl->name, sizeof(idx->players[0].name));
+		strlcpy (idx->players[idx->numplayers].team, pl->team, sizeof(idx->players[0].team));
+		idx->numplayers++;
+	}
+
+	DemoParse_Free (p);
+
+	return idx;
+}
+
+void DemoIndex_Free (demoindex_t *idx)
+{
+	if (!idx)
+		return;
+
+	Q_free (idx->events);
+	Q_free (idx);
+}
+
+//=============================================================================
+//								FILES
+//=============================================================================
+
+static int DemoIndex_MTime (const char *demopath)
+{
+	struct stat st;
+
+	return stat (demopath, &st) ? 0 : (int) st.st_mtime;
+}
+
+typedef struct demoindex_reader_s
+{
+	byte	*data;
+	int		len, pos;
+	qbool	bad;
+} demoindex_reader_t;
+
+static void DemoIndex_Read (demoindex_reader_t *r, void *out, int len)
+{
+	if (r->bad || r->pos + len > r->len)
+	{
+		r->bad = true;
+		memset (out, 0, len);
+		return;
+	}
+
+	memcpy (out, r->data + r->pos, len);
+	r->pos += len;
+}
+
+static int DemoIndex_ReadLong (demoindex_reader_t *r)
+{
+	int l;
+
+	DemoIndex_Read (r, &l, 4);
+	return LittleLong (l);
+}
+
+static float DemoIndex_ReadFloat (demoindex_reader_t *r)
+{
+	float f;
+
+	DemoIndex_Read (r, &f, 4);
+	return LittleFloat (f);
+}
+
+static void DemoIndex_ReadString (demoindex_reader_t *r, char *s, int len)
+{
+	DemoIndex_Read (r, s, len);
+	s[len - 1] = 0;
+}
+
+//
+// Loads the index saved next to the demo, if it is still good for it.
+//
+demoindex_t *DemoIndex_Load (const char *demopath, int demosize)
+{
+	demoindex_reader_t r = {NULL, 0, 0, false};
+	char path[MAX_OSPATH];
+	demoindex_t *idx;
+	FILE *f;
+	int i, mtime;
+
+	snprintf (path, sizeof(path), "%s" DEMOINDEX_EXTENSION, demopath);
+	if (!(f = fopen (path, "rb")))
+		return NULL;
+
+	fseek (f, 0, SEEK_END);
+	r.len = ftell (f);
+	fseek (f, 0, SEEK_SET);
+
+	if (r.len < DEMOINDEX_HEADERSIZE)
+	{
+		fclose (f);
+		return NULL;
+	}
+
+	r.data = (byte *) Q_malloc (r.len);
+	i = fread (r.data, 1, r.len, f);
+	fclose (f);
+
+	mtime = DemoIndex_MTime (demopath);
+
+	if (i != r.len || DemoIndex_ReadLong (&r) != DEMOINDEX_MAGIC || DemoIndex_ReadLong (&r) != DEMOINDEX_VERSION
+		|| DemoIndex_ReadLong (&r) != demosize || DemoIndex_ReadLong (&r) != mtime)
+	{
+		Q_free (r.data);
+		return NULL;
+	}
+
+	idx = (demoindex_t *) Q_malloc (sizeof(demoindex_t));
+	idx->demosize = demosize;
+	idx->demomtime = mtime;
+	idx->mvd = DemoIndex_ReadLong (&r) ? true : false;
+	idx->complete = true;
+	idx->duration = DemoIndex_ReadFloat (&r);
+	idx->starttime = DemoIndex_ReadFloat (&r);
+	idx->endtime = DemoIndex_ReadFloat (&r);
+	idx->pov = DemoIndex_ReadLong (&r);
+	DemoIndex_ReadLong (&r);	// reserved
+	DemoIndex_ReadString (&r, idx->mapname, sizeof(idx->mapname));
+	DemoIndex_ReadString (&r, idx->levelname, sizeof(idx->levelname));
+	idx->numplayers = DemoIndex_ReadLong (&r);
+	idx->numevents = idx->maxevents = DemoIndex_ReadLong (&r);
+
+	if (idx->numplayers < 0 || idx->numplayers > MAX_CLIENTS || idx->numevents < 0
+		|| r.len - r.pos != idx->numplayers * DEMOINDEX_PLAYERSIZE + idx->numevents * DEMOINDEX_EVENTSIZE)
+	{
+		idx->numevents = 0;
+		DemoIndex_Free (idx);
+		Q_free (r.data);
+		return NULL;
+	}
+
+	for (i = 0; i < idx->numplayers; i++)
+	{
+		byte b[4];
+
+		DemoIndex_Read (&r, b, 4);
+		idx->players[i].slot = b[0] % MAX_CLIENTS;
+		idx->players[i].spectator = b[1] ? true : false;
+		idx->players[i].frags = (short) (b[2] + (b[3] << 8));
+		DemoIndex_ReadString (&r, idx->players[i].name, sizeof(idx->players[i].name));
+		DemoIndex_ReadString (&r, idx->players[i].team, sizeof(idx->players[i].team));
+	}
+
+	idx->events = (demoevent_t *) Q_malloc (max (1, idx->numevents) * sizeof(demoevent_t));
+	for (i = 0; i < idx->numevents; i++)
+	{
+		byte b[4];
+
+		idx->events[i].time = DemoIndex_ReadFloat (&r);
+		DemoIndex_Read (&r, b, 4);
+		idx->events[i].type = b[0];
+		idx->events[i].player = b[1];
+		idx->events[i].stat = b[2];
+		idx->events[i].value = DemoIndex_ReadLong (&r);
+
+		// The events index arrays, a bad one means the file is no good and the index is made again.
+		if (b[0] >= DEMOEVENT_MAX || b[1] >= MAX_CLIENTS || b[2] >= MAX_CL_STATS)
+		{
+			DemoIndex_Free (idx);
+			Q_free (r.data);
+			return NULL;
+		}
+	}
+
+	Q_free (r.data);
+
+	return idx;
+}
+
+static void DemoIndex_WriteString (sizebuf_t *sb, const char *s, int len)
+{
+	char buf[MAX_QPATH + 64];
+
+	memset (buf, 0, len);
+	strlcpy (buf, s, len);
+	SZ_Write (sb, buf, len);
+}
+
+//
+// Saves the index next to the demo.
+//
+qbool DemoIndex_Save (demoindex_t *idx, const char *demopath)
+{
+	char path[MAX_OSPATH];
+	sizebuf_t sb;
+	byte *data;
+	FILE *f;
+	int i, len;
+	qbool ok;
+
+	len = DEMOINDEX_HEADERSIZE + idx->numplayers * DEMOINDEX_PLAYERSIZE + idx->numevents * DEMOINDEX_EVENTSIZE;
+	data = (byte *) Q_malloc (len);
+	SZ_Init (&sb, data, len);
+
+	MSG_WriteLong (&sb, DEMOINDEX_MAGIC);
+	MSG_WriteLong (&sb, DEMOINDEX_VERSION);
+	MSG_WriteLong (&sb, idx->demosize);
+	MSG_WriteLong (&sb, idx->demomtime);
+	MSG_WriteLong (&sb, idx->mvd);
+	MSG_WriteFloat (&sb, idx->duration);
+	MSG_WriteFloat (&sb, idx->starttime);
+	MSG_WriteFloat (&sb, idx->endtime);
+	MSG_WriteLong (&sb, idx->pov);
+	MSG_WriteLong (&sb, 0);		// reserved
+	DemoIndex_WriteString (&sb, idx->mapname, MAX_QPATH);
+	DemoIndex_WriteString (&sb, idx->levelname, 64);
+	MSG_WriteLong (&sb, idx->numplayers);
+	MSG_WriteLong (&sb, idx->numevents);
+
+	for (i = 0; i < idx->numplayers; i++)
+	{
+		MSG_WriteByte (&sb, idx->players[i].slot);
+		MSG_WriteByte (&sb, idx->players[i].spectator);
+		MSG_WriteShort (&sb, idx->players[i].frags);
+		DemoIndex_WriteString (&sb, idx->players[i].name, MAX_SCOREBOARDNAME);
+		DemoIndex_WriteString (&sb, idx->players[i].team, MAX_SCOREBOARDNAME);
+	}
+
+	for (i = 0; i < idx->numevents; i++)
+	{
+		MSG_WriteFloat (&sb, idx->events[i].time);
+		MSG_WriteByte (&sb, idx->events[i].type);
+		MSG_WriteByte (&sb, idx->events[i].player);
+		MSG_WriteByte (&sb, idx->events[i].stat);
+		MSG_WriteByte (&sb, 0);
+		MSG_WriteLong (&sb, idx->events[i].value);
+	}
+
+	snprintf (path, sizeof(path), "%s" DEMOINDEX_EXTENSION, demopath);
+	if (!(f = fopen (path, "wb")))
+	{
+		Q_free (data);
+		return false;
+	}
+
+	ok = fwrite (data, 1, sb.cursize, f) == sb.cursize;
+	fclose (f);
+	Q_free (data);
+
+	if (!ok)
+		remove (path);
+
+	return ok;
+}
+
+//
+// Makes the index of the demo, file is at its start and is left there.
+// Doesn't print anything, it may run in a thread.
+//
+static demoindex_t *DemoIndex_Make (vfsfile_t *file, const char *demopath, qbool mvd)
+{
+	int demosize = VFS_GETLEN (file);
+	demoindex_t *idx;
+
+	idx = DemoIndex_Build (file, mvd);
+	VFS_SEEK (file, 0, SEEK_SET);
+
+	idx->demosize = demosize;
+	idx->demomtime = demopath ? DemoIndex_MTime (demopath) : 0;
+
+	return idx;
+}
+
+//
+// The index of a demo about to be played, file is at its start and is left there.
+// demopath is the demo on disk, NULL if it isn't a plain file. Then the index is only made.
+//
+demoindex_t *DemoIndex_Get (vfsfile_t *file, const char *demopath, qbool mvd)
+{
+	demoindex_t *idx;
+	double start;
+
+	if (demopath && (idx = DemoIndex_Load (demopath, VFS_GETLEN (file))))
+		return idx;
+
+	start = Sys_DoubleTime ();
+	idx = DemoIndex_Make (file, demopath, mvd);
+
+	Com_DPrintf ("Demo indexed in %.3f seconds, %d events\n", Sys_DoubleTime () - start, idx->numevents);
+
+	if (demopath && idx->complete && demo_index.integer == 1 && !DemoIndex_Save (idx, demopath))
+		Com_DPrintf ("Couldn't save the demo index for %s\n", demopath);
+
+	return idx;
+}
+
+//=============================================================================
+//								LOOKUPS
+//=============================================================================
+
+//
+// The first event after time, numevents if there is none.
+//
+int DemoIndex_FindEvent (demoindex_t *idx, double time)
+{
+	int lo = 0, hi = idx->numevents, mid;
+
+	while (lo < hi)
+	{
+		mid = (lo + hi) / 2;
+		if (idx->events[mid].time <= time)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+const char *DemoIndex_ItemName (int item)
+{
+	switch (item)
+	{
+		case IT_SUPER_SHOTGUN:		return "ssg";
+		case IT_NAILGUN:			return "ng";
+		case IT_SUPER_NAILGUN:		return "sng";
+		case IT_GRENADE_LAUNCHER:	return "gl";
+		case IT_ROCKET_LAUNCHER:	return "rl";
+		case IT_LIGHTNING:			return "lg";
+		case IT_ARMOR1:				return "ga";
+		case IT_ARMOR2:				return "ya";
+		case IT_ARMOR3:				return "ra";
+		case IT_SUPERHEALTH:		return "mh";
+		case IT_KEY1:				return "key1";
+		case IT_KEY2:				return "key2";
+		case IT_INVISIBILITY:		return "ring";
+		case IT_INVULNERABILITY:	return "pent";
+		case IT_SUIT:				return "suit";
+		case IT_QUAD:				return "quad";
+		default:					return "?";
+	}
+}
+
+//=============================================================================
+//								DEMO BROWSER
+//=============================================================================
+
+//
+// The browser asks for the selected demo while drawing, so the index is
+// loaded or made by a thread and the line shows up once it's done.
+//
+
+typedef enum demoindex_describe_state_e
+{
+	DESCRIBE_IDLE,
+	DESCRIBE_BUSY,					// The thread owns the job.
+	DESCRIBE_DONE
+} demoindex_describe_state_t;
+
+typedef struct demoindex_describe_job_s
+{
+	char	demopath[MAX_OSPATH];
+	qbool	mvd;
+	qbool	ok;
+	char	description[256];
+} demoindex_describe_job_t;
+
+static demoindex_describe_job_t describe_job;
+static int describe_state = DESCRIBE_IDLE;
+static sem_t describe_wake;				// Posted for each job.
+static qbool describe_thread;			// The thread has been created.
+
+static void DemoIndex_Description (demoindex_t *idx, char *buf, int bufsize)
+{
+	char teams[2][MAX_SCOREBOARDNAME], vs[2 * MAX_SCOREBOARDNAME + 8];
+	int i, numplayers = 0, numteams = 0, player[2] = {0, 0};
+
+	for (i = 0; i < idx->numplayers; i++)
+	{
+		if (idx->players[i].spectator)
+			continue;
+
+		if (numplayers < 2)
+			player[numplayers] = i;
+		numplayers++;
+
+		if (numteams <= 2 && (!numteams || strcmp (teams[0], idx->players[i].team))
+			&& (numteams < 2 || strcmp (teams[1], idx->players[i].team)))
+		{
+			if (numteams < 2)
+				strlcpy (teams[numteams], idx->players[i].team, sizeof(teams[0]));
+			numteams++;
+		}
+	}
+
+	if (numplayers == 2)
+		snprintf (vs, sizeof(vs), "%s vs %s", idx->players[player[0]].name, idx->players[player[1]].name);
+	else if (numteams == 2 && teams[0][0] && teams[1][0])
+		snprintf (vs, sizeof(vs), "%s vs %s", teams[0], teams[1]);
+	else
+		snprintf (vs, sizeof(vs), "%d players", numplayers);
+
+	snprintf (buf, bufsize, "%s \x8f %d:%02d \x8f %s",
+		idx->mapname[0] ? idx->mapname : "?", (int) idx->duration / 60, (int) idx->duration % 60, vs);
+}
+
+static DWORD WINAPI DemoIndex_DescribeThread (void *param)
+{
+	demoindex_describe_job_t *job = (demoindex_describe_job_t *) param;
+	demoindex_t *idx;
+	vfsfile_t *f;
+	struct stat st;
+
+	for (;;)
+	{
+		Sys_SemWait (&describe_wake);
+
+		job->ok = false;
+
+		if (!stat (job->demopath, &st))
+		{
+			if (!(idx = DemoIndex_Load (job->demopath, st.st_size)) && (f = FS_OpenVFS (job->demopath, "rb", FS_NONE_OS)))
+			{
+				idx = DemoIndex_Make (f, job->demopath, job->mvd);
+				VFS_CLOSE (f);
+
+				if (idx->complete && demo_index.integer == 1)
+					DemoIndex_Save (idx, job->demopath);
+			}
+
+			if (idx)
+			{
+				DemoIndex_Description (idx, job->description, sizeof(job->description));
+				DemoIndex_Free (idx);
+				job->ok = true;
+			}
+		}
+
+		Sys_AtomicStore (&describe_state, DESCRIBE_DONE);
+	}
+
+	return 0;
+}
+
+//
+// The thread is made for the first demo and then waits for the next one.
+//
+static qbool DemoIndex_DescribeStart (void)
+{
+	if (describe_thread)
+		return true;
+
+	if (Sys_SemInit (&describe_wake, 0, 0x7fffffff))
+		return false;
+
+	if (!Sys_CreateThread (DemoIndex_DescribeThread, &describe_job))
+	{
+		Sys_SemDestroy (&describe_wake);
+		return false;
+	}
+
+	describe_thread = true;
+	return true;
+}
+
+//
+// A line about the demo for the browser: map, length and who played.
+// The thread is given the demo once it has been selected for a moment,
+// so scrolling through a directory doesn't parse every demo on the way.
+//
+qbool DemoIndex_Describe (const char *demopath, char *buf, int bufsize)
+{
+	static char lastpath[MAX_OSPATH], description[256];
+	static double selecttime;
+	static qbool described;
+	char *ext = COM_FileExtension (demopath);
+
+	if (!demo_index.integer || (strcasecmp (ext, "mvd") && strcasecmp (ext, "qwd")))
+		return false;
+
+	if (strcmp (lastpath, demopath))
+	{
+		strlcpy (lastpath, demopath, sizeof(lastpath));
+		selecttime = Sys_DoubleTime ();
+		described = false;
+	}
+
+	switch (Sys_AtomicLoad (&describe_state))
+	{
+		case DESCRIBE_BUSY:
+			break;
+
+		case DESCRIBE_DONE:
+			// Another demo may have been selected meanwhile.
+			if (!described && describe_job.ok && !strcmp (describe_job.demopath, lastpath))
+			{
+				strlcpy (description, describe_job.description, sizeof(description));
+				described = true;
+			}
+			Sys_AtomicStore (&describe_state, DESCRIBE_IDLE);
+			// fall through
+
+		case DESCRIBE_IDLE:
+			if (described || Sys_DoubleTime () - selecttime < 0.3 || !strcmp (describe_job.demopath, lastpath))
+				break;
+
+			if (!DemoIndex_DescribeStart ())
+				break;
+
+			strlcpy (describe_job.demopath, lastpath, sizeof(describe_job.demopath));
+			describe_job.mvd = !strcasecmp (ext, "mvd");
+			Sys_AtomicStore (&describe_state, DESCRIBE_BUSY);
+			Sys_SemPost (&describe_wake);
+			break;
+	}
+
+	if (!described)
+		return false;
+
+	strlcpy (buf, description, bufsize);
+	return true;
+}
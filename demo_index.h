@@ -0,0 +1,78 @@
+/*
+Copyright (C) 2007 ezQuake team
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef __DEMO_INDEX_H__
+#define __DEMO_INDEX_H__
+
+#include "demo_parse.h"
+
+//
+// Demo index.
+//
+// What a demo contains and when: the map and players, and the frags, deaths,
+// powerups, item pickups and stat changes with their times. It's saved next
+// to the demo as <demo>.idx so a demo is only parsed once, and made again
+// when the demo changes.
+//
+
+typedef struct demoindex_player_s
+{
+	int		slot;
+	qbool	spectator;
+	int		frags;
+	char	name[MAX_SCOREBOARDNAME];
+	char	team[MAX_SCOREBOARDNAME];
+} demoindex_player_t;
+
+typedef struct demoindex_s
+{
+	qbool	mvd;
+	qbool	complete;			// The whole demo could be parsed.
+	int		demosize;
+	int		demomtime;
+
+	float	duration;			// As CL_CalculateDemoTime returns it.
+	float	starttime;			// Stream times of the first and last blocks.
+	float	endtime;
+	int		pov;				// QWD only, the player whose stats the demo has.
+
+	char	mapname[MAX_QPATH];
+	char	levelname[64];
+
+	int		numplayers;
+	demoindex_player_t players[MAX_CLIENTS];
+
+	int		numevents, maxevents;
+	demoevent_t *events;		// Sorted by time.
+} demoindex_t;
+
+extern cvar_t demo_index;
+
+demoindex_t *DemoIndex_Build (vfsfile_t *file, qbool mvd);
+demoindex_t *DemoIndex_Load (const char *demopath, int demosize);
+qbool DemoIndex_Save (demoindex_t *idx, const char *demopath);
+demoindex_t *DemoIndex_Get (vfsfile_t *file, const char *demopath, qbool mvd);
+void DemoIndex_Free (demoindex_t *idx);
+
+int DemoIndex_FindEvent (demoindex_t *idx, double time);
+const char *DemoIndex_ItemName (int item);
+
+qbool DemoIndex_Describe (const char *demopath, char *buf, int bufsize);
+
+#endif // __DEMO_INDEX_H__
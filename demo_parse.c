@@ -0,0 +1,1133 @@
+/*
+Copyright (C) 2007 ezQuake team
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+//
+// Headless demo parser.
+//
+// This follows CL_GetDemoMessage and CL_ParseServerMessage byte for byte,
+// but only reads what it needs and skips the rest. It must not use the
+// MSG_Read functions, net_message, cl or cls, or anything else global:
+// the batch analyzer runs one parser per thread.
+//
+
+#include "quakedef.h"
+#include "demo_parse.h"
+
+#define DEMOPARSE_BUFSIZE		(64 * 1024)
+
+// Spawning gives these, so getting them is not an item pickup.
+#define DEMOPARSE_POWERUPS		(IT_QUAD | IT_INVULNERABILITY | IT_INVISIBILITY | IT_SUIT)
+#define DEMOPARSE_ITEMS			(IT_SUPER_SHOTGUN | IT_NAILGUN | IT_SUPER_NAILGUN | IT_GRENADE_LAUNCHER \
+								| IT_ROCKET_LAUNCHER | IT_LIGHTNING | IT_ARMOR1 | IT_ARMOR2 | IT_ARMOR3 \
+								| IT_SUPERHEALTH | IT_KEY1 | IT_KEY2)
+
+// The stats demo_jump_status can look at.
+static const int demoparse_eventstats[] = {
+	STAT_HEALTH, STAT_ARMOR, STAT_SHELLS, STAT_NAILS, STAT_ROCKETS, STAT_CELLS, STAT_ACTIVEWEAPON, STAT_ITEMS
+};
+
+//=============================================================================
+//								FILE READING
+//=============================================================================
+
+//
+// Reads from the demo through the buffer, data may be NULL to skip.
+//
+static int DP_FileRead (demoparser_t *p, void *data, int len)
+{
+	vfserrno_t err;
+	int n, total = 0;
+
+	while (len > 0)
+	{
+		if (p->bufpos == p->buflen)
+		{
+			if (p->eof)
+				break;
+
+			p->bufstart += p->buflen;
+			p->bufpos = 0;
+			p->buflen = VFS_READ (p->file, p->buf, DEMOPARSE_BUFSIZE, &err);
+
+			if (p->buflen <= 0)
+			{
+				p->buflen = 0;
+				p->eof = true;
+				break;
+			}
+		}
+
+		n = min (len, p->buflen - p->bufpos);
+		if (data)
+			memcpy ((byte *) data + total, p->buf + p->bufpos, n);
+
+		p->bufpos += n;
+		total += n;
+		len -= n;
+	}
+
+	return total;
+}
+
+static unsigned long DP_FileTell (demoparser_t *p)
+{
+	return p->bufstart + p->bufpos;
+}
+
+//=============================================================================
+//								MESSAGE READING
+//=============================================================================
+
+static qbool DP_Check (demoparser_t *p, int len)
+{
+	if (p->badread || p->msgpos + len > p->msglen)
+	{
+		p->badread = true;
+		return false;
+	}
+
+	return true;
+}
+
+static void DP_Skip (demoparser_t *p, int len)
+{
+	if (DP_Check (p, len))
+		p->msgpos += len;
+}
+
+static int DP_ReadByte (demoparser_t *p)
+{
+	return DP_Check (p, 1) ? p->msg[p->msgpos++] : -1;
+}
+
+static int DP_ReadShort (demoparser_t *p)
+{
+	short s;
+
+	if (!DP_Check (p, 2))
+		return -1;
+
+	s = (short) (p->msg[p->msgpos] + (p->msg[p->msgpos + 1] << 8));
+	p->msgpos += 2;
+
+	return s;
+}
+
+static int DP_ReadLong (demoparser_t *p)
+{
+	int l;
+
+	if (!DP_Check (p, 4))
+		return -1;
+
+	memcpy (&l, p->msg + p->msgpos, 4);
+	p->msgpos += 4;
+
+	return LittleLong (l);
+}
+
+static float DP_ReadFloat (demoparser_t *p)
+{
+	float f;
+
+	if (!DP_Check (p, 4))
+		return -1;
+
+	memcpy (&f, p->msg + p->msgpos, 4);
+	p->msgpos += 4;
+
+	return LittleFloat (f);
+}
+
+//
+// Returns the string in place, the message buffer is always zero terminated.
+//
+static char *DP_ReadString (demoparser_t *p)
+{
+	char *s = (char *) p->msg + p->msgpos;
+
+	if (p->badread)
+		return "";
+
+	while (p->msgpos < p->msglen && p->msg[p->msgpos])
+		p->msgpos++;
+
+	if (p->msgpos == p->msglen)
+	{
+		p->badread = true;
+		return "";
+	}
+
+	p->msgpos++;
+	return s;
+}
+
+static void DP_SkipCoords (demoparser_t *p, int count)
+{
+	DP_Skip (p, count * p->coordsize);
+}
+
+static void DP_SkipAngles (demoparser_t *p, int count)
+{
+	DP_Skip (p, count * (p->coordsize == 4 ? 2 : 1));
+}
+
+//
+// Info_ValueForKey uses static buffers, this one is safe in a thread.
+//
+static void DP_InfoValue (const char *s, const char *key, char *value, int size)
+{
+	int keylen = strlen (key), len;
+	const char *k, *v;
+
+	value[0] = 0;
+
+	while (*s)
+	{
+		if (*s == '\\')
+			s++;
+
+		for (k = s; *s && *s != '\\'; s++)
+			;
+		len = s - k;
+
+		if (*s)
+			s++;
+
+		for (v = s; *s && *s != '\\'; s++)
+			;
+
+		if (len == keylen && !strncmp (k, key, len))
+		{
+			strlcpy (value, v, min (size, s - v + 1));
+			return;
+		}
+	}
+}
+
+static void DP_ServerInfoKey (demoparser_t *p, const char *key, const char *value)
+{
+	if (!strcmp (key, "status"))
+		p->standby = !strcasecmp (value, "standby") || !strcasecmp (value, "countdown");
+	else if (!strcmp (key, "hostname"))
+		strlcpy (p->hostname, value, sizeof(p->hostname));
+	else if (!strcmp (key, "deathmatch"))
+		p->deathmatch = atoi (value);
+}
+
+//
+// fullserverinfo "<info>" stuffed by the server.
+//
+static void DP_ServerInfo (demoparser_t *p, char *s)
+{
+	char value[64];
+
+	if (*s == '"')
+		s++;
+	if (*s && s[strlen (s) - 1] == '\n')
+		s[strlen (s) - 1] = 0;
+	if (*s && s[strlen (s) - 1] == '"')
+		s[strlen (s) - 1] = 0;
+
+	DP_InfoValue (s, "status", value, sizeof(value));
+	DP_ServerInfoKey (p, "status", value);
+	DP_InfoValue (s, "hostname", p->hostname, sizeof(p->hostname));
+	DP_InfoValue (s, "deathmatch", value, sizeof(value));
+	DP_ServerInfoKey (p, "deathmatch", value);
+}
+
+//=============================================================================
+//								EVENTS
+//=============================================================================
+
+static void DP_Event (demoparser_t *p, demoevent_type_t type, int player, int stat, int value)
+{
+	demoevent_t event;
+
+	if (!p->OnEvent)
+		return;
+
+	event.time = p->time;
+	event.type = type;
+	event.player = player;
+	event.stat = stat;
+	event.value = value;
+
+	p->OnEvent (p, &event);
+}
+
+static void DP_SetStat (demoparser_t *p, int player, int stat, int value)
+{
+	demoparse_player_t *pl;
+	int i, old, gained;
+
+	if (player < 0 || player >= MAX_CLIENTS || stat < 0 || stat >= MAX_CL_STATS)
+		return;
+
+	pl = &p->players[player];
+	old = pl->stats[stat];
+
+	if (old == value)
+		return;
+
+	pl->stats[stat] = value;
+
+	for (i = 0; i < sizeof(demoparse_eventstats) / sizeof(demoparse_eventstats[0]); i++)
+	{
+		if (demoparse_eventstats[i] == stat)
+		{
+			DP_Event (p, DEMOEVENT_STAT, player, stat, value);
+			break;
+		}
+	}
+
+	if (stat == STAT_HEALTH && old > 0 && value <= 0)
+		DP_Event (p, DEMOEVENT_DEATH, player, stat, value);
+
+	if (stat == STAT_ITEMS)
+	{
+		gained = value & ~old;
+
+		for (i = 0; i < 32; i++)
+		{
+			if (!(gained & (1 << i)))
+				continue;
+
+			if ((1 << i) & DEMOPARSE_POWERUPS)
+				DP_Event (p, DEMOEVENT_POWERUP, player, stat, 1 << i);
+			else if ((1 << i) & DEMOPARSE_ITEMS)
+				DP_Event (p, DEMOEVENT_ITEM, player, stat, 1 << i);
+		}
+	}
+}
+
+//
+// The player svc_updatestat applies to.
+//
+static int DP_StatPlayer (demoparser_t *p)
+{
+	if (!p->mvd)
+		return p->playernum;
+
+	if (p->lasttype == dem_stats || p->lasttype == dem_single)
+		return p->lastto;
+
+	return -1;
+}
+
+static void DP_SetUserinfoKey (demoparse_player_t *pl, const char *key, const char *value)
+{
+	if (!strcmp (key, "name"))
+		strlcpy (pl->name, value, sizeof(pl->name));
+	else if (!strcmp (key, "team"))
+		strlcpy (pl->team, value, sizeof(pl->team));
+	else if (!strcmp (key, "*spectator"))
+		pl->spectator = value[0] ? true : false;
+
+	pl->active = pl->name[0] ? true : false;
+}
+
+//=============================================================================
+//								SERVER MESSAGES
+//=============================================================================
+
+//
+// CL_ParseServerData.
+//
+static void DP_ParseServerData (demoparser_t *p)
+{
+	int protover, i;
+	float time;
+
+	p->fteprotocolextensions = 0;
+
+	for (;;)
+	{
+		protover = DP_ReadLong (p);
+
+		if (protover == PROTOCOL_VERSION_FTE)
+		{
+			p->fteprotocolextensions = DP_ReadLong (p);
+			continue;
+		}
+
+		if (protover == PROTOCOL_VERSION_FTE2)
+		{
+			DP_ReadLong (p);
+			continue;
+		}
+
+		if (protover == PROTOCOL_VERSION || protover == 26 || protover == 27 || protover == 28)
+			break;
+
+		p->badread = true;
+		return;
+	}
+
+	p->protocol = protover;
+	p->coordsize = (p->fteprotocolextensions & FTE_PEXT_FLOATCOORDS) ? 4 : 2;
+
+	DP_ReadLong (p);		// servercount
+	DP_ReadString (p);		// gamedir
+
+	if (p->mvd)
+	{
+		// Playback moves the time forward to this.
+		time = DP_ReadFloat (p);
+		p->time = max (p->time, time);
+	}
+	else
+	{
+		p->playernum = DP_ReadByte (p) & ~128;
+	}
+
+	if (!p->levelname[0])
+		strlcpy (p->levelname, DP_ReadString (p), sizeof(p->levelname));
+	else
+		DP_ReadString (p);
+
+	DP_Skip (p, 10 * 4);	// movevars
+
+	// A new map, CL_ClearState wipes the players.
+	for (i = 0; i < MAX_CLIENTS; i++)
+	{
+		p->players[i].frags = 0;
+		memset (p->players[i].stats, 0, sizeof(p->players[i].stats));
+	}
+
+	if (p->OnServerData && !p->badread)
+		p->OnServerData (p);
+}
+
+//
+// CL_ParseModellist.
+//
+static void DP_ParseModellist (demoparser_t *p, qbool extended)
+{
+	int nummodels = extended ? (unsigned short) DP_ReadShort (p) : DP_ReadByte (p);
+	char *str;
+
+	while (!p->badread)
+	{
+		str = DP_ReadString (p);
+		if (!str[0])
+			break;
+
+		if (++nummodels == 1 && !p->mapname[0])
+			COM_StripExtension (COM_SkipPath (str), p->mapname);
+	}
+
+	DP_ReadByte (p);
+}
+
+//
+// CL_ParseSoundlist.
+//
+static void DP_ParseSoundlist (demoparser_t *p)
+{
+	DP_ReadByte (p);
+
+	while (!p->badread && DP_ReadString (p)[0])
+		;
+
+	DP_ReadByte (p);
+}
+
+//
+// CL_ParseDelta.
+//
+static void DP_ParseDelta (demoparser_t *p, int bits)
+{
+	int morebits = 0;
+
+	bits &= ~511;
+
+	if (bits & U_MOREBITS)
+		bits |= DP_ReadByte (p);
+
+	if ((bits & U_FTE_EVENMORE) && p->fteprotocolextensions)
+	{
+		morebits = DP_ReadByte (p);
+		if (morebits & U_FTE_YETMORE)
+			morebits |= DP_ReadByte (p) << 8;
+	}
+
+	if (bits & U_MODEL)
+		DP_Skip (p, 1);
+	if (bits & U_FRAME)
+		DP_Skip (p, 1);
+	if (bits & U_COLORMAP)
+		DP_Skip (p, 1);
+	if (bits & U_SKIN)
+		DP_Skip (p, 1);
+	if (bits & U_EFFECTS)
+		DP_Skip (p, 1);
+	if (bits & U_ORIGIN1)
+		DP_SkipCoords (p, 1);
+	if (bits & U_ANGLE1)
+		DP_SkipAngles (p, 1);
+	if (bits & U_ORIGIN2)
+		DP_SkipCoords (p, 1);
+	if (bits & U_ANGLE2)
+		DP_SkipAngles (p, 1);
+	if (bits & U_ORIGIN3)
+		DP_SkipCoords (p, 1);
+	if (bits & U_ANGLE3)
+		DP_SkipAngles (p, 1);
+
+	if ((morebits & U_FTE_TRANS) && (p->fteprotocolextensions & FTE_PEXT_TRANS))
+		DP_Skip (p, 1);
+}
+
+//
+// CL_ParsePacketEntities.
+//
+static void DP_ParsePacketEntities (demoparser_t *p, qbool delta)
+{
+	int word;
+
+	if (delta)
+		DP_ReadByte (p);
+
+	while (!p->badread)
+	{
+		word = (unsigned short) DP_ReadShort (p);
+		if (!word || p->badread)
+			break;
+
+		if (word & U_REMOVE)
+		{
+			if ((word & U_MOREBITS) && (p->fteprotocolextensions & FTE_PEXT_ENTITYDBL))
+			{
+				if (DP_ReadByte (p) & U_FTE_EVENMORE)
+					DP_ReadByte (p);
+			}
+			continue;
+		}
+
+		DP_ParseDelta (p, word);
+	}
+}
+
+//
+// MSG_ReadDeltaUsercmd.
+//
+static void DP_ParseDeltaUsercmd (demoparser_t *p)
+{
+	int bits = DP_ReadByte (p);
+
+	if (p->protocol == 26)
+	{
+		if (bits & CM_ANGLE1)
+			DP_Skip (p, 2);
+		DP_Skip (p, 2);
+		if (bits & CM_ANGLE3)
+			DP_Skip (p, 2);
+		if (bits & CM_FORWARD)
+			DP_Skip (p, 1);
+		if (bits & CM_SIDE)
+			DP_Skip (p, 1);
+		if (bits & CM_UP)
+			DP_Skip (p, 1);
+	}
+	else
+	{
+		if (bits & CM_ANGLE1)
+			DP_Skip (p, 2);
+		if (bits & CM_ANGLE2)
+			DP_Skip (p, 2);
+		if (bits & CM_ANGLE3)
+			DP_Skip (p, 2);
+		if (bits & CM_FORWARD)
+			DP_Skip (p, 2);
+		if (bits & CM_SIDE)
+			DP_Skip (p, 2);
+		if (bits & CM_UP)
+			DP_Skip (p, 2);
+	}
+
+	if (bits & CM_BUTTONS)
+		DP_Skip (p, 1);
+	if (bits & CM_IMPULSE)
+		DP_Skip (p, 1);
+
+	// msec, CM_MSEC shares its bit with CM_ANGLE2
+	if (p->protocol != 26 || (bits & CM_ANGLE2))
+		DP_Skip (p, 1);
+}
+
+//
+// CL_ParsePlayerinfo.
+//
+static void DP_ParsePlayerinfo (demoparser_t *p)
+{
+	demoparse_player_t *pl, dummy;
+	int flags, i, num;
+
+	num = DP_ReadByte (p);
+	pl = num < MAX_CLIENTS ? &p->players[num] : &dummy;
+
+	if (p->mvd)
+	{
+		flags = DP_ReadShort (p);
+		DP_Skip (p, 1);		// frame
+
+		for (i = 0; i < 3; i++)
+			if (flags & (DF_ORIGIN << i))
+				DP_SkipCoords (p, 1);
+
+		for (i = 0; i < 3; i++)
+			if (flags & (DF_ANGLES << i))
+				DP_Skip (p, 2);
+
+		if (flags & DF_MODEL)
+			DP_Skip (p, 1);
+		if (flags & DF_SKINNUM)
+			DP_Skip (p, 1);
+		if (flags & DF_EFFECTS)
+			DP_Skip (p, 1);
+		if (flags & DF_WEAPONFRAME)
+			pl->weaponframe = DP_ReadByte (p);	// Delta from the last one, kept otherwise.
+
+		return;
+	}
+
+	flags = DP_ReadShort (p);
+	DP_SkipCoords (p, 3);
+	DP_Skip (p, 1);		// frame
+
+	if (flags & PF_MSEC)
+		DP_Skip (p, 1);
+	if (flags & PF_COMMAND)
+		DP_ParseDeltaUsercmd (p);
+
+	for (i = 0; i < 3; i++)
+		if (flags & (PF_VELOCITY1 << i))
+			DP_Skip (p, 2);
+
+	if (flags & PF_MODEL)
+		DP_Skip (p, 1);
+	if (flags & PF_SKINNUM)
+		DP_Skip (p, 1);
+	if (flags & PF_EFFECTS)
+		DP_Skip (p, 1);
+	pl->weaponframe = (flags & PF_WEAPONFRAME) ? DP_ReadByte (p) : 0;
+	if ((flags & PF_TRANS_Z) && (p->fteprotocolextensions & FTE_PEXT_TRANS))
+		DP_Skip (p, 1);
+}
+
+//
+// CL_ParseTEnt.
+//
+static void DP_ParseTEnt (demoparser_t *p)
+{
+	switch (DP_ReadByte (p))
+	{
+		case TE_LIGHTNING1:
+		case TE_LIGHTNING2:
+		case TE_LIGHTNING3:
+			DP_Skip (p, 2);
+			DP_SkipCoords (p, 6);
+			break;
+		case TE_GUNSHOT:
+		case TE_BLOOD:
+			DP_Skip (p, 1);
+			DP_SkipCoords (p, 3);
+			break;
+		case TE_LIGHTNINGBLOOD:
+		case TE_WIZSPIKE:
+		case TE_KNIGHTSPIKE:
+		case TE_SPIKE:
+		case TE_SUPERSPIKE:
+		case TE_EXPLOSION:
+		case TE_TAREXPLOSION:
+		case TE_LAVASPLASH:
+		case TE_TELEPORT:
+			DP_SkipCoords (p, 3);
+			break;
+		default:
+			p->badread = true;
+			break;
+	}
+}
+
+//
+// CL_ParseDownload, demos only ever skip the data.
+//
+static void DP_ParseDownload (demoparser_t *p)
+{
+	int size;
+
+	if (p->fteprotocolextensions & FTE_PEXT_CHUNKEDDOWNLOADS)
+	{
+		if (DP_ReadLong (p) < 0)
+		{
+			DP_ReadLong (p);
+			DP_ReadString (p);
+		}
+		else
+		{
+			DP_Skip (p, 1024);	// DLBLOCKSIZE
+		}
+		return;
+	}
+
+	size = DP_ReadShort (p);
+	DP_ReadByte (p);
+
+	if (size > 0)
+		DP_Skip (p, size);
+}
+
+//
+// CL_ParseServerMessage.
+//
+static void DP_ParseMessage (demoparser_t *p)
+{
+	demoparse_player_t *pl;
+	char *key, spec[8];
+	int cmd, i, j;
+
+	p->messages++;
+	p->badread = false;
+
+	while (p->msgpos < p->msglen && !p->badread)
+	{
+		cmd = DP_ReadByte (p);
+
+		switch (cmd)
+		{
+			case svc_nop:
+			case svc_killedmonster:
+			case svc_foundsecret:
+			case svc_sellscreen:
+			case svc_smallkick:
+			case svc_bigkick:
+				break;
+
+			case svc_disconnect:
+				// MVDs can go on with the next map, QWDs end here.
+				if (p->mvd && p->msgpos < p->msglen)
+					DP_ReadString (p);
+				else
+					p->msgpos = p->msglen;
+				break;
+
+			case nq_svc_time:
+			case svc_maxspeed:
+			case svc_entgravity:
+				DP_Skip (p, 4);
+				break;
+
+			case svc_print:
+				DP_ReadByte (p);
+				DP_ReadString (p);
+				break;
+
+			case svc_centerprint:
+			case svc_stufftext:
+				key = DP_ReadString (p);
+				if (cmd == svc_stufftext && p->OnStuffText && !p->badread)
+					p->OnStuffText (p, key);
+				if (!strncmp (key, "fullserverinfo ", 15))
+					DP_ServerInfo (p, key + 15);
+				break;
+
+			case svc_finale:
+				DP_ReadString (p);
+				break;
+
+			case svc_damage:
+				DP_Skip (p, 2);
+				DP_SkipCoords (p, 3);
+				break;
+
+			case svc_serverdata:
+				DP_ParseServerData (p);
+				break;
+
+			case svc_setangle:
+				if (p->mvd)
+					DP_ReadByte (p);
+				DP_SkipAngles (p, 3);
+				break;
+
+			case svc_lightstyle:
+				DP_ReadByte (p);
+				DP_ReadString (p);
+				break;
+
+			case svc_sound:
+				i = DP_ReadShort (p);
+				if (i & SND_VOLUME)
+					DP_Skip (p, 1);
+				if (i & SND_ATTENUATION)
+					DP_Skip (p, 1);
+				DP_Skip (p, 1);
+				DP_SkipCoords (p, 3);
+				break;
+
+			case svc_stopsound:
+			case svc_muzzleflash:
+				DP_Skip (p, 2);
+				break;
+
+			case svc_updatefrags:
+				i = DP_ReadByte (p);
+				j = DP_ReadShort (p);
+				if (p->badread || i >= MAX_CLIENTS)
+					break;
+				if (p->players[i].frags != j)
+				{
+					p->players[i].frags = j;
+					DP_Event (p, DEMOEVENT_FRAG, i, 0, j);
+				}
+				break;
+
+			case svc_updateping:
+				DP_Skip (p, 3);
+				break;
+
+			case svc_updatepl:
+				DP_Skip (p, 2);
+				break;
+
+			case svc_updateentertime:
+				DP_Skip (p, 5);
+				break;
+
+			case svc_spawnbaseline:
+				DP_Skip (p, 2);
+				// fall through
+			case svc_spawnstatic:
+				DP_Skip (p, 4);
+				DP_Skip (p, 3 * p->coordsize);
+				DP_SkipAngles (p, 3);
+				break;
+
+			case svc_fte_spawnbaseline2:
+			case svc_fte_spawnstatic2:
+				DP_ParseDelta (p, (unsigned short) DP_ReadShort (p));
+				break;
+
+			case svc_temp_entity:
+				DP_ParseTEnt (p);
+				break;
+
+			case svc_updatestat:
+				i = DP_ReadByte (p);
+				j = DP_ReadByte (p);
+				if (!p->badread)
+					DP_SetStat (p, DP_StatPlayer (p), i, j);
+				break;
+
+			case svc_updatestatlong:
+				i = DP_ReadByte (p);
+				j = DP_ReadLong (p);
+				if (!p->badread)
+					DP_SetStat (p, DP_StatPlayer (p), i, j);
+				break;
+
+			case svc_spawnstaticsound:
+				DP_SkipCoords (p, 3);
+				DP_Skip (p, 3);
+				break;
+
+			case svc_cdtrack:
+			case svc_chokecount:
+			case svc_setpause:
+				DP_Skip (p, 1);
+				break;
+
+			case svc_intermission:
+				DP_SkipCoords (p, 3);
+				DP_SkipAngles (p, 3);
+				break;
+
+			case svc_updateuserinfo:
+				i = DP_ReadByte (p);
+				j = DP_ReadLong (p);
+				key = DP_ReadString (p);
+				if (p->badread || i >= MAX_CLIENTS)
+					break;
+				pl = &p->players[i];
+				pl->userid = j;
+				DP_InfoValue (key, "name", pl->name, sizeof(pl->name));
+				DP_InfoValue (key, "team", pl->team, sizeof(pl->team));
+				DP_InfoValue (key, "*spectator", spec, sizeof(spec));
+				pl->spectator = spec[0] ? true : false;
+				pl->active = pl->name[0] ? true : false;
+				break;
+
+			case svc_setinfo:
+				i = DP_ReadByte (p);
+				key = DP_ReadString (p);
+				if (!p->badread && i < MAX_CLIENTS)
+					DP_SetUserinfoKey (&p->players[i], key, DP_ReadString (p));
+				else
+					DP_ReadString (p);
+				break;
+
+			case svc_serverinfo:
+				key = DP_ReadString (p);
+				DP_ServerInfoKey (p, key, DP_ReadString (p));
+				break;
+
+			case svc_download:
+				DP_ParseDownload (p);
+				break;
+
+			case svc_playerinfo:
+				DP_ParsePlayerinfo (p);
+				break;
+
+			case svc_nails:
+			case svc_nails2:
+				i = DP_ReadByte (p);
+				DP_Skip (p, i * (cmd == svc_nails2 ? 7 : 6));
+				break;
+
+			case svc_modellist:
+				DP_ParseModellist (p, false);
+				break;
+
+			case svc_fte_modellistshort:
+				DP_ParseModellist (p, true);
+				break;
+
+			case svc_soundlist:
+				DP_ParseSoundlist (p);
+				break;
+
+			case svc_packetentities:
+				DP_ParsePacketEntities (p, false);
+				break;
+
+			case svc_deltapacketentities:
+				DP_ParsePacketEntities (p, true);
+				break;
+
+			case svc_qizmovoice:
+				DP_Skip (p, 34);
+				break;
+
+			default:
+				p->badread = true;
+				break;
+		}
+	}
+
+	// The client would Host_Error, here the rest of the message is dropped.
+	if (p->badread)
+		p->badmessages++;
+}
+
+//=============================================================================
+//								DEMO BLOCKS
+//=============================================================================
+
+//
+// Reads a dem_read block into the message buffer.
+//
+static qbool DP_ReadBlockMessage (demoparser_t *p)
+{
+	int size;
+
+	if (DP_FileRead (p, &size, 4) != 4)
+		return false;
+
+	size = LittleLong (size);
+	if (size < 0 || size > MSG_BUF_SIZE)
+	{
+		snprintf (p->error, sizeof(p->error), "bad message size %d at offset %lu", size, p->blockstart);
+		return false;
+	}
+
+	if (DP_FileRead (p, p->msg, size) != size)
+		return false;
+
+	p->msg[size] = 0;
+	p->msglen = size;
+	p->msgpos = 0;
+
+	if (!p->mvd)
+	{
+		// Connectionless packets, then the netchan header.
+		if (size < 8 || LittleLong (*(int *) p->msg) == -1)
+			return true;
+
+		p->msgpos = 8;
+	}
+
+	DP_ParseMessage (p);
+
+	return true;
+}
+
+demoparser_t *DemoParse_New (vfsfile_t *file, qbool mvd)
+{
+	demoparser_t *p = (demoparser_t *) Q_malloc (sizeof(demoparser_t));
+
+	p->file = file;
+	p->mvd = mvd;
+	p->buf = (byte *) Q_malloc (DEMOPARSE_BUFSIZE);
+	p->msg = (byte *) Q_malloc (MSG_BUF_SIZE + 1);
+	p->protocol = PROTOCOL_VERSION;
+	p->coordsize = 2;
+
+	return p;
+}
+
+void DemoParse_Free (demoparser_t *p)
+{
+	if (!p)
+		return;
+
+	Q_free (p->buf);
+	Q_free (p->msg);
+	Q_free (p);
+}
+
+//
+// Parses a server message which isn't read from the file, the netchan
+// header already skipped. Returns false if it couldn't all be parsed.
+//
+qbool DemoParse_Message (demoparser_t *p, byte *data, int len)
+{
+	if (len < 0 || len > MSG_BUF_SIZE)
+		return false;
+
+	memcpy (p->msg, data, len);
+	p->msg[len] = 0;
+	p->msglen = len;
+	p->msgpos = 0;
+
+	DP_ParseMessage (p);
+
+	return !p->badread;
+}
+
+//
+// The extension decides between MVD and QWD, as for playback.
+//
+qbool DemoParse_IsMVDName (const char *name)
+{
+	char stripped[MAX_OSPATH];
+
+	if (!strcasecmp (COM_FileExtension (name), "gz"))
+	{
+		COM_StripExtension (name, stripped);
+		name = stripped;
+	}
+
+	return !strcasecmp (COM_FileExtension (name), "mvd");
+}
+
+//
+// Parses the demo from the current file position to the end.
+// Returns false if the demo could not be read to the end, with p->error set.
+// Demos cut short are still fine, what could be read is reported.
+//
+qbool DemoParse_Run (demoparser_t *p)
+{
+	unsigned int total_mvd_time = 0;
+	byte mvd_time, c;
+	float qwd_time;
+	int i;
+
+	for (;;)
+	{
+		p->blockstart = DP_FileTell (p);
+
+		// Read the time.
+		if (p->mvd)
+		{
+			if (DP_FileRead (p, &mvd_time, 1) != 1)
+				break;
+
+			total_mvd_time += mvd_time;
+			p->time += mvd_time * 0.001;
+		}
+		else
+		{
+			if (DP_FileRead (p, &qwd_time, 4) != 4)
+				break;
+
+			p->time = LittleFloat (qwd_time);
+		}
+
+		if (DP_FileRead (p, &c, 1) != 1)
+			break;
+
+		p->blocks++;
+
+		if (p->OnBlock)
+			p->OnBlock (p);
+
+		switch (c & 7)
+		{
+			case dem_cmd:
+				if (DP_FileRead (p, NULL, sizeof(usercmd_t) + 12) != sizeof(usercmd_t) + 12)
+					goto done;
+				continue;
+
+			case dem_set:
+				if (DP_FileRead (p, NULL, 8) != 8)
+					goto done;
+				continue;
+
+			case dem_multiple:
+				if (DP_FileRead (p, &i, 4) != 4)
+					goto done;
+				p->lastto = LittleLong (i);
+				p->lasttype = dem_multiple;
+				break;
+
+			case dem_single:
+			case dem_stats:
+				p->lastto = c >> 3;
+				p->lasttype = c & 7;
+				break;
+
+			case dem_all:
+				p->lastto = 0;
+				p->lasttype = dem_all;
+				break;
+
+			case dem_read:
+				break;
+
+			default:
+				snprintf (p->error, sizeof(p->error), "unknown block type %d at offset %lu", c & 7, p->blockstart);
+				return false;
+		}
+
+		if (!DP_ReadBlockMessage (p))
+		{
+			if (p->error[0])
+				return false;
+			break;
+		}
+	}
+
+done:
+	p->duration = p->mvd ? total_mvd_time * 0.001 : p->time;
+
+	return true;
+}
@@ -0,0 +1,118 @@
+/*
+Copyright (C) 2007 ezQuake team
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef __DEMO_PARSE_H__
+#define __DEMO_PARSE_H__
+
+//
+// Headless demo parser.
+//
+// Walks a QWD or MVD and decodes the server messages in it without touching
+// the client state, the renderer or the sound system. It keeps track of the
+// players and their stats and reports what happens through a callback.
+// All the state lives in the parser, so several can run in different threads.
+// It can also be given the messages one by one, as a client receives them.
+//
+
+typedef enum demoevent_type_e
+{
+	DEMOEVENT_FRAG,			// value = new frag count
+	DEMOEVENT_DEATH,
+	DEMOEVENT_POWERUP,		// value = item bit picked up (IT_QUAD etc)
+	DEMOEVENT_ITEM,			// value = item bit picked up (weapons, armors, keys)
+	DEMOEVENT_STAT,			// stat = changed stat, value = new value
+	DEMOEVENT_MAX
+} demoevent_type_t;
+
+typedef struct demoevent_s
+{
+	float	time;
+	byte	type;
+	byte	player;
+	byte	stat;
+	int		value;
+} demoevent_t;
+
+typedef struct demoparse_player_s
+{
+	qbool	active;
+	qbool	spectator;
+	int		userid;
+	char	name[MAX_SCOREBOARDNAME];
+	char	team[MAX_SCOREBOARDNAME];
+	int		frags;
+	int		weaponframe;		// Non zero while firing.
+	int		stats[MAX_CL_STATS];
+} demoparse_player_t;
+
+typedef struct demoparser_s demoparser_t;
+
+struct demoparser_s
+{
+	vfsfile_t	*file;
+	qbool		mvd;
+
+	// File read buffer.
+	byte		*buf;
+	int			bufpos, buflen;
+	unsigned long bufstart;			// File offset of buf[0].
+	qbool		eof;
+
+	// The message being parsed.
+	byte		*msg;
+	int			msglen, msgpos;
+	qbool		badread;
+
+	// Protocol state.
+	int			protocol;
+	int			fteprotocolextensions;
+	int			coordsize;
+	int			playernum;			// QWD only, the POV of the demo.
+	int			lastto, lasttype;	// MVD only, who the message is for.
+
+	double		time;				// Stream time of the current block, as playback computes it.
+	double		duration;			// As CL_CalculateDemoTime returns it.
+	unsigned long blockstart;		// File offset of the current block.
+
+	char		levelname[64];
+	char		mapname[MAX_QPATH];
+	char		hostname[64];
+	qbool		standby;			// Serverinfo status is standby or countdown, the match hasn't started.
+	int			deathmatch;
+	demoparse_player_t players[MAX_CLIENTS];
+
+	int			blocks, messages, badmessages;
+
+	// Callbacks, may be NULL.
+	void		*userdata;
+	void		(*OnBlock) (demoparser_t *p);						// Before each block is read.
+	void		(*OnEvent) (demoparser_t *p, demoevent_t *event);
+	void		(*OnServerData) (demoparser_t *p);
+	void		(*OnStuffText) (demoparser_t *p, const char *text);
+
+	char		error[128];
+};
+
+demoparser_t *DemoParse_New (vfsfile_t *file, qbool mvd);
+void DemoParse_Free (demoparser_t *p);
+qbool DemoParse_Run (demoparser_t *p);
+qbool DemoParse_Message (demoparser_t *p, byte *data, int len);
+qbool DemoParse_IsMVDName (const char *name);
+
+#endif // __DEMO_PARSE_H__
@@ -1194,6 +1194,29 @@ archive_fail:
 	return NULL;
 }
 
+/* ================
+ * FS_FileSource
+ * ================
+ * Where FS_OpenVFS with FS_ANY would find the file: the search path it is in,
+ * or NULL if it isn't found. If it is a plain file on disk, its full path is
+ * put in ospath, otherwise ospath is set to "".
+ */
+void *FS_FileSource(const char *filename, char *ospath, int ospathsize)
+{
+	flocation_t loc;
+
+	ospath[0] = 0;
+
+	FS_FLocateFile(filename, FSLFRT_IFFOUND, &loc);
+	if (!loc.search)
+		return NULL;
+
+	if (loc.search->funcs == &osfilefuncs)
+		snprintf(ospath, ospathsize, "%s/%s", (char *)loc.search->handle, loc.rawname);
+
+	return loc.search;
+}
+
 
 
 // VFS
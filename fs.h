@@ -89,6 +89,8 @@ qbool			VFS_COPYPROTECTED(struct vfsfile_s *vf);
 
 // some general function to open VFS file, except TCP
 vfsfile_t *FS_OpenVFS(const char *filename, char *mode,relativeto_t relativeto);
+// the search path a file would be opened from, and its path if it is on disk
+void *FS_FileSource(const char *filename, char *ospath, int ospathsize);
 
 // TCP VFS file
 vfsfile_t *FS_OpenTCP(char *name);
@@ -2046,6 +2046,7 @@ void R_RenderScene(void)
 	extern void Skins_PreCache(void);
 
 	vec3_t		colors;
+	double		td;
 
 	R_SetupFrame ();
 
@@ -2059,12 +2060,16 @@ void R_RenderScene(void)
 
 	Skins_PreCache ();  // preache skins if needed
 
+	td = CL_TimeDemo_PartStart();
 	R_DrawWorld ();		// adds static entities to the list
+	CL_TimeDemo_PartEnd(TDP_WORLD, td);
 
 	CL_S_ExtraUpdate ();	// don't let sound get messed up if going slow
 
+	td = CL_TimeDemo_PartStart();
 	R_DrawEntitiesOnList (&cl_visents);
 	R_DrawEntitiesOnList (&cl_alphaents);	
+	CL_TimeDemo_PartEnd(TDP_MODELS, td);
 
 	R_DrawWaterSurfaces ();
 
@@ -2360,7 +2365,7 @@ void R_RenderView(void)
 {
 	extern void DrawCI (void);
 
-	double time1 = 0, time2;
+	double time1 = 0, time2, td;
 	if (!r_worldentity.model || !cl.worldmodel)
 		Sys_Error ("R_RenderView: NULL worldmodel");
 
@@ -2379,7 +2384,10 @@ void R_RenderView(void)
 	// render normal view
 	R_RenderScene ();
 	R_RenderDlights ();
+
+	td = CL_TimeDemo_PartStart();
 	R_DrawParticles ();
+	CL_TimeDemo_PartEnd(TDP_PARTICLES, td);
 
 	DrawCI ();
 
@@ -45,6 +45,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "version.h"
 #include "qsound.h"
 #include "keys.h"
+#include "mvd_utils.h"
 
 double		curtime;
 
@@ -557,6 +558,11 @@ void Host_Init (int argc, char **argv, int default_memsize)
 	Cmd_Init ();
 	Cvar_Init ();
 	COM_Init ();
+
+	// Headless MVD stats, done before the video and sound are started.
+	if ((i = MVD_BatchStats_CommandLine ()) >= 0)
+		exit (i);
+
 	Key_Init ();
 
 #ifdef WITH_DP_MEM
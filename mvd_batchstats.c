@@ -0,0 +1,714 @@
+/*
+Copyright (C) 2007 ezQuake team
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+// MultiView Demo batch stats
+// Parses a directory of .mvd and .mvd.gz files with the headless demo parser
+// in worker threads, and writes the stats of each player next to each demo
+// (or to another directory) as JSON or XML.
+//
+// From the command line, before the video and sound are initialized:
+//   ezquake -mvdstats <dir> [-mvdstats_format json|xml] [-mvdstats_threads n] [-mvdstats_out <dir>]
+// or from the console with mvd_batchstats.
+//
+// The stats are gathered with the rules mvd_utils uses while watching a demo
+// (MVD_Stats_GatherPlayer), on the players of the parser, and nothing is
+// counted while the server is in standby or countdown.
+
+#include <SDL.h>
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#endif
+#include "quakedef.h"
+#include "hash.h"
+#include "fs.h"
+#include "vfs.h"
+#include "mvd_utils.h"
+#include "mvd_utils_common.h"
+#include "demo_parse.h"
+
+#define BATCHSTATS_MAXTHREADS	64
+
+typedef enum batchstats_format_e
+{
+	BATCHSTATS_JSON,
+	BATCHSTATS_XML
+} batchstats_format_t;
+
+typedef struct batchstats_player_s
+{
+	qbool		started;
+	double		alivetime;				// All lives, the mvd_info_t only has the current one.
+	mvd_info_t	info;
+} batchstats_player_t;
+
+typedef struct batchstats_demo_s
+{
+	char	path[MAX_OSPATH];
+	qbool	ok;
+	int		size;						// Uncompressed.
+	double	duration;
+	char	error[MAX_OSPATH + 32];			// Room for "couldn't write <output path>".
+} batchstats_demo_t;
+
+typedef struct batchstats_job_s
+{
+	batchstats_demo_t	*demos;
+	int					numdemos, maxdemos;
+	int					next;			// Next demo to take, shared by the workers.
+
+	batchstats_format_t	format;
+	char				outdir[MAX_OSPATH];
+	sem_t				done;
+} batchstats_job_t;
+
+typedef struct batchstats_s
+{
+	double				lastgather;
+	batchstats_player_t	players[MAX_CLIENTS];
+} batchstats_t;
+
+static void BatchStats_Printf (qbool headless, char *fmt, ...)
+{
+	va_list argptr;
+	char msg[1024];
+
+	va_start (argptr, fmt);
+	vsnprintf (msg, sizeof(msg), fmt, argptr);
+	va_end (argptr);
+
+	if (headless)
+		printf ("%s", msg);
+	else
+		Com_Printf ("%s", msg);
+}
+
+//=============================================================================
+//								GATHERING
+//=============================================================================
+
+static void BatchStats_Gather (demoparser_t *p, batchstats_t *bs)
+{
+	batchstats_player_t *s;
+	mvd_gather_event_t ev;
+	int i;
+
+	for (i = 0; i < MAX_CLIENTS; i++)
+	{
+		if (!p->players[i].active || p->players[i].spectator)
+			continue;
+
+		s = &bs->players[i];
+
+		// The stats start over with the match, as MVD_Init_Info does them.
+		if (p->standby)
+		{
+			if (s->started)
+				memset (s, 0, sizeof(*s));
+			continue;
+		}
+
+		s->started = true;
+		MVD_Stats_GatherPlayer (&s->info, p->players[i].stats, p->players[i].frags,
+			p->players[i].weaponframe, p->deathmatch, p->time, &ev);
+
+		if (ev.died)
+			s->alivetime += s->info.das.alivetime;
+	}
+}
+
+static double BatchStats_AliveTime (batchstats_player_t *s)
+{
+	return s->alivetime + (s->info.das.isdead ? 0 : s->info.das.alivetime);
+}
+
+//
+// The stats are looked at once per frame, when all the messages of the previous one are in.
+//
+static void BatchStats_OnBlock (demoparser_t *p)
+{
+	batchstats_t *bs = (batchstats_t *) p->userdata;
+
+	if (p->time == bs->lastgather)
+		return;
+
+	bs->lastgather = p->time;
+	BatchStats_Gather (p, bs);
+}
+
+//=============================================================================
+//								OUTPUT
+//=============================================================================
+
+static void BatchStats_JSONString (FILE *f, const char *s)
+{
+	fputc ('"', f);
+
+	for (; *s; s++)
+	{
+		if (*s == '"' || *s == '\\')
+			fprintf (f, "\\%c", *s);
+		else if ((byte) *s < 32 || (byte) *s > 126)
+			fprintf (f, "\\u%04x", (byte) *s);	// Quake chars, not UTF-8.
+		else
+			fputc (*s, f);
+	}
+
+	fputc ('"', f);
+}
+
+// Quake names as char codes, as mvd_xmlstats does for mvdstats.xsl.
+static void BatchStats_XMLName (FILE *f, const char *s)
+{
+	fprintf (f, "\n");
+	for (; *s; s++)
+		fprintf (f, "\t\t\t<char>%i</char>\n", (byte) *s);
+	fprintf (f, "\t\t");
+}
+
+static void BatchStats_XMLString (FILE *f, const char *s)
+{
+	for (; *s; s++)
+	{
+		switch (*s)
+		{
+			case '<': fprintf (f, "&lt;"); break;
+			case '>': fprintf (f, "&gt;"); break;
+			case '&': fprintf (f, "&amp;"); break;
+			default:
+				if ((byte) *s >= 32 && (byte) *s <= 126)
+					fputc (*s, f);
+		}
+	}
+}
+
+static void BatchStats_JSONRuns (FILE *f, mvd_runs_t *runs, int count)
+{
+	int x;
+
+	fprintf (f, "[");
+	for (x = 0; x < count; x++)
+		fprintf (f, "%s{\"time\": %.3f, \"frags\": %d, \"teamfrags\": %d}", x ? ", " : "", runs[x].time, runs[x].frags, runs[x].teamfrags);
+	fprintf (f, "]");
+}
+
+static void BatchStats_WriteJSON (FILE *f, demoparser_t *p, batchstats_t *bs)
+{
+	mvd_info_t *s;
+	int i, x, teamkills, first = true;
+
+	fprintf (f, "{\n\t\"map\": ");
+	BatchStats_JSONString (f, p->mapname);
+	fprintf (f, ",\n\t\"hostname\": ");
+	BatchStats_JSONString (f, p->hostname);
+	fprintf (f, ",\n\t\"duration\": %.3f,\n\t\"players\": [", p->duration);
+
+	for (i = 0; i < MAX_CLIENTS; i++)
+	{
+		if (!p->players[i].active || p->players[i].spectator)
+			continue;
+
+		s = &bs->players[i].info;
+
+		fprintf (f, "%s\n\t\t{\n\t\t\t\"name\": ", first ? "" : ",");
+		BatchStats_JSONString (f, p->players[i].name);
+		fprintf (f, ",\n\t\t\t\"team\": ");
+		BatchStats_JSONString (f, p->players[i].team);
+		fprintf (f, ",\n\t\t\t\"frags\": %d,\n\t\t\t\"deaths\": %d,\n\t\t\t\"alivetime\": %.3f,\n",
+			p->players[i].frags, s->das.deathcount, BatchStats_AliveTime (&bs->players[i]));
+
+		fprintf (f, "\t\t\t\"kills\": {");
+		for (x = AXE_INFO; x <= LG_INFO; x++)
+			fprintf (f, "\"%s\": %d, ", mvd_wp_info[x].name, s->killstats.normal[x].kills);
+		fprintf (f, "\"spawn\": %d},\n", s->spawntelefrags);
+
+		for (teamkills = 0, x = AXE_INFO; x <= LG_INFO; x++)
+			teamkills += s->killstats.normal[x].teamkills;
+		fprintf (f, "\t\t\t\"teamkills\": {\"weapons\": %d, \"spawn\": %d},\n", teamkills, s->teamspawntelefrags);
+
+		fprintf (f, "\t\t\t\"took\": {");
+		for (x = SSG_INFO; x < mvd_info_types; x++)
+			fprintf (f, "%s\"%s\": %d", x == SSG_INFO ? "" : ", ", mvd_wp_info[x].name, s->itemstats[x].count);
+		fprintf (f, "},\n");
+
+		fprintf (f, "\t\t\t\"lost\": {");
+		for (x = SSG_INFO; x < mvd_info_types; x++)
+			fprintf (f, "%s\"%s\": %d", x == SSG_INFO ? "" : ", ", mvd_wp_info[x].name, s->itemstats[x].lost);
+		fprintf (f, "},\n");
+
+		fprintf (f, "\t\t\t\"runs\": ");
+		BatchStats_JSONRuns (f, s->runs, s->run);
+		for (x = RING_INFO; x <= PENT_INFO; x++)
+		{
+			fprintf (f, ",\n\t\t\t\"%s_runs\": ", mvd_wp_info[x].name);
+			BatchStats_JSONRuns (f, s->itemstats[x].runs, s->itemstats[x].run);
+		}
+		fprintf (f, "\n\t\t}");
+
+		first = false;
+	}
+
+	fprintf (f, "\n\t]\n}\n");
+}
+
+static void BatchStats_XMLRuns (FILE *f, const char *tag, mvd_runs_t *runs, int count)
+{
+	int x;
+
+	fprintf (f, "\t\t<%s>\n", tag);
+	for (x = 0; x < count; x++)
+	{
+		fprintf (f, "\t\t\t<run id=\"%i\">\n", x);
+		fprintf (f, "\t\t\t\t<time>%9.3f</time>\n", runs[x].time);
+		fprintf (f, "\t\t\t\t<frags>%i</frags>\n", runs[x].frags);
+		fprintf (f, "\t\t\t\t<teamfrags>%i</teamfrags>\n", runs[x].teamfrags);
+		fprintf (f, "\t\t\t</run>\n");
+	}
+	fprintf (f, "\t\t</%s>\n", tag);
+}
+
+static void BatchStats_WriteXML (FILE *f, demoparser_t *p, batchstats_t *bs)
+{
+	mvd_info_t *s;
+	char tag[32];
+	int i, x, all, id = 0;
+
+	fprintf (f, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+	fprintf (f, "<mvdstats>\n");
+	fprintf (f, "<demoinfos>\n");
+	fprintf (f, "\t\t<map>");
+	BatchStats_XMLString (f, p->mapname);
+	fprintf (f, "</map>\n");
+	fprintf (f, "\t\t<hostname>");
+	BatchStats_XMLString (f, p->hostname);
+	fprintf (f, "</hostname>\n");
+	fprintf (f, "\t\t<duration>%.3f</duration>\n", p->duration);
+	fprintf (f, "</demoinfos>\n");
+
+	for (i = 0; i < MAX_CLIENTS; i++)
+	{
+		if (!p->players[i].active || p->players[i].spectator)
+			continue;
+
+		s = &bs->players[i].info;
+
+		fprintf (f, "\t<player id=\"%i\">\n", id++);
+		fprintf (f, "\t\t<nick>");
+		BatchStats_XMLName (f, p->players[i].name);
+		fprintf (f, "</nick>\n");
+		fprintf (f, "\t\t<team>");
+		BatchStats_XMLName (f, p->players[i].team);
+		fprintf (f, "</team>\n");
+		fprintf (f, "\t\t<frags>%i</frags>\n", p->players[i].frags);
+
+		fprintf (f, "\t\t<kills>\n");
+		for (all = 0, x = AXE_INFO; x <= LG_INFO; x++)
+		{
+			fprintf (f, "\t\t\t<%s>%i</%s>\n", mvd_wp_info[x].name, s->killstats.normal[x].kills, mvd_wp_info[x].name);
+			all += s->killstats.normal[x].kills;
+		}
+		fprintf (f, "\t\t\t<spawn>%i</spawn>\n", s->spawntelefrags);
+		fprintf (f, "\t\t\t<all>%i</all>\n", all + s->spawntelefrags);
+		fprintf (f, "\t\t</kills>\n");
+
+		fprintf (f, "\t\t<teamkills>\n");
+		for (all = 0, x = AXE_INFO; x <= LG_INFO; x++)
+		{
+			fprintf (f, "\t\t\t<%s>%i</%s>\n", mvd_wp_info[x].name, s->killstats.normal[x].teamkills, mvd_wp_info[x].name);
+			all += s->killstats.normal[x].teamkills;
+		}
+		fprintf (f, "\t\t\t<spawn>%i</spawn>\n", s->teamspawntelefrags);
+		fprintf (f, "\t\t\t<all>%i</all>\n", all + s->teamspawntelefrags);
+		fprintf (f, "\t\t</teamkills>\n");
+
+		fprintf (f, "\t\t<deaths>%i</deaths>\n", s->das.deathcount);
+		fprintf (f, "\t\t<alivetime>%.3f</alivetime>\n", BatchStats_AliveTime (&bs->players[i]));
+
+		fprintf (f, "\t\t<took>\n");
+		for (x = SSG_INFO; x < mvd_info_types; x++)
+			fprintf (f, "\t\t\t<%s>%i</%s>\n", mvd_wp_info[x].name, s->itemstats[x].count, mvd_wp_info[x].name);
+		fprintf (f, "\t\t</took>\n");
+
+		fprintf (f, "\t\t<lost>\n");
+		for (x = SSG_INFO; x < mvd_info_types; x++)
+			fprintf (f, "\t\t\t<%s>%i</%s>\n", mvd_wp_info[x].name, s->itemstats[x].lost, mvd_wp_info[x].name);
+		fprintf (f, "\t\t</lost>\n");
+
+		BatchStats_XMLRuns (f, "runs", s->runs, s->run);
+		for (x = RING_INFO; x <= PENT_INFO; x++)
+		{
+			snprintf (tag, sizeof(tag), "%s_runs", mvd_wp_info[x].name);
+			BatchStats_XMLRuns (f, tag, s->itemstats[x].runs, s->itemstats[x].run);
+		}
+
+		fprintf (f, "\t</player>\n\n");
+	}
+
+	fprintf (f, "</mvdstats>\n");
+}
+
+//=============================================================================
+//								WORKERS
+//=============================================================================
+
+//
+// The workers can't use COM_FileExtension, it returns a static buffer.
+// Returns the dot of the extension of the file name, or NULL.
+//
+static char *BatchStats_Extension (const char *path)
+{
+	char *dot = strrchr (path, '.');
+
+	if (!dot || strchr (dot, '/') || strchr (dot, '\\'))
+		return NULL;
+
+	return dot;
+}
+
+static qbool BatchStats_HasExtension (const char *path, const char *ext)
+{
+	char *dot = BatchStats_Extension (path);
+
+	return dot && !strcasecmp (dot + 1, ext);
+}
+
+//
+// Reads the whole demo, gzipped or not.
+//
+static byte *BatchStats_Load (const char *path, int *len)
+{
+	byte *buf = NULL;
+	int size = 0, alloc = 0, r;
+#ifdef WITH_ZLIB
+	gzFile f = gzopen (path, "rb");
+
+	if (!f)
+		return NULL;
+
+	do
+	{
+		if (size == alloc)
+		{
+			alloc = alloc ? alloc * 2 : 4 * 1024 * 1024;
+			buf = (byte *) Q_realloc (buf, alloc);
+		}
+
+		r = gzread (f, buf + size, alloc - size);
+		size += max (r, 0);
+	} while (r > 0);
+
+	gzclose (f);
+#else
+	FILE *f = fopen (path, "rb");
+
+	if (!f)
+		return NULL;
+
+	if (BatchStats_HasExtension (path, "gz"))
+	{
+		fclose (f);
+		return NULL;
+	}
+
+	fseek (f, 0, SEEK_END);
+	alloc = ftell (f);
+	fseek (f, 0, SEEK_SET);
+
+	buf = (byte *) Q_malloc (alloc + 1);
+	size = r = fread (buf, 1, alloc, f);
+	fclose (f);
+#endif
+
+	if (r < 0)
+	{
+		Q_free (buf);
+		return NULL;
+	}
+
+	*len = size;
+	return buf;
+}
+
+//
+// Returns false if the path doesn't fit.
+//
+static qbool BatchStats_OutputPath (batchstats_job_t *job, batchstats_demo_t *d, char *path, int pathsize)
+{
+	char name[MAX_OSPATH], *dot;
+
+	strlcpy (name, d->path, sizeof(name));
+	if (BatchStats_HasExtension (name, "gz"))
+		*BatchStats_Extension (name) = 0;
+	if ((dot = BatchStats_Extension (name)))
+		*dot = 0;
+
+	if (!job->outdir[0])
+		strlcpy (path, name, pathsize);
+	else if (snprintf (path, pathsize, "%s/%s", job->outdir, COM_SkipPath (name)) >= pathsize)
+		return false;
+
+	return strlcat (path, job->format == BATCHSTATS_XML ? ".xml" : ".json", pathsize) < pathsize;
+}
+
+static void BatchStats_Demo (batchstats_job_t *job, batchstats_demo_t *d)
+{
+	char outpath[MAX_OSPATH];
+	batchstats_t *bs;
+	demoparser_t *p;
+	vfsfile_t *vf;
+	byte *buf;
+	qbool ok;
+	FILE *f;
+
+	// Set while listing the demos.
+	if (d->error[0])
+		return;
+
+	if (!(buf = BatchStats_Load (d->path, &d->size)))
+	{
+		strlcpy (d->error, "couldn't read the demo", sizeof(d->error));
+		return;
+	}
+
+	vf = FSMMAP_OpenVFS (buf, d->size);
+	bs = (batchstats_t *) Q_malloc (sizeof(batchstats_t));
+	bs->lastgather = -1;
+
+	p = DemoParse_New (vf, true);
+	p->userdata = bs;
+	p->OnBlock = BatchStats_OnBlock;
+
+	ok = DemoParse_Run (p);
+	BatchStats_Gather (p, bs);		// The last frame.
+	d->duration = p->duration;
+
+	if (!ok)
+	{
+		strlcpy (d->error, p->error, sizeof(d->error));
+	}
+	else if (!BatchStats_OutputPath (job, d, outpath, sizeof(outpath)))
+	{
+		strlcpy (d->error, "the output path is too long", sizeof(d->error));
+	}
+	else
+	{
+		if (!(f = fopen (outpath, "wb")))
+		{
+			snprintf (d->error, sizeof(d->error), "couldn't write %s", outpath);
+		}
+		else
+		{
+			if (job->format == BATCHSTATS_XML)
+				BatchStats_WriteXML (f, p, bs);
+			else
+				BatchStats_WriteJSON (f, p, bs);
+
+			d->ok = !ferror (f);
+			fclose (f);
+
+			if (!d->ok)
+				snprintf (d->error, sizeof(d->error), "couldn't write %s", outpath);
+		}
+	}
+
+	DemoParse_Free (p);
+	Q_free (bs);
+	VFS_CLOSE (vf);
+}
+
+static int BatchStats_NextDemo (batchstats_job_t *job)
+{
+	int i;
+
+	do
+	{
+		i = Sys_AtomicLoad (&job->next);
+		if (i >= job->numdemos)
+			return -1;
+	} while (!Sys_AtomicCAS (&job->next, i, i + 1));
+
+	return i;
+}
+
+static DWORD WINAPI BatchStats_Thread (void *param)
+{
+	batchstats_job_t *job = (batchstats_job_t *) param;
+	int i;
+
+	while ((i = BatchStats_NextDemo (job)) >= 0)
+		BatchStats_Demo (job, &job->demos[i]);
+
+	Sys_SemPost (&job->done);
+	return 0;
+}
+
+//=============================================================================
+//								RUNNING
+//=============================================================================
+
+static int BatchStats_AddDemo (char *name, int size, void *parm)
+{
+	batchstats_job_t *job = (batchstats_job_t *) parm;
+
+	if (name[strlen (name) - 1] == '/' || !DemoParse_IsMVDName (name))
+		return true;
+
+	if (job->numdemos == job->maxdemos)
+	{
+		job->maxdemos = job->maxdemos ? job->maxdemos * 2 : 256;
+		job->demos = (batchstats_demo_t *) Q_realloc (job->demos, job->maxdemos * sizeof(batchstats_demo_t));
+	}
+
+	memset (&job->demos[job->numdemos], 0, sizeof(batchstats_demo_t));
+	strlcpy (job->demos[job->numdemos].path, name, sizeof(job->demos[0].path));
+	job->numdemos++;
+
+	return true;
+}
+
+//
+// Parses all the MVDs in dir, returns the number of demos that failed.
+//
+static int BatchStats_Run (const char *dir, batchstats_format_t format, int threads, const char *outdir, qbool headless)
+{
+	batchstats_job_t job;
+	double start, elapsed, demotime = 0, megs = 0;
+	char path[MAX_OSPATH];
+	int i, started, failed = 0;
+
+	memset (&job, 0, sizeof(job));
+	job.format = format;
+	strlcpy (job.outdir, outdir ? outdir : "", sizeof(job.outdir));
+
+	strlcpy (path, dir, sizeof(path));
+	Sys_EnumerateFiles (path, "*", BatchStats_AddDemo, &job);
+
+	if (!job.numdemos)
+	{
+		BatchStats_Printf (headless, "No MVDs found in %s\n", dir);
+		return 0;
+	}
+
+	// Sys_EnumerateFiles gives the names relative to dir.
+	for (i = 0; i < job.numdemos; i++)
+	{
+		strlcpy (path, job.demos[i].path, sizeof(path));
+		if (snprintf (job.demos[i].path, sizeof(job.demos[i].path), "%s/%s", dir, path) >= (int) sizeof(job.demos[i].path))
+			strlcpy (job.demos[i].error, "the path is too long", sizeof(job.demos[i].error));
+	}
+
+	if (threads <= 0)
+		threads = SDL_GetCPUCount ();
+	threads = bound (1, min (threads, job.numdemos), BATCHSTATS_MAXTHREADS);
+
+#ifndef SYS_ATOMICS
+	threads = 1;	// The workers can't share the demo list.
+#endif
+
+	BatchStats_Printf (headless, "Parsing %d demos with %d thread%s...\n", job.numdemos, threads, threads > 1 ? "s" : "");
+
+	start = Sys_DoubleTime ();
+
+	if (threads > 1 && !Sys_SemInit (&job.done, 0, threads))
+	{
+		for (started = 0; started < threads && Sys_CreateThread (BatchStats_Thread, &job); started++)
+			;
+
+		// If some threads couldn't be started, their share is done here.
+		if (started < threads)
+		{
+			BatchStats_Thread (&job);
+			started++;
+		}
+
+		while (started--)
+			Sys_SemWait (&job.done);
+
+		Sys_SemDestroy (&job.done);
+	}
+	else
+	{
+		for (i = 0; i < job.numdemos; i++)
+			BatchStats_Demo (&job, &job.demos[i]);
+	}
+
+	elapsed = max (Sys_DoubleTime () - start, 0.001);
+
+	for (i = 0; i < job.numdemos; i++)
+	{
+		megs += job.demos[i].size / (1024.0 * 1024.0);
+		demotime += job.demos[i].duration;
+
+		if (!job.demos[i].ok)
+		{
+			BatchStats_Printf (headless, "%s: %s\n", COM_SkipPath (job.demos[i].path), job.demos[i].error);
+			failed++;
+		}
+	}
+
+	BatchStats_Printf (headless, "%d demos (%d failed) in %.2f seconds\n", job.numdemos, failed, elapsed);
+	BatchStats_Printf (headless, "%.1f demos/s, %.1f MB/s, %.0fx realtime\n",
+		job.numdemos / elapsed, megs / elapsed, demotime / elapsed);
+
+	Q_free (job.demos);
+
+	return failed;
+}
+
+static batchstats_format_t BatchStats_Format (const char *s)
+{
+	return !strcasecmp (s, "xml") ? BATCHSTATS_XML : BATCHSTATS_JSON;
+}
+
+static void MVD_BatchStats_f (void)
+{
+	if (Cmd_Argc () < 2)
+	{
+		Com_Printf ("Usage: %s <directory> [json|xml] [threads] [output directory]\n", Cmd_Argv (0));
+		Com_Printf ("Writes the stats of every MVD in the directory, 0 threads = one per CPU\n");
+		return;
+	}
+
+	BatchStats_Run (Cmd_Argv (1), BatchStats_Format (Cmd_Argv (2)), Q_atoi (Cmd_Argv (3)),
+		Cmd_Argc () > 4 ? Cmd_Argv (4) : NULL, false);
+}
+
+//
+// -mvdstats <dir> on the command line. Returns the exit code, or -1 to start normally.
+//
+int MVD_BatchStats_CommandLine (void)
+{
+	int dir, format, threads, out;
+
+	if (!(dir = COM_CheckParm ("-mvdstats")) || dir + 1 >= COM_Argc ())
+		return -1;
+
+	format = COM_CheckParm ("-mvdstats_format");
+	threads = COM_CheckParm ("-mvdstats_threads");
+	out = COM_CheckParm ("-mvdstats_out");
+
+	return BatchStats_Run (COM_Argv (dir + 1),
+		format && format + 1 < COM_Argc () ? BatchStats_Format (COM_Argv (format + 1)) : BATCHSTATS_JSON,
+		threads && threads + 1 < COM_Argc () ? Q_atoi (COM_Argv (threads + 1)) : 0,
+		out && out + 1 < COM_Argc () ? COM_Argv (out + 1) : NULL, true) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+void MVD_BatchStats_Init (void)
+{
+	Cmd_AddCommand ("mvd_batchstats", MVD_BatchStats_f);
+}
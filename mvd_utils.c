@@ -694,15 +694,15 @@ void MVD_Status_Announcer(int i, int z){
 	}
 }
 
-void MVD_Status_WP(int i, int *taken){
+static void MVD_Status_WP(mvd_info_t *info, int items, int deathmatch, int *taken){
 	int j,k;
 	for (k = j = SSG_INFO; j <= LG_INFO; j++, k = k*2){
-		if (!mvd_new_info[i].mvdinfo.itemstats[j].has && mvd_new_info[i].p_info->stats[STAT_ITEMS] & k){
-			if (j >= GL_INFO && cl.deathmatch == 1) {
+		if (!info->itemstats[j].has && items & k){
+			if (j >= GL_INFO && deathmatch == 1) {
 				*taken |= (1 << j);
 			}
-			mvd_new_info[i].mvdinfo.itemstats[j].has = 1;
-			mvd_new_info[i].mvdinfo.itemstats[j].count++;
+			info->itemstats[j].has = 1;
+			info->itemstats[j].count++;
 		}
 	}
 
@@ -722,19 +722,41 @@ void MVD_Stats_Cleanup (void){
 	memset(&mvd_cg_info, 0, sizeof(mvd_cg_info_s));
 }
 
-void MVD_Set_Armor_Stats(int z,int i){
+// Demo rewind keyframes hold the stats. Returns their size, buf may be NULL to only get that.
+int MVD_Stats_Keyframe (byte *buf, qbool restore)
+{
+	if (buf && restore) {
+		memcpy(mvd_new_info, buf, sizeof(mvd_new_info));
+		memcpy(&mvd_cg_info, buf + sizeof(mvd_new_info), sizeof(mvd_cg_info));
+
+		// item clocks and powerup cams start over from the keyframe
+		while (mvd_clocklist) {
+			MVD_ClockList_Remove(mvd_clocklist);
+		}
+		quad_is_active = pent_is_active = 0;
+		powerup_cam_active = 0;
+	}
+	else if (buf) {
+		memcpy(buf, mvd_new_info, sizeof(mvd_new_info));
+		memcpy(buf + sizeof(mvd_new_info), &mvd_cg_info, sizeof(mvd_cg_info));
+	}
+
+	return sizeof(mvd_new_info) + sizeof(mvd_cg_info);
+}
+
+static void MVD_Set_Armor_Stats(mvd_info_t *info, int z){
 	switch(z){
 		case GA_INFO:
-			mvd_new_info[i].mvdinfo.itemstats[YA_INFO].has=0;
-			mvd_new_info[i].mvdinfo.itemstats[RA_INFO].has=0;
+			info->itemstats[YA_INFO].has=0;
+			info->itemstats[RA_INFO].has=0;
 			break;
 		case YA_INFO:
-			mvd_new_info[i].mvdinfo.itemstats[GA_INFO].has=0;
-			mvd_new_info[i].mvdinfo.itemstats[RA_INFO].has=0;
+			info->itemstats[GA_INFO].has=0;
+			info->itemstats[RA_INFO].has=0;
 			break;
 		case RA_INFO:
-			mvd_new_info[i].mvdinfo.itemstats[GA_INFO].has=0;
-			mvd_new_info[i].mvdinfo.itemstats[YA_INFO].has=0;
+			info->itemstats[GA_INFO].has=0;
+			info->itemstats[YA_INFO].has=0;
 			break;
 
 	}
@@ -844,163 +866,183 @@ static qbool MVD_Weapon_From_Backpack(int weapon, int taken, int *ammotaken)
 	return false;
 }
 
-static void MVD_Stats_Gather_AlivePlayer(int player_index)
+static void MVD_Stats_Gather_AlivePlayer(mvd_info_t *info, const int *stats, int frags, int weaponframe, int deathmatch, double time, mvd_gather_event_t *ev)
 {
 	int x; // item index
 	int z; // item index
-	int i = player_index;
 	int killdiff;
-	int taken = 0;
-	int ammotaken[AMMO_TYPES] = {0, 0, 0, 0};
-
-	for (x=GA_INFO;x<=RA_INFO && mvd_cg_info.deathmatch!=4;x++){
-		if(mvd_new_info[i].p_info->stats[STAT_ITEMS] & mvd_wp_info[x].it) {
-			if (!mvd_new_info[i].mvdinfo.itemstats[x].has){
-				taken |= (1 << x);
-				MVD_Set_Armor_Stats(x,i);
-				mvd_new_info[i].mvdinfo.itemstats[x].count++;
-				mvd_new_info[i].mvdinfo.itemstats[x].lost=mvd_new_info[i].p_info->stats[STAT_ARMOR];
-				mvd_new_info[i].mvdinfo.itemstats[x].has=1;
+
+	for (x=GA_INFO;x<=RA_INFO && deathmatch!=4;x++){
+		if(stats[STAT_ITEMS] & mvd_wp_info[x].it) {
+			if (!info->itemstats[x].has){
+				ev->taken |= (1 << x);
+				MVD_Set_Armor_Stats(info,x);
+				info->itemstats[x].count++;
+				info->itemstats[x].lost=stats[STAT_ARMOR];
+				info->itemstats[x].has=1;
 			}
-			if (mvd_new_info[i].mvdinfo.itemstats[x].lost < mvd_new_info[i].p_info->stats[STAT_ARMOR]) {
-				taken |= (1 << x);
-				mvd_new_info[i].mvdinfo.itemstats[x].count++;
+			if (info->itemstats[x].lost < stats[STAT_ARMOR]) {
+				ev->taken |= (1 << x);
+				info->itemstats[x].count++;
 			}
-			mvd_new_info[i].mvdinfo.itemstats[x].lost=mvd_new_info[i].p_info->stats[STAT_ARMOR];
+			info->itemstats[x].lost=stats[STAT_ARMOR];
 		}
 	}
 
-	for (x=RING_INFO;x<=PENT_INFO && mvd_cg_info.deathmatch!=4;x++){
-		if(!mvd_new_info[i].mvdinfo.itemstats[x].has && mvd_new_info[i].p_info->stats[STAT_ITEMS] & mvd_wp_info[x].it){
-			taken |= (1 << x);
-			mvd_new_info[i].mvdinfo.itemstats[x].has = 1;
-			if (x==PENT_INFO && (powerup_cam_active == 3 || powerup_cam_active == 2)){
-				pent_mentioned=0;
-				pent_is_active=1;
-				powerup_cam_active-=2;
-			}
-			if (x==QUAD_INFO && (powerup_cam_active == 3 || powerup_cam_active == 1)){
-				quad_mentioned=0;
-				quad_is_active=1;
-				powerup_cam_active-=1;
-			}
-			mvd_new_info[i].mvdinfo.itemstats[x].starttime = cls.demotime;
-			mvd_new_info[i].mvdinfo.itemstats[x].count++;
+	for (x=RING_INFO;x<=PENT_INFO && deathmatch!=4;x++){
+		if(!info->itemstats[x].has && stats[STAT_ITEMS] & mvd_wp_info[x].it){
+			ev->taken |= (1 << x);
+			info->itemstats[x].has = 1;
+			info->itemstats[x].starttime = time;
+			info->itemstats[x].count++;
 		}
-		if (mvd_new_info[i].mvdinfo.itemstats[x].has && !(mvd_new_info[i].p_info->stats[STAT_ITEMS] & mvd_wp_info[x].it)){
-			mvd_new_info[i].mvdinfo.itemstats[x].has = 0;
-			if (x==QUAD_INFO && quad_is_active){
-				quad_is_active=0;
-			}
-			if (x==PENT_INFO && pent_is_active){
-				pent_is_active=0;
-			}
-			mvd_new_info[i].mvdinfo.itemstats[x].runs[mvd_new_info[i].mvdinfo.itemstats[x].run].starttime = mvd_new_info[i].mvdinfo.itemstats[x].starttime;
-			mvd_new_info[i].mvdinfo.itemstats[x].runs[mvd_new_info[i].mvdinfo.itemstats[x].run].time = cls.demotime - mvd_new_info[i].mvdinfo.itemstats[x].starttime;
-			mvd_new_info[i].mvdinfo.itemstats[x].run++;
+		if (info->itemstats[x].has && !(stats[STAT_ITEMS] & mvd_wp_info[x].it)){
+			ev->ended |= (1 << x);
+			info->itemstats[x].has = 0;
+			info->itemstats[x].runs[info->itemstats[x].run].starttime = info->itemstats[x].starttime;
+			info->itemstats[x].runs[info->itemstats[x].run].time = time - info->itemstats[x].starttime;
+			info->itemstats[x].run++;
 		}
 	}
 
-	if (!mvd_new_info[i].mvdinfo.itemstats[MH_INFO].has && mvd_new_info[i].p_info->stats[STAT_ITEMS] & IT_SUPERHEALTH){
-		mvd_new_info[i].mvdinfo.itemstats[MH_INFO].mention = 1;
-		mvd_new_info[i].mvdinfo.itemstats[MH_INFO].has = 1;
-		mvd_new_info[i].mvdinfo.itemstats[MH_INFO].count++;
+	if (!info->itemstats[MH_INFO].has && stats[STAT_ITEMS] & IT_SUPERHEALTH){
+		info->itemstats[MH_INFO].mention = 1;
+		info->itemstats[MH_INFO].has = 1;
+		info->itemstats[MH_INFO].count++;
 	}
-	if (mvd_new_info[i].mvdinfo.itemstats[MH_INFO].has && !(mvd_new_info[i].p_info->stats[STAT_ITEMS] & IT_SUPERHEALTH)) {
-		mvd_new_info[i].mvdinfo.itemstats[MH_INFO].has = 0;
-		MVD_ClockStart(MH_INFO);
+	if (info->itemstats[MH_INFO].has && !(stats[STAT_ITEMS] & IT_SUPERHEALTH)) {
+		ev->ended |= (1 << MH_INFO);
+		info->itemstats[MH_INFO].has = 0;
 	}
 
 	for (z=RING_INFO;z<=PENT_INFO;z++){
-		if (mvd_new_info[i].mvdinfo.itemstats[z].has == 1){
-			mvd_new_info[i].mvdinfo.itemstats[z].runs[mvd_new_info[i].mvdinfo.itemstats[z].run].starttime = mvd_new_info[i].mvdinfo.itemstats[z].starttime;
-			mvd_new_info[i].mvdinfo.itemstats[z].runs[mvd_new_info[i].mvdinfo.itemstats[z].run].time = cls.demotime - mvd_new_info[i].mvdinfo.itemstats[z].starttime;
+		if (info->itemstats[z].has == 1){
+			info->itemstats[z].runs[info->itemstats[z].run].starttime = info->itemstats[z].starttime;
+			info->itemstats[z].runs[info->itemstats[z].run].time = time - info->itemstats[z].starttime;
 		}
 	}
 
-	if (mvd_new_info[i].mvdinfo.lastfrags != mvd_new_info[i].p_info->frags ){
-		if (mvd_new_info[i].mvdinfo.lastfrags < mvd_new_info[i].p_info->frags){
-			killdiff = mvd_new_info[i].p_info->frags - mvd_new_info[i].mvdinfo.lastfrags;
+	if (info->lastfrags != frags ){
+		if (info->lastfrags < frags){
+			killdiff = frags - info->lastfrags;
 			for (z=0;z<8;z++){
-				if (z == MVD_Weapon_LWF(mvd_new_info[i].mvdinfo.lfw))
-						mvd_new_info[i].mvdinfo.killstats.normal[z].kills+=killdiff;
+				if (z == MVD_Weapon_LWF(info->lfw))
+						info->killstats.normal[z].kills+=killdiff;
 			}
-			if (mvd_new_info[i].mvdinfo.lfw == -1)
-				mvd_new_info[i].mvdinfo.spawntelefrags+=killdiff;
+			if (info->lfw == -1)
+				info->spawntelefrags+=killdiff;
 			for(z=8;z<11;z++){
-				if(mvd_new_info[i].mvdinfo.itemstats[z].has)
-					mvd_new_info[i].mvdinfo.itemstats[z].runs[mvd_new_info[i].mvdinfo.itemstats[z].run].frags+=killdiff;
+				if(info->itemstats[z].has)
+					info->itemstats[z].runs[info->itemstats[z].run].frags+=killdiff;
 			}
-			mvd_new_info[i].mvdinfo.runs[mvd_new_info[i].mvdinfo.run].frags++;
-			}else if (mvd_new_info[i].mvdinfo.lastfrags > mvd_new_info[i].p_info->frags){
-			killdiff = mvd_new_info[i].mvdinfo.lastfrags - mvd_new_info[i].p_info->frags ;
+			info->runs[info->run].frags++;
+			}else if (info->lastfrags > frags){
+			killdiff = info->lastfrags - frags ;
 			for (z=AXE_INFO;z<=LG_INFO;z++){
-				if (z == MVD_Weapon_LWF(mvd_new_info[i].mvdinfo.lfw))
-					mvd_new_info[i].mvdinfo.killstats.normal[z].teamkills+=killdiff;
+				if (z == MVD_Weapon_LWF(info->lfw))
+					info->killstats.normal[z].teamkills+=killdiff;
 			}
-			if (mvd_new_info[i].mvdinfo.lfw == -1){
-				mvd_new_info[i].mvdinfo.teamspawntelefrags+=killdiff;
+			if (info->lfw == -1){
+				info->teamspawntelefrags+=killdiff;
 
 			}
 			for(z=8;z<11;z++){
-				if(mvd_new_info[i].mvdinfo.itemstats[z].has)
-					mvd_new_info[i].mvdinfo.itemstats[z].runs[mvd_new_info[i].mvdinfo.itemstats[z].run].teamfrags+=killdiff;
+				if(info->itemstats[z].has)
+					info->itemstats[z].runs[info->itemstats[z].run].teamfrags+=killdiff;
 			}
-			mvd_new_info[i].mvdinfo.runs[mvd_new_info[i].mvdinfo.run].teamfrags++;
+			info->runs[info->run].teamfrags++;
 			}
 
 
-		mvd_new_info[i].mvdinfo.lastfrags = mvd_new_info[i].p_info->frags ;
+		info->lastfrags = frags ;
 	}
 
-	mvd_new_info[i].mvdinfo.runs[mvd_new_info[i].mvdinfo.run].time=cls.demotime - mvd_new_info[i].mvdinfo.das.alivetimestart;
+	info->runs[info->run].time=time - info->das.alivetimestart;
 
-	if (mvd_new_info[i].mvdinfo.lfw == -1){
-		if (mvd_new_info[i].mvdinfo.lastfrags > mvd_new_info[i].p_info->frags ){
-			mvd_new_info[i].mvdinfo.teamspawntelefrags += mvd_new_info[i].p_info->frags - mvd_new_info[i].mvdinfo.lastfrags ;
-		}else if (mvd_new_info[i].mvdinfo.lastfrags < mvd_new_info[i].p_info->frags ){
-			mvd_new_info[i].mvdinfo.spawntelefrags += mvd_new_info[i].p_info->frags -mvd_new_info[i].mvdinfo.lastfrags  ;
+	if (info->lfw == -1){
+		if (info->lastfrags > frags ){
+			info->teamspawntelefrags += frags - info->lastfrags ;
+		}else if (info->lastfrags < frags ){
+			info->spawntelefrags += frags -info->lastfrags  ;
 		}
-		mvd_new_info[i].mvdinfo.lastfrags = mvd_new_info[i].p_info->frags;
+		info->lastfrags = frags;
 	}
 
-	if (mvd_new_info[i].p_state->weaponframe > 0)
-			mvd_new_info[i].mvdinfo.lfw=mvd_new_info[i].p_info->stats[STAT_ACTIVEWEAPON];
-	if (mvd_cg_info.deathmatch!=4){
-		MVD_Status_WP(i, &taken);
-		for (z=SSG_INFO;z<=RA_INFO;z++) {
-			MVD_Status_Announcer(i,z);
-		}
+	if (weaponframe > 0)
+			info->lfw=stats[STAT_ACTIVEWEAPON];
+	if (deathmatch!=4){
+		MVD_Status_WP(info, stats[STAT_ITEMS], deathmatch, &ev->taken);
 	}
 
 	for (x = 0; x < AMMO_TYPES; x++) {
-		int ammo_new = mvd_new_info[i].p_info->stats[STAT_SHELLS + x];
-		int ammo_old = mvd_new_info[i].mvdinfo.ammostats[x];
-		if (mvd_new_info[i].mvdinfo.initialized && ammo_new > ammo_old) {
-			int diff = ammo_new - ammo_old;
-			ammotaken[x] = diff;
+		int ammo_new = stats[STAT_SHELLS + x];
+		int ammo_old = info->ammostats[x];
+		if (info->initialized && ammo_new > ammo_old) {
+			ev->ammotaken[x] = ammo_new - ammo_old;
 		}
-		mvd_new_info[i].mvdinfo.ammostats[x] =
-			mvd_new_info[i].p_info->stats[STAT_SHELLS + x];
+		info->ammostats[x] = ammo_new;
+	}
+}
+
+//
+// The stats rules for one player, from its stats, frags and weaponframe at the given time.
+// Only changes info, so the batch stats can run it on the headless parser's players
+// in any thread. What happened in the frame is put in ev for the caller to act on.
+//
+void MVD_Stats_GatherPlayer(mvd_info_t *info, const int *stats, int frags, int weaponframe, int deathmatch, double time, mvd_gather_event_t *ev)
+{
+	int x;
+
+	memset(ev, 0, sizeof(*ev));
+
+	if (info->firstrun == 0){
+		info->das.alivetimestart = time;
+		info->firstrun = 1;
+		info->lfw = -1;
+		ev->firstrun = true;
+	}
+	// death alive stats
+	if (stats[STAT_HEALTH]>0 && info->das.isdead == 1){
+		info->das.isdead = 0;
+		info->das.alivetimestart = time;
+		info->lfw = -1;
 	}
 
-	for (x = 0; x < mvd_info_types; x++) {
-		if (taken & (1 << x)) {
-			qbool weapon_from_backpack =
-				IS_WEAPON(x) && MVD_Weapon_From_Backpack(x, taken, ammotaken);
-			// don't start clock if item was from backpack
-			qbool add_clock = !weapon_from_backpack;
-			Com_DPrintf("player %i took %i, weapon from backpack: %s\n",
-				i, x, weapon_from_backpack ? "yes" : "no");
+	info->das.alivetime = time - info->das.alivetimestart;
+	if (stats[STAT_HEALTH]<=0 && info->das.isdead != 1){
+		info->das.isdead = 1;
+		info->das.deathcount++;
+		info->run++;
+		ev->died = true;
+
+		for(x=0;x<13;x++){ // XXX: x<13? for sure? maybe x<mvd_info_types?
+
+			if (x == MVD_Weapon_LWF(info->lfw)){
+					info->itemstats[x].mention=-1;
+					info->itemstats[x].lost++;
+			}
 
-			MVD_Took(i, x, add_clock);
+			if (x == QUAD_INFO && info->itemstats[QUAD_INFO].has){
+				ev->ended |= (1 << QUAD_INFO);
+				info->itemstats[x].run++;
+				info->itemstats[x].lost++;
+			}
+			info->itemstats[x].has=0;
 		}
+		info->lfw = -1;
+	}
+
+	if(!info->das.isdead) {
+		MVD_Stats_Gather_AlivePlayer(info, stats, frags, weaponframe, deathmatch, time, ev);
 	}
+
+	info->initialized = true;
 }
 
 int MVD_Stats_Gather(void){
-	int death_stats = 0;
-	int x,i;
+	mvd_gather_event_t ev;
+	mvd_info_t *info;
+	int x,z,i;
 
 	if(cl.countdown == true){
 		return 0;
@@ -1009,56 +1051,55 @@ int MVD_Stats_Gather(void){
 		return 0;
 
 	for ( i=0; i<mvd_cg_info.pcount ; i++ ){
-		if (quad_time == pent_time && quad_time == 0 && !mvd_new_info[i].mvdinfo.firstrun){
+		info = &mvd_new_info[i].mvdinfo;
+
+		if (quad_time == pent_time && quad_time == 0 && !info->firstrun){
 			powerup_cam_active = 3;
 			quad_time=pent_time=cls.demotime;
 		}
 
-		if (mvd_new_info[i].mvdinfo.firstrun == 0){
-			mvd_new_info[i].mvdinfo.das.alivetimestart = cls.demotime;
+		MVD_Stats_GatherPlayer(info, mvd_new_info[i].p_info->stats, mvd_new_info[i].p_info->frags,
+			mvd_new_info[i].p_state->weaponframe, mvd_cg_info.deathmatch, cls.demotime, &ev);
+
+		if (ev.firstrun)
 			gamestart_time = cls.demotime;
-			mvd_new_info[i].mvdinfo.firstrun = 1;
-			mvd_new_info[i].mvdinfo.lfw = -1;
-		}
-		// death alive stats
-		if (mvd_new_info[i].p_info->stats[STAT_HEALTH]>0 && mvd_new_info[i].mvdinfo.das.isdead == 1){
-			mvd_new_info[i].mvdinfo.das.isdead = 0;
-			mvd_new_info[i].mvdinfo.das.alivetimestart = cls.demotime;
-			mvd_new_info[i].mvdinfo.lfw = -1;
-		}
 
-		mvd_new_info[i].mvdinfo.das.alivetime = cls.demotime - mvd_new_info[i].mvdinfo.das.alivetimestart;
-		if (mvd_new_info[i].p_info->stats[STAT_HEALTH]<=0 && mvd_new_info[i].mvdinfo.das.isdead != 1){
-			mvd_new_info[i].mvdinfo.das.isdead = 1;
-			mvd_new_info[i].mvdinfo.das.deathcount++;
-			death_stats=1;
+		if ((ev.taken & (1 << PENT_INFO)) && (powerup_cam_active == 3 || powerup_cam_active == 2)){
+			pent_mentioned=0;
+			pent_is_active=1;
+			powerup_cam_active-=2;
 		}
-
-		if (death_stats){
-			death_stats=0;
-			mvd_new_info[i].mvdinfo.run++;
-
-
-			for(x=0;x<13;x++){ // XXX: x<13? for sure? maybe x<mvd_info_types?
-
-				if (x == MVD_Weapon_LWF(mvd_new_info[i].mvdinfo.lfw)){
-						mvd_new_info[i].mvdinfo.itemstats[x].mention=-1;
-						mvd_new_info[i].mvdinfo.itemstats[x].lost++;
+		if ((ev.taken & (1 << QUAD_INFO)) && (powerup_cam_active == 3 || powerup_cam_active == 1)){
+			quad_mentioned=0;
+			quad_is_active=1;
+			powerup_cam_active-=1;
+		}
+		if (ev.ended & (1 << QUAD_INFO))
+			quad_is_active=0;
+		if (ev.ended & (1 << PENT_INFO))
+			pent_is_active=0;
+		if (ev.ended & (1 << MH_INFO))
+			MVD_ClockStart(MH_INFO);
+
+		if(!info->das.isdead) {
+			if (mvd_cg_info.deathmatch!=4){
+				for (z=SSG_INFO;z<=RA_INFO;z++) {
+					MVD_Status_Announcer(i,z);
 				}
+			}
+
+			for (x = 0; x < mvd_info_types; x++) {
+				if (ev.taken & (1 << x)) {
+					qbool weapon_from_backpack =
+						IS_WEAPON(x) && MVD_Weapon_From_Backpack(x, ev.taken, ev.ammotaken);
+					// don't start clock if item was from backpack
+					qbool add_clock = !weapon_from_backpack;
+					Com_DPrintf("player %i took %i, weapon from backpack: %s\n",
+						i, x, weapon_from_backpack ? "yes" : "no");
 
-				if (x == QUAD_INFO && mvd_new_info[i].mvdinfo.itemstats[QUAD_INFO].has){
-					if (mvd_new_info[i].mvdinfo.itemstats[x].starttime - cls.demotime < 30 )
-						quad_is_active = 0;
-						mvd_new_info[i].mvdinfo.itemstats[x].run++;
-						mvd_new_info[i].mvdinfo.itemstats[x].lost++;
+					MVD_Took(i, x, add_clock);
 				}
-				mvd_new_info[i].mvdinfo.itemstats[x].has=0;
 			}
-			mvd_new_info[i].mvdinfo.lfw = -1;
-		}
-
-		if(!mvd_new_info[i].mvdinfo.das.isdead) {
-			MVD_Stats_Gather_AlivePlayer(i);
 		}
 
 		if ((((pent_time + 300) - cls.demotime) < 5) && !pent_is_active){
@@ -1083,7 +1124,6 @@ int MVD_Stats_Gather(void){
 			else if (powerup_cam_active == 0)
 				powerup_cam_active = 1;
 		}
-		mvd_new_info[i].mvdinfo.initialized = true;
 	}
 
 	return 1;
@@ -1276,6 +1316,20 @@ void MVD_Mainhook (void){
 		MVD_Demo_Track ();
 }
 
+//
+// Cut down MVD_Mainhook for demo seeking, only keeps the stats and the
+// itemsclock up to date. Tracking and the averages are done again by
+// MVD_Mainhook once the seek is over.
+//
+void MVD_Seekhook (void)
+{
+	if (MVD_MatchStarted())
+		MVD_Init_Info(MAX_CLIENTS);
+
+	MVD_Stats_Gather();
+	MVD_ClockList_RemoveExpired();
+}
+
 void MVD_PC_Get_Coords (void){
 	char val[1024];
 	//cvar_t *p;
@@ -1431,6 +1485,7 @@ void MVD_Powerup_Cams(void){
 void MVD_Utils_Init (void) {
 	MVD_AutoTrack_Init();
 	MVD_XMLStats_Init();
+	MVD_BatchStats_Init();
 
 	Cvar_SetCurrentGroup(CVAR_GROUP_MVD);
 	Cvar_Register (&mvd_info);
@@ -26,12 +26,17 @@ void MVD_Screen (void);
 // initialize the module, add variables and commands
 void MVD_Utils_Init(void); 
 void MVD_Mainhook(void);
+void MVD_Seekhook(void);
 void MVD_Stats_Cleanup(void);
+int MVD_Stats_Keyframe(byte *buf, qbool restore);
 void MVD_ClockList_TopItems_Draw(double time_limit, int style, int x, int y);
 void MVD_ClockList_TopItems_DimensionsGet(double time_limit, int style, int *width, int *height);
 
 // update match info structures
 void MVD_Init_Info(int player_slot);
 
+// -mvdstats on the command line, see mvd_batchstats.c
+int MVD_BatchStats_CommandLine(void);
+
 extern int powerup_cam_active,cam_1,cam_2,cam_3,cam_4;
 extern cvar_t mvd_pc_view_1,mvd_pc_view_2,mvd_pc_view_3,mvd_pc_view_4;
@@ -153,6 +153,17 @@ typedef struct mvd_new_info_s {
 
 extern mvd_new_info_t mvd_new_info[MAX_CLIENTS];
 
+// what MVD_Stats_GatherPlayer saw happen to a player in a frame
+typedef struct mvd_gather_event_s {
+	qbool	firstrun;		// the stats of the player just started
+	qbool	died;
+	int		taken;			// 1 << x for the items picked up
+	int		ended;			// 1 << x for the powerups and the mega health that ran out or were lost
+	int		ammotaken[AMMO_TYPES];
+} mvd_gather_event_t;
+
+void MVD_Stats_GatherPlayer(mvd_info_t *info, const int *stats, int frags, int weaponframe, int deathmatch, double time, mvd_gather_event_t *ev);
+
 typedef struct mvd_cg_info_s {
 	char mapname[1024];
 	char team1[1024];
@@ -195,3 +206,6 @@ void MVD_AutoTrack_Init(void);
 
 // mvd_xmlstats:
 void MVD_XMLStats_Init(void);
+
+// mvd_batchstats:
+void MVD_BatchStats_Init(void);
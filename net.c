@@ -19,6 +19,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
     $Id: net.c,v 1.19 2007-10-04 13:48:11 dkure Exp $
 */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // recvmmsg/sendmmsg
+#endif
+
 #include "quakedef.h"
 #include "server.h"
 
@@ -211,11 +215,149 @@ qbool NET_GetLoopPacket (netsrc_t sock, netadr_t *from, sizebuf_t *message)
 	return true;
 }
 
+/*
+=============================================================================
+LOOPBACK BUFFERS FOR LOAD TEST CLIENTS
+
+The synthetic clients of sv_loadtest use loopback addresses with the port set
+to their slot, 1 and up. The local player always has port 0. Every client
+has its own queue, and the server has a queue of their packets which keeps
+the slot of the sender.
+=============================================================================
+*/
+
+#define MAX_LOOPCLIENT_MSGS	8	// per client, must be a power of two
+
+typedef struct {
+	loopmsg_t		*msgs;
+	unsigned short	*ports;
+	unsigned int	mask, get, send;
+} loopqueue_t;
+
+static loopqueue_t	loopclient_server;
+static loopqueue_t	*loopclient_queues;
+static int			num_loopclients;
+
+static void NET_InitLoopQueue (loopqueue_t *q, int size)
+{
+	q->msgs = (loopmsg_t *) Q_malloc (size * sizeof(loopmsg_t));
+	q->ports = (unsigned short *) Q_malloc (size * sizeof(unsigned short));
+	q->mask = size - 1;
+	q->get = q->send = 0;
+}
+
+static void NET_FreeLoopQueue (loopqueue_t *q)
+{
+	Q_free (q->msgs);
+	Q_free (q->ports);
+}
+
+static void NET_PutLoopQueue (loopqueue_t *q, unsigned short port, int length, void *data)
+{
+	int i = q->send & q->mask;
+
+	if (length > (int) sizeof(q->msgs[i].data))
+		Sys_Error ("NET_SendLoopPacket: length > MAX_UDP_PACKET");
+
+	q->send++;
+	memcpy (q->msgs[i].data, data, length);
+	q->msgs[i].datalen = length;
+	q->ports[i] = port;
+}
+
+static qbool NET_GetLoopQueue (loopqueue_t *q, unsigned short *port, sizebuf_t *message)
+{
+	int i;
+
+	// like the player loopback, the oldest packets are lost
+	if (q->send - q->get > q->mask + 1)
+		q->get = q->send - (q->mask + 1);
+
+	if (q->get >= q->send)
+		return false;
+
+	i = q->get & q->mask;
+	q->get++;
+
+	if (message->maxsize < q->msgs[i].datalen)
+		Sys_Error("NET_GetLoopQueue: Loopback buffer was too big");
+
+	memcpy (message->data, q->msgs[i].data, q->msgs[i].datalen);
+	message->cursize = q->msgs[i].datalen;
+	*port = q->ports[i];
+	return true;
+}
+
+/*
+===================
+NET_SetLoopClients
+
+Sets up queues for count load test clients, or frees them if count is 0
+===================
+*/
+void NET_SetLoopClients (int count)
+{
+	int i;
+
+	if (num_loopclients)
+	{
+		for (i = 0; i < num_loopclients; i++)
+			NET_FreeLoopQueue (&loopclient_queues[i]);
+		NET_FreeLoopQueue (&loopclient_server);
+		Q_free (loopclient_queues);
+		num_loopclients = 0;
+	}
+
+	if (count <= 0)
+		return;
+
+	loopclient_queues = (loopqueue_t *) Q_malloc (count * sizeof(loopqueue_t));
+	for (i = 0; i < count; i++)
+		NET_InitLoopQueue (&loopclient_queues[i], MAX_LOOPCLIENT_MSGS);
+
+	// enough for a few packets from every client in a server frame
+	for (i = MAX_LOOPCLIENT_MSGS; i < count * 4; i <<= 1)
+		;
+	NET_InitLoopQueue (&loopclient_server, i);
+
+	num_loopclients = count;
+}
+
+/*
+===================
+NET_GetLoopClientPacket
+
+Reads a packet sent by the server to load test client slot
+===================
+*/
+qbool NET_GetLoopClientPacket (int slot, sizebuf_t *message)
+{
+	unsigned short port;
+
+	if (slot < 1 || slot > num_loopclients)
+		return false;
+
+	return NET_GetLoopQueue (&loopclient_queues[slot - 1], &port, message);
+}
+
 void NET_SendLoopPacket (netsrc_t sock, int length, void *data, netadr_t to)
 {
 	int i;
 	loopback_t *loop;
 
+	if (to.port)
+	{
+		// a load test client
+		if (to.port > num_loopclients)
+			return;		// the test is over
+
+		if (sock == NS_SERVER)
+			NET_PutLoopQueue (&loopclient_queues[to.port - 1], 0, length, data);
+		else
+			NET_PutLoopQueue (&loopclient_server, to.port, length, data);
+		return;
+	}
+
 	loop = &loopbacks[sock ^ 1];
 
 	i = loop->send & (MAX_LOOPBACK - 1);
@@ -228,6 +370,168 @@ void NET_SendLoopPacket (netsrc_t sock, int length, void *data, netadr_t to)
 	loop->msgs[i].datalen = length;
 }
 
+/*
+=============================================================================
+BATCHED SERVER SOCKET I/O
+
+Drains the server socket with recvmmsg() into a ring of packet buffers and
+collects outgoing datagrams of one SV_SendClientMessages() pass so they can
+be flushed with a single sendmmsg().
+=============================================================================
+*/
+
+net_batchstats_t net_batchstats;
+
+#if !defined(CLIENTONLY) && defined(__linux__) && defined(MSG_WAITFORONE)
+#define NET_BATCHIO
+#endif
+
+#ifdef NET_BATCHIO
+
+extern cvar_t sv_batchio;
+
+#define NET_BATCH_SIZE 32
+
+static byte net_recv_buf[NET_BATCH_SIZE][MSG_BUF_SIZE];
+static struct sockaddr_storage net_recv_addr[NET_BATCH_SIZE];
+static struct iovec net_recv_iov[NET_BATCH_SIZE];
+static struct mmsghdr net_recv_hdr[NET_BATCH_SIZE];
+static int net_recv_count, net_recv_next;
+
+static byte net_send_buf[NET_BATCH_SIZE][MAX_UDP_PACKET];
+static struct sockaddr_storage net_send_addr[NET_BATCH_SIZE];
+static struct iovec net_send_iov[NET_BATCH_SIZE];
+static struct mmsghdr net_send_hdr[NET_BATCH_SIZE];
+static int net_send_count;
+static qbool net_send_batching;
+
+// returns the length of the next queued datagram copied into net_message_buffer,
+// or -1 with errno set when the socket has been drained
+static int NET_BatchRecv (socket_t socket, struct sockaddr_storage *from)
+{
+	int i, ret;
+
+	if (net_recv_next >= net_recv_count)
+	{
+		net_recv_next = net_recv_count = 0;
+
+		for (i = 0; i < NET_BATCH_SIZE; i++)
+		{
+			net_recv_iov[i].iov_base = net_recv_buf[i];
+			net_recv_iov[i].iov_len = sizeof(net_recv_buf[i]);
+			memset(&net_recv_hdr[i], 0, sizeof(net_recv_hdr[i]));
+			net_recv_hdr[i].msg_hdr.msg_name = &net_recv_addr[i];
+			net_recv_hdr[i].msg_hdr.msg_namelen = sizeof(net_recv_addr[i]);
+			net_recv_hdr[i].msg_hdr.msg_iov = &net_recv_iov[i];
+			net_recv_hdr[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		ret = recvmmsg (socket, net_recv_hdr, NET_BATCH_SIZE, MSG_DONTWAIT, NULL);
+		net_batchstats.recv_calls++;
+
+		if (ret <= 0)
+		{
+			if (ret == 0)
+				errno = EWOULDBLOCK;
+			return -1;
+		}
+
+		net_recv_count = ret;
+		net_batchstats.recv_packets += ret;
+	}
+
+	i = net_recv_next++;
+	memcpy (from, &net_recv_addr[i], sizeof(*from));
+	memcpy (net_message_buffer, net_recv_buf[i], net_recv_hdr[i].msg_len);
+
+	return net_recv_hdr[i].msg_len;
+}
+
+//
+// Sends the queued datagrams, batching stays on for the rest of the frame
+// so the datagrams which follow don't overtake the queue.
+//
+static void NET_SendQueued (void)
+{
+	int sent = 0, ret, err;
+
+	while (sent < net_send_count)
+	{
+		ret = sendmmsg (svs.socketip, net_send_hdr + sent, net_send_count - sent, 0);
+		net_batchstats.send_calls++;
+
+		if (ret == -1)
+		{
+			err = qerrno;
+
+			// socket buffer is full, drop the rest just like sendto() would
+			if (err == EWOULDBLOCK)
+				break;
+
+			if (err != ECONNREFUSED && err != EADDRNOTAVAIL)
+				Sys_Printf ("NET_FlushSendBatch: sendmmsg: (%i): %s %i\n", err, strerror(err), svs.socketip);
+
+			sent++; // skip the datagram which failed
+			continue;
+		}
+
+		net_batchstats.send_packets += ret;
+		sent += ret;
+	}
+
+	net_send_count = 0;
+}
+
+static void NET_BatchSend (int length, void *data, netadr_t *to)
+{
+	int i;
+
+	if (net_send_count == NET_BATCH_SIZE)
+		NET_SendQueued ();
+
+	i = net_send_count++;
+	memcpy (net_send_buf[i], data, length);
+	NetadrToSockadr (to, &net_send_addr[i]);
+
+	net_send_iov[i].iov_base = net_send_buf[i];
+	net_send_iov[i].iov_len = length;
+	memset(&net_send_hdr[i], 0, sizeof(net_send_hdr[i]));
+	net_send_hdr[i].msg_hdr.msg_name = &net_send_addr[i];
+	net_send_hdr[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+	net_send_hdr[i].msg_hdr.msg_iov = &net_send_iov[i];
+	net_send_hdr[i].msg_hdr.msg_iovlen = 1;
+}
+
+void NET_BeginSendBatch (void)
+{
+	net_send_batching = sv_batchio.integer && svs.socketip != INVALID_SOCKET;
+}
+
+void NET_FlushSendBatch (void)
+{
+	NET_SendQueued ();
+	net_send_batching = false;
+}
+
+static void NET_ClearBatch (void)
+{
+	net_recv_count = net_recv_next = 0;
+	net_send_count = 0;
+	net_send_batching = false;
+}
+
+#else
+
+void NET_BeginSendBatch (void)
+{
+}
+
+void NET_FlushSendBatch (void)
+{
+}
+
+#endif // NET_BATCHIO
+
 //=============================================================================
 
 void NET_ClearLoopback (void)
@@ -271,6 +575,19 @@ qbool NET_GetPacketEx (netsrc_t netsrc, qbool delay)
 	if (NET_GetLoopPacket(netsrc, &net_from, &net_message))
 		return true;
 
+	if (netsrc == NS_SERVER && num_loopclients)
+	{
+		unsigned short port;
+
+		if (NET_GetLoopQueue (&loopclient_server, &port, &net_message))
+		{
+			memset (&net_from, 0, sizeof(net_from));
+			net_from.type = NA_LOOPBACK;
+			net_from.port = port;
+			return true;
+		}
+	}
+
 	for (i = 0; i < 1; i++) {
 		if (netsrc == NS_SERVER) {
 	#ifdef CLIENTONLY
@@ -295,6 +612,11 @@ qbool NET_GetPacketEx (netsrc_t netsrc, qbool delay)
 			continue;
 
 		fromlen = sizeof(from);
+#ifdef NET_BATCHIO
+		if (netsrc == NS_SERVER && (sv_batchio.integer || net_recv_next < net_recv_count))
+			ret = NET_BatchRecv (socket, &from);
+		else
+#endif
 		ret = recvfrom (socket, (char *)net_message_buffer, sizeof(net_message_buffer), 0, (struct sockaddr *)&from, &fromlen);
 
 		if (ret == -1) {
@@ -636,6 +958,19 @@ void NET_SendPacketEx (netsrc_t netsrc, int length, void *data, netadr_t to, qbo
 	if (socket == INVALID_SOCKET)
 		return;
 
+#ifdef NET_BATCHIO
+	if (netsrc == NS_SERVER && net_send_batching)
+	{
+		if (length <= MAX_UDP_PACKET)
+		{
+			NET_BatchSend (length, data, &to);
+			return;
+		}
+
+		NET_SendQueued ();
+	}
+#endif
+
 	NetadrToSockadr (&to, &addr);
 	size = sizeof(struct sockaddr_in);
 
@@ -1001,6 +1336,10 @@ void NET_InitClient(void)
 #ifndef CLIENTONLY
 void NET_CloseServer (void)
 {
+#ifdef NET_BATCHIO
+	NET_ClearBatch ();
+#endif
+
 	if (svs.socketip != INVALID_SOCKET) {
 		closesocket(svs.socketip);
 		svs.socketip = INVALID_SOCKET;
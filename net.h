@@ -130,6 +130,22 @@ qbool	NET_GetPacket (netsrc_t sock);
 void	NET_SendPacket (netsrc_t sock, int length, void *data, netadr_t to);
 
 void	NET_ClearLoopback (void);
+void	NET_SetLoopClients (int count);
+qbool	NET_GetLoopClientPacket (int slot, sizebuf_t *message);
+
+// batched server socket I/O, see sv_batchio
+typedef struct {
+	unsigned int	recv_calls;
+	unsigned int	recv_packets;
+	unsigned int	send_calls;
+	unsigned int	send_packets;
+} net_batchstats_t;
+
+extern	net_batchstats_t	net_batchstats;
+
+void	NET_BeginSendBatch (void);
+void	NET_FlushSendBatch (void);
+
 qbool	NET_Sleep (int msec);
 
 qbool	NET_CompareAdr (netadr_t a, netadr_t b);
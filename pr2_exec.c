@@ -30,6 +30,7 @@ cvar_t	sv_progtype = {"sv_progtype","0"};	// bound the size of the
 #ifdef QVM_PROFILE
 extern cvar_t sv_enableprofile;
 #endif
+extern cvar_t sv_qvmjit;
 //int usedll;
 
 void ED2_PrintEdicts (void);
@@ -44,9 +45,11 @@ void PR2_Init(void)
 	Cvar_Register(&sv_progtype);
 	Cvar_Register(&sv_progsname);
 	Cvar_Register(&sv_forcenqprogs);
+	Cvar_Register(&sv_progsthreaded);
 #ifdef QVM_PROFILE
 	Cvar_Register(&sv_enableprofile);
 #endif
+	Cvar_Register(&sv_qvmjit);
 
 	p = COM_CheckParm ("-progtype");
 
@@ -64,7 +67,9 @@ void PR2_Init(void)
 	Cmd_AddCommand ("edicts", ED2_PrintEdicts);
 	Cmd_AddCommand ("edictcount", ED_Count);
 	Cmd_AddCommand ("profile", PR2_Profile_f);
+	Cmd_AddCommand ("pr_profile", PR_Prof_f);
 	Cmd_AddCommand ("mod", PR2_GameConsoleCommand);
+	Cmd_AddCommand ("sv_qvmbench", VM_Bench_f);
 
 	PR_CleanLogText_Init();
 }
@@ -0,0 +1,989 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+/*
+  x86-64 code generator for QVM bytecode
+
+  Every QVM instruction is translated to a short run of native code, keeping
+  the operand stack in memory (rbx points at its top). QVM functions become
+  native functions: OP_ENTER is the entry and OP_LEAVE returns with "ret".
+
+  Registers while running generated code:
+	rbx		operand stack top
+	rbp		jitframe_t of the current QVM_JITExec call
+	r12		data segment base
+	r13		LP (local stack pointer, offset into the data segment)
+	r14		qvm_jit_t
+	r15		jump table
+
+  The sandbox is the same as the interpreter's: every data segment access is
+  checked against ds_mask, LP is kept inside the stack area, call and jump
+  targets are checked against the code size, and the operand stack is range
+  checked at the start of every basic block (blocks are kept short enough
+  that they can't walk off the guard area around it).
+*/
+
+#ifdef USE_PR2
+
+#include "qwsvdef.h"
+
+#ifdef QVM_JIT
+
+#include <stddef.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define JIT_OPSTACK_GUARD	64		// slots either side of the operand stack
+#define JIT_BLOCK_RANGE		(JIT_OPSTACK_GUARD / 2)	// max operand stack movement in a block
+#define JIT_MAX_INSTR		256		// more than any single instruction needs
+#define JIT_STUBS_SIZE		4096	// entry and error stubs
+#define JIT_BUDGET			(MAX_CYCLES * MAX_PROC_CALL)	// calls and backward jumps per vmMain call
+
+typedef struct
+{
+	int		*opbase;
+	int		*oplimit;
+	int		depth;			// QVM call depth
+	int		budget;			// runaway protection
+} jitframe_t;
+
+struct qvm_jit_s
+{
+	byte	*ds;
+	byte	**jumptable;	// native code of every instruction, for OP_JUMP
+	byte	**calltable;	// the same, but only for OP_ENTER, for OP_CALL
+	qvm_t	*qvm;
+
+	byte	*code;
+	int		codesize;
+	int		(*entry) (jitframe_t *frame, struct qvm_jit_s *jit, int LP, int *opstack);
+};
+
+typedef enum
+{
+	JITERR_DATA,
+	JITERR_PC,
+	JITERR_BADTARGET,
+	JITERR_OPSTACK,
+	JITERR_STACK,
+	JITERR_DEPTH,
+	JITERR_RUNAWAY,
+	JITERR_BREAK,
+	JITERR_DIVZERO,
+	JITERR_NUM
+} jiterror_t;
+
+static char *jit_errors[JITERR_NUM] =
+{
+	"data access out of range",
+	"PC out of range",
+	"bad call or jump target",
+	"opStack out of range",
+	"Stack overflow",
+	"MAX_PROC_CALL reached",
+	"runaway loop error",
+	"OP_BREAK",
+	"division by zero"
+};
+
+// x86 condition codes
+enum { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_BE = 0x6, CC_A = 0x7,
+	   CC_S = 0x8, CC_NS = 0x9, CC_P = 0xA, CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF };
+
+typedef struct
+{
+	int		pos;		// rel32 to patch
+	int		target;		// instruction number
+} jitfixup_t;
+
+typedef struct
+{
+	byte		*code;
+	int			pos;
+	int			size;
+
+	int			*instrofs;
+	jitfixup_t	*fixups;
+	int			numfixups;
+
+	int			errorstub[JITERR_NUM];
+} jitbuild_t;
+
+/*
+===============================================================================
+
+Runtime helpers called from generated code
+
+===============================================================================
+*/
+
+static void QVM_JITError (qvm_jit_t *jit, int err, int pc, int LP)
+{
+	qvm_t *qvm = jit->qvm;
+
+	qvm->PC = pc;
+	qvm->LP = LP;
+	QVM_RunError (qvm, "QVM JIT: %s at %8x", (unsigned) err < JITERR_NUM ? jit_errors[err] : "error", pc);
+}
+
+static int QVM_JITSyscall (qvm_jit_t *jit, int LP, int apinum)
+{
+	qvm_t *qvm = jit->qvm;
+
+	qvm->LP = LP;	// the syscall may call vmMain again
+	return qvm->syscall (qvm->ds, qvm->ds_mask, apinum, (pr2val_t *) (qvm->ds + LP + 2 * sizeof(int)));
+}
+
+static void QVM_JITBlockCopy (qvm_jit_t *jit, int pc, int off1, int off2, int len, int LP)
+{
+	qvm_t *qvm = jit->qvm;
+
+	if ((off1 & ~qvm->ds_mask) || (off2 & ~qvm->ds_mask)
+		|| ((off1 + len) & ~qvm->ds_mask) || ((off2 + len) & ~qvm->ds_mask))
+		QVM_JITError (jit, JITERR_DATA, pc, LP);
+
+	memmove (qvm->ds + off1, qvm->ds + off2, len);
+}
+
+/*
+===============================================================================
+
+Code emission
+
+===============================================================================
+*/
+
+static void JIT_Emit (jitbuild_t *b, const char *bytes, int len)
+{
+	memcpy (b->code + b->pos, bytes, len);
+	b->pos += len;
+}
+
+#define EMIT(s)	JIT_Emit (b, s, sizeof(s) - 1)
+
+static void JIT_Emit1 (jitbuild_t *b, int v)
+{
+	b->code[b->pos++] = v;
+}
+
+static void JIT_Emit4 (jitbuild_t *b, int v)
+{
+	memcpy (b->code + b->pos, &v, 4);
+	b->pos += 4;
+}
+
+static void JIT_Emit8 (jitbuild_t *b, void *p)
+{
+	memcpy (b->code + b->pos, &p, 8);
+	b->pos += 8;
+}
+
+// jmp/jcc rel32 to a position already emitted
+static void JIT_Jump (jitbuild_t *b, int cc, int target)
+{
+	if (cc < 0)
+	{
+		JIT_Emit1 (b, 0xE9);
+	}
+	else
+	{
+		JIT_Emit1 (b, 0x0F);
+		JIT_Emit1 (b, 0x80 + cc);
+	}
+	JIT_Emit4 (b, target - (b->pos + 4));
+}
+
+// jcc rel32 to an instruction, patched once all code is emitted
+static void JIT_JumpInstr (jitbuild_t *b, int cc, int instr)
+{
+	JIT_Emit1 (b, 0x0F);
+	JIT_Emit1 (b, 0x80 + cc);
+	b->fixups[b->numfixups].pos = b->pos;
+	b->fixups[b->numfixups].target = instr;
+	b->numfixups++;
+	JIT_Emit4 (b, 0);
+}
+
+// short jump forward, returns the byte to patch with JIT_Land
+static int JIT_ShortJump (jitbuild_t *b, int opcode)
+{
+	JIT_Emit1 (b, opcode);
+	JIT_Emit1 (b, 0);
+	return b->pos - 1;
+}
+
+static void JIT_Land (jitbuild_t *b, int patch)
+{
+	b->code[patch] = b->pos - (patch + 1);
+}
+
+// raises err at pc unless condition cc holds
+static void JIT_ErrorUnless (jitbuild_t *b, int cc, jiterror_t err, int pc)
+{
+	JIT_Emit1 (b, 0x70 + cc);
+	JIT_Emit1 (b, 10);
+	JIT_Emit1 (b, 0xBA);					// mov edx, pc
+	JIT_Emit4 (b, pc);
+	JIT_Jump (b, -1, b->errorstub[err]);
+}
+
+static void JIT_CallHelper (jitbuild_t *b, void *func)
+{
+	EMIT ("\x48\xB8");						// mov rax, func
+	JIT_Emit8 (b, func);
+	EMIT ("\xFF\xD0");						// call rax
+}
+
+static void JIT_CheckOpStack (jitbuild_t *b, int pc)
+{
+	EMIT ("\x48\x3B\x5D");					// cmp rbx, [rbp+opbase]
+	JIT_Emit1 (b, offsetof (jitframe_t, opbase));
+	JIT_ErrorUnless (b, CC_AE, JITERR_OPSTACK, pc);
+	EMIT ("\x48\x3B\x5D");					// cmp rbx, [rbp+oplimit]
+	JIT_Emit1 (b, offsetof (jitframe_t, oplimit));
+	JIT_ErrorUnless (b, CC_BE, JITERR_OPSTACK, pc);
+}
+
+static void JIT_CountCycle (jitbuild_t *b, int pc)
+{
+	EMIT ("\xFF\x4D");						// dec dword [rbp+budget]
+	JIT_Emit1 (b, offsetof (jitframe_t, budget));
+	JIT_ErrorUnless (b, CC_NS, JITERR_RUNAWAY, pc);
+}
+
+static void JIT_CheckLP (jitbuild_t *b, qvm_t *qvm, int pc)
+{
+	EMIT ("\x41\x81\xFD");					// cmp r13d, stack bottom
+	JIT_Emit4 (b, qvm->len_ds - qvm->len_ss);
+	JIT_ErrorUnless (b, CC_GE, JITERR_STACK, pc);
+	EMIT ("\x41\x81\xFD");					// cmp r13d, stack top
+	JIT_Emit4 (b, qvm->len_ds - 2 * sizeof(int));
+	JIT_ErrorUnless (b, CC_LE, JITERR_STACK, pc);
+}
+
+// checks the data segment address in eax
+static void JIT_CheckData (jitbuild_t *b, qvm_t *qvm, int pc)
+{
+#ifdef QVM_DATA_PROTECTION
+	JIT_Emit1 (b, 0xA9);					// test eax, ~ds_mask
+	JIT_Emit4 (b, ~qvm->ds_mask);
+	JIT_ErrorUnless (b, CC_E, JITERR_DATA, pc);
+#else
+	JIT_Emit1 (b, 0x25);					// and eax, ds_mask
+	JIT_Emit4 (b, qvm->ds_mask);
+#endif
+}
+
+static void JIT_EmitEntry (jitbuild_t *b)
+{
+	EMIT ("\x53\x55\x41\x54\x41\x55\x41\x56\x41\x57");	// push rbx, rbp, r12-r15
+	EMIT ("\x48\x83\xEC\x08");				// sub rsp, 8
+	EMIT ("\x48\x89\xFD");					// mov rbp, rdi
+	EMIT ("\x49\x89\xF6");					// mov r14, rsi
+	EMIT ("\x41\x89\xD5");					// mov r13d, edx
+	EMIT ("\x48\x89\xCB");					// mov rbx, rcx
+	EMIT ("\x4D\x8B\x66");					// mov r12, [r14+ds]
+	JIT_Emit1 (b, offsetof (qvm_jit_t, ds));
+	EMIT ("\x4D\x8B\x7E");					// mov r15, [r14+jumptable]
+	JIT_Emit1 (b, offsetof (qvm_jit_t, jumptable));
+	EMIT ("\x49\x8B\x56");					// mov rdx, [r14+calltable]
+	JIT_Emit1 (b, offsetof (qvm_jit_t, calltable));
+	EMIT ("\xFF\x12");						// call [rdx]
+	EMIT ("\x8B\x03");						// mov eax, [rbx]
+	EMIT ("\x48\x83\xC4\x08");				// add rsp, 8
+	EMIT ("\x41\x5F\x41\x5E\x41\x5D\x41\x5C\x5D\x5B");	// pop r15-r12, rbp, rbx
+	EMIT ("\xC3");							// ret
+}
+
+static void JIT_EmitErrorStubs (jitbuild_t *b)
+{
+	int err;
+
+	for (err = 0; err < JITERR_NUM; err++)
+	{
+		b->errorstub[err] = b->pos;
+		if (err == JITERR_BADTARGET)
+		{
+			JIT_Emit1 (b, 0xBA);			// mov edx, -1
+			JIT_Emit4 (b, -1);
+		}
+		EMIT ("\x4C\x89\xF7");				// mov rdi, r14
+		JIT_Emit1 (b, 0xBE);				// mov esi, err
+		JIT_Emit4 (b, err);
+		EMIT ("\x44\x89\xE9");				// mov ecx, r13d
+		EMIT ("\x48\x83\xE4\xF0");			// and rsp, -16
+		JIT_CallHelper (b, (void *) QVM_JITError);
+		EMIT ("\x0F\x0B");					// ud2
+	}
+}
+
+// operand stack slots an instruction reads and writes
+static void JIT_StackEffect (opcode_t op, int *pops, int *pushes)
+{
+	*pops = *pushes = 0;
+
+	switch (op)
+	{
+	case OP_PUSH:
+	case OP_CONST:
+	case OP_LOCAL:
+		*pushes = 1;
+		break;
+
+	case OP_POP:
+	case OP_JUMP:
+	case OP_ARG:
+		*pops = 1;
+		break;
+
+	case OP_CALL:
+	case OP_LOAD1:
+	case OP_LOAD2:
+	case OP_LOAD4:
+	case OP_SEX8:
+	case OP_SEX16:
+	case OP_NEGI:
+	case OP_BCOM:
+	case OP_NEGF:
+	case OP_CVIF:
+	case OP_CVFI:
+		*pops = *pushes = 1;
+		break;
+
+	case OP_EQ: case OP_NE:
+	case OP_LTI: case OP_LEI: case OP_GTI: case OP_GEI:
+	case OP_LTU: case OP_LEU: case OP_GTU: case OP_GEU:
+	case OP_EQF: case OP_NEF:
+	case OP_LTF: case OP_LEF: case OP_GTF: case OP_GEF:
+	case OP_STORE1:
+	case OP_STORE2:
+	case OP_STORE4:
+	case OP_BLOCK_COPY:
+		*pops = 2;
+		break;
+
+	case OP_ADD: case OP_SUB:
+	case OP_DIVI: case OP_DIVU: case OP_MODI: case OP_MODU:
+	case OP_MULI: case OP_MULU:
+	case OP_BAND: case OP_BOR: case OP_BXOR:
+	case OP_LSH: case OP_RSHI: case OP_RSHU:
+	case OP_ADDF: case OP_SUBF: case OP_DIVF: case OP_MULF:
+		*pops = 2;
+		*pushes = 1;
+		break;
+
+	default:
+		break;
+	}
+}
+
+/*
+==================
+JIT_FindBlocks
+
+Marks the instructions that start a basic block. Besides jump targets and
+instructions after a jump or call, a block is split whenever its operand
+stack movement would get larger than JIT_BLOCK_RANGE.
+==================
+*/
+static byte *JIT_FindBlocks (qvm_t *qvm)
+{
+	int i, target, pops, pushes, c, lo, hi;
+	opcode_t op;
+	byte *leader;
+
+	leader = (byte *) Q_calloc (qvm->len_cs + 1, 1);
+	leader[0] = true;
+
+	for (i = 0; i < qvm->len_cs; i++)
+	{
+		op = qvm->cs[i].opcode;
+
+		if (op == OP_ENTER)
+			leader[i] = true;
+		else if (op >= OP_EQ && op <= OP_GEF)
+		{
+			target = qvm->cs[i].parm._int;
+			if (target >= 0 && target < qvm->len_cs)
+				leader[target] = true;
+			leader[i + 1] = true;
+		}
+		else if (op == OP_JUMP || op == OP_CALL || op == OP_LEAVE)
+			leader[i + 1] = true;
+	}
+
+	c = lo = hi = 0;
+	for (i = 0; i < qvm->len_cs; i++)
+	{
+		JIT_StackEffect (qvm->cs[i].opcode, &pops, &pushes);
+
+		if (leader[i])
+			c = lo = hi = 0;
+
+		if (max (hi, c + pushes) - min (lo, c - pops) > JIT_BLOCK_RANGE)
+		{
+			leader[i] = true;
+			c = lo = hi = 0;
+		}
+
+		lo = min (lo, c - pops);
+		hi = max (hi, c + pushes);
+		c += pushes - pops;
+	}
+
+	return leader;
+}
+
+static qbool JIT_ValidTarget (qvm_t *qvm, int target)
+{
+	return target >= 0 && target < qvm->len_cs && qvm->cs[target].opcode != OP_ENTER;
+}
+
+static void JIT_EmitBranch (jitbuild_t *b, qvm_t *qvm, int pc, qvm_instruction_t *op)
+{
+	int target = op->parm._int;
+	qbool valid = JIT_ValidTarget (qvm, target);
+	qbool isfloat = op->opcode >= OP_EQF;
+	int cc = 0, patch;
+
+	if (valid && target <= pc)
+		JIT_CountCycle (b, pc);
+
+	if (isfloat)
+	{
+		EMIT ("\xF3\x0F\x10\x43\xFC");		// movss xmm0, [rbx-4]
+		EMIT ("\xF3\x0F\x10\x0B");			// movss xmm1, [rbx]
+	}
+	else
+	{
+		EMIT ("\x8B\x43\xFC");				// mov eax, [rbx-4]
+		EMIT ("\x8B\x0B");					// mov ecx, [rbx]
+	}
+	EMIT ("\x48\x83\xEB\x08");				// sub rbx, 8
+
+	switch (op->opcode)
+	{
+	case OP_EQ:		cc = CC_E;	break;
+	case OP_NE:		cc = CC_NE;	break;
+	case OP_LTI:	cc = CC_L;	break;
+	case OP_LEI:	cc = CC_LE;	break;
+	case OP_GTI:	cc = CC_G;	break;
+	case OP_GEI:	cc = CC_GE;	break;
+	case OP_LTU:	cc = CC_B;	break;
+	case OP_LEU:	cc = CC_BE;	break;
+	case OP_GTU:	cc = CC_A;	break;
+	case OP_GEU:	cc = CC_AE;	break;
+	// ucomiss sets CF/ZF/PF on unordered, so a < b is tested as b > a
+	case OP_EQF:	cc = CC_E;	EMIT ("\x0F\x2E\xC1");	break;	// ucomiss xmm0, xmm1
+	case OP_NEF:	cc = CC_NE;	EMIT ("\x0F\x2E\xC1");	break;
+	case OP_LTF:	cc = CC_A;	EMIT ("\x0F\x2E\xC8");	break;	// ucomiss xmm1, xmm0
+	case OP_LEF:	cc = CC_AE;	EMIT ("\x0F\x2E\xC8");	break;
+	case OP_GTF:	cc = CC_A;	EMIT ("\x0F\x2E\xC1");	break;
+	case OP_GEF:	cc = CC_AE;	EMIT ("\x0F\x2E\xC1");	break;
+	default:		break;
+	}
+
+	if (!isfloat)
+		EMIT ("\x39\xC8");					// cmp eax, ecx
+
+	patch = -1;
+	if (op->opcode == OP_EQF)
+		patch = JIT_ShortJump (b, 0x70 + CC_P);	// unordered is never equal
+	else if (op->opcode == OP_NEF)
+	{
+		// unordered is always not equal
+		if (valid)
+			JIT_JumpInstr (b, CC_P, target);
+		else
+			JIT_Jump (b, CC_P, b->errorstub[JITERR_BADTARGET]);
+	}
+
+	if (valid)
+		JIT_JumpInstr (b, cc, target);
+	else
+		JIT_Jump (b, cc, b->errorstub[JITERR_BADTARGET]);
+
+	if (patch >= 0)
+		JIT_Land (b, patch);
+}
+
+static void JIT_EmitInstruction (jitbuild_t *b, qvm_t *qvm, int pc)
+{
+	qvm_instruction_t *op = &qvm->cs[pc];
+	int patch, patch2;
+
+	switch (op->opcode)
+	{
+	case OP_UNDEF:
+	case OP_BREAK:
+		JIT_Emit1 (b, 0xBA);				// mov edx, pc
+		JIT_Emit4 (b, pc);
+		JIT_Jump (b, -1, b->errorstub[JITERR_BREAK]);
+		break;
+
+	case OP_IGNORE:
+		break;
+
+	case OP_ENTER:
+		EMIT ("\x48\x83\xEC\x08");			// sub rsp, 8 (keeps calls 16 byte aligned)
+		EMIT ("\x41\x81\xED");				// sub r13d, parm
+		JIT_Emit4 (b, op->parm._int);
+		JIT_CheckLP (b, qvm, pc);
+		EMIT ("\x43\xC7\x44\x2C\x04");		// mov dword [r12+r13+4], parm
+		JIT_Emit4 (b, op->parm._int);
+		EMIT ("\xFF\x45");					// inc dword [rbp+depth]
+		JIT_Emit1 (b, offsetof (jitframe_t, depth));
+		EMIT ("\x83\x7D");					// cmp dword [rbp+depth], MAX_PROC_CALL
+		JIT_Emit1 (b, offsetof (jitframe_t, depth));
+		JIT_Emit1 (b, MAX_PROC_CALL);
+		JIT_ErrorUnless (b, CC_L, JITERR_DEPTH, pc);
+		JIT_CountCycle (b, pc);
+		break;
+
+	case OP_LEAVE:
+		EMIT ("\x41\x81\xC5");				// add r13d, parm
+		JIT_Emit4 (b, op->parm._int);
+		JIT_CheckLP (b, qvm, pc);
+		EMIT ("\xFF\x4D");					// dec dword [rbp+depth]
+		JIT_Emit1 (b, offsetof (jitframe_t, depth));
+		EMIT ("\x48\x83\xC4\x08");			// add rsp, 8
+		EMIT ("\xC3");						// ret
+		break;
+
+	case OP_CALL:
+		EMIT ("\x8B\x03");					// mov eax, [rbx]
+		EMIT ("\x43\xC7\x04\x2C");			// mov dword [r12+r13], return address
+		JIT_Emit4 (b, pc + 1);
+		EMIT ("\x85\xC0");					// test eax, eax
+		patch = JIT_ShortJump (b, 0x70 + CC_NS);
+		// negative numbers are system calls
+		EMIT ("\x4C\x89\xF7");				// mov rdi, r14
+		EMIT ("\x44\x89\xEE");				// mov esi, r13d
+		EMIT ("\x89\xC2");					// mov edx, eax
+		EMIT ("\xF7\xD2");					// not edx
+		JIT_CallHelper (b, (void *) QVM_JITSyscall);
+		EMIT ("\x89\x03");					// mov [rbx], eax
+		patch2 = JIT_ShortJump (b, 0xEB);
+		JIT_Land (b, patch);
+		JIT_Emit1 (b, 0x3D);				// cmp eax, len_cs
+		JIT_Emit4 (b, qvm->len_cs);
+		JIT_ErrorUnless (b, CC_B, JITERR_PC, pc);
+		EMIT ("\x48\x83\xEB\x04");			// sub rbx, 4
+		EMIT ("\x49\x8B\x56");				// mov rdx, [r14+calltable]
+		JIT_Emit1 (b, offsetof (qvm_jit_t, calltable));
+		EMIT ("\xFF\x14\xC2");				// call [rdx+rax*8]
+		JIT_Land (b, patch2);
+		break;
+
+	case OP_PUSH:
+		EMIT ("\x48\x83\xC3\x04");			// add rbx, 4
+		break;
+
+	case OP_POP:
+		EMIT ("\x48\x83\xEB\x04");			// sub rbx, 4
+		break;
+
+	case OP_CONST:
+		EMIT ("\x48\x83\xC3\x04");			// add rbx, 4
+		EMIT ("\xC7\x03");					// mov dword [rbx], parm
+		JIT_Emit4 (b, op->parm._int);
+		break;
+
+	case OP_LOCAL:
+		EMIT ("\x41\x8D\x85");				// lea eax, [r13+parm]
+		JIT_Emit4 (b, op->parm._int);
+		EMIT ("\x48\x83\xC3\x04");			// add rbx, 4
+		EMIT ("\x89\x03");					// mov [rbx], eax
+		break;
+
+	case OP_JUMP:
+		EMIT ("\x8B\x03");					// mov eax, [rbx]
+		EMIT ("\x48\x83\xEB\x04");			// sub rbx, 4
+		JIT_Emit1 (b, 0x3D);				// cmp eax, len_cs
+		JIT_Emit4 (b, qvm->len_cs);
+		JIT_ErrorUnless (b, CC_B, JITERR_PC, pc);
+		JIT_CountCycle (b, pc);
+		JIT_CheckOpStack (b, pc);			// the target may be in the middle of a block
+		EMIT ("\x41\xFF\x24\xC7");			// jmp [r15+rax*8]
+		break;
+
+	case OP_EQ: case OP_NE:
+	case OP_LTI: case OP_LEI: case OP_GTI: case OP_GEI:
+	case OP_LTU: case OP_LEU: case OP_GTU: case OP_GEU:
+	case OP_EQF: case OP_NEF:
+	case OP_LTF: case OP_LEF: case OP_GTF: case OP_GEF:
+		JIT_EmitBranch (b, qvm, pc, op);
+		break;
+
+	case OP_LOAD1:
+	case OP_LOAD2:
+	case OP_LOAD4:
+		EMIT ("\x8B\x03");					// mov eax, [rbx]
+		JIT_CheckData (b, qvm, pc);
+		if (op->opcode == OP_LOAD1)
+			EMIT ("\x41\x0F\xBE\x04\x04");	// movsx eax, byte [r12+rax]
+		else if (op->opcode == OP_LOAD2)
+			EMIT ("\x41\x0F\xBF\x04\x04");	// movsx eax, word [r12+rax]
+		else
+			EMIT ("\x41\x8B\x04\x04");		// mov eax, [r12+rax]
+		EMIT ("\x89\x03");					// mov [rbx], eax
+		break;
+
+	case OP_STORE1:
+	case OP_STORE2:
+	case OP_STORE4:
+		EMIT ("\x8B\x43\xFC");				// mov eax, [rbx-4]
+		JIT_CheckData (b, qvm, pc);
+		EMIT ("\x8B\x0B");					// mov ecx, [rbx]
+		if (op->opcode == OP_STORE1)
+			EMIT ("\x41\x88\x0C\x04");		// mov [r12+rax], cl
+		else if (op->opcode == OP_STORE2)
+			EMIT ("\x66\x41\x89\x0C\x04");	// mov [r12+rax], cx
+		else
+			EMIT ("\x41\x89\x0C\x04");		// mov [r12+rax], ecx
+		EMIT ("\x48\x83\xEB\x08");			// sub rbx, 8
+		break;
+
+	case OP_ARG:
+		EMIT ("\x41\x8D\x85");				// lea eax, [r13+parm]
+		JIT_Emit4 (b, op->parm._int);
+		JIT_CheckData (b, qvm, pc);
+		EMIT ("\x8B\x0B");					// mov ecx, [rbx]
+		EMIT ("\x41\x89\x0C\x04");			// mov [r12+rax], ecx
+		EMIT ("\x48\x83\xEB\x04");			// sub rbx, 4
+		break;
+
+	case OP_BLOCK_COPY:
+		EMIT ("\x4C\x89\xF7");				// mov rdi, r14
+		JIT_Emit1 (b, 0xBE);				// mov esi, pc
+		JIT_Emit4 (b, pc);
+		EMIT ("\x8B\x53\xFC");				// mov edx, [rbx-4]
+		EMIT ("\x8B\x0B");					// mov ecx, [rbx]
+		EMIT ("\x41\xB8");					// mov r8d, parm
+		JIT_Emit4 (b, op->parm._int);
+		EMIT ("\x45\x89\xE9");				// mov r9d, r13d
+		JIT_CallHelper (b, (void *) QVM_JITBlockCopy);
+		EMIT ("\x48\x83\xEB\x08");			// sub rbx, 8
+		break;
+
+	case OP_SEX8:
+		EMIT ("\x0F\xBE\x03");				// movsx eax, byte [rbx]
+		EMIT ("\x89\x03");					// mov [rbx], eax
+		break;
+
+	case OP_SEX16:
+		EMIT ("\x0F\xBF\x03");				// movsx eax, word [rbx]
+		EMIT ("\x89\x03");					// mov [rbx], eax
+		break;
+
+	case OP_NEGI:
+		EMIT ("\xF7\x1B");					// neg dword [rbx]
+		break;
+
+	case OP_BCOM:
+		EMIT ("\xF7\x13");					// not dword [rbx]
+		break;
+
+	case OP_ADD:
+	case OP_SUB:
+	case OP_BAND:
+	case OP_BOR:
+	case OP_BXOR:
+		EMIT ("\x8B\x03");					// mov eax, [rbx]
+		EMIT ("\x48\x83\xEB\x04");			// sub rbx, 4
+		switch (op->opcode)
+		{
+		case OP_ADD:	EMIT ("\x01\x03");	break;	// add [rbx], eax
+		case OP_SUB:	EMIT ("\x29\x03");	break;	// sub [rbx], eax
+		case OP_BAND:	EMIT ("\x21\x03");	break;	// and [rbx], eax
+		case OP_BOR:	EMIT ("\x09\x03");	break;	// or [rbx], eax
+		default:		EMIT ("\x31\x03");	break;	// xor [rbx], eax
+		}
+		break;
+
+	case OP_MULI:
+	case OP_MULU:
+		EMIT ("\x8B\x43\xFC");				// mov eax, [rbx-4]
+		EMIT ("\x0F\xAF\x03");				// imul eax, [rbx]
+		EMIT ("\x48\x83\xEB\x04");			// sub rbx, 4
+		EMIT ("\x89\x03");					// mov [rbx], eax
+		break;
+
+	case OP_DIVI:
+	case OP_MODI:
+	case OP_DIVU:
+	case OP_MODU:
+		EMIT ("\x8B\x43\xFC");				// mov eax, [rbx-4]
+		EMIT ("\x8B\x0B");					// mov ecx, [rbx]
+		EMIT ("\x85\xC9");					// test ecx, ecx
+		JIT_ErrorUnless (b, CC_NE, JITERR_DIVZERO, pc);
+		if (op->opcode == OP_DIVU || op->opcode == OP_MODU)
+		{
+			EMIT ("\x31\xD2");				// xor edx, edx
+			EMIT ("\xF7\xF1");				// div ecx
+			patch2 = -1;
+		}
+		else
+		{
+			// INT_MIN / -1 would fault
+			EMIT ("\x83\xF9\xFF");			// cmp ecx, -1
+			patch = JIT_ShortJump (b, 0x70 + CC_NE);
+			EMIT ("\xF7\xD8");				// neg eax
+			EMIT ("\x31\xD2");				// xor edx, edx
+			patch2 = JIT_ShortJump (b, 0xEB);
+			JIT_Land (b, patch);
+			EMIT ("\x99");					// cdq
+			EMIT ("\xF7\xF9");				// idiv ecx
+		}
+		if (patch2 >= 0)
+			JIT_Land (b, patch2);
+		EMIT ("\x48\x83\xEB\x04");			// sub rbx, 4
+		if (op->opcode == OP_DIVI || op->opcode == OP_DIVU)
+			EMIT ("\x89\x03");				// mov [rbx], eax
+		else
+			EMIT ("\x89\x13");				// mov [rbx], edx
+		break;
+
+	case OP_LSH:
+	case OP_RSHI:
+	case OP_RSHU:
+		EMIT ("\x8B\x0B");					// mov ecx, [rbx]
+		EMIT ("\x48\x83\xEB\x04");			// sub rbx, 4
+		if (op->opcode == OP_LSH)
+			EMIT ("\xD3\x23");				// shl dword [rbx], cl
+		else if (op->opcode == OP_RSHI)
+			EMIT ("\xD3\x3B");				// sar dword [rbx], cl
+		else
+			EMIT ("\xD3\x2B");				// shr dword [rbx], cl
+		break;
+
+	case OP_NEGF:
+		EMIT ("\x81\x33");					// xor dword [rbx], sign bit
+		JIT_Emit4 (b, 0x80000000);
+		break;
+
+	case OP_ADDF:
+	case OP_SUBF:
+	case OP_MULF:
+	case OP_DIVF:
+		EMIT ("\xF3\x0F\x10\x43\xFC");		// movss xmm0, [rbx-4]
+		if (op->opcode == OP_ADDF)
+			EMIT ("\xF3\x0F\x58\x03");		// addss xmm0, [rbx]
+		else if (op->opcode == OP_SUBF)
+			EMIT ("\xF3\x0F\x5C\x03");		// subss xmm0, [rbx]
+		else if (op->opcode == OP_MULF)
+			EMIT ("\xF3\x0F\x59\x03");		// mulss xmm0, [rbx]
+		else
+			EMIT ("\xF3\x0F\x5E\x03");		// divss xmm0, [rbx]
+		EMIT ("\x48\x83\xEB\x04");			// sub rbx, 4
+		EMIT ("\xF3\x0F\x11\x03");			// movss [rbx], xmm0
+		break;
+
+	case OP_CVIF:
+		EMIT ("\xF3\x0F\x2A\x03");			// cvtsi2ss xmm0, dword [rbx]
+		EMIT ("\xF3\x0F\x11\x03");			// movss [rbx], xmm0
+		break;
+
+	case OP_CVFI:
+		EMIT ("\xF3\x0F\x2C\x03");			// cvttss2si eax, dword [rbx]
+		EMIT ("\x89\x03");					// mov [rbx], eax
+		break;
+
+	default:
+		JIT_Emit1 (b, 0xBA);				// mov edx, pc
+		JIT_Emit4 (b, pc);
+		JIT_Jump (b, -1, b->errorstub[JITERR_BREAK]);
+		break;
+	}
+}
+
+/*
+==================
+QVM_JITCompile
+
+Translates the whole code segment. Returns false if the code could not be
+generated, the interpreter is used then.
+==================
+*/
+qbool QVM_JITCompile (qvm_t *qvm)
+{
+	jitbuild_t build, *b = &build;
+	qvm_jit_t *jit;
+	byte *leader;
+	int i, pagesize, size, rel;
+	double start = Sys_DoubleTime ();
+
+	// untouched pages of the reservation cost nothing, the tail is unmapped below
+	memset (b, 0, sizeof(*b));
+	b->size = qvm->len_cs * JIT_MAX_INSTR + JIT_STUBS_SIZE;
+	b->code = mmap (NULL, b->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (b->code == MAP_FAILED)
+	{
+		Con_Printf ("QVM JIT: couldn't allocate code buffer\n");
+		return false;
+	}
+
+	b->instrofs = (int *) Q_malloc (qvm->len_cs * sizeof(int));
+	b->fixups = (jitfixup_t *) Q_malloc (2 * qvm->len_cs * sizeof(jitfixup_t));
+	leader = JIT_FindBlocks (qvm);
+
+	JIT_EmitEntry (b);
+	JIT_EmitErrorStubs (b);
+
+	for (i = 0; i < qvm->len_cs; i++)
+	{
+		// functions may only be entered by a call
+		if (qvm->cs[i].opcode == OP_ENTER)
+			JIT_Jump (b, -1, b->errorstub[JITERR_BADTARGET]);
+
+		b->instrofs[i] = b->pos;
+		if (leader[i])
+			JIT_CheckOpStack (b, i);
+
+		JIT_EmitInstruction (b, qvm, i);
+	}
+
+	Q_free (leader);
+
+	for (i = 0; i < b->numfixups; i++)
+	{
+		rel = b->instrofs[b->fixups[i].target] - (b->fixups[i].pos + 4);
+		memcpy (b->code + b->fixups[i].pos, &rel, 4);
+	}
+
+	// give back what wasn't used and make it executable
+	pagesize = sysconf (_SC_PAGESIZE);
+	size = (b->pos + pagesize - 1) & ~(pagesize - 1);
+	if (size < b->size)
+	{
+		munmap (b->code + size, b->size - size);
+		b->size = size;
+	}
+
+	if (mprotect (b->code, b->size, PROT_READ | PROT_EXEC))
+	{
+		munmap (b->code, b->size);
+		Q_free (b->instrofs);
+		Q_free (b->fixups);
+		Con_Printf ("QVM JIT: couldn't make code executable\n");
+		return false;
+	}
+
+	jit = (qvm_jit_t *) Q_malloc (sizeof(qvm_jit_t));
+	jit->ds = qvm->ds;
+	jit->qvm = qvm;
+	jit->code = b->code;
+	jit->codesize = b->size;
+	jit->entry = (void *) b->code;
+	jit->jumptable = (byte **) Q_malloc (qvm->len_cs * sizeof(byte *));
+	jit->calltable = (byte **) Q_malloc (qvm->len_cs * sizeof(byte *));
+
+	for (i = 0; i < qvm->len_cs; i++)
+	{
+		if (qvm->cs[i].opcode == OP_ENTER)
+		{
+			jit->jumptable[i] = b->code + b->errorstub[JITERR_BADTARGET];
+			jit->calltable[i] = b->code + b->instrofs[i];
+		}
+		else
+		{
+			jit->jumptable[i] = b->code + b->instrofs[i];
+			jit->calltable[i] = b->code + b->errorstub[JITERR_BADTARGET];
+		}
+	}
+
+	Q_free (b->instrofs);
+	Q_free (b->fixups);
+
+	qvm->jit = jit;
+
+	Con_DPrintf ("QVM JIT: %d instructions, %d bytes of code in %.1f ms\n",
+				 qvm->len_cs, b->pos, 1000 * (Sys_DoubleTime () - start));
+	return true;
+}
+
+void QVM_JITFree (qvm_t *qvm)
+{
+	qvm_jit_t *jit = qvm->jit;
+
+	if (!jit)
+		return;
+
+	munmap (jit->code, jit->codesize);
+	Q_free (jit->jumptable);
+	Q_free (jit->calltable);
+	Q_free (jit);
+	qvm->jit = NULL;
+}
+
+/*
+==================
+QVM_JITExec
+
+Same as QVM_Exec, but runs the generated code
+==================
+*/
+int QVM_JITExec (qvm_t *qvm, int command, int arg0, int arg1, int arg2, int arg3,
+				 int arg4, int arg5, int arg6, int arg7, int arg8, int arg9, int arg10, int arg11)
+{
+	int opstack[JIT_OPSTACK_GUARD + OPSTACKSIZE + 1 + JIT_OPSTACK_GUARD];
+	qvm_jit_t *jit = qvm->jit;
+	jitframe_t frame;
+	int saveLP, ret, *args;
+
+	saveLP = qvm->LP;
+
+	if (!qvm->reenter)
+		qvm->LP = qvm->len_ds - sizeof(int);
+	if (qvm->reenter++ > MAX_vmMain_Call)
+		QVM_RunError (qvm, "QVM_Exec MAX_vmMain_Call reached");
+
+	qvm->LP -= 14 * sizeof(int);
+	if (qvm->LP < qvm->len_ds - qvm->len_ss)
+		QVM_RunError (qvm, "QVM Stack overflow on vmMain call");
+
+	args = (int *) (qvm->ds + qvm->LP);
+	args[0] = 0;				// return address
+	args[1] = 14 * sizeof(int);	// 11 params + command + retaddr + num args
+	args[2] = command;
+	args[3] = arg0;
+	args[4] = arg1;
+	args[5] = arg2;
+	args[6] = arg3;
+	args[7] = arg4;
+	args[8] = arg5;
+	args[9] = arg6;
+	args[10] = arg7;
+	args[11] = arg8;
+	args[12] = arg9;
+	args[13] = arg10;
+	args[14] = arg11;
+
+	frame.opbase = opstack + JIT_OPSTACK_GUARD;
+	frame.oplimit = frame.opbase + OPSTACKSIZE;
+	frame.depth = 0;
+	frame.budget = JIT_BUDGET;
+	frame.opbase[0] = 0;
+
+	ret = jit->entry (&frame, jit, qvm->LP, frame.opbase);
+
+	qvm->LP = saveLP;
+	qvm->reenter--;
+	return ret;
+}
+
+#endif /* QVM_JIT */
+
+#endif /* USE_PR2 */
@@ -32,6 +32,12 @@
 #include "qwsvdef.h"
 //#include "crc.c"
 
+#ifdef QVM_JIT
+cvar_t	sv_qvmjit = {"sv_qvmjit","1"};
+#else
+cvar_t	sv_qvmjit = {"sv_qvmjit","0"};
+#endif
+
 #ifdef QVM_PROFILE
 cvar_t	sv_enableprofile = {"sv_enableprofile","0"};
 typedef struct
@@ -69,7 +75,6 @@ profile_t* ProfileEnterFunction(int adress)
 
 	return &profile_funcs[num_profile_func++];
 }
-symbols_t* QVM_FindName( qvm_t * qvm, int off);
 #endif
 
 void PR2_Profile_f()
@@ -136,8 +141,12 @@ void PR2_Profile_f()
 
 void VM_UnloadQVM( qvm_t * qvm )
 {
-	if(qvm)
-		Q_free( qvm );
+	if(!qvm)
+		return;
+#ifdef QVM_JIT
+	QVM_JITFree( qvm );
+#endif
+	Q_free( qvm );
 }
 
 void VM_Unload( vm_t * vm )
@@ -350,9 +359,18 @@ qbool VM_LoadBytecode( vm_t * vm, sys_callex_t syscall1 )
 	}
 	// create vitrual machine
 	if(vm->hInst)
+	{
 		qvm = (qvm_t *)vm->hInst;
+#ifdef QVM_JIT
+		QVM_JITFree( qvm );
+#endif
+	}
 	else
+	{
 		qvm = (qvm_t *) Q_malloc (sizeof (qvm_t));
+		qvm->jit = NULL;
+	}
+	qvm->jit_failed = false;
 
 	qvm->len_cs = header->instructionCount + 1;	//bad opcode padding.
 	qvm->len_ds = header->dataOffset + header->litLength + header->bssLength;
@@ -445,6 +463,11 @@ qbool VM_LoadBytecode( vm_t * vm, sys_callex_t syscall1 )
 	LoadMapFile( qvm, vm->name );
 	vm->type = VM_BYTECODE;
 	vm->hInst = qvm;
+
+#ifdef QVM_JIT
+	if ( (int)sv_qvmjit.value && !QVM_JITCompile( qvm ) )
+		qvm->jit_failed = true;
+#endif
 	return true;
 }
 
@@ -485,6 +508,7 @@ vm_t   *VM_Load( vm_t * vm, vm_type_t type, char *name, sys_call_t syscall1, sys
 		break;
 	}
 
+	PR_ProfProgsChanged();
 	VM_PrintInfo(vm);
 	return vm;
 }
@@ -504,6 +528,20 @@ int VM_Call( vm_t * vm, int command, int arg0, int arg1, int arg2, int arg3, int
 	case VM_NATIVE:
 		return vm->vmMain( command, arg0, arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8, arg9, arg10, arg11 );
 	case VM_BYTECODE:
+#ifdef QVM_JIT
+		// the profilers only work with the interpreter
+		if ( (int)sv_qvmjit.value && !(int)sv_enableprofile.value && !pr_profiling )
+		{
+			qvm_t *qvm = (qvm_t*) vm->hInst;
+
+			if ( !qvm->jit && !qvm->jit_failed && !QVM_JITCompile( qvm ) )
+				qvm->jit_failed = true;
+
+			if ( qvm->jit )
+				return QVM_JITExec( qvm, command, arg0, arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8, arg9,
+				                    arg10, arg11 );
+		}
+#endif
 		return QVM_Exec( (qvm_t*) vm->hInst, command, arg0, arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8, arg9, arg10,
 		                 arg11 );
 	case VM_NONE:
@@ -634,6 +672,13 @@ int QVM_Exec( register qvm_t * qvm, int command, int arg0, int arg1, int arg2, i
 		//FIXME check last exit REGISTERS
 		qvm->LP = qvm->len_ds - sizeof(int);
 	}
+	if ( pr_profiling )
+	{
+		// an error may have left calls on the profiler stack
+		if ( !qvm->reenter )
+			PR_ProfResetStack();
+		PR_ProfEnter( PROF_QVM, 0 );
+	}
 	if ( qvm->reenter++ > MAX_vmMain_Call )
 		QVM_RunError( qvm, "QVM_Exec MAX_vmMain_Call reached");
 
@@ -724,6 +769,8 @@ int QVM_Exec( register qvm_t * qvm, int command, int arg0, int arg1, int arg2, i
 				QVM_RunError( qvm, "QVM Stack underflow on leave at %8x", qvm->PC );
 #endif
 			qvm->PC = STACK_INT( 0 );
+			if ( pr_profiling )
+				PR_ProfLeave();
 #ifdef QVM_PROFILE
 			if((int)sv_enableprofile.value)
 			{
@@ -742,12 +789,21 @@ int QVM_Exec( register qvm_t * qvm, int command, int arg0, int arg1, int arg2, i
 			ivar = opStack[qvm->SP--]._int;
 			if ( ivar < 0 )
 			{
-				ivar = trap_Call( qvm, -ivar - 1 );
+				if ( pr_profiling )
+				{
+					PR_ProfEnter( PROF_SYSCALL, -ivar - 1 );
+					ivar = trap_Call( qvm, -ivar - 1 );
+					PR_ProfLeave();
+				}
+				else
+					ivar = trap_Call( qvm, -ivar - 1 );
 				opStack[qvm->SP]._int = ivar;
 			}
 			else
 			{
 				qvm->PC = ivar;
+				if ( pr_profiling )
+					PR_ProfEnter( PROF_QVM, ivar );
 #ifdef QVM_PROFILE
 				if((int)sv_enableprofile.value)
 					profile_func = ProfileEnterFunction(ivar);
@@ -1110,6 +1166,83 @@ int QVM_Exec( register qvm_t * qvm, int command, int arg0, int arg1, int arg2, i
 	qvm->reenter--;
 	return ivar;
 }
+/*
+============
+VM_Bench_f
+
+Runs the mod's StartFrame through the interpreter and the native code.
+The calls run the live game, so nobody may be on the server.
+============
+*/
+void VM_Bench_f( void )
+{
+	qvm_t *qvm;
+	client_t *cl;
+	int i, frames;
+	double start, interp;
+#ifdef QVM_JIT
+	double native;
+#endif
+
+	if ( !sv_vm || sv_vm->type != VM_BYTECODE || sv.state != ss_active )
+	{
+		Con_Printf( "sv_qvmbench: no QVM mod running\n" );
+		return;
+	}
+
+	for ( i = 0, cl = svs.clients; i < MAX_CLIENTS; i++, cl++ )
+	{
+		if ( cl->state != cs_free && cl->state != cs_zombie )
+		{
+			Con_Printf( "sv_qvmbench: the calls run the game, not with clients connected\n" );
+			return;
+		}
+	}
+
+	qvm = (qvm_t*) sv_vm->hInst;
+	frames = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 1000;
+	frames = bound( 1, frames, 100000 );
+
+#ifdef QVM_JIT
+	if ( !qvm->jit && !QVM_JITCompile( qvm ) )
+	{
+		Con_Printf( "sv_qvmbench: couldn't compile %s\n", sv_vm->name );
+		return;
+	}
+#endif
+
+	start = Sys_DoubleTime();
+	for ( i = 0; i < frames; i++ )
+	{
+		pr_global_struct->self = EDICT_TO_PROG( sv.edicts );
+		pr_global_struct->other = EDICT_TO_PROG( sv.edicts );
+		pr_global_struct->time = sv.time;
+		QVM_Exec( qvm, GAME_START_FRAME, (int) (sv.time * 1000), 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 );
+	}
+	interp = Sys_DoubleTime() - start;
+
+	Con_Printf( "%d StartFrame calls\n", frames );
+	Con_Printf( "interpreter : %8.3f ms (%.2f us/call)\n", interp * 1000, interp * 1000000 / frames );
+
+#ifdef QVM_JIT
+	start = Sys_DoubleTime();
+	for ( i = 0; i < frames; i++ )
+	{
+		pr_global_struct->self = EDICT_TO_PROG( sv.edicts );
+		pr_global_struct->other = EDICT_TO_PROG( sv.edicts );
+		pr_global_struct->time = sv.time;
+		QVM_JITExec( qvm, GAME_START_FRAME, (int) (sv.time * 1000), 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 );
+	}
+	native = Sys_DoubleTime() - start;
+
+	Con_Printf( "native code : %8.3f ms (%.2f us/call)\n", native * 1000, native * 1000000 / frames );
+	if ( native > 0 )
+		Con_Printf( "speedup     : %8.2fx\n", interp / native );
+#else
+	Con_Printf( "native code : not available on this platform\n" );
+#endif
+}
+
 /*
   QVM Debug stuff
 */
@@ -28,6 +28,11 @@
 #define QVM_DATA_PROTECTION
 #define QVM_PROFILE
 
+// translate bytecode to native code
+#if defined(__x86_64__) && defined(__linux__)
+#define QVM_JIT
+#endif
+
 #ifdef _WIN32
 #define EXPORT_FN __cdecl
 #else
@@ -207,6 +212,8 @@ typedef struct symbols_s
 	char name[1];
 }symbols_t;
 
+typedef struct qvm_jit_s qvm_jit_t;
+
 typedef struct {
 	// segments
 	qvm_instruction_t *cs;
@@ -228,6 +235,9 @@ typedef struct {
 	int	reenter;
 	symbols_t* sym_info;
 	sys_callex_t syscall;
+
+	qvm_jit_t *jit;		// native code, NULL if not compiled
+	qbool	jit_failed;	// don't try to compile again
 } qvm_t;
 
 
@@ -271,6 +281,16 @@ vm_t* VM_Load(vm_t *vm, vm_type_t type, char *name,sys_call_t syscall,sys_callex
 extern int VM_Call(vm_t *vm, int /*command*/, int /*arg0*/, int , int , int , int , int , 
 				int , int , int , int , int , int /*arg11*/);
 void  QVM_StackTrace( qvm_t * qvm );
+symbols_t* QVM_FindName( qvm_t * qvm, int off );
+void  QVM_RunError( qvm_t * qvm, char *error, ... );
 void VM_PrintInfo( vm_t * vm);
 
+#ifdef QVM_JIT
+qbool QVM_JITCompile( qvm_t * qvm );
+void  QVM_JITFree( qvm_t * qvm );
+int   QVM_JITExec( qvm_t * qvm, int command, int arg0, int arg1, int arg2, int arg3,
+                   int arg4, int arg5, int arg6, int arg7, int arg8, int arg9, int arg10, int arg11 );
+#endif
+void VM_Bench_f( void );
+
 #endif /* !__PR2_VM_H__ */
@@ -1119,6 +1119,7 @@ void PF_strunzone (void)
 	if (pr_newstrtbl[num] == pr_strings)
 		return;	// allow multiple strunzone on the same string (like free in C)
 
+	PR_ReleaseString(pr_newstrtbl[num]);
 	Q_free(pr_newstrtbl[num]);
 	pr_newstrtbl[num] = pr_strings;
 }
@@ -1131,6 +1132,7 @@ void PF_clear_strtbl(void)
 	{
 		if (pr_newstrtbl[i] && pr_newstrtbl[i] != pr_strings)
 		{
+			PR_ReleaseString(pr_newstrtbl[i]);
 			Q_free(pr_newstrtbl[i]);
 			pr_newstrtbl[i] = NULL;
 		}
@@ -1244,7 +1246,10 @@ void PF_forcedemoframe (void)
 {
 	demo.forceFrame = 1;
 	if (G_FLOAT(OFS_PARM0) == 1)
+	{
+		SV_InvalidateEntityVisibility(); // we are in the middle of a frame
 		SV_SendDemoMessage();
+	}
 }
 
 
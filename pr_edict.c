@@ -1209,7 +1209,8 @@ void PR_LoadProgs (void)
 	pr_fielddefs = (ddef_t *)((byte *)progs + progs->ofs_fielddefs);
 	pr_statements = (dstatement_t *)((byte *)progs + progs->ofs_statements);
 
-	num_prstr = 0;
+	PR_ClearStringTable ();
+	PR_ProfProgsChanged ();
 
 	pr_global_struct = (globalvars_t *)((byte *)progs + progs->ofs_globals);
 	pr_globals = (float *)pr_global_struct;
@@ -1258,6 +1259,8 @@ void PR_LoadProgs (void)
 	PR_InitPatchTables();
 #endif
 
+	PR_TranslateProgs ();
+
 	// find optional QC-exported functions
 	SpectatorConnect = ED_FindFunctionOffset ("SpectatorConnect");
 	SpectatorThink = ED_FindFunctionOffset ("SpectatorThink");
@@ -1285,11 +1288,13 @@ void PR_Init (void)
 {
 	Cvar_Register(&sv_progsname);
 	Cvar_Register(&sv_forcenqprogs);
+	Cvar_Register(&sv_progsthreaded);
 
 	Cmd_AddCommand ("edict", ED_PrintEdict_f);
 	Cmd_AddCommand ("edicts", ED_PrintEdicts);
 	Cmd_AddCommand ("edictcount", ED_Count);
 	Cmd_AddCommand ("profile", PR_Profile_f);
+	Cmd_AddCommand ("pr_profile", PR_Prof_f);
 
 	memset(pr_newstrtbl, 0, sizeof(pr_newstrtbl));
 	//	PR_CleanLogText_Init();
@@ -44,6 +44,13 @@ int			pr_xstatement;
 
 int			pr_argc;
 
+cvar_t		sv_progsthreaded = {"sv_progsthreaded", "1"};
+
+// the threaded code interpreter needs computed gotos
+#ifdef __GNUC__
+#define PR_THREADED
+#endif
+
 char *pr_opnames[] =
     {
         "DONE",
@@ -318,6 +325,10 @@ int PR_EnterFunction (dfunction_t *f)
 	}
 
 	pr_xfunction = f;
+
+	if (pr_profiling)
+		PR_ProfEnter (PROF_PROGS, f - pr_functions);
+
 	return f->first_statement - 1; // offset the s++
 }
 
@@ -333,6 +344,9 @@ int PR_LeaveFunction (void)
 	if (pr_depth <= 0)
 		SV_Error ("prog stack underflow");
 
+	if (pr_profiling)
+		PR_ProfLeave ();
+
 	// restore locals from the stack
 	c = pr_xfunction->locals;
 	localstack_used -= c;
@@ -348,6 +362,647 @@ int PR_LeaveFunction (void)
 	return pr_stack[pr_depth].s;
 }
 
+#ifdef PR_THREADED
+/*
+============================================================================
+Threaded code
+
+PR_TranslateProgs turns the statements into prinstr_t when progs are loaded:
+operands become pointers into pr_globals, branch offsets become statement
+numbers, and a few common pairs of statements get a fused opcode. Those are
+run by PR_ExecuteThreaded, which jumps from one handler to the next with
+computed gotos.
+
+The runaway counter and the function profile counts are updated once per
+basic block. A block that could run out of runaway count, and every block
+while tracing, is run a statement at a time with exactly the same
+bookkeeping as PR_ExecuteProgram, so errors happen on the same statement.
+============================================================================
+*/
+
+enum
+{
+	// a comparison and the IF/IFNOT on its result
+	OPX_EQ_F_BRANCH = OP_BITOR + 1,
+	OPX_NE_F_BRANCH,
+	OPX_LE_BRANCH,
+	OPX_GE_BRANCH,
+	OPX_LT_BRANCH,
+	OPX_GT_BRANCH,
+	OPX_EQ_E_BRANCH,
+	OPX_NE_E_BRANCH,
+	OPX_NOT_F_BRANCH,
+	OPX_NOT_ENT_BRANCH,
+	OPX_NOT_FNC_BRANCH,
+
+	// OP_ADDRESS and the STOREP through it
+	OPX_ADDRESS_STOREP,
+	OPX_ADDRESS_STOREP_V,
+
+	OPX_BAD,			// invalid opcode, the number is in jump
+	OPX_NUMOPS
+};
+
+typedef struct
+{
+	eval_t	*a, *b, *c;
+	int		jump;		// branch target
+	int		cost;		// statements in the block starting here, 0 inside blocks
+	short	op;			// possibly fused
+	short	baseop;		// op of this statement alone
+	short	branchif;	// fused branches: jump if the result is true
+} prinstr_t;
+
+static prinstr_t	*pr_code;
+
+// fused opcode for a comparison followed by IF/IFNOT on its result
+static int PR_FusedBranch (int op)
+{
+	switch (op)
+	{
+	case OP_EQ_F:		return OPX_EQ_F_BRANCH;
+	case OP_NE_F:		return OPX_NE_F_BRANCH;
+	case OP_LE:			return OPX_LE_BRANCH;
+	case OP_GE:			return OPX_GE_BRANCH;
+	case OP_LT:			return OPX_LT_BRANCH;
+	case OP_GT:			return OPX_GT_BRANCH;
+	case OP_EQ_E:		return OPX_EQ_E_BRANCH;
+	case OP_NE_E:		return OPX_NE_E_BRANCH;
+	case OP_NOT_F:		return OPX_NOT_F_BRANCH;
+	case OP_NOT_ENT:	return OPX_NOT_ENT_BRANCH;
+	case OP_NOT_FNC:	return OPX_NOT_FNC_BRANCH;
+	default:			return 0;
+	}
+}
+
+/*
+====================
+PR_TranslateProgs
+
+Builds pr_code from pr_statements. Progs with branches out of range keep
+using PR_ExecuteProgram.
+====================
+*/
+void PR_TranslateProgs (void)
+{
+	int i, n, op, target, fused;
+	dstatement_t *st;
+	prinstr_t *in;
+	byte *leader;
+
+	pr_code = NULL;
+	n = progs->numstatements;
+	if (n <= 0)
+		return;
+
+	leader = (byte *) Q_calloc (n + 1, 1);
+	leader[0] = true;
+
+	for (i = 0; i < progs->numfunctions; i++)
+	{
+		if (pr_functions[i].first_statement >= 0 && pr_functions[i].first_statement < n)
+			leader[pr_functions[i].first_statement] = true;
+	}
+
+	for (i = 0, st = pr_statements; i < n; i++, st++)
+	{
+		switch (st->op)
+		{
+		case OP_IF:
+		case OP_IFNOT:
+		case OP_GOTO:
+			target = i + (st->op == OP_GOTO ? st->a : st->b);
+			if (target < 0 || target >= n)
+			{
+				Con_DPrintf ("PR_TranslateProgs: statement %i branches out of range\n", i);
+				Q_free (leader);
+				return;
+			}
+			leader[target] = true;
+			leader[i + 1] = true;
+			break;
+
+		case OP_CALL0: case OP_CALL1: case OP_CALL2:
+		case OP_CALL3: case OP_CALL4: case OP_CALL5:
+		case OP_CALL6: case OP_CALL7: case OP_CALL8:
+		case OP_DONE:
+		case OP_RETURN:
+			leader[i + 1] = true;
+			break;
+		}
+	}
+
+	pr_code = (prinstr_t *) Hunk_AllocName (n * sizeof(prinstr_t), "prcode");
+
+	for (i = 0, st = pr_statements, in = pr_code; i < n; i++, st++, in++)
+	{
+		op = st->op;
+		if (op > OP_BITOR)
+		{
+			in->jump = op;
+			op = OPX_BAD;
+		}
+
+		in->op = in->baseop = op;
+		in->a = (eval_t *) &pr_globals[st->a];
+		in->b = (eval_t *) &pr_globals[st->b];
+		in->c = (eval_t *) &pr_globals[st->c];
+
+		if (op == OP_IF || op == OP_IFNOT)
+			in->jump = i + st->b;
+		else if (op == OP_GOTO)
+			in->jump = i + st->a;
+
+		if (i + 1 >= n || leader[i + 1])
+			continue;
+
+		// fuse with the next statement, which is never a jump target
+		fused = PR_FusedBranch (op);
+		if (fused && (st[1].op == OP_IF || st[1].op == OP_IFNOT) && st[1].a == st->c)
+		{
+			in->op = fused;
+			in->branchif = (st[1].op == OP_IF);
+			in->jump = i + 1 + st[1].b;
+		}
+		else if (op == OP_ADDRESS && st[1].b == st->c
+				 && st[1].op >= OP_STOREP_F && st[1].op <= OP_STOREP_FNC)
+		{
+			in->op = (st[1].op == OP_STOREP_V) ? OPX_ADDRESS_STOREP_V : OPX_ADDRESS_STOREP;
+		}
+	}
+
+	// block costs
+	for (i = 0; i < n; )
+	{
+		int start = i;
+
+		for (i++; i < n && !leader[i]; i++)
+			;
+		pr_code[start].cost = i - start;
+	}
+
+	Q_free (leader);
+}
+
+/*
+====================
+PR_ExecuteThreaded
+
+Same as PR_ExecuteProgram, running pr_code
+====================
+*/
+static void PR_ExecuteThreaded (func_t fnum)
+{
+	static void *dispatch[OPX_NUMOPS] =
+	{
+		[OP_DONE] = &&op_return,
+		[OP_MUL_F] = &&op_mul_f,
+		[OP_MUL_V] = &&op_mul_v,
+		[OP_MUL_FV] = &&op_mul_fv,
+		[OP_MUL_VF] = &&op_mul_vf,
+		[OP_DIV_F] = &&op_div_f,
+		[OP_ADD_F] = &&op_add_f,
+		[OP_ADD_V] = &&op_add_v,
+		[OP_SUB_F] = &&op_sub_f,
+		[OP_SUB_V] = &&op_sub_v,
+		[OP_EQ_F] = &&op_eq_f,
+		[OP_EQ_V] = &&op_eq_v,
+		[OP_EQ_S] = &&op_eq_s,
+		[OP_EQ_E] = &&op_eq_e,
+		[OP_EQ_FNC] = &&op_eq_fnc,
+		[OP_NE_F] = &&op_ne_f,
+		[OP_NE_V] = &&op_ne_v,
+		[OP_NE_S] = &&op_ne_s,
+		[OP_NE_E] = &&op_ne_e,
+		[OP_NE_FNC] = &&op_ne_fnc,
+		[OP_LE] = &&op_le,
+		[OP_GE] = &&op_ge,
+		[OP_LT] = &&op_lt,
+		[OP_GT] = &&op_gt,
+		[OP_LOAD_F] = &&op_load,
+		[OP_LOAD_V] = &&op_load_v,
+		[OP_LOAD_S] = &&op_load,
+		[OP_LOAD_ENT] = &&op_load,
+		[OP_LOAD_FLD] = &&op_load,
+		[OP_LOAD_FNC] = &&op_load,
+		[OP_ADDRESS] = &&op_address,
+		[OP_STORE_F] = &&op_store,
+		[OP_STORE_V] = &&op_store_v,
+		[OP_STORE_S] = &&op_store,
+		[OP_STORE_ENT] = &&op_store,
+		[OP_STORE_FLD] = &&op_store,
+		[OP_STORE_FNC] = &&op_store,
+		[OP_STOREP_F] = &&op_storep,
+		[OP_STOREP_V] = &&op_storep_v,
+		[OP_STOREP_S] = &&op_storep,
+		[OP_STOREP_ENT] = &&op_storep,
+		[OP_STOREP_FLD] = &&op_storep,
+		[OP_STOREP_FNC] = &&op_storep,
+		[OP_RETURN] = &&op_return,
+		[OP_NOT_F] = &&op_not_f,
+		[OP_NOT_V] = &&op_not_v,
+		[OP_NOT_S] = &&op_not_s,
+		[OP_NOT_ENT] = &&op_not_ent,
+		[OP_NOT_FNC] = &&op_not_fnc,
+		[OP_IF] = &&op_if,
+		[OP_IFNOT] = &&op_ifnot,
+		[OP_CALL0] = &&op_call,
+		[OP_CALL1] = &&op_call,
+		[OP_CALL2] = &&op_call,
+		[OP_CALL3] = &&op_call,
+		[OP_CALL4] = &&op_call,
+		[OP_CALL5] = &&op_call,
+		[OP_CALL6] = &&op_call,
+		[OP_CALL7] = &&op_call,
+		[OP_CALL8] = &&op_call,
+		[OP_STATE] = &&op_state,
+		[OP_GOTO] = &&op_goto,
+		[OP_AND] = &&op_and,
+		[OP_OR] = &&op_or,
+		[OP_BITAND] = &&op_bitand,
+		[OP_BITOR] = &&op_bitor,
+		[OPX_EQ_F_BRANCH] = &&opx_eq_f_branch,
+		[OPX_NE_F_BRANCH] = &&opx_ne_f_branch,
+		[OPX_LE_BRANCH] = &&opx_le_branch,
+		[OPX_GE_BRANCH] = &&opx_ge_branch,
+		[OPX_LT_BRANCH] = &&opx_lt_branch,
+		[OPX_GT_BRANCH] = &&opx_gt_branch,
+		[OPX_EQ_E_BRANCH] = &&opx_eq_e_branch,
+		[OPX_NE_E_BRANCH] = &&opx_ne_e_branch,
+		[OPX_NOT_F_BRANCH] = &&opx_not_f_branch,
+		[OPX_NOT_ENT_BRANCH] = &&opx_not_ent_branch,
+		[OPX_NOT_FNC_BRANCH] = &&opx_not_fnc_branch,
+		[OPX_ADDRESS_STOREP] = &&opx_address_storep,
+		[OPX_ADDRESS_STOREP_V] = &&opx_address_storep_v,
+		[OPX_BAD] = &&opx_bad
+	};
+	prinstr_t *ip;
+	eval_t *a, *b, *c, *ptr;
+	dfunction_t *f, *newf;
+	edict_t *ed;
+	int runaway, exitdepth, slow, s, i;
+
+	f = &pr_functions[fnum];
+
+	runaway = 100000;
+	pr_trace = false;
+	slow = false;
+
+	// make a stack frame
+	exitdepth = pr_depth;
+
+	// an error may have left calls on the profiler stack
+	if (pr_profiling && !exitdepth)
+		PR_ProfResetStack ();
+
+	s = PR_EnterFunction (f);
+	ip = pr_code + s + 1;
+
+// every handler ends here, blocks start with their bookkeeping
+#define DISPATCH	a = ip->a; b = ip->b; c = ip->c; if (ip->cost | slow) goto block; goto *dispatch[ip->op]
+#define NEXT		ip++; DISPATCH
+#define JUMP(cond)	if (cond) ip = pr_code + ip->jump; else ip++; DISPATCH
+#define FUSED_JUMP(cond)	if ((cond) == ip->branchif) ip = pr_code + ip->jump; else ip += 2; DISPATCH
+
+	DISPATCH;
+
+block:
+	if (ip->cost)
+	{
+		slow = pr_trace || runaway <= ip->cost;
+		if (!slow)
+		{
+			runaway -= ip->cost;
+			pr_xfunction->profile += ip->cost;
+			// what a runaway error in the next block reports
+			pr_xstatement = ip - pr_code + ip->cost - 1;
+			goto *dispatch[ip->op];
+		}
+	}
+
+	// one statement at a time, like PR_ExecuteProgram
+	if (--runaway == 0)
+		PR_RunError ("runaway loop error");
+
+	pr_xfunction->profile++;
+	pr_xstatement = ip - pr_code;
+
+	if (pr_trace)
+		PR_PrintStatement (pr_statements + pr_xstatement);
+
+	goto *dispatch[ip->baseop];
+
+op_add_f:
+	c->_float = a->_float + b->_float;
+	NEXT;
+op_add_v:
+	c->vector[0] = a->vector[0] + b->vector[0];
+	c->vector[1] = a->vector[1] + b->vector[1];
+	c->vector[2] = a->vector[2] + b->vector[2];
+	NEXT;
+op_sub_f:
+	c->_float = a->_float - b->_float;
+	NEXT;
+op_sub_v:
+	c->vector[0] = a->vector[0] - b->vector[0];
+	c->vector[1] = a->vector[1] - b->vector[1];
+	c->vector[2] = a->vector[2] - b->vector[2];
+	NEXT;
+op_mul_f:
+	c->_float = a->_float * b->_float;
+	NEXT;
+op_mul_v:
+	c->_float = a->vector[0]*b->vector[0]
+	            + a->vector[1]*b->vector[1]
+	            + a->vector[2]*b->vector[2];
+	NEXT;
+op_mul_fv:
+	c->vector[0] = a->_float * b->vector[0];
+	c->vector[1] = a->_float * b->vector[1];
+	c->vector[2] = a->_float * b->vector[2];
+	NEXT;
+op_mul_vf:
+	c->vector[0] = b->_float * a->vector[0];
+	c->vector[1] = b->_float * a->vector[1];
+	c->vector[2] = b->_float * a->vector[2];
+	NEXT;
+op_div_f:
+	c->_float = a->_float / b->_float;
+	NEXT;
+op_bitand:
+	c->_float = (int)a->_float & (int)b->_float;
+	NEXT;
+op_bitor:
+	c->_float = (int)a->_float | (int)b->_float;
+	NEXT;
+
+op_ge:
+	c->_float = a->_float >= b->_float;
+	NEXT;
+op_le:
+	c->_float = a->_float <= b->_float;
+	NEXT;
+op_gt:
+	c->_float = a->_float > b->_float;
+	NEXT;
+op_lt:
+	c->_float = a->_float < b->_float;
+	NEXT;
+op_and:
+	c->_float = a->_float && b->_float;
+	NEXT;
+op_or:
+	c->_float = a->_float || b->_float;
+	NEXT;
+
+op_not_f:
+	c->_float = !a->_float;
+	NEXT;
+op_not_v:
+	c->_float = !a->vector[0] && !a->vector[1] && !a->vector[2];
+	NEXT;
+op_not_s:
+	c->_float = !a->string || !*PR_GetString(a->string);
+	NEXT;
+op_not_fnc:
+	c->_float = !a->function;
+	NEXT;
+op_not_ent:
+	c->_float = (PROG_TO_EDICT(a->edict) == sv.edicts);
+	NEXT;
+
+op_eq_f:
+	c->_float = a->_float == b->_float;
+	NEXT;
+op_eq_v:
+	c->_float = (a->vector[0] == b->vector[0]) &&
+	            (a->vector[1] == b->vector[1]) &&
+	            (a->vector[2] == b->vector[2]);
+	NEXT;
+op_eq_s:
+	c->_float = !strcmp(PR_GetString(a->string), PR_GetString(b->string));
+	NEXT;
+op_eq_e:
+	c->_float = a->_int == b->_int;
+	NEXT;
+op_eq_fnc:
+	c->_float = a->function == b->function;
+	NEXT;
+
+op_ne_f:
+	c->_float = a->_float != b->_float;
+	NEXT;
+op_ne_v:
+	c->_float = (a->vector[0] != b->vector[0]) ||
+	            (a->vector[1] != b->vector[1]) ||
+	            (a->vector[2] != b->vector[2]);
+	NEXT;
+op_ne_s:
+	c->_float = strcmp(PR_GetString(a->string), PR_GetString(b->string));
+	NEXT;
+op_ne_e:
+	c->_float = a->_int != b->_int;
+	NEXT;
+op_ne_fnc:
+	c->_float = a->function != b->function;
+	NEXT;
+
+op_store:
+	b->_int = a->_int;
+	NEXT;
+op_store_v:
+	b->vector[0] = a->vector[0];
+	b->vector[1] = a->vector[1];
+	b->vector[2] = a->vector[2];
+	NEXT;
+
+op_storep:
+	ptr = (eval_t *)((byte *)sv.edicts + b->_int);
+	ptr->_int = a->_int;
+	NEXT;
+op_storep_v:
+	ptr = (eval_t *)((byte *)sv.edicts + b->_int);
+	ptr->vector[0] = a->vector[0];
+	ptr->vector[1] = a->vector[1];
+	ptr->vector[2] = a->vector[2];
+	NEXT;
+
+op_address:
+	ed = PROG_TO_EDICT(a->edict);
+#ifdef PARANOID
+	NUM_FOR_EDICT(ed);		// make sure it's in range
+#endif
+	if (ed == (edict_t *)sv.edicts && sv.state == ss_active)
+	{
+		pr_xstatement = ip - pr_code;
+		PR_RunError ("assignment to world entity");
+	}
+	c->_int = (byte *)((int *)&ed->v + PR_FIELDOFS(b->_int)) - (byte *)sv.edicts;
+	NEXT;
+
+op_load:
+	ed = PROG_TO_EDICT(a->edict);
+#ifdef PARANOID
+	NUM_FOR_EDICT(ed);		// make sure it's in range
+#endif
+	//need for checking 'cmd mmode player N', if N >= 0x10000000 =(signed)=> negative
+	if (b->_int >= 0)
+	{
+		ptr = (eval_t *)((int *)&ed->v + PR_FIELDOFS(b->_int));
+		c->_int = ptr->_int;
+	}
+	else
+		c->_int = 0;
+	NEXT;
+
+op_load_v:
+	ed = PROG_TO_EDICT(a->edict);
+#ifdef PARANOID
+	NUM_FOR_EDICT(ed);		// make sure it's in range
+#endif
+	ptr = (eval_t *)((int *)&ed->v + PR_FIELDOFS(b->_int));
+	c->vector[0] = ptr->vector[0];
+	c->vector[1] = ptr->vector[1];
+	c->vector[2] = ptr->vector[2];
+	NEXT;
+
+op_ifnot:
+	JUMP (!a->_int);
+op_if:
+	JUMP (a->_int);
+op_goto:
+	JUMP (true);
+
+op_call:
+	pr_xstatement = ip - pr_code;
+	pr_argc = ip->baseop - OP_CALL0;
+	if (!a->function)
+		PR_RunError ("NULL function");
+
+	newf = &pr_functions[a->function];
+
+	if (newf->first_statement < 0)
+	{	// negative statements are built in functions
+		i = -newf->first_statement;
+		if (i >= pr_numbuiltins)
+			PR_RunError ("Bad builtin call number");
+		if (pr_profiling)
+		{
+			PR_ProfEnter (PROF_PROGS, newf - pr_functions);
+			pr_builtins[i] ();
+			PR_ProfLeave ();
+		}
+		else
+			pr_builtins[i] ();
+		NEXT;
+	}
+
+	s = PR_EnterFunction (newf);
+	ip = pr_code + s + 1;
+	DISPATCH;
+
+op_return:
+	pr_xstatement = ip - pr_code;
+	pr_globals[OFS_RETURN] = a->vector[0];
+	pr_globals[OFS_RETURN+1] = a->vector[1];
+	pr_globals[OFS_RETURN+2] = a->vector[2];
+
+	s = PR_LeaveFunction ();
+	if (pr_depth == exitdepth)
+		return;		// all done
+	ip = pr_code + s + 1;
+	DISPATCH;
+
+op_state:
+	ed = PROG_TO_EDICT(pr_global_struct->self);
+	ed->v.nextthink = pr_global_struct->time + 0.1;
+	if (a->_float != ed->v.frame)
+	{
+		ed->v.frame = a->_float;
+	}
+	ed->v.think = b->function;
+	NEXT;
+
+opx_eq_f_branch:
+	c->_float = a->_float == b->_float;
+	FUSED_JUMP (c->_int != 0);
+opx_ne_f_branch:
+	c->_float = a->_float != b->_float;
+	FUSED_JUMP (c->_int != 0);
+opx_le_branch:
+	c->_float = a->_float <= b->_float;
+	FUSED_JUMP (c->_int != 0);
+opx_ge_branch:
+	c->_float = a->_float >= b->_float;
+	FUSED_JUMP (c->_int != 0);
+opx_lt_branch:
+	c->_float = a->_float < b->_float;
+	FUSED_JUMP (c->_int != 0);
+opx_gt_branch:
+	c->_float = a->_float > b->_float;
+	FUSED_JUMP (c->_int != 0);
+opx_eq_e_branch:
+	c->_float = a->_int == b->_int;
+	FUSED_JUMP (c->_int != 0);
+opx_ne_e_branch:
+	c->_float = a->_int != b->_int;
+	FUSED_JUMP (c->_int != 0);
+opx_not_f_branch:
+	c->_float = !a->_float;
+	FUSED_JUMP (c->_int != 0);
+opx_not_ent_branch:
+	c->_float = (PROG_TO_EDICT(a->edict) == sv.edicts);
+	FUSED_JUMP (c->_int != 0);
+opx_not_fnc_branch:
+	c->_float = !a->function;
+	FUSED_JUMP (c->_int != 0);
+
+opx_address_storep:
+	ed = PROG_TO_EDICT(a->edict);
+	if (ed == (edict_t *)sv.edicts && sv.state == ss_active)
+	{
+		pr_xstatement = ip - pr_code;
+		PR_RunError ("assignment to world entity");
+	}
+	c->_int = (byte *)((int *)&ed->v + PR_FIELDOFS(b->_int)) - (byte *)sv.edicts;
+	ptr = (eval_t *)((byte *)sv.edicts + ip[1].b->_int);
+	ptr->_int = ip[1].a->_int;
+	ip += 2;
+	DISPATCH;
+
+opx_address_storep_v:
+	ed = PROG_TO_EDICT(a->edict);
+	if (ed == (edict_t *)sv.edicts && sv.state == ss_active)
+	{
+		pr_xstatement = ip - pr_code;
+		PR_RunError ("assignment to world entity");
+	}
+	c->_int = (byte *)((int *)&ed->v + PR_FIELDOFS(b->_int)) - (byte *)sv.edicts;
+	ptr = (eval_t *)((byte *)sv.edicts + ip[1].b->_int);
+	ptr->vector[0] = ip[1].a->vector[0];
+	ptr->vector[1] = ip[1].a->vector[1];
+	ptr->vector[2] = ip[1].a->vector[2];
+	ip += 2;
+	DISPATCH;
+
+opx_bad:
+	pr_xstatement = ip - pr_code;
+	PR_RunError ("Bad opcode %i", ip->jump);
+
+#undef DISPATCH
+#undef NEXT
+#undef JUMP
+#undef FUSED_JUMP
+}
+
+#else
+
+void PR_TranslateProgs (void)
+{
+}
+
+#endif /* PR_THREADED */
+
 /*
 ============================================================================
 PR_ExecuteProgram
@@ -374,6 +1029,14 @@ void PR_ExecuteProgram (func_t fnum)
 		SV_Error ("PR_ExecuteProgram: NULL function");
 	}
 
+#ifdef PR_THREADED
+	if (pr_code && (int)sv_progsthreaded.value)
+	{
+		PR_ExecuteThreaded (fnum);
+		return;
+	}
+#endif
+
 	f = &pr_functions[fnum];
 
 	runaway = 100000;
@@ -382,6 +1045,10 @@ void PR_ExecuteProgram (func_t fnum)
 	// make a stack frame
 	exitdepth = pr_depth;
 
+	// an error may have left calls on the profiler stack
+	if (pr_profiling && !exitdepth)
+		PR_ProfResetStack ();
+
 	s = PR_EnterFunction (f);
 
 	while (1)
@@ -631,7 +1298,14 @@ void PR_ExecuteProgram (func_t fnum)
 				i = -newf->first_statement;
 				if (i >= pr_numbuiltins)
 					PR_RunError ("Bad builtin call number");
-				pr_builtins[i] ();
+				if (pr_profiling)
+				{
+					PR_ProfEnter (PROF_PROGS, newf - pr_functions);
+					pr_builtins[i] ();
+					PR_ProfLeave ();
+				}
+				else
+					pr_builtins[i] ();
 				break;
 			}
 
@@ -673,6 +1347,82 @@ char *pr_newstrtbl[MAX_PRSTR];
 char *pr_strtbl[MAX_PRSTR];
 int num_prstr;
 
+/*
+pr_strtbl is indexed by a pointer keyed hash, open addressing with linear
+probing. Indices handed out to QC never change while the string lives,
+entries of freed strings are put on a free list and reused.
+*/
+#define PR_STRHASH_BITS		11
+#define PR_STRHASH_SIZE		(1 << PR_STRHASH_BITS)	// at most half full
+
+static short pr_strhash[PR_STRHASH_SIZE];	// pr_strtbl index, 0 is empty
+static short pr_strfree[MAX_PRSTR];
+int pr_numstrfree;
+
+int pr_strtbl_lookups;
+int pr_strtbl_probes;
+
+static int PR_StrHash (char *s)
+{
+	return ((unsigned int) (intptr_t) s * 2654435761u) >> (32 - PR_STRHASH_BITS);
+}
+
+// returns the hash slot of s, or the empty slot where it would go
+static int PR_FindStrSlot (char *s)
+{
+	int h, i;
+
+	pr_strtbl_lookups++;
+
+	for (h = PR_StrHash (s); (i = pr_strhash[h]); h = (h + 1) & (PR_STRHASH_SIZE - 1))
+	{
+		pr_strtbl_probes++;
+		if (pr_strtbl[i] == s)
+			break;
+	}
+
+	return h;
+}
+
+void PR_ClearStringTable (void)
+{
+	memset (pr_strhash, 0, sizeof(pr_strhash));
+	pr_numstrfree = 0;
+	num_prstr = 0;
+	pr_strtbl_lookups = pr_strtbl_probes = 0;
+}
+
+/*
+==============
+PR_ReleaseString
+
+s is about to be freed, drop its pr_strtbl entry
+==============
+*/
+void PR_ReleaseString (char *s)
+{
+	int h, i, j, k, home;
+
+	h = PR_FindStrSlot (s);
+	if (!(i = pr_strhash[h]))
+		return;
+
+	pr_strtbl[i] = pr_strings;	// stale references read an empty string
+	pr_strfree[pr_numstrfree++] = i;
+
+	// move following entries back so no probe sequence stops at the hole
+	for (j = (h + 1) & (PR_STRHASH_SIZE - 1); (k = pr_strhash[j]); j = (j + 1) & (PR_STRHASH_SIZE - 1))
+	{
+		home = PR_StrHash (pr_strtbl[k]);
+		if (h <= j ? (home <= h || home > j) : (home <= h && home > j))
+		{
+			pr_strhash[h] = k;
+			h = j;
+		}
+	}
+	pr_strhash[h] = 0;
+}
+
 char *PR_GetString(int num)
 {
 	if (num < 0)
@@ -694,21 +1444,29 @@ char *PR_GetString(int num)
 
 int PR_SetString(char *s)
 {
-	int i;
+	int h, i;
+
+	if (!s)
+		return 0;
 
 	if (s - pr_strings < 0)
 	{
-		for (i = 0; i <= num_prstr; i++)
-			if (pr_strtbl[i] == s)
-				break;
-		if (i < num_prstr)
+		h = PR_FindStrSlot (s);
+		if ((i = pr_strhash[h]))
 			return -i;
-		if (num_prstr == MAX_PRSTR - 1)
-			Sys_Error("MAX_PRSTR");
-		num_prstr++;
-		pr_strtbl[num_prstr] = s;
-		//Con_DPrintf("SET:%d == %s\n", -num_prstr, s);
-		return -num_prstr;
+
+		if (pr_numstrfree)
+			i = pr_strfree[--pr_numstrfree];
+		else
+		{
+			if (num_prstr == MAX_PRSTR - 1)
+				Sys_Error("MAX_PRSTR");
+			i = ++num_prstr;
+		}
+		pr_strtbl[i] = s;
+		pr_strhash[h] = i;
+		//Con_DPrintf("SET:%d == %s\n", -i, s);
+		return -i;
 	}
 	return (int)(s - pr_strings);
 }
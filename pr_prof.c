@@ -0,0 +1,396 @@
+/*
+Copyright (C) 1996-1997 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+/*
+  Call tree profiler for QuakeC and QVM mods
+
+  Every call made by the progs interpreter or the QVM interpreter is
+  recorded in a calling context tree: a node for each distinct call stack,
+  holding the number of calls, the inclusive time and the time spent in the
+  function itself. Builtins and QVM system calls are leaves of the tree.
+
+  The tree can be printed, or saved in the collapsed stack format used by
+  flame graph tools: one "outer;caller;callee <microseconds>" line per stack,
+  with the time spent in the innermost function itself.
+*/
+
+#include "qwsvdef.h"
+
+#define MAX_PROF_NODES	8192
+#define MAX_PROF_DEPTH	256
+#define PROF_NAME_LEN	40
+
+typedef struct
+{
+	int		kind, id;
+	int		parent, child, sibling;
+	int		calls;
+	double	total;			// inclusive time
+	double	self;			// exclusive time
+	char	name[PROF_NAME_LEN];
+} profnode_t;
+
+typedef struct
+{
+	int		node;			// -1 if the call isn't recorded
+	double	start;
+	double	children;		// time spent in callees
+} profframe_t;
+
+qbool		pr_profiling;
+
+static profnode_t	prof_nodes[MAX_PROF_NODES];
+static int			prof_numnodes;
+static profframe_t	prof_stack[MAX_PROF_DEPTH];
+static int			prof_depth;
+static int			prof_overflow;	// calls not pushed because the stack was full
+static int			prof_dropped;	// calls not recorded because there were no free nodes
+static double		prof_started, prof_elapsed;
+
+static void PR_ProfName (int kind, int id, char *name, int size)
+{
+#ifdef USE_PR2
+	symbols_t *sym;
+#endif
+
+	switch (kind)
+	{
+	case PROF_PROGS:
+		strlcpy (name, PR_GetString (pr_functions[id].s_name), size);
+		break;
+
+#ifdef USE_PR2
+	case PROF_QVM:
+		sym = (sv_vm && sv_vm->type == VM_BYTECODE) ? QVM_FindName ((qvm_t *) sv_vm->hInst, id) : NULL;
+		if (sym && sym->off == id)
+			strlcpy (name, sym->name, size);
+		else
+			snprintf (name, size, "qvm_%x", id);
+		break;
+
+	case PROF_SYSCALL:
+		snprintf (name, size, "trap_%d", id);
+		break;
+#endif
+
+	default:
+		snprintf (name, size, "unknown_%d", id);
+		break;
+	}
+}
+
+static int PR_ProfChild (int parent, int kind, int id)
+{
+	profnode_t *n;
+	int i;
+
+	for (i = prof_nodes[parent].child; i; i = prof_nodes[i].sibling)
+	{
+		if (prof_nodes[i].id == id && prof_nodes[i].kind == kind)
+			return i;
+	}
+
+	if (prof_numnodes == MAX_PROF_NODES)
+	{
+		prof_dropped++;
+		return -1;
+	}
+
+	i = prof_numnodes++;
+	n = &prof_nodes[i];
+	memset (n, 0, sizeof(*n));
+	n->kind = kind;
+	n->id = id;
+	n->parent = parent;
+	n->sibling = prof_nodes[parent].child;
+	prof_nodes[parent].child = i;
+	PR_ProfName (kind, id, n->name, sizeof(n->name));
+
+	return i;
+}
+
+void PR_ProfEnter (int kind, int id)
+{
+	profframe_t *frame;
+	int parent;
+
+	if (prof_depth == MAX_PROF_DEPTH)
+	{
+		prof_overflow++;
+		return;
+	}
+
+	parent = prof_depth ? prof_stack[prof_depth - 1].node : 0;
+
+	frame = &prof_stack[prof_depth++];
+	frame->node = parent < 0 ? -1 : PR_ProfChild (parent, kind, id);
+	frame->children = 0;
+	frame->start = Sys_DoubleTime ();
+}
+
+void PR_ProfLeave (void)
+{
+	profframe_t *frame;
+	profnode_t *n;
+	double elapsed;
+
+	if (prof_overflow)
+	{
+		prof_overflow--;
+		return;
+	}
+
+	if (!prof_depth)
+		return;		// profiling was started inside this call
+
+	frame = &prof_stack[--prof_depth];
+	if (frame->node < 0)
+		return;		// its time stays with the caller
+
+	elapsed = Sys_DoubleTime () - frame->start;
+
+	n = &prof_nodes[frame->node];
+	n->calls++;
+	n->total += elapsed;
+	n->self += elapsed - frame->children;
+
+	if (prof_depth)
+		prof_stack[prof_depth - 1].children += elapsed;
+}
+
+/*
+============
+PR_ProfResetStack
+
+Drops calls that never returned, after an error aborted the progs
+============
+*/
+void PR_ProfResetStack (void)
+{
+	prof_depth = prof_overflow = 0;
+}
+
+void PR_ProfClear (void)
+{
+	memset (&prof_nodes[0], 0, sizeof(prof_nodes[0]));
+	strlcpy (prof_nodes[0].name, "root", sizeof(prof_nodes[0].name));
+	prof_numnodes = 1;
+	prof_dropped = 0;
+	prof_elapsed = 0;
+	prof_started = Sys_DoubleTime ();
+	PR_ProfResetStack ();
+}
+
+/*
+============
+PR_ProfProgsChanged
+
+Function numbers mean something else once other progs are loaded. The old
+nodes are kept for the report, but are never matched again.
+============
+*/
+void PR_ProfProgsChanged (void)
+{
+	int i;
+
+	for (i = 1; i < prof_numnodes; i++)
+		prof_nodes[i].kind = PROF_STALE;
+
+	PR_ProfResetStack ();
+}
+
+typedef struct
+{
+	char	*name;
+	int		calls;
+	double	total;
+	double	self;
+} proffunc_t;
+
+static int PR_ProfCompareNames (const void *a, const void *b)
+{
+	return strcmp (prof_nodes[*(int *) a].name, prof_nodes[*(int *) b].name);
+}
+
+static int PR_ProfCompareTotals (const void *a, const void *b)
+{
+	double d = ((proffunc_t *) b)->total - ((proffunc_t *) a)->total;
+
+	return d > 0 ? 1 : d < 0 ? -1 : 0;
+}
+
+// true if a caller of node n is the same function, its time is counted there
+static qbool PR_ProfRecursive (int n)
+{
+	int p;
+
+	for (p = prof_nodes[n].parent; p; p = prof_nodes[p].parent)
+	{
+		if (!strcmp (prof_nodes[p].name, prof_nodes[n].name))
+			return true;
+	}
+
+	return false;
+}
+
+static void PR_ProfPrint (int count)
+{
+	static int order[MAX_PROF_NODES];
+	static proffunc_t funcs[MAX_PROF_NODES];
+	int i, n, numfuncs;
+	proffunc_t *f;
+	double elapsed;
+
+	if (prof_numnodes <= 1)
+	{
+		Con_Printf ("No profile recorded\n");
+		return;
+	}
+
+	elapsed = prof_elapsed + (pr_profiling ? Sys_DoubleTime () - prof_started : 0);
+
+	// merge the nodes of each function
+	for (i = 1; i < prof_numnodes; i++)
+		order[i - 1] = i;
+	qsort (order, prof_numnodes - 1, sizeof(order[0]), PR_ProfCompareNames);
+
+	numfuncs = 0;
+	f = NULL;
+	for (i = 0; i < prof_numnodes - 1; i++)
+	{
+		n = order[i];
+		if (!f || strcmp (f->name, prof_nodes[n].name))
+		{
+			f = &funcs[numfuncs++];
+			f->name = prof_nodes[n].name;
+			f->calls = 0;
+			f->total = f->self = 0;
+		}
+
+		f->calls += prof_nodes[n].calls;
+		f->self += prof_nodes[n].self;
+		if (!PR_ProfRecursive (n))
+			f->total += prof_nodes[n].total;
+	}
+
+	qsort (funcs, numfuncs, sizeof(funcs[0]), PR_ProfCompareTotals);
+
+	Con_Printf ("%.1f seconds profiled, %d call stacks", elapsed, prof_numnodes - 1);
+	if (prof_dropped)
+		Con_Printf (", %d calls not recorded", prof_dropped);
+	Con_Printf ("\n");
+
+	Con_Printf ("  incl ms   self ms    calls  function\n");
+	for (i = 0; i < numfuncs && i < count; i++)
+	{
+		Con_Printf ("%9.2f %9.2f %8d  %s\n", funcs[i].total * 1000, funcs[i].self * 1000,
+					funcs[i].calls, funcs[i].name);
+	}
+}
+
+static void PR_ProfSave (char *filename)
+{
+	static int path[MAX_PROF_DEPTH + 1];
+	char name[MAX_OSPATH];
+	int i, j, depth, lines;
+	FILE *f;
+
+	if (prof_numnodes <= 1)
+	{
+		Con_Printf ("No profile recorded\n");
+		return;
+	}
+
+	if (snprintf (name, sizeof(name), "%s/%s", com_gamedir, filename) >= sizeof(name))
+	{
+		Con_Printf ("Profile file name too long\n");
+		return;
+	}
+	COM_ForceExtensionEx (name, ".txt", sizeof(name));
+
+	if (!(f = fopen (name, "w")))
+	{
+		Con_Printf ("Couldn't open %s\n", name);
+		return;
+	}
+
+	lines = 0;
+	for (i = 1; i < prof_numnodes; i++)
+	{
+		if ((int) (prof_nodes[i].self * 1000000) <= 0)
+			continue;
+
+		depth = 0;
+		for (j = i; j && depth < MAX_PROF_DEPTH; j = prof_nodes[j].parent)
+			path[depth++] = j;
+
+		while (depth--)
+			fprintf (f, depth ? "%s;" : "%s", prof_nodes[path[depth]].name);
+		fprintf (f, " %d\n", (int) (prof_nodes[i].self * 1000000));
+		lines++;
+	}
+
+	fclose (f);
+	Con_Printf ("Wrote %d call stacks to %s\n", lines, name);
+}
+
+/*
+============
+PR_Prof_f
+
+pr_profile <start | stop | print [count] | save <file>>
+============
+*/
+void PR_Prof_f (void)
+{
+	char *cmd = Cmd_Argv (1);
+
+	if (!strcmp (cmd, "start"))
+	{
+#ifdef USE_PR2
+		if (sv_vm && sv_vm->type == VM_NATIVE)
+			Con_Printf ("Native game modules can't be profiled\n");
+#endif
+		PR_ProfClear ();
+		pr_profiling = true;
+		Con_Printf ("Profiling started\n");
+	}
+	else if (!strcmp (cmd, "stop"))
+	{
+		if (!pr_profiling)
+			return;
+
+		pr_profiling = false;
+		prof_elapsed += Sys_DoubleTime () - prof_started;
+		PR_ProfResetStack ();
+		Con_Printf ("Profiling stopped\n");
+	}
+	else if (!strcmp (cmd, "print"))
+	{
+		PR_ProfPrint (Cmd_Argc () > 2 ? atoi (Cmd_Argv (2)) : 20);
+	}
+	else if (!strcmp (cmd, "save") && Cmd_Argc () == 3)
+	{
+		PR_ProfSave (Cmd_Argv (2));
+	}
+	else
+	{
+		Con_Printf ("Usage: %s <start | stop | print [count] | save <file>>\n", Cmd_Argv (0));
+	}
+}
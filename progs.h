@@ -87,6 +87,7 @@ extern	int		pr_edict_size;	// in bytes
 extern	int		pr_teamfield;
 extern	cvar_t		sv_progsname; 
 extern	cvar_t		sv_forcenqprogs; 
+extern	cvar_t		sv_progsthreaded;
 
 //============================================================================
 
@@ -204,10 +205,32 @@ int ED_FindFieldOffset (char *field);
 extern char *pr_strtbl[MAX_PRSTR];
 extern char *pr_newstrtbl[MAX_PRSTR];
 extern int num_prstr;
+extern int pr_numstrfree, pr_strtbl_lookups, pr_strtbl_probes;
 
 char *PR_GetString(int num);
 int PR_SetString(char *s);
 int PR_SetTmpString(char *s);
+void PR_ReleaseString(char *s);
+void PR_TranslateProgs(void);
+void PR_ClearStringTable(void);
+
+// pr_prof.c
+typedef enum
+{
+	PROF_STALE = -1,	// from progs that are no longer loaded
+	PROF_PROGS,			// progs function number
+	PROF_QVM,			// QVM code offset
+	PROF_SYSCALL		// QVM system call number
+} profkind_t;
+
+extern qbool pr_profiling;
+
+void PR_ProfEnter (int kind, int id);
+void PR_ProfLeave (void);
+void PR_ProfResetStack (void);
+void PR_ProfClear (void);
+void PR_ProfProgsChanged (void);
+void PR_Prof_f (void);
 
 // pr_cmds.c
 void PR_InitBuiltins (void);
@@ -390,6 +390,8 @@ typedef struct mvddest_s
 	int cacheused;
 	int maxcachesize;
 
+	struct demowriter_s *writer; // DEST_FILE written in the background
+
 	unsigned int totalsize;
 
 // { used by QTV
@@ -402,6 +404,10 @@ typedef struct mvddest_s
 
 	char			qtvname[64];
 	qtvuser_t		*qtvuserlist;
+
+	struct qtvrecord_s *streamrec;	// position in the data shared by all streams, NULL if not there
+	int				streamofs;
+	qbool			resync;			// too far behind, skip to the end and send the gamestate again
 // }
 
 	struct mvddest_s *nextdest;
@@ -456,13 +462,29 @@ typedef struct
 	double			demo;
 	int				count;
 	int				packets;
+	int				multicasts;
+	int				multicast_recipients;
 
 	double			latched_active;
 	double			latched_idle;
 	double			latched_demo;
 	int				latched_packets;
+	int				latched_multicasts;
+	int				latched_multicast_recipients;
 } svstats_t;
 
+// parts of SV_Frame timed by sv_frametime.c
+typedef enum
+{
+	SVPHASE_FRAME,
+	SVPHASE_READPACKETS,
+	SVPHASE_PHYSICS,
+	SVPHASE_SENDMESSAGES,
+	SVPHASE_DEMO,
+	SVPHASE_QTV,
+	SVPHASE_NUM
+} svphase_t;
+
 // MAX_CHALLENGES is made large to prevent a denial
 // of service attack that could cycle all of them
 // out before legitimate users connected
@@ -800,6 +822,7 @@ void SV_BroadcastPrintf (int level, char *fmt, ...);
 void SV_BroadcastPrintfEx (int level, int flags, char *fmt, ...);
 void SV_BroadcastCommand (char *fmt, ...);
 void SV_SendClientMessages (void);
+void SV_SnapshotBench_f (void);
 void SV_SendDemoMessage(void);
 void SV_SendMessagesToAll (void);
 void SV_FindModelNumbers (void);
@@ -822,6 +845,11 @@ void SV_SendServerInfoChange (char *key, char *value);
 // sv_ents.c
 //
 void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder);
+void SV_InvalidateEntityVisibility (void);
+void SV_PrepareClientVisibility (client_t *client);
+void SV_ResetDeltaStats (void);
+void SV_PrintDeltaStats (void);
+void SV_DeltaStats_f (void);
 
 //
 // sv_nchan.c
@@ -900,6 +928,9 @@ char *SV_MVDNum(int num);
 //
 
 char	*SV_PrintTeams (void);
+void	SV_DemoTxtName (char *name);
+void	Run_sv_demotxt (const char *dest_name, const char *dest_path, qbool destroyfiles);
+void	Run_sv_onrecordfinish (const char *dest_name, const char *dest_path, qbool destroyfiles);
 void	Run_sv_demotxt_and_sv_onrecordfinish (const char *dest_name, const char *dest_path, qbool destroyfiles);
 qbool	SV_DirSizeCheck (void);
 char	*SV_CleanName (unsigned char *name);
@@ -920,6 +951,25 @@ void	SV_MVDInfoRemove_f (void);
 void	SV_MVDInfo_f (void);
 void	SV_LastScores_f (void);
 
+//
+// sv_demo_async.c
+//
+
+typedef struct demowriter_s demowriter_t;
+
+extern cvar_t	sv_demoAsync;
+extern cvar_t	sv_demoGzip;
+
+qbool	SV_DemoWriterWanted (void);
+demowriter_t *SV_DemoWriterOpen (char *filename);
+qbool	SV_DemoWriterWrite (demowriter_t *w, void *data, int len);
+qbool	SV_DemoWriterFlush (demowriter_t *w);
+void	SV_DemoWriterClose (demowriter_t *w, char *removepath);
+void	SV_DemoWriterOnFinish (demowriter_t *w, const char *name, const char *path);
+void	SV_DemoWritersFrame (void);
+void	SV_DemoWritersWait (void);
+void	SV_DemoWriter_Init (void);
+
 //
 // sv_demo_qtv.c
 //
@@ -936,6 +986,10 @@ void SV_MVDCloseStreams(void);
 void SV_QTV_Init(void);
 
 void DemoWriteQTV (sizebuf_t *msg);
+void DemoWriteStreams (void *data, int len);
+void QTV_EndStreamRecord (void);
+void QTV_FlushStream (mvddest_t *d);
+void QTV_LeaveStream (mvddest_t *d);
 void QTVsv_FreeUserList(mvddest_t *d);
 
 //
@@ -962,5 +1016,36 @@ void Master_Heartbeat (void);
 void SV_SaveGame_f (void); 
 void SV_LoadGame_f (void); 
 
+// sv_frametime.c
+double SV_PhaseClock (void);
+void SV_AddPhaseTime (svphase_t phase, double seconds);
+void SV_FrameTimesFrame (void);
+void SV_ResetFrameTimes (void);
+void SV_PrintFrameTimes (void);
+void SV_FrameTimes_Init (void);
+
+// sv_loadtest.c
+void SV_LoadTestFrame (double frametime);
+void SV_LoadTest_Init (void);
+
+// sv_iptrie.c
+typedef struct
+{
+	struct ipnode_s	*root;
+	int				keylen;		// bytes, 4 for IPv4
+	int				count;
+} iptrie_t;
+
+void IPTrie_Clear (iptrie_t *t);
+void IPTrie_Insert (iptrie_t *t, const byte *key, const byte *mask, int value);
+int IPTrie_Match (iptrie_t *t, const byte *ip);
+void SV_IPFilterBench_f (void);
+
+// sv_download.c
+vfsfile_t *SV_OpenDownload (char *name);
+void SV_DownloadServed (int bytes);
+void SV_FlushDownloadCache (void);
+void SV_Download_Init (void);
+
 
 #endif /* !__SERVER_H__ */
@@ -1179,6 +1179,19 @@ void SV_Status_f (void)
 				(int)avg,
 				pak, num_prstr);
 
+	Con_Printf ("qc string table             : %d entries (%.2f probes/lookup)\n",
+				num_prstr - pr_numstrfree,
+				pr_strtbl_lookups ? (float)pr_strtbl_probes / pr_strtbl_lookups : 0);
+
+	Con_Printf ("multicasts/frame            : %5.2f (%5.2f recipients)\n",
+				(float)svs.stats.latched_multicasts / STATFRAMES,
+				(float)svs.stats.latched_multicast_recipients / STATFRAMES);
+
+	if (net_batchstats.recv_calls || net_batchstats.send_calls)
+		Con_Printf ("packets/syscall (in/out)    : %5.2f / %5.2f\n",
+					net_batchstats.recv_calls ? (float)net_batchstats.recv_packets / net_batchstats.recv_calls : 0,
+					net_batchstats.send_calls ? (float)net_batchstats.send_packets / net_batchstats.send_calls : 0);
+
 	switch (sv_redirected)
 	{
 		case RD_MOD:
@@ -119,20 +119,26 @@ void DestClose (mvddest_t *d, qbool destroyfiles)
 {
 	char path[MAX_OSPATH];
 
+	snprintf(path, MAX_OSPATH, "%s/%s/%s", fs_gamedir, d->path, d->name);
+
 	if (d->cache)
 		Q_free(d->cache);
 	if (d->file)
 		fclose(d->file);
+	if (d->writer)
+		SV_DemoWriterClose(d->writer, destroyfiles ? path : NULL); // it removes the file when done
 	if (d->socket)
 		closesocket(d->socket);
+	if (d->streamrec)
+		QTV_LeaveStream(d);
 	if (d->qtvuserlist)
 		QTVsv_FreeUserList(d);
 
 	if (destroyfiles)
 	{
-		snprintf(path, MAX_OSPATH, "%s/%s/%s", fs_gamedir, d->path, d->name);
-		Sys_remove(path);
-		strlcpy(path + strlen(path) - 3, "txt", MAX_OSPATH - strlen(path) + 3);
+		if (!d->writer)
+			Sys_remove(path);
+		SV_DemoTxtName(path);
 		Sys_remove(path);
 	}
 
@@ -147,6 +153,8 @@ void DestFlush (qbool compleate)
 	int len;
 	mvddest_t *d, *t;
 
+	SV_DemoWritersFrame();
+
 	if (!demo.dest)
 		return;
 
@@ -164,12 +172,20 @@ void DestFlush (qbool compleate)
 		}
 	}
 
+	QTV_EndStreamRecord();
+
 	for (d = demo.dest; d; d = d->nextdest)
 	{
 		switch(d->desttype)
 		{
 		case DEST_FILE:
-			fflush (d->file);
+			if (!d->writer)
+				fflush (d->file);
+			else if (!SV_DemoWriterFlush(d->writer))
+			{
+				Sys_Printf("DestFlush: demo writer error\n");
+				d->error = true;
+			}
 			break;
 
 		case DEST_BUFFEREDFILE:
@@ -188,40 +204,7 @@ void DestFlush (qbool compleate)
 			break;
 
 		case DEST_STREAM:
-			if (d->io_time + qtv_streamtimeout.value <= Sys_DoubleTime())
-			{
-				// problem what send() have internal buffer, so send() success some time even peer side does't read,
-				// this may take some time before internal buffer overflow and timeout trigger, depends of buffer size.
-				Sys_Printf("DestFlush: stream timeout\n");
-				d->error = true;
-			}
-
-			if (d->cacheused && !d->error)
-			{
-				len = send(d->socket, d->cache, d->cacheused, 0);
-
-				if (len == 0) //client died
-				{
-//					d->error = true;
-					// man says: The calls return the number of characters sent, or -1 if an error occurred.   
-					// so 0 is legal or what?
-				}
-				else if (len > 0) //we put some data through
-				{ //move up the buffer
-					d->cacheused -= len;
-					memmove(d->cache, d->cache+len, d->cacheused);
-
-					d->io_time = Sys_DoubleTime(); // update IO activity
-				}
-				else
-				{ //error of some kind. would block or something
-					if (qerrno != EWOULDBLOCK && qerrno != EAGAIN)
-					{
-						Sys_Printf("DestFlush: error on stream\n");
-						d->error = true;
-					}
-				}
-			}
+			QTV_FlushStream(d);
 			break;
 
 		case DEST_NONE:
@@ -265,6 +248,7 @@ static int DestCloseAllFlush (qbool destroyfiles, qbool mvdonly)
 		if (!mvdonly || d->desttype != DEST_STREAM)
 		{
 			desttype_t dt = d->desttype;
+			demowriter_t *writer = d->writer;
 			char dest_name[sizeof(d->name)];
 			char dest_path[sizeof(d->path)];
 
@@ -276,7 +260,15 @@ static int DestCloseAllFlush (qbool destroyfiles, qbool mvdonly)
 			numclosed++;
 
 			if (dt != DEST_STREAM && dest_name[0]) // ignore stream or empty file name
-				Run_sv_demotxt_and_sv_onrecordfinish (dest_name, dest_path, destroyfiles);
+			{
+				Run_sv_demotxt (dest_name, dest_path, destroyfiles);
+
+				// a background writer may still be busy with the file
+				if (writer && !destroyfiles)
+					SV_DemoWriterOnFinish (writer, dest_name, dest_path);
+				else
+					Run_sv_onrecordfinish (dest_name, dest_path, destroyfiles);
+			}
 		}
 		else
 			prev = &d->nextdest;
@@ -299,6 +291,18 @@ int DemoWriteDest (void *data, int len, mvddest_t *d)
 	switch(d->desttype)
 	{
 		case DEST_FILE:
+			if (d->writer)
+			{
+				if (!SV_DemoWriterWrite(d->writer, data, len))
+				{
+					Sys_Printf("DemoWriteDest: demo writer can't keep up with the server\n");
+					d->error = true;
+					return 0;
+				}
+
+				break;
+			}
+
 			ret = fwrite(data, 1, len, d->file);
 			if (ret != len)
 			{
@@ -335,8 +339,14 @@ static void DemoWrite (void *data, int len) //broadcast to all proxies/mvds
 		if (singledest && singledest != d)
 			continue;
 
+		if (!singledest && d->desttype == DEST_STREAM)
+			continue; // written once for all of them below
+
 		DemoWriteDest(data, len, d);
 	}
+
+	if (!singledest)
+		DemoWriteStreams(data, len);
 }
 
 /*
@@ -769,17 +779,28 @@ qbool SV_MVDWritePackets (int num)
 SV_InitRecord
 ====================
 */
-static mvddest_t *SV_InitRecordFile (char *name)
+static mvddest_t *SV_InitRecordFile (char *demoname)
 {
 	char *s;
 	mvddest_t *dst;
-	FILE *file;
+	FILE *file = NULL;
+	demowriter_t *writer = NULL;
 
 	char path[MAX_OSPATH];
+	char name[MAX_OSPATH];
+
+	strlcpy(name, demoname, sizeof(name));
+#ifdef WITH_ZLIB
+	if ((int)sv_demoGzip.value)
+		strlcat(name, ".gz", sizeof(name));
+#endif
 
 	Con_DPrintf("SV_InitRecordFile: Demo name: \"%s\"\n", name);
-	file = fopen (name, "wb");
-	if (!file)
+	if (SV_DemoWriterWanted())
+		writer = SV_DemoWriterOpen (name);
+	else
+		file = fopen (name, "wb");
+	if (!file && !writer)
 	{
 		Con_Printf ("ERROR: couldn't open \"%s\"\n", name);
 		return NULL;
@@ -787,7 +808,13 @@ static mvddest_t *SV_InitRecordFile (char *name)
 
 	dst = (mvddest_t*) Q_malloc (sizeof(mvddest_t));
 
-	if (!(int)sv_demoUseCache.value)
+	if (writer)
+	{
+		dst->desttype = DEST_FILE;
+		dst->writer = writer;
+		dst->maxcachesize = 0;
+	}
+	else if (!(int)sv_demoUseCache.value)
 	{
 		dst->desttype = DEST_FILE;
 		dst->file = file;
@@ -811,7 +838,7 @@ static mvddest_t *SV_InitRecordFile (char *name)
 	Cvar_SetROM(&serverdemo, dst->name);
 
 	strlcpy(path, name, MAX_OSPATH);
-	strlcpy(path + strlen(path) - 3, "txt", MAX_OSPATH - strlen(path) + 3);
+	SV_DemoTxtName(path);
 
 	if ((int)sv_demotxt.value)
 	{
@@ -1700,6 +1727,7 @@ static void MVD_Init (void)
 	Cvar_Register (&sv_demotxt);
 	Cvar_Register (&sv_demoExtraNames);
 	Cvar_Register (&sv_demoRegexp);
+	SV_DemoWriter_Init ();
 
 	p = COM_CheckParm ("-democache");
 	if (p)
@@ -0,0 +1,387 @@
+/*
+Copyright (C) 1996-1997 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+/*
+  Background MVD file writer
+
+  With sv_demoAsync, demo files are written by a thread of their own. The
+  server frame copies the data into a ring buffer with a single producer and
+  a single consumer, so neither side ever waits for the other. With
+  sv_demoGzip the writer also compresses the demo, which is then saved as
+  .mvd.gz.
+
+  When the disk falls behind and the ring is full, data waits in a spill
+  buffer of sv_demoCacheSize kilobytes. Only when that overflows too is the
+  demo given up; the frame is never blocked.
+
+  Closing a demo hands whatever is left to the writer, which finishes the
+  file on its own. sv_onRecordFinish runs once it is done.
+
+  sv_demoUseCache still records to memory as it always did, sv_demoAsync
+  is ignored then. With sv_demoGzip as well, the demo is compressed in the
+  server frame.
+*/
+
+#include "qwsvdef.h"
+
+cvar_t	sv_demoAsync		= {"sv_demoAsync",			"1"};
+cvar_t	sv_demoAsyncBuffer	= {"sv_demoAsyncBuffer",	"1024"};	// KB
+cvar_t	sv_demoGzip			= {"sv_demoGzip",			"0"};
+
+struct demowriter_s
+{
+	// ring, written by the server thread at head and read by the writer at tail
+	char			*ring;
+	int				size;
+	volatile int	head;
+	volatile int	tail;
+	int				woken;			// head when the writer was last woken
+
+	// server thread only until closing is set, then the writer's
+	char			*spill;
+	int				spillsize;
+	int				spillstart, spillused;
+
+	FILE			*file;
+#ifdef WITH_ZLIB
+	gzFile			gz;
+#endif
+	qbool			threaded;
+	sem_t			wake;
+
+	volatile int	failed;
+	volatile int	closing;
+	volatile int	finished;
+	char			removepath[MAX_OSPATH];	// demo cancelled, remove it when closed
+
+	// sv_onRecordFinish waits for the file to be complete
+	qbool			runscript;
+	char			name[MAX_QPATH];
+	char			path[MAX_QPATH];
+
+	struct demowriter_s *next;		// closing writers
+};
+
+static demowriter_t	*dw_closing;
+
+static qbool DW_Async (void)
+{
+	return (int)sv_demoAsync.value && !(int)sv_demoUseCache.value;
+}
+
+qbool SV_DemoWriterWanted (void)
+{
+	return DW_Async () || (int)sv_demoGzip.value;
+}
+
+static int DW_WriteFile (demowriter_t *w, char *data, int len)
+{
+#ifdef WITH_ZLIB
+	if (w->gz)
+		return gzwrite (w->gz, data, len);
+#endif
+	return fwrite (data, 1, len, w->file);
+}
+
+// writer side, writes everything in the ring
+static void DW_Drain (demowriter_t *w)
+{
+	int head, tail, len;
+
+	head = Sys_AtomicLoad (&w->head);
+	tail = w->tail;
+
+	if (tail == head)
+		return;
+
+	while (tail != head)
+	{
+		len = (head > tail ? head : w->size) - tail;
+
+		if (!w->failed && DW_WriteFile (w, w->ring + tail, len) != len)
+			Sys_AtomicStore (&w->failed, 1);	// keep consuming, the server will drop the demo
+
+		tail = (tail + len) % w->size;
+		Sys_AtomicStore (&w->tail, tail);
+	}
+
+	if (w->file)
+		fflush (w->file);
+}
+
+// writer side, the demo was closed, write what is left and close the file
+static void DW_Finish (demowriter_t *w)
+{
+	int len;
+
+	DW_Drain (w);
+
+	len = w->spillused - w->spillstart;
+	if (len && !w->failed && DW_WriteFile (w, w->spill + w->spillstart, len) != len)
+		w->failed = true;
+
+#ifdef WITH_ZLIB
+	if (w->gz && gzclose (w->gz) != Z_OK)
+		w->failed = true;
+#endif
+	if (w->file)
+		fclose (w->file);
+
+	if (w->removepath[0])
+		Sys_remove (w->removepath);
+
+	Sys_AtomicStore (&w->finished, 1);
+}
+
+static DWORD WINAPI DW_Thread (void *param)
+{
+	demowriter_t *w = (demowriter_t *) param;
+
+	while (1)
+	{
+		Sys_SemWait (&w->wake);
+
+		if (Sys_AtomicLoad (&w->closing))
+			break;
+
+		DW_Drain (w);
+	}
+
+	DW_Finish (w);	// w may be freed once this returns
+	return 0;
+}
+
+/*
+====================
+SV_DemoWriterOpen
+
+Opens the demo file, NULL if it can't be
+====================
+*/
+demowriter_t *SV_DemoWriterOpen (char *filename)
+{
+	demowriter_t *w;
+
+	w = (demowriter_t *) Q_malloc (sizeof(demowriter_t));
+
+#ifdef WITH_ZLIB
+	if (!strcasecmp (COM_FileExtension (filename), "gz"))
+		w->gz = gzopen (filename, "wb");
+	else
+#endif
+		w->file = fopen (filename, "wb");
+
+	if (!w->file
+#ifdef WITH_ZLIB
+		&& !w->gz
+#endif
+		)
+	{
+		Q_free (w);
+		return NULL;
+	}
+
+	w->size = 1024 * bound (64, (int)sv_demoAsyncBuffer.value, 65536);
+	w->ring = (char *) Q_malloc (w->size);
+	w->spillsize = 1024 * (int)sv_demoCacheSize.value;
+
+#ifdef SYS_ATOMICS
+	// without a thread the ring is written out by DestFlush
+	if (DW_Async () && !Sys_SemInit (&w->wake, 0, 0x7fffffff))
+	{
+		if (Sys_CreateThread (DW_Thread, w))
+			w->threaded = true;
+		else
+			Sys_SemDestroy (&w->wake);
+	}
+#endif
+
+	return w;
+}
+
+// server side, free space in the ring
+static int DW_Free (demowriter_t *w)
+{
+	return (Sys_AtomicLoad (&w->tail) - w->head - 1 + w->size) % w->size;
+}
+
+static void DW_Put (demowriter_t *w, char *data, int len)
+{
+	int head = w->head, n;
+
+	n = min (len, w->size - head);
+	memcpy (w->ring + head, data, n);
+	memcpy (w->ring, data + n, len - n);
+
+	Sys_AtomicStore (&w->head, (head + len) % w->size);
+}
+
+/*
+====================
+SV_DemoWriterWrite
+
+Never blocks, returns false if the data doesn't fit anywhere
+====================
+*/
+qbool SV_DemoWriterWrite (demowriter_t *w, void *data, int len)
+{
+	if (w->spillused == w->spillstart && DW_Free (w) >= len)
+	{
+		DW_Put (w, (char *) data, len);
+		return true;
+	}
+
+	// the writer is behind, keep the data in order until the ring has room
+	if (!w->spill)
+		w->spill = (char *) Q_malloc (w->spillsize);
+
+	if (w->spillused + len > w->spillsize && w->spillstart)
+	{
+		memmove (w->spill, w->spill + w->spillstart, w->spillused - w->spillstart);
+		w->spillused -= w->spillstart;
+		w->spillstart = 0;
+	}
+
+	if (w->spillused + len > w->spillsize)
+		return false;
+
+	memcpy (w->spill + w->spillused, data, len);
+	w->spillused += len;
+
+	return true;
+}
+
+/*
+====================
+SV_DemoWriterFlush
+
+Called once per demo frame, false if the file couldn't be written
+====================
+*/
+qbool SV_DemoWriterFlush (demowriter_t *w)
+{
+	int n;
+
+	n = min (DW_Free (w), w->spillused - w->spillstart);
+	if (n > 0)
+	{
+		DW_Put (w, w->spill + w->spillstart, n);
+		w->spillstart += n;
+		if (w->spillstart == w->spillused)
+			w->spillstart = w->spillused = 0;
+	}
+
+	if (!w->threaded)
+		DW_Drain (w);
+	else if (w->woken != w->head)
+	{
+		w->woken = w->head;
+		Sys_SemPost (&w->wake);
+	}
+
+	return !Sys_AtomicLoad (&w->failed);
+}
+
+/*
+====================
+SV_DemoWriterClose
+
+The writer finishes the file in the background. If removepath is given the
+demo was cancelled and the file is removed afterwards.
+====================
+*/
+void SV_DemoWriterClose (demowriter_t *w, char *removepath)
+{
+	if (removepath)
+		strlcpy (w->removepath, removepath, sizeof(w->removepath));
+
+	w->next = dw_closing;
+	dw_closing = w;
+
+	if (!w->threaded)
+	{
+		DW_Finish (w);
+		return;
+	}
+
+	Sys_AtomicStore (&w->closing, 1);
+	Sys_SemPost (&w->wake);
+}
+
+// runs sv_onRecordFinish for the demo once the writer is done with it
+void SV_DemoWriterOnFinish (demowriter_t *w, const char *name, const char *path)
+{
+	w->runscript = true;
+	strlcpy (w->name, name, sizeof(w->name));
+	strlcpy (w->path, path, sizeof(w->path));
+}
+
+/*
+====================
+SV_DemoWritersFrame
+
+Frees the writers that have finished their files
+====================
+*/
+void SV_DemoWritersFrame (void)
+{
+	demowriter_t *w, **prev;
+
+	for (prev = &dw_closing; (w = *prev); )
+	{
+		if (!Sys_AtomicLoad (&w->finished))
+		{
+			prev = &w->next;
+			continue;
+		}
+
+		*prev = w->next;
+
+		if (w->failed)
+			Sys_Printf ("SV_DemoWritersFrame: error writing %s\n", w->name[0] ? w->name : "demo");
+		if (w->threaded)
+			Sys_SemDestroy (&w->wake);
+		if (w->runscript)
+			Run_sv_onrecordfinish (w->name, w->path, false);
+
+		Q_free (w->spill);
+		Q_free (w->ring);
+		Q_free (w);
+	}
+}
+
+// at shutdown, gives the writers a few seconds to finish their files
+void SV_DemoWritersWait (void)
+{
+	double start = Sys_DoubleTime ();
+
+	while (dw_closing && Sys_DoubleTime () - start < 5)
+	{
+		SV_DemoWritersFrame ();
+		if (dw_closing)
+			Sys_MSleep (10);
+	}
+}
+
+void SV_DemoWriter_Init (void)
+{
+	Cvar_Register (&sv_demoAsync);
+	Cvar_Register (&sv_demoAsyncBuffer);
+	Cvar_Register (&sv_demoGzip);
+}
@@ -194,12 +194,24 @@ qbool SV_DirSizeCheck (void)
 	return true;
 }
 
-void Run_sv_demotxt_and_sv_onrecordfinish (const char *dest_name, const char *dest_path, qbool destroyfiles)
+// "x.mvd" or "x.mvd.gz" to "x.txt", in place
+void SV_DemoTxtName (char *name)
+{
+	int len = strlen(name);
+
+	if (len > 3 && !strcasecmp(name + len - 3, ".gz"))
+		name[len -= 3] = 0;
+
+	if (len >= 3)
+		strlcpy(name + len - 3, "txt", 4);
+}
+
+void Run_sv_demotxt (const char *dest_name, const char *dest_path, qbool destroyfiles)
 {
 	char path[MAX_OSPATH];
 
 	snprintf(path, MAX_OSPATH, "%s/%s/%s", fs_gamedir, dest_path, dest_name);
-	strlcpy(path + strlen(path) - 3, "txt", MAX_OSPATH - strlen(path) + 3);
+	SV_DemoTxtName(path);
 
 	if ((int)sv_demotxt.value && !destroyfiles) // dont keep txt's for deleted demos
 	{
@@ -219,6 +231,12 @@ void Run_sv_demotxt_and_sv_onrecordfinish (const char *dest_name, const char *de
 			fclose(f);
 		}
 	}
+}
+
+// must wait until the demo file is complete
+void Run_sv_onrecordfinish (const char *dest_name, const char *dest_path, qbool destroyfiles)
+{
+	char path[MAX_OSPATH];
 
 	if (sv_onrecordfinish.string[0] && !destroyfiles) // dont gzip deleted demos
 	{
@@ -230,7 +248,7 @@ void Run_sv_demotxt_and_sv_onrecordfinish (const char *dest_name, const char *de
 			*p = 0; // strip parameters
 	
 		strlcpy(path, dest_name, MAX_OSPATH);
-		strlcpy(path + strlen(dest_name) - 3, "txt", MAX_OSPATH - strlen(dest_name) + 3);
+		SV_DemoTxtName(path);
 	
 		sv_redirected = RD_NONE; // onrecord script is called always from the console
 		Cmd_TokenizeString(va("script %s \"%s\" \"%s\" \"%s\" %s", sv_onrecordfinish.string, dest_path, dest_name, path, p != NULL ? p+1 : ""));
@@ -244,6 +262,12 @@ void Run_sv_demotxt_and_sv_onrecordfinish (const char *dest_name, const char *de
 	}
 }
 
+void Run_sv_demotxt_and_sv_onrecordfinish (const char *dest_name, const char *dest_path, qbool destroyfiles)
+{
+	Run_sv_demotxt (dest_name, dest_path, destroyfiles);
+	Run_sv_onrecordfinish (dest_name, dest_path, destroyfiles);
+}
+
 char *SV_PrintTeams (void)
 {
 	char			*teams[MAX_CLIENTS], *p;
@@ -1300,7 +1300,6 @@ void DemoWriteQTVTimePad (int msecs)	//broadcast to all proxies
 //broadcast to all proxies
 void DemoWriteQTV (sizebuf_t *msg)
 {
-	mvddest_t		*d;
 	sizebuf_t		mvdheader;
 	byte			mvdheader_buf[6];
 
@@ -1313,13 +1312,345 @@ void DemoWriteQTV (sizebuf_t *msg)
 	//length
 	MSG_WriteLong (&mvdheader, msg->cursize);
 
+	DemoWriteStreams(mvdheader.data, mvdheader.cursize);
+	DemoWriteStreams(msg->data, msg->cursize);
+}
+
+/*
+=============================================================================
+
+SHARED STREAM DATA
+
+Data for all QTV streams is written once into a chain of records, and each
+stream keeps its position in the chain. A record counts the streams that
+still have to send it, and is freed when the last of them is done, so memory
+is bounded by the slowest stream. A record holds the data written between
+two flushes, which always ends on a message boundary.
+
+A stream that falls more than qtv_maxbacklog kilobytes behind is dropped,
+or with qtv_backlogpolicy 1 skips what it missed at the next record and gets
+the gamestate again, as if it had just connected.
+
+Data for one stream only (the initial gamestate) goes to its own cache and
+is sent before the stream joins the chain.
+
+=============================================================================
+*/
+
+cvar_t	qtv_maxbacklog		= {"qtv_maxbacklog",		"1024"};	// KB
+cvar_t	qtv_backlogpolicy	= {"qtv_backlogpolicy",		"0"};		// 0 drop the stream, 1 resync it
+
+#define QTV_MAX_IOV		64
+
+typedef struct qtvrecord_s
+{
+	int					refs;		// streams that haven't sent all of it
+	unsigned int		start;		// stream position of data[0]
+	int					size;
+	int					maxsize;
+	byte				*data;
+	struct qtvrecord_s	*next;
+} qtvrecord_t;
+
+static qtvrecord_t	*qtv_head, *qtv_tail;
+static qbool		qtv_tailopen;	// the tail still takes data
+static int			qtv_joined;		// streams in the chain
+static unsigned int	qtv_streampos;	// end of the data written so far
+
+// frees the records no stream needs any more, they are always at the head
+static void QTV_FreeRecords (void)
+{
+	qtvrecord_t *rec;
+
+	while (qtv_head && !qtv_head->refs && (qtv_head != qtv_tail || !qtv_tailopen))
+	{
+		rec = qtv_head;
+		qtv_head = rec->next;
+		if (rec == qtv_tail)
+			qtv_tail = NULL;
+
+		Q_free (rec->data);
+		Q_free (rec);
+	}
+}
+
+static qtvrecord_t *QTV_OpenRecord (void)
+{
+	qtvrecord_t *rec;
+
+	if (qtv_tail && qtv_tailopen)
+		return qtv_tail;
+
+	rec = (qtvrecord_t *) Q_malloc (sizeof(qtvrecord_t));
+	rec->refs = qtv_joined;
+	rec->start = qtv_streampos;
+	rec->maxsize = 8192;
+	rec->data = (byte *) Q_malloc (rec->maxsize);
+
+	if (qtv_tail)
+		qtv_tail->next = rec;
+	else
+		qtv_head = rec;
+	qtv_tail = rec;
+	qtv_tailopen = true;
+
+	return rec;
+}
+
+// the stream leaves the chain, dropping the data it hasn't sent
+void QTV_LeaveStream (mvddest_t *d)
+{
+	qtvrecord_t *rec, *next;
+
+	if (!d->streamrec)
+		return;
+
+	for (rec = d->streamrec; rec; rec = next)
+	{
+		next = rec->next;
+		rec->refs--;
+	}
+
+	d->streamrec = NULL;
+	d->streamofs = 0;
+	qtv_joined--;
+
+	QTV_FreeRecords ();
+}
+
+/*
+====================
+DemoWriteStreams
+
+Writes to all QTV streams at once
+====================
+*/
+void DemoWriteStreams (void *data, int len)
+{
+	qtvrecord_t *rec;
+	mvddest_t *d;
+
 	for (d = demo.dest; d; d = d->nextdest)
 	{
-		if (d->desttype == DEST_STREAM)
+		if (d->desttype != DEST_STREAM || d->error || d->streamrec)
+			continue;
+
+		// joins at the end of the data
+		rec = QTV_OpenRecord ();
+		rec->refs++;
+		d->streamrec = rec;
+		d->streamofs = rec->size;
+		qtv_joined++;
+	}
+
+	if (!qtv_joined)
+		return;
+
+	rec = QTV_OpenRecord ();
+	if (rec->size + len > rec->maxsize)
+	{
+		rec->maxsize = max (rec->maxsize * 2, rec->size + len);
+		rec->data = (byte *) Q_realloc (rec->data, rec->maxsize);
+	}
+
+	memcpy (rec->data + rec->size, data, len);
+	rec->size += len;
+	qtv_streampos += len;
+}
+
+// sends as much of the chain as the socket takes, returns bytes sent or -1
+static int QTV_SendRecords (mvddest_t *d)
+{
+	qtvrecord_t *rec;
+	int n, ofs;
+#ifdef _WIN32
+	WSABUF iov[QTV_MAX_IOV];
+	DWORD sent;
+#else
+	struct iovec iov[QTV_MAX_IOV];
+	struct msghdr hdr;
+#endif
+	// a stream waiting to resync stops at the end of its current record
+	int maxiov = d->resync ? 1 : QTV_MAX_IOV;
+
+	for (n = 0, rec = d->streamrec, ofs = d->streamofs; rec && n < maxiov; rec = rec->next, ofs = 0)
+	{
+		if (rec->size == ofs)
+			continue;
+
+#ifdef _WIN32
+		iov[n].buf = (char *) rec->data + ofs;
+		iov[n].len = rec->size - ofs;
+#else
+		iov[n].iov_base = rec->data + ofs;
+		iov[n].iov_len = rec->size - ofs;
+#endif
+		n++;
+	}
+
+	if (!n)
+		return 0;
+
+#ifdef _WIN32
+	if (WSASend (d->socket, iov, n, &sent, 0, NULL, NULL) == SOCKET_ERROR)
+		return -1;
+	return sent;
+#else
+	memset (&hdr, 0, sizeof(hdr));
+	hdr.msg_iov = iov;
+	hdr.msg_iovlen = n;
+#ifdef MSG_NOSIGNAL
+	return sendmsg (d->socket, &hdr, MSG_NOSIGNAL);
+#else
+	return sendmsg (d->socket, &hdr, 0);
+#endif
+#endif
+}
+
+// moves the stream len bytes forward, releasing the records it has sent
+static void QTV_AdvanceStream (mvddest_t *d, int len)
+{
+	qtvrecord_t *rec;
+
+	while ((rec = d->streamrec) && len >= rec->size - d->streamofs)
+	{
+		// the open tail may still grow, stay at its end
+		if (!rec->next && rec == qtv_tail && qtv_tailopen)
+			break;
+
+		len -= rec->size - d->streamofs;
+		d->streamrec = rec->next;
+		d->streamofs = 0;
+		rec->refs--;
+	}
+
+	if (!d->streamrec)
+		qtv_joined--;	// sent everything, joins again with the next data
+	else
+		d->streamofs += len;
+
+	QTV_FreeRecords ();
+}
+
+/*
+====================
+QTV_EndStreamRecord
+
+The data written so far is complete, called before the streams are flushed
+====================
+*/
+void QTV_EndStreamRecord (void)
+{
+	qtv_tailopen = false;
+	QTV_FreeRecords ();
+}
+
+static qbool QTV_SendError (void)
+{
+	// would block or something
+	return qerrno != EWOULDBLOCK && qerrno != EAGAIN;
+}
+
+/*
+====================
+QTV_CheckBacklog
+
+Drops a stream too far behind, or marks it for a resync. The stream may
+still be sending its own cache, the records it holds count all the same.
+====================
+*/
+static void QTV_CheckBacklog (mvddest_t *d)
+{
+	unsigned int backlog, limit;
+
+	if (d->error || !d->streamrec)
+		return;
+
+	backlog = qtv_streampos - (d->streamrec->start + d->streamofs);
+	limit = 1024 * max (64, (int)qtv_maxbacklog.value);
+
+	if (backlog > limit && (!(int)qtv_backlogpolicy.value || backlog > 2 * limit))
+	{
+		Sys_Printf("DestFlush: QTV stream %d is %u KB behind, dropped\n", d->id, backlog / 1024);
+		d->error = true;
+		return;
+	}
+
+	if (backlog > limit)
+		d->resync = true;
+}
+
+/*
+====================
+QTV_FlushStream
+====================
+*/
+void QTV_FlushStream (mvddest_t *d)
+{
+	int len;
+
+	if (d->io_time + qtv_streamtimeout.value <= Sys_DoubleTime())
+	{
+		// problem what send() have internal buffer, so send() success some time even peer side does't read,
+		// this may take some time before internal buffer overflow and timeout trigger, depends of buffer size.
+		Sys_Printf("DestFlush: stream timeout\n");
+		d->error = true;
+	}
+
+	QTV_CheckBacklog (d);
+
+	// data of this stream only goes first
+	if (d->cacheused && !d->error)
+	{
+		len = send(d->socket, d->cache, d->cacheused, 0);
+
+		if (len == 0) //client died
 		{
-			DemoWriteDest(mvdheader.data, mvdheader.cursize, d);
-			DemoWriteDest(msg->data, msg->cursize, d);
+//			d->error = true;
+			// man says: The calls return the number of characters sent, or -1 if an error occurred.   
+			// so 0 is legal or what?
+		}
+		else if (len > 0) //we put some data through
+		{ //move up the buffer
+			d->cacheused -= len;
+			memmove(d->cache, d->cache+len, d->cacheused);
+
+			d->io_time = Sys_DoubleTime(); // update IO activity
 		}
+		else if (QTV_SendError())
+		{
+			Sys_Printf("DestFlush: error on stream\n");
+			d->error = true;
+		}
+	}
+
+	if (d->cacheused || d->error || !d->streamrec)
+		return;
+
+	len = QTV_SendRecords (d);
+	if (len > 0)
+	{
+		QTV_AdvanceStream (d, len);
+		d->io_time = Sys_DoubleTime();
+	}
+	else if (len < 0 && QTV_SendError())
+	{
+		Sys_Printf("DestFlush: error on stream\n");
+		d->error = true;
+		return;
+	}
+
+	if (!d->streamrec)
+		return;
+
+	// skip the backlog once the current record is sent, the gamestate brings it up to date
+	if (d->resync && (!d->streamofs || d->streamofs == d->streamrec->size) && sv.mvdrecording)
+	{
+		Con_Printf("QTV stream %d is %u KB behind, resyncing\n", d->id,
+			(qtv_streampos - (d->streamrec->start + d->streamofs)) / 1024);
+		QTV_LeaveStream (d);
+		d->resync = false;
+		SV_MVD_SendInitialGamestate (d);
 	}
 }
 
@@ -1418,6 +1749,8 @@ void SV_QTV_Init(void)
 	Cvar_Register (&qtv_password);
 	Cvar_Register (&qtv_pendingtimeout);
 	Cvar_Register (&qtv_streamtimeout);
+	Cvar_Register (&qtv_maxbacklog);
+	Cvar_Register (&qtv_backlogpolicy);
 
 	Cmd_AddCommand ("qtv_list", Qtv_List_f);
 	Cmd_AddCommand ("qtv_close", Qtv_Close_f);
@@ -0,0 +1,385 @@
+/*
+Copyright (C) 1996-1997 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+/*
+  Download cache
+
+  Files being downloaded are kept in memory, one read-only copy for all the
+  clients downloading them, so a new map fetched by a whole server is read
+  from the disk once rather than a chunk at a time per client. Plain files
+  can be mapped with sv_downloadmmap, otherwise files are read in whole.
+
+  Unused files stay cached until sv_downloadcache megabytes are exceeded. A
+  file that changed on disk, or now comes from another pak, is read again.
+  Note that a mapped file must be replaced, not rewritten in place.
+*/
+
+#include "qwsvdef.h"
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+cvar_t	sv_downloadcache	= {"sv_downloadcache",	"64"};	// MB, 0 disables
+// Mapped files are shared with the disk: a file overwritten or truncated in
+// place while it's being downloaded crashes the server (SIGBUS), so only turn
+// this on when files are always replaced (written elsewhere and renamed).
+cvar_t	sv_downloadmmap		= {"sv_downloadmmap",	"0"};
+
+typedef struct dlcache_s
+{
+	char		name[MAX_QPATH];
+	void		*source;		// search path the file was found in
+	time_t		mtime;			// of files on disk
+	int			len;
+	byte		*data;
+	qbool		mapped;
+	qbool		stale;			// no longer in the list, freed with its last reader
+	int			refs;
+	double		lastused;
+	struct dlcache_s *next;
+} dlcache_t;
+
+typedef struct
+{
+	vfsfile_t	funcs;			// <= must be at top/begining of struct
+	dlcache_t	*entry;
+	unsigned long pos;
+} dlfile_t;
+
+static dlcache_t	*dl_cache;
+static int			dl_cachedbytes;
+
+// stats
+static int			dl_hits, dl_misses, dl_uncached;
+static double		dl_bytes;
+static double		dl_secstart, dl_secbytes, dl_rate, dl_peakrate;
+
+static void DL_Free (dlcache_t *e)
+{
+	dl_cachedbytes -= e->len;
+
+#ifndef _WIN32
+	if (e->mapped)
+		munmap (e->data, e->len);
+	else
+#endif
+		Q_free (e->data);
+
+	Q_free (e);
+}
+
+// takes the entry out of the list, it goes away once nobody reads it
+static void DL_Remove (dlcache_t *e)
+{
+	dlcache_t **prev;
+
+	for (prev = &dl_cache; *prev; prev = &(*prev)->next)
+	{
+		if (*prev == e)
+		{
+			*prev = e->next;
+			break;
+		}
+	}
+
+	if (e->refs)
+		e->stale = true;
+	else
+		DL_Free (e);
+}
+
+// drops unused files, least recently used first, until len more bytes fit
+static void DL_MakeRoom (int len, int limit)
+{
+	dlcache_t *e, *oldest;
+
+	while (dl_cachedbytes + len > limit)
+	{
+		oldest = NULL;
+		for (e = dl_cache; e; e = e->next)
+			if (!e->refs && (!oldest || e->lastused < oldest->lastused))
+				oldest = e;
+
+		if (!oldest)
+			return;
+
+		DL_Remove (oldest);
+	}
+}
+
+static qbool DL_Load (dlcache_t *e, vfsfile_t *vf, char *ospath)
+{
+	int r, ofs;
+
+#ifndef _WIN32
+	if (ospath[0] && (int)sv_downloadmmap.value)
+	{
+		int fd = open (ospath, O_RDONLY);
+
+		if (fd != -1)
+		{
+			void *p = mmap (NULL, e->len, PROT_READ, MAP_SHARED, fd, 0);
+
+			close (fd);
+			if (p != MAP_FAILED)
+			{
+				e->data = (byte *) p;
+				e->mapped = true;
+				return true;
+			}
+		}
+	}
+#endif
+
+	e->data = (byte *) Q_malloc (e->len);
+
+	for (ofs = 0; ofs < e->len; ofs += r)
+	{
+		if ((r = VFS_READ (vf, e->data + ofs, e->len - ofs, NULL)) <= 0)
+		{
+			Q_free (e->data);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//=============================================================================
+
+static int DLFile_ReadBytes (vfsfile_t *file, void *buffer, int bytestoread, vfserrno_t *err)
+{
+	dlfile_t *f = (dlfile_t *) file;
+	int len = f->entry->len;
+
+	bytestoread = bound (0, bytestoread, (int)(len - min (f->pos, len)));
+	memcpy (buffer, f->entry->data + f->pos, bytestoread);
+	f->pos += bytestoread;
+
+	if (err)
+		*err = bytestoread ? VFSERR_NONE : VFSERR_EOF;
+
+	return bytestoread;
+}
+
+static int DLFile_WriteBytes (vfsfile_t *file, const void *buffer, int bytestowrite)
+{
+	return 0;	// read only
+}
+
+static int DLFile_Seek (vfsfile_t *file, unsigned long offset, int whence)
+{
+	dlfile_t *f = (dlfile_t *) file;
+	unsigned long pos;
+
+	switch (whence)
+	{
+		case SEEK_SET: pos = offset; break;
+		case SEEK_CUR: pos = f->pos + offset; break;
+		case SEEK_END: pos = f->entry->len + offset; break;
+		default: return -1;
+	}
+
+	if (pos > (unsigned long) f->entry->len)
+		return -1;
+
+	f->pos = pos;
+	return 0;
+}
+
+static unsigned long DLFile_Tell (vfsfile_t *file)
+{
+	return ((dlfile_t *) file)->pos;
+}
+
+static unsigned long DLFile_GetLen (vfsfile_t *file)
+{
+	return ((dlfile_t *) file)->entry->len;
+}
+
+static void DLFile_Close (vfsfile_t *file)
+{
+	dlfile_t *f = (dlfile_t *) file;
+	dlcache_t *e = f->entry;
+
+	e->lastused = realtime;
+	if (!--e->refs && e->stale)
+		DL_Free (e);
+
+	Q_free (f);
+}
+
+static void DLFile_Flush (vfsfile_t *file)
+{
+}
+
+//=============================================================================
+
+/*
+==================
+SV_OpenDownload
+
+Opens a file to be downloaded, the cached copy if there is one
+==================
+*/
+vfsfile_t *SV_OpenDownload (char *name)
+{
+	char ospath[MAX_OSPATH];
+	int limit = 1024 * 1024 * bound (0, (int)sv_downloadcache.value, 2047);
+	struct stat st;
+	dlcache_t *e, *next;
+	dlfile_t *f;
+	vfsfile_t *vf;
+	void *source;
+	time_t mtime = 0;
+	int len;
+
+	if (!(vf = FS_OpenVFS (name, "rb", FS_ANY)))
+		return NULL;
+
+	len = VFS_GETLEN (vf);
+	if (!limit || len <= 0 || len > limit)
+	{
+		dl_uncached++;
+		return vf;
+	}
+
+	source = FS_FileSource (name, ospath, sizeof(ospath));
+	if (ospath[0] && !stat (ospath, &st))
+		mtime = st.st_mtime;
+
+	for (e = dl_cache; e; e = next)
+	{
+		next = e->next;
+		if (strcmp (e->name, name))
+			continue;
+
+		if (e->source == source && e->len == len && e->mtime == mtime)
+			break;
+
+		DL_Remove (e);	// the file was changed
+	}
+
+	if (e)
+		dl_hits++;
+	else
+	{
+		DL_MakeRoom (len, limit);
+
+		e = (dlcache_t *) Q_malloc (sizeof(dlcache_t));
+		strlcpy (e->name, name, sizeof(e->name));
+		e->source = source;
+		e->mtime = mtime;
+		e->len = len;
+
+		if (!DL_Load (e, vf, ospath))
+		{
+			Q_free (e);
+			VFS_SEEK (vf, 0, SEEK_SET);
+			dl_uncached++;
+			return vf;
+		}
+
+		dl_cachedbytes += len;
+		e->next = dl_cache;
+		dl_cache = e;
+		dl_misses++;
+	}
+
+	f = (dlfile_t *) Q_malloc (sizeof(dlfile_t));
+	f->funcs.ReadBytes = DLFile_ReadBytes;
+	f->funcs.WriteBytes = DLFile_WriteBytes;
+	f->funcs.Seek = DLFile_Seek;
+	f->funcs.Tell = DLFile_Tell;
+	f->funcs.GetLen = DLFile_GetLen;
+	f->funcs.Close = DLFile_Close;
+	f->funcs.Flush = DLFile_Flush;
+	f->funcs.copyprotected = VFS_COPYPROTECTED (vf);
+	f->entry = e;
+
+	e->refs++;
+	e->lastused = realtime;
+
+	VFS_CLOSE (vf);
+
+	return (vfsfile_t *) f;
+}
+
+// counts the download data sent to clients
+void SV_DownloadServed (int bytes)
+{
+	if (realtime - dl_secstart >= 1 || realtime < dl_secstart)
+	{
+		dl_rate = (realtime - dl_secstart < 2) ? dl_secbytes / max (1, realtime - dl_secstart) : 0;
+		dl_peakrate = max (dl_peakrate, dl_rate);
+		dl_secstart = realtime;
+		dl_secbytes = 0;
+	}
+
+	dl_secbytes += bytes;
+	dl_bytes += bytes;
+}
+
+// drops the cached files, those still being downloaded once they are done
+void SV_FlushDownloadCache (void)
+{
+	while (dl_cache)
+		DL_Remove (dl_cache);
+}
+
+static void SV_DownloadStats_f (void)
+{
+	dlcache_t *e;
+	int n = 0;
+
+	if (Cmd_Argc () == 2 && !strcmp (Cmd_Argv (1), "reset"))
+	{
+		dl_hits = dl_misses = dl_uncached = 0;
+		dl_bytes = dl_rate = dl_peakrate = 0;
+		return;
+	}
+
+	if (Cmd_Argc () == 2 && !strcmp (Cmd_Argv (1), "flush"))
+	{
+		SV_FlushDownloadCache ();
+		return;
+	}
+
+	for (e = dl_cache; e; e = e->next)
+	{
+		Con_Printf ("%-32s %8.0fKB %2d %s\n", e->name, e->len / 1024.0, e->refs, e->mapped ? "mapped" : "");
+		n++;
+	}
+
+	Con_Printf ("%d files cached, %.1fMB\n", n, dl_cachedbytes / (1024.0 * 1024));
+	Con_Printf ("opens: %d hits, %d misses, %d uncached\n", dl_hits, dl_misses, dl_uncached);
+	Con_Printf ("served: %.1fMB, %.0fKB/s now, %.0fKB/s peak\n", dl_bytes / (1024 * 1024),
+				(realtime - dl_secstart < 2) ? dl_rate / 1024 : 0, dl_peakrate / 1024);
+}
+
+void SV_Download_Init (void)
+{
+	Cvar_Register (&sv_downloadcache);
+	Cvar_Register (&sv_downloadmmap);
+
+	Cmd_AddCommand ("sv_downloadstats", SV_DownloadStats_f);
+}
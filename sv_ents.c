@@ -27,8 +27,12 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 // because there can be a lot of nails, there is a special
 // network protocol for them
 #define MAX_NAILS 32
-static edict_t *nails[MAX_NAILS];
-static int numnails;
+typedef struct
+{
+	edict_t	*nails[MAX_NAILS];
+	int		numnails;
+} nailupdate_t;
+
 static int nailcount = 0;
 
 extern	int sv_nailmodel, sv_supernailmodel, sv_playermodel;
@@ -36,7 +40,7 @@ extern	int sv_nailmodel, sv_supernailmodel, sv_playermodel;
 cvar_t	sv_nailhack	= {"sv_nailhack", "1"};
 
 
-static qbool SV_AddNailUpdate (edict_t *ent)
+static qbool SV_AddNailUpdate (nailupdate_t *nu, edict_t *ent)
 {
 	if ((int)sv_nailhack.value)
 		return false;
@@ -47,22 +51,22 @@ static qbool SV_AddNailUpdate (edict_t *ent)
 	if (msg_coordsize != 2)
 		return false; // Do not allow nailhack in case of sv_bigcoords.
 
-	if (numnails == MAX_NAILS)
+	if (nu->numnails == MAX_NAILS)
 		return true;
 
-	nails[numnails] = ent;
-	numnails++;
+	nu->nails[nu->numnails] = ent;
+	nu->numnails++;
 	return true;
 }
 
-static void SV_EmitNailUpdate (sizebuf_t *msg, qbool recorder)
+static void SV_EmitNailUpdate (nailupdate_t *nu, sizebuf_t *msg, qbool recorder)
 {
 	int x, y, z, p, yaw, n, i;
 	byte bits[6]; // [48 bits] xyzpy 12 12 12 4 8
 	edict_t *ent;
 
 
-	if (!numnails)
+	if (!nu->numnails)
 		return;
 
 	if (recorder)
@@ -70,11 +74,11 @@ static void SV_EmitNailUpdate (sizebuf_t *msg, qbool recorder)
 	else
 		MSG_WriteByte (msg, svc_nails);
 
-	MSG_WriteByte (msg, numnails);
+	MSG_WriteByte (msg, nu->numnails);
 
-	for (n=0 ; n<numnails ; n++)
+	for (n=0 ; n<nu->numnails ; n++)
 	{
-		ent = nails[n];
+		ent = nu->nails[n];
 		if (recorder)
 		{
 			if (!ent->v.colormap)
@@ -109,18 +113,15 @@ static void SV_EmitNailUpdate (sizebuf_t *msg, qbool recorder)
 
 /*
 ==================
-SV_WriteDelta
+SV_DeltaBits
 
-Writes part of a packetentities message.
-Can delta from either a baseline or a previous packet_entity
+The U_* bits needed to go from one entity state to another
 ==================
 */
-static void SV_WriteDelta (entity_state_t *from, entity_state_t *to, sizebuf_t *msg, qbool force)
+static int SV_DeltaBits (entity_state_t *from, entity_state_t *to)
 {
 	int bits, i;
 
-
-	// send an update
 	bits = 0;
 
 	for (i=0 ; i<3 ; i++)
@@ -157,20 +158,13 @@ static void SV_WriteDelta (entity_state_t *from, entity_state_t *to, sizebuf_t *
 	if (to->flags & U_SOLID)
 		bits |= U_SOLID;
 
-	//
-	// write the message
-	//
-	if (!to->number)
-		SV_Error ("Unset entity number");
-	if (to->number >= MAX_EDICTS)
-	{
-		/*SV_Error*/
-		Con_Printf ("Entity number >= MAX_EDICTS (%d), set to MAX_EDICTS - 1\n", MAX_EDICTS);
-		to->number = MAX_EDICTS - 1;
-	}
+	return bits;
+}
+
+static void SV_WriteDeltaBits (entity_state_t *to, int bits, sizebuf_t *msg)
+{
+	int i;
 
-	if (!bits && !force)
-		return;		// nothing to send!
 	i = to->number | (bits&~U_CHECKMOREBITS);
 	if (i & U_REMOVE)
 		Sys_Error ("U_REMOVE");
@@ -202,6 +196,188 @@ static void SV_WriteDelta (entity_state_t *from, entity_state_t *to, sizebuf_t *
 		MSG_WriteAngle(msg, to->angles[2]);
 }
 
+/*
+==================
+SV_WriteDelta
+
+Writes part of a packetentities message.
+Can delta from either a baseline or a previous packet_entity
+==================
+*/
+static void SV_WriteDelta (entity_state_t *from, entity_state_t *to, sizebuf_t *msg, qbool force)
+{
+	int bits;
+
+	// send an update
+	bits = SV_DeltaBits (from, to);
+
+	//
+	// write the message
+	//
+	if (!to->number)
+		SV_Error ("Unset entity number");
+	if (to->number >= MAX_EDICTS)
+	{
+		/*SV_Error*/
+		Con_Printf ("Entity number >= MAX_EDICTS (%d), set to MAX_EDICTS - 1\n", MAX_EDICTS);
+		to->number = MAX_EDICTS - 1;
+	}
+
+	if (!bits && !force)
+		return;		// nothing to send!
+
+	SV_WriteDeltaBits (to, bits, msg);
+}
+
+/*
+=============================================================================
+
+DELTA CACHE
+
+The bytes of an entity update only depend on the new state of the entity and
+on which fields changed, so clients that delta from the same baseline or from
+frames with the same old state get identical updates. The first client to
+need an update encodes it and keeps a copy for the frame, the others copy it
+into their message.
+
+Entries are claimed with a compare and swap on their state, so the cache can
+be used from the snapshot threads. A client that finds an entry being filled
+simply encodes the update itself.
+
+=============================================================================
+*/
+
+#define DC_WAYS		4		// entries per entity
+#define DC_MAXBYTES	32		// largest update is 26 bytes, with float coords and short angles
+
+typedef struct
+{
+	volatile int	state;	// sv_deltaframe * 2 when ready, + 1 while being filled
+	int				bits;
+	entity_state_t	to;
+	int				len;
+	byte			data[DC_MAXBYTES];
+} deltacache_t;
+
+typedef struct
+{
+	int		hits;
+	int		misses;
+	int		packets;
+	double	time;			// spent in SV_EmitPacketEntities
+} deltastats_t;
+
+#ifndef SYS_ATOMICS
+extern cvar_t sv_snapshot_threads;	// the cache is off when they run
+#endif
+
+cvar_t	sv_deltacache = {"sv_deltacache", "1"};
+
+static deltacache_t	sv_deltacache_ents[MAX_EDICTS][DC_WAYS];
+static int			sv_deltaframe = 1;		// entries of older frames are free
+
+// one per client, so the snapshot threads don't share counters, the last is for
+// the recorder and clients outside svs.clients
+static deltastats_t	sv_deltastats[MAX_CLIENTS + 1];
+
+static qbool SV_SameDeltaTarget (entity_state_t *a, entity_state_t *b)
+{
+	return a->number == b->number && VectorCompare (a->origin, b->origin) && VectorCompare (a->angles, b->angles)
+		&& a->modelindex == b->modelindex && a->frame == b->frame && a->colormap == b->colormap
+		&& a->skinnum == b->skinnum && a->effects == b->effects;
+}
+
+static void SV_WriteCachedDelta (entity_state_t *from, entity_state_t *to, sizebuf_t *msg, qbool force, deltastats_t *st)
+{
+	int bits, i, state, ready, freestate = 0, start;
+	deltacache_t *dc, *freedc = NULL;
+
+	bits = SV_DeltaBits (from, to);
+
+	if ((!bits && !force) || to->number <= 0 || to->number >= MAX_EDICTS)
+	{
+		SV_WriteDelta (from, to, msg, force);
+		return;
+	}
+
+	ready = sv_deltaframe << 1;
+
+	for (i = 0, dc = sv_deltacache_ents[to->number]; i < DC_WAYS; i++, dc++)
+	{
+		state = Sys_AtomicLoad (&dc->state);
+
+		if (state == ready)
+		{
+			if (dc->bits == bits && SV_SameDeltaTarget (&dc->to, to))
+			{
+				SZ_Write (msg, dc->data, dc->len);
+				st->hits++;
+				return;
+			}
+		}
+		else if ((state >> 1) != sv_deltaframe && !freedc)
+		{
+			freedc = dc;
+			freestate = state;
+		}
+	}
+
+	st->misses++;
+
+	start = msg->cursize;
+	SV_WriteDeltaBits (to, bits, msg);
+
+	if (!freedc || msg->overflowed || !Sys_AtomicCAS (&freedc->state, freestate, ready | 1))
+		return;
+
+	freedc->bits = bits;
+	freedc->to = *to;
+	freedc->len = msg->cursize - start;
+	memcpy (freedc->data, msg->data + start, freedc->len);
+	Sys_AtomicStore (&freedc->state, ready);
+}
+
+void SV_ResetDeltaStats (void)
+{
+	memset (sv_deltastats, 0, sizeof(sv_deltastats));
+}
+
+void SV_PrintDeltaStats (void)
+{
+	deltastats_t total;
+	int i, lookups;
+
+	memset (&total, 0, sizeof(total));
+	for (i = 0; i <= MAX_CLIENTS; i++)
+	{
+		total.hits += sv_deltastats[i].hits;
+		total.misses += sv_deltastats[i].misses;
+		total.packets += sv_deltastats[i].packets;
+		total.time += sv_deltastats[i].time;
+	}
+
+	lookups = total.hits + total.misses;
+	Con_Printf ("delta cache %s: %i hits, %i misses (%.1f%% hit rate)\n", sv_deltacache.value ? "on" : "off",
+				total.hits, total.misses, lookups ? 100.0 * total.hits / lookups : 0);
+	Con_Printf ("packet entities: %i messages, %.2f us each\n",
+				total.packets, total.packets ? 1000000 * total.time / total.packets : 0);
+}
+
+/*
+==================
+SV_DeltaStats_f
+
+Compare the time per message with sv_deltacache 0 and 1 to see the CPU saved
+==================
+*/
+void SV_DeltaStats_f (void)
+{
+	if (Cmd_Argc () == 2 && !strcmp (Cmd_Argv (1), "reset"))
+		SV_ResetDeltaStats ();
+	else
+		SV_PrintDeltaStats ();
+}
+
 /*
 =============
 SV_EmitPacketEntities
@@ -216,7 +392,18 @@ static void SV_EmitPacketEntities (client_t *client, packet_entities_t *to, size
 	client_frame_t	*fromframe;
 	packet_entities_t *from1;
 	edict_t	*ent;
+	deltastats_t *st;
+	qbool cached;
+	double start;
+
+	st = &sv_deltastats[(client >= svs.clients && client < svs.clients + MAX_CLIENTS) ? client - svs.clients : MAX_CLIENTS];
+	start = SV_PhaseClock ();
 
+	cached = sv_deltacache.value;
+#ifndef SYS_ATOMICS
+	if (sv_snapshot_threads.value)
+		cached = false;
+#endif
 
 	// this is the frame that we are going to delta update from
 	if (client->delta_sequence != -1)
@@ -248,7 +435,10 @@ static void SV_EmitPacketEntities (client_t *client, packet_entities_t *to, size
 		if (newnum == oldnum)
 		{	// delta update from old position
 			//Con_Printf ("delta %i\n", newnum);
-			SV_WriteDelta (&from1->entities[oldindex], &to->entities[newindex], msg, false);
+			if (cached)
+				SV_WriteCachedDelta (&from1->entities[oldindex], &to->entities[newindex], msg, false, st);
+			else
+				SV_WriteDelta (&from1->entities[oldindex], &to->entities[newindex], msg, false);
 			oldindex++;
 			newindex++;
 			continue;
@@ -267,7 +457,10 @@ static void SV_EmitPacketEntities (client_t *client, packet_entities_t *to, size
 			}
 			ent = EDICT_NUM(newnum);
 			//Con_Printf ("baseline %i\n", newnum);
-			SV_WriteDelta (&ent->e->baseline, &to->entities[newindex], msg, true);
+			if (cached)
+				SV_WriteCachedDelta (&ent->e->baseline, &to->entities[newindex], msg, true, st);
+			else
+				SV_WriteDelta (&ent->e->baseline, &to->entities[newindex], msg, true);
 			newindex++;
 			continue;
 		}
@@ -282,6 +475,9 @@ static void SV_EmitPacketEntities (client_t *client, packet_entities_t *to, size
 	}
 
 	MSG_WriteShort (msg, 0);	// end of packetentities
+
+	st->packets++;
+	st->time += SV_PhaseClock () - start;
 }
 
 static int TranslateEffects (edict_t *ent)
@@ -308,11 +504,9 @@ SV_WritePlayersToClient
 
 #define ISUNDERWATER(x) ((x) == CONTENTS_WATER || (x) == CONTENTS_SLIME || (x) == CONTENTS_LAVA)
 
-static qbool disable_updates; // disables sending entities to the client
-
 
 int SV_PMTypeForClient (client_t *cl);
-static void SV_WritePlayersToClient (client_t *client, edict_t *clent, byte *pvs, sizebuf_t *msg)
+static void SV_WritePlayersToClient (client_t *client, edict_t *clent, byte *pvs, qbool disable_updates, sizebuf_t *msg)
 {
 	int msec, pflags, pm_type = 0, pm_code = 0, i, j;
 	demo_frame_t *demo_frame;
@@ -604,6 +798,267 @@ qbool SV_InvisibleToClient(edict_t *viewer, edict_t *seen)
     return true;
 }
 
+/*
+=============================================================================
+
+ENTITY VISIBILITY INDEX
+
+Once per frame the entities with a visible model are gathered into a compact
+list together with their leafs. Clients with the same fat PVS (usually the
+ones standing in the same leaf) then share one list of the entities they can
+see, so the per client work only deals with visible entities.
+
+=============================================================================
+*/
+
+typedef struct
+{
+	edict_t		*ent;
+	int			num;
+	int			num_leafs;
+	short		leafnums[MAX_ENT_LEAFS];
+} visent_t;
+
+typedef struct
+{
+	unsigned	hash;					// of the fat PVS
+	byte		pvs[MAX_MAP_LEAFS/8];
+	int			numvisible;
+	short		visible[MAX_EDICTS];	// indexes into sv_visents
+} visset_t;
+
+static visent_t	sv_visents[MAX_EDICTS];
+static int		sv_numvisents;
+static int		sv_visframe = 1;		// bumped whenever entities may have changed
+static int		sv_visents_frame;		// sv_visframe the index was built for
+
+static visset_t	sv_vissets[MAX_CLIENTS];
+static int		sv_numvissets;
+
+static visset_t	*sv_clientvis[MAX_CLIENTS];
+static int		sv_clientvis_frame[MAX_CLIENTS];
+
+void SV_InvalidateEntityVisibility (void)
+{
+	sv_visframe++;
+	sv_deltaframe++;
+}
+
+static void SV_BuildEntityVisibility (void)
+{
+	visent_t *v;
+	edict_t *ent;
+	int e;
+
+	sv_numvisents = 0;
+	sv_numvissets = 0;
+	sv_visents_frame = sv_visframe;
+
+	// QW protocol can only handle 512 entities. Any entity with number >= 512 will be invisible
+	for (e = pr_nqprogs ? 1 : MAX_CLIENTS+1, ent=EDICT_NUM(e);
+		e < sv.num_edicts;
+		e++, ent = NEXT_EDICT(ent))
+	{
+		if (pr_nqprogs) {
+			// don't send the player's model to himself
+			if (e < MAX_CLIENTS + 1 && svs.clients[e-1].state != cs_free)
+				continue;
+		}
+
+		// ignore ents without visible models
+		if (!ent->v.modelindex || !*
+#ifdef USE_PR2
+		        PR2_GetString(ent->v.model)
+#else
+				PR_GetString(ent->v.model)
+#endif
+		   )
+			continue;
+
+		v = &sv_visents[sv_numvisents++];
+		v->ent = ent;
+		v->num = e;
+		v->num_leafs = ent->e->num_leafs;
+		memcpy (v->leafnums, ent->e->leafnums, v->num_leafs * sizeof(v->leafnums[0]));
+	}
+}
+
+// returns the set of entities visible from the given fat PVS, NULL if we ran out of sets
+static visset_t *SV_FindVisSet (byte *pvs)
+{
+	int i, j, fatbytes;
+	unsigned hash;
+	visset_t *set;
+	visent_t *v;
+
+	fatbytes = CM_FatPVSBytes ();
+	for (i = 0, hash = 2166136261u; i < fatbytes; i++)
+		hash = (hash ^ pvs[i]) * 16777619u;
+
+	for (i = 0, set = sv_vissets; i < sv_numvissets; i++, set++)
+	{
+		if (set->hash == hash && !memcmp (set->pvs, pvs, fatbytes))
+			return set;
+	}
+
+	if (sv_numvissets == MAX_CLIENTS)
+		return NULL;
+
+	set = &sv_vissets[sv_numvissets++];
+	set->hash = hash;
+	memcpy (set->pvs, pvs, fatbytes);
+	set->numvisible = 0;
+
+	for (i = 0, v = sv_visents; i < sv_numvisents; i++, v++)
+	{
+		// ignore if not touching a PV leaf
+		for (j = 0; j < v->num_leafs; j++)
+			if (pvs[v->leafnums[j] >> 3] & (1 << (v->leafnums[j]&7)))
+				break;
+
+		if (j < v->num_leafs)
+			set->visible[set->numvisible++] = i;
+	}
+
+	return set;
+}
+
+/*
+=============
+SV_PrepareClientVisibility
+
+Finds the client's shared visible entity set for this frame. Must be called
+from the main thread, SV_WriteEntitiesToClient then only reads the result.
+=============
+*/
+void SV_PrepareClientVisibility (client_t *client)
+{
+	int n = client - svs.clients;
+	byte fatpvs[MAX_MAP_LEAFS/8];
+	vec3_t org;
+
+	if (n < 0 || n >= MAX_CLIENTS || !client->edict)
+		return;
+
+	if (sv_visents_frame != sv_visframe)
+		SV_BuildEntityVisibility ();
+
+	VectorAdd (client->edict->v.origin, client->edict->v.view_ofs, org);
+	sv_clientvis[n] = SV_FindVisSet (CM_FatPVSTo (org, fatpvs));
+	sv_clientvis_frame[n] = sv_visframe;
+}
+
+static visset_t *SV_ClientVisibility (client_t *client)
+{
+	int n = client - svs.clients;
+
+	if (n < 0 || n >= MAX_CLIENTS || sv_clientvis_frame[n] != sv_visframe || sv_visents_frame != sv_visframe)
+		return NULL;
+
+	return sv_clientvis[n];
+}
+
+// puts a visible entity into either the packet entities or the nails update
+static void SV_AddPacketEntity (nailupdate_t *nu, packet_entities_t *pack, int max_packet_entities, int e, edict_t *ent)
+{
+	entity_state_t *state;
+
+	if (SV_AddNailUpdate (nu, ent))
+		return; // added to the special update list
+
+	// add to the packetentities
+	if (pack->num_entities == max_packet_entities)
+		return;	// all full
+
+	state = &pack->entities[pack->num_entities];
+	pack->num_entities++;
+
+	state->number = e;
+	state->flags = 0;
+	VectorCopy (ent->v.origin, state->origin);
+	VectorCopy (ent->v.angles, state->angles);
+	state->modelindex = ent->v.modelindex;
+	state->frame = ent->v.frame;
+	state->colormap = ent->v.colormap;
+	state->skinnum = ent->v.skin;
+	state->effects = TranslateEffects(ent);
+}
+
+/*
+===============================================================================
+
+RECORDER PVS
+
+The MVD recorder sees everything visible to any active player, so its PVS is
+the union of all their fat PVSs. Each player's fat PVS is kept between frames
+and only recalculated when the view origin moves; when the origin is well
+inside one leaf the leaf's own PVS row is used without copying.
+
+===============================================================================
+*/
+
+#define MAX_PVS_LONGS	((MAX_MAP_LEAFS + 31) >> 5)
+
+typedef struct
+{
+	qbool			valid;
+	int				spawncount;			// svs.spawncount the cache belongs to
+	vec3_t			org;
+	unsigned int	*row;				// leaf PVS row or fat
+	unsigned int	fat[MAX_PVS_LONGS];
+} recpvs_t;
+
+static recpvs_t		sv_recpvs[MAX_CLIENTS];
+static unsigned int	sv_recpvs_union[MAX_PVS_LONGS];
+
+static unsigned int *SV_PlayerFatPVS (int num, vec3_t org)
+{
+	recpvs_t *rp = &sv_recpvs[num];
+	struct cleaf_s *leaf;
+
+	if (rp->valid && rp->spawncount == svs.spawncount && VectorCompare (org, rp->org))
+		return rp->row;
+
+	if ((leaf = CM_FatPVSLeaf (org)))
+		rp->row = (unsigned int *)CM_LeafPVS (leaf);
+	else
+		rp->row = (unsigned int *)CM_FatPVSTo (org, (byte *)rp->fat);
+
+	VectorCopy (org, rp->org);
+	rp->spawncount = svs.spawncount;
+	rp->valid = true;
+
+	return rp->row;
+}
+
+static byte *SV_RecorderPVS (void)
+{
+	unsigned int *row;
+	int i, j, longs;
+	client_t *cl;
+	vec3_t org;
+
+	longs = (CM_FatPVSBytes () + 3) >> 2;
+	memset (sv_recpvs_union, 0, longs * sizeof(sv_recpvs_union[0]));
+
+	for (i = 0, cl = svs.clients; i < MAX_CLIENTS; i++, cl++)
+	{
+		if (cl->state != cs_spawned || cl->spectator)
+		{
+			sv_recpvs[i].valid = false;
+			continue;
+		}
+
+		VectorAdd (cl->edict->v.origin, cl->edict->v.view_ofs, org);
+		row = SV_PlayerFatPVS (i, org);
+
+		for (j = 0; j < longs; j++)
+			sv_recpvs_union[j] |= row[j];
+	}
+
+	return (byte *)sv_recpvs_union;
+}
+
 /*
 =============
 SV_WriteEntitiesToClient
@@ -612,6 +1067,10 @@ Encodes the current state of the world as
 a svc_packetentities messages and possibly
 a svc_nails message and
 svc_playerinfo messages
+
+Only touches the client's own frame and message for real clients, so it may
+run for several clients at once (see SV_SnapshotThreadsActive). The recorder
+and the sv_cullentities/NQ progs paths still modify shared state.
 =============
 */
 
@@ -620,13 +1079,15 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 	int e, i, max_packet_entities;
 	packet_entities_t *pack;
 	client_frame_t *frame;
-	entity_state_t *state;
 	edict_t	*clent;
-	client_t *cl;
 	edict_t *ent;
 	vec3_t org;
 	byte *pvs;
+	byte fatpvs[MAX_MAP_LEAFS/8];
+	nailupdate_t nu;
+	qbool disable_updates; // disables sending entities to the client
 	int hideent;
+	visset_t *vis;
 
 	// this is the frame we are creating
 	frame = &client->frames[client->netchan.incoming_sequence & UPDATE_MASK];
@@ -634,10 +1095,16 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 	// find the client's PVS
 	clent = client->edict;
 	pvs = NULL;
+	vis = NULL;
 	if (!recorder)
 	{
-		VectorAdd (clent->v.origin, clent->v.view_ofs, org);
-		pvs = CM_FatPVS (org);
+		if ((vis = SV_ClientVisibility (client)))
+			pvs = vis->pvs;
+		else
+		{
+			VectorAdd (clent->v.origin, clent->v.view_ofs, org);
+			pvs = CM_FatPVSTo (org, fatpvs);
+		}
 		if (client->fteprotocolextensions & FTE_PEXT_256PACKETENTITIES)
 			max_packet_entities = 256;
 		else
@@ -647,23 +1114,7 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 	{
 		max_packet_entities = MAX_MVD_PACKET_ENTITIES;
 
-		for (i=0, cl=svs.clients ; i<MAX_CLIENTS ; i++,cl++)
-		{
-			if (cl->state != cs_spawned)
-				continue;
-
-			if (cl->spectator)
-				continue;
-
-			VectorAdd (cl->edict->v.origin, cl->edict->v.view_ofs, org);
-
-			// disconnect --> "is it correct?"
-			//if (pvs == NULL)
-				pvs = CM_FatPVS (org);
-			//else
-				//	SV_AddToFatPVS (org, sv.worldmodel->nodes, false);
-			// <-- disconnect
-		}
+		pvs = SV_RecorderPVS ();
 	}
 	if (clent && client->disable_updates_stop > realtime)
 	{ // Vladis
@@ -676,20 +1127,38 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 	}
 
 	// send over the players in the PVS
-	SV_WritePlayersToClient (client, clent, pvs, msg);
+	SV_WritePlayersToClient (client, clent, pvs, disable_updates, msg);
 
 	// put other visible entities into either a packet_entities or a nails message
 	pack = &frame->entities;
 	pack->num_entities = 0;
 
-	numnails = 0;
+	nu.numnails = 0;
 
 	if (fofs_hideentity)
 		hideent = ((eval_t *)((byte *)&(clent)->v + fofs_hideentity))->_int / pr_edict_size;
 	else
 		hideent = 0;
 
-	if (!disable_updates)
+	if (!disable_updates && vis)
+	{// Vladis, server flash
+
+		// only walk the entities in the client's shared visible set
+		for (i = 0; i < vis->numvisible; i++)
+		{
+			e = sv_visents[vis->visible[i]].num;
+			ent = sv_visents[vis->visible[i]].ent;
+
+			if (e == hideent)
+				continue;
+
+			if (sv_cullentities.value && SV_InvisibleToClient(clent, ent))
+				continue;
+
+			SV_AddPacketEntity (&nu, pack, max_packet_entities, e, ent);
+		}
+	}
+	else if (!disable_updates)
 	{// Vladis, server flash
 
 		// QW protocol can only handle 512 entities. Any entity with number >= 512 will be invisible
@@ -733,25 +1202,7 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 					continue;
 			}
 
-			if (SV_AddNailUpdate (ent))
-				continue; // added to the special update list
-
-			// add to the packetentities
-			if (pack->num_entities == max_packet_entities)
-				continue;	// all full
-
-			state = &pack->entities[pack->num_entities];
-			pack->num_entities++;
-
-			state->number = e;
-			state->flags = 0;
-			VectorCopy (ent->v.origin, state->origin);
-			VectorCopy (ent->v.angles, state->angles);
-			state->modelindex = ent->v.modelindex;
-			state->frame = ent->v.frame;
-			state->colormap = ent->v.colormap;
-			state->skinnum = ent->v.skin;
-			state->effects = TranslateEffects(ent);
+			SV_AddPacketEntity (&nu, pack, max_packet_entities, e, ent);
 		}
 	} // server flash
 	// encode the packet entities as a delta from the
@@ -760,7 +1211,7 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 	SV_EmitPacketEntities (client, pack, msg);
 
 	// now add the specialized nail update
-	SV_EmitNailUpdate (msg, recorder);
+	SV_EmitNailUpdate (&nu, msg, recorder);
 
 	// Translate NQ progs' EF_MUZZLEFLASH to svc_muzzleflash
 	if (pr_nqprogs)
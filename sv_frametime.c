@@ -0,0 +1,285 @@
+/*
+Copyright (C) 1996-1997 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+/*
+  Server frame timing
+
+  SV_Frame times its phases, and the time of each phase over the last
+  FT_WINDOW frames is kept in a histogram with FT_SUBBUCKETS buckets per
+  power of two microseconds, so percentiles are within a few percent of the
+  real value. The exact maximum comes from the samples themselves.
+
+  "sv_frametimes" prints the percentiles. If sv_frametimes_file is set, they
+  are also written to that file in the game directory every
+  sv_frametimes_interval seconds, as JSON.
+*/
+
+#include "qwsvdef.h"
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+#define FT_WINDOW		1024		// frames
+#define FT_SUBBUCKETS	8
+#define FT_OCTAVES		25			// up to 2^25 us, half a minute
+#define FT_BUCKETS		(1 + FT_OCTAVES * FT_SUBBUCKETS)
+
+typedef struct
+{
+	int		count[FT_BUCKETS];
+	float	sample[FT_WINDOW];		// seconds
+	byte	bucket[FT_WINDOW];
+	int		numsamples;
+	int		next;					// oldest sample once the window is full
+	double	total;					// since the server started
+} frametimes_t;
+
+static char *ft_phasenames[SVPHASE_NUM] =
+{
+	"frame",
+	"readpackets",
+	"physics",
+	"sendmessages",
+	"demo",
+	"qtv"
+};
+
+static frametimes_t	ft_phases[SVPHASE_NUM];
+static double		ft_lastwrite;
+
+cvar_t	sv_frametimes_file = {"sv_frametimes_file", ""};
+cvar_t	sv_frametimes_interval = {"sv_frametimes_interval", "10"};
+
+/*
+================
+SV_PhaseClock
+
+A monotonic clock with better resolution than Sys_DoubleTime
+================
+*/
+double SV_PhaseClock (void)
+{
+#if defined(_WIN32) || !defined(CLOCK_MONOTONIC)
+	return Sys_DoubleTime ();
+#else
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 0.000000001;
+#endif
+}
+
+static int FT_Bucket (double seconds)
+{
+	double us = seconds * 1000000;
+	int exp, b;
+	double mant;
+
+	if (us < 1)
+		return 0;
+
+	// us = mant * 2^exp, 0.5 <= mant < 1
+	mant = frexp (us, &exp);
+	b = 1 + (exp - 1) * FT_SUBBUCKETS + (int) ((mant * 2 - 1) * FT_SUBBUCKETS);
+
+	return min (b, FT_BUCKETS - 1);
+}
+
+// lowest value in bucket b, in seconds
+static double FT_BucketStart (int b)
+{
+	if (b == 0)
+		return 0;
+
+	b--;
+	return ldexp (1 + (double) (b % FT_SUBBUCKETS) / FT_SUBBUCKETS, b / FT_SUBBUCKETS) / 1000000;
+}
+
+/*
+================
+SV_AddPhaseTime
+================
+*/
+void SV_AddPhaseTime (svphase_t phase, double seconds)
+{
+	frametimes_t *ft = &ft_phases[phase];
+	int b = FT_Bucket (seconds);
+
+	if (ft->numsamples == FT_WINDOW)
+		ft->count[ft->bucket[ft->next]]--;
+	else
+		ft->numsamples++;
+
+	ft->count[b]++;
+	ft->sample[ft->next] = seconds;
+	ft->bucket[ft->next] = b;
+	ft->next = (ft->next + 1) % FT_WINDOW;
+	ft->total += seconds;
+}
+
+static double FT_Percentile (frametimes_t *ft, double p)
+{
+	double rank = p * ft->numsamples, lo, hi;
+	int b, seen = 0;
+
+	for (b = 0; b < FT_BUCKETS; b++)
+	{
+		if (!ft->count[b])
+			continue;
+
+		if (seen + ft->count[b] >= rank)
+		{
+			// spread the samples of the bucket evenly over it
+			lo = FT_BucketStart (b);
+			hi = (b == FT_BUCKETS - 1) ? lo : FT_BucketStart (b + 1);
+			return lo + (hi - lo) * (rank - seen) / ft->count[b];
+		}
+
+		seen += ft->count[b];
+	}
+
+	return 0;
+}
+
+typedef struct
+{
+	double	p50, p95, p99, max, mean;
+} phasestats_t;
+
+static void FT_Stats (frametimes_t *ft, phasestats_t *st)
+{
+	double sum = 0;
+	int i;
+
+	memset (st, 0, sizeof(*st));
+	if (!ft->numsamples)
+		return;
+
+	for (i = 0; i < ft->numsamples; i++)
+	{
+		sum += ft->sample[i];
+		st->max = max (st->max, ft->sample[i]);
+	}
+
+	st->mean = sum / ft->numsamples;
+	st->p50 = FT_Percentile (ft, 0.50);
+	st->p95 = FT_Percentile (ft, 0.95);
+	st->p99 = FT_Percentile (ft, 0.99);
+}
+
+void SV_ResetFrameTimes (void)
+{
+	memset (ft_phases, 0, sizeof(ft_phases));
+}
+
+void SV_PrintFrameTimes (void)
+{
+	phasestats_t st;
+	int i;
+
+	Con_Printf ("last %d frames, ms:\n", ft_phases[SVPHASE_FRAME].numsamples);
+	Con_Printf ("phase            mean     p50     p95     p99     max\n");
+	for (i = 0; i < SVPHASE_NUM; i++)
+	{
+		FT_Stats (&ft_phases[i], &st);
+		Con_Printf ("%-12s %8.3f%8.3f%8.3f%8.3f%8.3f\n", ft_phasenames[i],
+					st.mean * 1000, st.p50 * 1000, st.p95 * 1000, st.p99 * 1000, st.max * 1000);
+	}
+}
+
+static void SV_FrameTimes_f (void)
+{
+	if (Cmd_Argc () == 2 && !strcmp (Cmd_Argv (1), "reset"))
+		SV_ResetFrameTimes ();
+	else
+		SV_PrintFrameTimes ();
+}
+
+static void SV_WriteFrameTimes (void)
+{
+	char name[MAX_OSPATH], tmpname[MAX_OSPATH + 4];
+	phasestats_t st;
+	FILE *f;
+	int i;
+
+	if (strstr (sv_frametimes_file.string, "..") || sv_frametimes_file.string[0] == '/')
+	{
+		Con_Printf ("Bad sv_frametimes_file\n");
+		Cvar_Set (&sv_frametimes_file, "");
+		return;
+	}
+
+	if (snprintf (name, sizeof(name), "%s/%s", com_gamedir, sv_frametimes_file.string) >= sizeof(name))
+	{
+		Con_DPrintf ("sv_frametimes_file is too long\n");
+		return;
+	}
+	snprintf (tmpname, sizeof(tmpname), "%s.tmp", name);
+
+	if (!(f = fopen (tmpname, "w")))
+	{
+		Con_DPrintf ("Couldn't open %s\n", tmpname);
+		return;
+	}
+
+	fprintf (f, "{\n\t\"unit\": \"ms\",\n\t\"time\": %.0f,\n\t\"frames\": %d,\n\t\"phases\": {\n",
+			 (double) time (NULL), ft_phases[SVPHASE_FRAME].numsamples);
+	for (i = 0; i < SVPHASE_NUM; i++)
+	{
+		FT_Stats (&ft_phases[i], &st);
+		fprintf (f, "\t\t\"%s\": {\"mean\": %.3f, \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f, \"total_sec\": %.3f}%s\n",
+				 ft_phasenames[i], st.mean * 1000, st.p50 * 1000, st.p95 * 1000, st.p99 * 1000, st.max * 1000,
+				 ft_phases[i].total, i < SVPHASE_NUM - 1 ? "," : "");
+	}
+	fprintf (f, "\t}\n}\n");
+	fclose (f);
+
+	// readers never see a partly written file
+#ifdef _WIN32
+	remove (name);
+#endif
+	rename (tmpname, name);
+}
+
+/*
+================
+SV_FrameTimesFrame
+
+Called at the end of every server frame
+================
+*/
+void SV_FrameTimesFrame (void)
+{
+	if (!sv_frametimes_file.string[0])
+		return;
+
+	if (realtime - ft_lastwrite < max (1, sv_frametimes_interval.value) && realtime >= ft_lastwrite)
+		return;
+
+	ft_lastwrite = realtime;
+	SV_WriteFrameTimes ();
+}
+
+void SV_FrameTimes_Init (void)
+{
+	Cvar_Register (&sv_frametimes_file);
+	Cvar_Register (&sv_frametimes_interval);
+
+	Cmd_AddCommand ("sv_frametimes", SV_FrameTimes_f);
+}
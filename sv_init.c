@@ -264,6 +264,7 @@ void SV_SpawnServer (char *mapname, qbool devmap)
 
 	SV_SaveSpawnparms ();
 	SV_LoadAccounts();
+	SV_FlushDownloadCache ();	// the files may have been replaced with the map
 #ifdef USE_PR2
 	//save client names from mod memory before unload mod and clearing VM memory by Hunk_FreeToLowMark
 	memset(savenames, 0, sizeof(savenames));
@@ -0,0 +1,289 @@
+/*
+Copyright (C) 1996-1997 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+/*
+  IP filter trie
+
+  Filters are keys of keylen bytes (4 for IPv4, 16 will do for IPv6) with a
+  mask, and the trie has one level per byte. A byte the mask ignores goes
+  to the "any" child of its node, so a lookup follows at most two branches
+  per level whatever the number of filters. Partly masked bytes are stored
+  once for every value they match.
+
+  Each filter has a value, and a lookup returns the lowest value of the
+  filters matching the address. The filter lists use their index, so the
+  first match in the list wins as it did with a linear scan.
+*/
+
+#include "qwsvdef.h"
+
+typedef struct
+{
+	byte			key;
+	struct ipnode_s	*node;
+} ipchild_t;
+
+typedef struct ipnode_s
+{
+	struct ipnode_s	*any;			// for any value of this byte
+	ipchild_t		*child;			// sorted by key
+	int				numchildren, maxchildren;
+	int				value;			// in leaves, lowest value of the filters ending here
+} ipnode_t;
+
+static ipnode_t *IPTrie_NewNode (void)
+{
+	ipnode_t *n = (ipnode_t *) Q_malloc (sizeof(ipnode_t));
+
+	n->value = -1;
+	return n;
+}
+
+static void IPTrie_FreeNode (ipnode_t *n)
+{
+	int i;
+
+	if (!n)
+		return;
+
+	for (i = 0; i < n->numchildren; i++)
+		IPTrie_FreeNode (n->child[i].node);
+
+	IPTrie_FreeNode (n->any);
+	Q_free (n->child);
+	Q_free (n);
+}
+
+static int IPTrie_Find (ipnode_t *n, byte key)
+{
+	int lo = 0, hi = n->numchildren - 1, mid;
+
+	while (lo <= hi)
+	{
+		mid = (lo + hi) / 2;
+		if (n->child[mid].key == key)
+			return mid;
+		if (n->child[mid].key < key)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+
+	return -(lo + 1);	// where it would go
+}
+
+static ipnode_t *IPTrie_Child (ipnode_t *n, byte key)
+{
+	int i = IPTrie_Find (n, key);
+
+	if (i >= 0)
+		return n->child[i].node;
+
+	i = -i - 1;
+	if (n->numchildren == n->maxchildren)
+	{
+		n->maxchildren = n->maxchildren ? n->maxchildren * 2 : 4;
+		n->child = (ipchild_t *) Q_realloc (n->child, n->maxchildren * sizeof(ipchild_t));
+	}
+
+	memmove (n->child + i + 1, n->child + i, (n->numchildren - i) * sizeof(ipchild_t));
+	n->numchildren++;
+
+	n->child[i].key = key;
+	n->child[i].node = IPTrie_NewNode ();
+
+	return n->child[i].node;
+}
+
+static void IPTrie_InsertNode (iptrie_t *t, ipnode_t *n, int depth, const byte *key, const byte *mask, int value)
+{
+	int c;
+
+	if (depth == t->keylen)
+	{
+		if (n->value < 0 || value < n->value)
+			n->value = value;
+		return;
+	}
+
+	if (!mask[depth])
+	{
+		if (!n->any)
+			n->any = IPTrie_NewNode ();
+		IPTrie_InsertNode (t, n->any, depth + 1, key, mask, value);
+	}
+	else if (mask[depth] == 0xff)
+		IPTrie_InsertNode (t, IPTrie_Child (n, key[depth]), depth + 1, key, mask, value);
+	else
+	{
+		for (c = 0; c < 256; c++)
+			if ((c & mask[depth]) == (key[depth] & mask[depth]))
+				IPTrie_InsertNode (t, IPTrie_Child (n, c), depth + 1, key, mask, value);
+	}
+}
+
+static int IPTrie_MatchNode (iptrie_t *t, ipnode_t *n, int depth, const byte *ip)
+{
+	int i, v, best = -1;
+
+	if (depth == t->keylen)
+		return n->value;
+
+	if ((i = IPTrie_Find (n, ip[depth])) >= 0)
+		best = IPTrie_MatchNode (t, n->child[i].node, depth + 1, ip);
+
+	if (n->any && (v = IPTrie_MatchNode (t, n->any, depth + 1, ip)) >= 0 && (best < 0 || v < best))
+		best = v;
+
+	return best;
+}
+
+/*
+================
+IPTrie_Clear
+
+Removes all filters, the trie keeps its keylen
+================
+*/
+void IPTrie_Clear (iptrie_t *t)
+{
+	IPTrie_FreeNode (t->root);
+	t->root = NULL;
+	t->count = 0;
+}
+
+/*
+================
+IPTrie_Insert
+
+Adds a filter matching the addresses with (ip & mask) == (key & mask)
+================
+*/
+void IPTrie_Insert (iptrie_t *t, const byte *key, const byte *mask, int value)
+{
+	if (!t->root)
+		t->root = IPTrie_NewNode ();
+
+	IPTrie_InsertNode (t, t->root, 0, key, mask, value);
+	t->count++;
+}
+
+/*
+================
+IPTrie_Match
+
+The lowest value of the filters matching ip, -1 if there are none
+================
+*/
+int IPTrie_Match (iptrie_t *t, const byte *ip)
+{
+	if (!t->root)
+		return -1;
+
+	return IPTrie_MatchNode (t, t->root, 0, ip);
+}
+
+//=============================================================================
+
+/*
+================
+SV_IPFilterBench_f
+
+Times a linear scan and the trie on the same random filter list
+================
+*/
+void SV_IPFilterBench_f (void)
+{
+	int numfilters = Cmd_Argc () > 1 ? Q_atoi (Cmd_Argv (1)) : 100000;
+	int numlookups = Cmd_Argc () > 2 ? Q_atoi (Cmd_Argv (2)) : 1000000;
+	int numscans, i, j, hits = 0, mismatches = 0, r, *found;
+	unsigned *compare, *mask, *ips, in;
+	double start, built, triet, scant;
+	iptrie_t trie = { NULL, 4, 0 };
+	byte m[4];
+
+	numfilters = bound (1, numfilters, 10000000);
+	numlookups = bound (1, numlookups, 100000000);
+	numscans = max (1, min (numlookups, 100000000 / numfilters));	// the scan is slow
+
+	compare = (unsigned *) Q_malloc (numfilters * sizeof(unsigned));
+	mask = (unsigned *) Q_malloc (numfilters * sizeof(unsigned));
+	ips = (unsigned *) Q_malloc (numlookups * sizeof(unsigned));
+	found = (int *) Q_malloc (numscans * sizeof(int));
+
+	// mostly single addresses, some class C and B networks, as addip makes them
+	for (i = 0; i < numfilters; i++)
+	{
+		r = rand () % 10;
+		m[0] = m[1] = 0xff;
+		m[2] = r < 9 ? 0xff : 0;
+		m[3] = r < 7 ? 0xff : 0;
+		mask[i] = *(unsigned *)m;
+		compare[i] = (((unsigned) rand () << 16) ^ (unsigned) rand ()) & mask[i];
+	}
+
+	// a quarter of the lookups hit a filter
+	for (i = 0; i < numlookups; i++)
+	{
+		in = ((unsigned) rand () << 16) ^ (unsigned) rand ();
+		if (!(rand () & 3))
+		{
+			j = rand () % numfilters;
+			in = compare[j] | (in & ~mask[j]);
+		}
+		ips[i] = in;
+	}
+
+	start = SV_PhaseClock ();
+	for (i = 0; i < numfilters; i++)
+		IPTrie_Insert (&trie, (byte *) &compare[i], (byte *) &mask[i], i);
+	built = SV_PhaseClock ();
+
+	for (i = 0; i < numlookups; i++)
+		hits += IPTrie_Match (&trie, (byte *) &ips[i]) >= 0;
+	triet = SV_PhaseClock () - built;
+
+	start = built - start;
+	built = SV_PhaseClock ();
+	for (i = 0; i < numscans; i++)
+	{
+		for (j = 0; j < numfilters; j++)
+			if ((ips[i] & mask[j]) == compare[j])
+				break;
+		found[i] = j < numfilters ? j : -1;
+	}
+	scant = SV_PhaseClock () - built;
+
+	// checked after the timing, so the scan is timed alone
+	for (i = 0; i < numscans; i++)
+		if (found[i] != IPTrie_Match (&trie, (byte *) &ips[i]))
+			mismatches++;
+
+	Con_Printf ("%d filters, trie built in %.1f ms\n", numfilters, start * 1000);
+	Con_Printf ("trie:   %d lookups, %.1f ns each, %d hits\n", numlookups, triet * 1e9 / numlookups, hits);
+	Con_Printf ("linear: %d lookups, %.1f ns each\n", numscans, scant * 1e9 / numscans);
+	if (mismatches)
+		Con_Printf ("%d lookups disagree!\n", mismatches);
+
+	IPTrie_Clear (&trie);
+	Q_free (compare);
+	Q_free (mask);
+	Q_free (ips);
+	Q_free (found);
+}
@@ -0,0 +1,567 @@
+/*
+Copyright (C) 1996-1997 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+/*
+  Server load test
+
+  "sv_loadtest <clients> <frames> [demo]" connects synthetic clients to the
+  running map over loopback. They go through the normal connection process
+  and then send a move every server frame, either the usercmds recorded in a
+  .qwd demo or a seeded pseudo random walk, so every run sends the same
+  input. Once all of them are in the game, the test runs for the given number
+  of server frames and prints the frame times of sv_frametime.c and the
+  traffic per client.
+
+  The clients parse what the server sends them with the headless demo
+  parser, follow the stufftext commands that take them through the signon,
+  and ask for delta compressed updates like a real client does. The server
+  chokes them to the rate in their userinfo like remote clients, only the
+  local client's loopback is unlimited.
+*/
+
+#include "quakedef.h"
+#include "server.h"
+#include "demo_parse.h"
+
+extern cvar_t qport;
+
+#define LT_QPORT		0x7a00		// qport of the first client
+#define LT_WARMUP		15			// seconds allowed for the clients to spawn
+
+typedef enum {lt_connecting, lt_connected, lt_spawned, lt_failed} ltstate_t;
+
+typedef struct
+{
+	ltstate_t	state;
+	netchan_t	netchan;
+	netadr_t	adr;
+	int			qport;
+	double		lastconnect;
+	usercmd_t	cmds[3];			// last moves sent, newest first
+	int			cmdnum;				// next command of the demo
+	double		msec;				// time not given to moves yet
+	unsigned int seed;
+	int			bytes_in, bytes_out;
+	demoparser_t *parser;			// what the server sends
+} loadclient_t;
+
+static loadclient_t	*lt_clients;
+static int			lt_numclients;
+static int			lt_spawncount;
+static qbool		lt_stopping;		// the queues are freed on the next frame
+
+static usercmd_t	*lt_cmds;			// from the demo
+static int			lt_numcmds;
+
+static int			lt_frames;			// to measure
+static int			lt_frame;
+static qbool		lt_measuring;
+static double		lt_start;
+
+/*
+================
+LT_LoadDemo
+
+Reads the usercmds of a client demo
+================
+*/
+static qbool LT_LoadDemo (char *name)
+{
+	char path[MAX_OSPATH];
+	byte *buf, *p, *end;
+	int len, msglen, i;
+	usercmd_t *cmd;
+
+	strlcpy (path, name, sizeof(path));
+	if (!strcmp (COM_FileExtension (path), "mvd"))
+	{
+		Con_Printf ("%s: MVD demos have no usercmds, use a .qwd demo\n", path);
+		return false;
+	}
+	COM_DefaultExtension (path, ".qwd");
+
+	if (!(buf = FS_LoadHeapFile (path, &len)))
+	{
+		Con_Printf ("Couldn't load %s\n", path);
+		return false;
+	}
+
+	// there can't be more commands than this
+	lt_cmds = (usercmd_t *) Q_malloc ((len / (5 + sizeof(usercmd_t) + 12) + 1) * sizeof(usercmd_t));
+	lt_numcmds = 0;
+
+	for (p = buf, end = buf + len; end - p >= 5; )
+	{
+		p += 4;		// time
+
+		switch (*p++)
+		{
+		case dem_cmd:
+			if (end - p < (int) sizeof(usercmd_t) + 12)
+			{
+				p = end;
+				break;
+			}
+			cmd = &lt_cmds[lt_numcmds++];
+			memcpy (cmd, p, sizeof(*cmd));
+			for (i = 0; i < 3; i++)
+				cmd->angles[i] = LittleFloat (cmd->angles[i]);
+			cmd->forwardmove = LittleShort (cmd->forwardmove);
+			cmd->sidemove = LittleShort (cmd->sidemove);
+			cmd->upmove = LittleShort (cmd->upmove);
+			p += sizeof(usercmd_t) + 12;	// and the view angles
+			break;
+
+		case dem_read:
+			if (end - p < 4)
+			{
+				p = end;
+				break;
+			}
+			memcpy (&msglen, p, 4);
+			p += 4 + LittleLong (msglen);
+			break;
+
+		case dem_set:
+			p += 8;
+			break;
+
+		default:
+			Con_Printf ("%s: not a .qwd demo\n", path);
+			p = end;
+			lt_numcmds = 0;
+			break;
+		}
+	}
+
+	Q_free (buf);
+
+	if (!lt_numcmds)
+	{
+		Con_Printf ("No usercmds in %s\n", path);
+		Q_free (lt_cmds);
+		return false;
+	}
+
+	Con_Printf ("%d usercmds from %s\n", lt_numcmds, path);
+	return true;
+}
+
+static unsigned int LT_Random (loadclient_t *lc)
+{
+	lc->seed = lc->seed * 1103515245 + 12345;
+	return (lc->seed >> 16) & 0x7fff;
+}
+
+// the next move of a client, without msec
+static void LT_NextCmd (loadclient_t *lc, usercmd_t *cmd)
+{
+	if (lt_numcmds)
+	{
+		*cmd = lt_cmds[lc->cmdnum++ % lt_numcmds];
+		return;
+	}
+
+	// run around, turning now and then
+	*cmd = lc->cmds[0];
+	cmd->impulse = 0;
+	cmd->buttons = 0;
+
+	if (LT_Random (lc) % 20 == 0)
+		cmd->sidemove = (LT_Random (lc) % 3 - 1) * 350;
+	cmd->angles[YAW] = anglemod (cmd->angles[YAW] + (int) (LT_Random (lc) % 9) - 4);
+	cmd->forwardmove = (LT_Random (lc) % 10) ? 400 : -400;
+	if (LT_Random (lc) % 25 == 0)
+		cmd->buttons |= BUTTON_JUMP;
+	if (LT_Random (lc) % 4 == 0)
+		cmd->buttons |= BUTTON_ATTACK;
+}
+
+static void LT_StringCmd (loadclient_t *lc, char *s)
+{
+	MSG_WriteByte (&lc->netchan.message, clc_stringcmd);
+	MSG_WriteString (&lc->netchan.message, s);
+}
+
+static void LT_Connect (loadclient_t *lc, int slot)
+{
+	lc->lastconnect = realtime;
+	Netchan_OutOfBandPrint (NS_CLIENT, lc->adr, "connect %i %i %i \"\\name\\loadtest%i\\rate\\25000\\msg\\1\"\n",
+							PROTOCOL_VERSION, lc->qport, 0, slot);
+}
+
+// follows the stufftexts of the signon
+static void LT_StuffText (loadclient_t *lc, const char *text)
+{
+	char line[256];
+	const char *nl;
+	int len;
+
+	while ((nl = strchr (text, '\n')))
+	{
+		len = min (nl - text, (int) sizeof(line) - 1);
+		memcpy (line, text, len);
+		line[len] = 0;
+		text = nl + 1;
+
+		if (!strncmp (line, "cmd ", 4))
+			LT_StringCmd (lc, line + 4);
+		else if (!strcmp (line, "skins"))
+		{
+			LT_StringCmd (lc, va ("begin %i", svs.spawncount));
+			lc->state = lt_spawned;
+		}
+	}
+}
+
+// the answer to "new", the signon starts with the first prespawn
+static void LT_OnServerData (demoparser_t *p)
+{
+	if (p->protocol == PROTOCOL_VERSION)
+		LT_StringCmd ((loadclient_t *) p->userdata, va ("prespawn %i 0 %i", svs.spawncount, sv.map_checksum2));
+}
+
+static void LT_OnStuffText (demoparser_t *p, const char *text)
+{
+	LT_StuffText ((loadclient_t *) p->userdata, text);
+}
+
+static void LT_ReadPackets (loadclient_t *lc, int slot)
+{
+	int c;
+
+	while (NET_GetLoopClientPacket (slot, &net_message))
+	{
+		if (*(int *) net_message.data == -1)
+		{
+			MSG_BeginReading ();
+			MSG_ReadLong ();
+			c = MSG_ReadByte ();
+
+			if (c == S2C_CONNECTION && lc->state == lt_connecting)
+			{
+				Netchan_Setup (NS_CLIENT, &lc->netchan, lc->adr, lc->qport);
+				lc->state = lt_connected;
+				LT_StringCmd (lc, "new");
+			}
+			else if (c == A2C_PRINT)
+			{
+				Con_Printf ("loadtest%i: %s", slot, MSG_ReadString ());
+				if (lc->state == lt_connecting)
+					lc->state = lt_failed;
+			}
+			continue;
+		}
+
+		if (lc->state == lt_connecting || lc->state == lt_failed)
+			continue;
+
+		if (!Netchan_Process (&lc->netchan))
+			continue;
+
+		lc->bytes_in += net_message.cursize;
+		DemoParse_Message (lc->parser, net_message.data + MSG_GetReadCount (), net_message.cursize - MSG_GetReadCount ());
+	}
+}
+
+static void LT_SendMove (loadclient_t *lc, double frametime)
+{
+	static usercmd_t nullcmd;
+	sizebuf_t buf;
+	byte data[128];
+	int checksumIndex;
+
+	memmove (&lc->cmds[1], &lc->cmds[0], 2 * sizeof(usercmd_t));
+	LT_NextCmd (lc, &lc->cmds[0]);
+
+	// moves add up to the time that passed, like a client's do
+	lc->msec += frametime * 1000;
+	lc->cmds[0].msec = (byte) bound (0, (int) lc->msec, 250);
+	lc->msec -= lc->cmds[0].msec;
+
+	SZ_Init (&buf, data, sizeof(data));
+	MSG_WriteByte (&buf, clc_move);
+	checksumIndex = buf.cursize;
+	MSG_WriteByte (&buf, 0);
+	MSG_WriteByte (&buf, 0);	// packet loss
+	MSG_WriteDeltaUsercmd (&buf, &nullcmd, &lc->cmds[2]);
+	MSG_WriteDeltaUsercmd (&buf, &lc->cmds[2], &lc->cmds[1]);
+	MSG_WriteDeltaUsercmd (&buf, &lc->cmds[1], &lc->cmds[0]);
+	buf.data[checksumIndex] = COM_BlockSequenceCRCByte (buf.data + checksumIndex + 1,
+		buf.cursize - checksumIndex - 1, lc->netchan.outgoing_sequence);
+
+	// every update is received, so the last one can be the delta base
+	if (lc->state == lt_spawned && lc->netchan.incoming_sequence)
+	{
+		MSG_WriteByte (&buf, clc_delta);
+		MSG_WriteByte (&buf, lc->netchan.incoming_sequence & 255);
+	}
+
+	lc->bytes_out += buf.cursize + lc->netchan.message.cursize;
+	Netchan_Transmit (&lc->netchan, buf.cursize, buf.data);
+}
+
+static void LT_Report (void)
+{
+	double elapsed = realtime - lt_start;
+	int i, spawned = 0, in = 0, out = 0, bad = 0;
+
+	for (i = 0; i < lt_numclients; i++)
+	{
+		bad += lt_clients[i].parser->badmessages;
+
+		if (lt_clients[i].state != lt_spawned)
+			continue;
+
+		spawned++;
+		in += lt_clients[i].bytes_in;
+		out += lt_clients[i].bytes_out;
+	}
+
+	Con_Printf ("Load test: %i clients, %i frames in %.1f seconds (%.1f fps)\n",
+				spawned, lt_frame, elapsed, elapsed > 0 ? lt_frame / elapsed : 0);
+	if (spawned && elapsed > 0)
+		Con_Printf ("bytes per client per second: %.0f to clients, %.0f from clients\n",
+					in / elapsed / spawned, out / elapsed / spawned);
+	if (bad)
+		Con_Printf ("%i messages the clients couldn't parse\n", bad);
+	SV_PrintFrameTimes ();
+	SV_PrintDeltaStats ();
+}
+
+static void LT_Stop (void)
+{
+	loadclient_t *lc;
+	int i;
+
+	for (i = 0, lc = lt_clients; i < lt_numclients; i++, lc++)
+	{
+		if (lc->state == lt_connected || lc->state == lt_spawned)
+		{
+			LT_StringCmd (lc, "drop");
+			Netchan_Transmit (&lc->netchan, 0, NULL);
+		}
+	}
+
+	lt_stopping = true;
+	lt_measuring = false;
+}
+
+// the server side of the clients that are still there, their "drop" may not have been read
+static void LT_DropClients (void)
+{
+	client_t *cl;
+	int i;
+
+	for (i = 0, cl = svs.clients; i < MAX_CLIENTS; i++, cl++)
+	{
+		if (cl->state == cs_free || cl->state == cs_zombie)
+			continue;
+
+		if (cl->netchan.remote_address.type != NA_LOOPBACK
+			|| cl->netchan.remote_address.port < 1 || cl->netchan.remote_address.port > lt_numclients)
+			continue;
+
+		SV_DropClient (cl);
+		SV_ClearReliable (cl);	// nobody reads the disconnect
+	}
+}
+
+static void LT_Free (void)
+{
+	int i;
+
+	LT_DropClients ();
+
+	for (i = 0; i < lt_numclients; i++)
+		DemoParse_Free (lt_clients[i].parser);
+
+	NET_SetLoopClients (0);
+	Q_free (lt_clients);
+	Q_free (lt_cmds);
+	lt_numclients = lt_numcmds = 0;
+	lt_stopping = false;
+}
+
+/*
+================
+SV_LoadTestFrame
+
+Runs the load test clients, called by SV_Frame before reading packets
+================
+*/
+void SV_LoadTestFrame (double frametime)
+{
+	loadclient_t *lc;
+	int i, waiting;
+
+	if (!lt_numclients)
+		return;
+
+	if (lt_stopping)
+	{
+		LT_Free ();
+		return;
+	}
+
+	if (sv.state != ss_active || svs.spawncount != lt_spawncount)
+	{
+		Con_Printf ("Load test aborted by a map change\n");
+		LT_Free ();
+		return;
+	}
+
+	waiting = 0;
+	for (i = 0, lc = lt_clients; i < lt_numclients; i++, lc++)
+	{
+		LT_ReadPackets (lc, i + 1);
+
+		switch (lc->state)
+		{
+		case lt_connecting:
+			if (realtime - lc->lastconnect > 1)
+				LT_Connect (lc, i + 1);
+			waiting++;
+			break;
+
+		case lt_connected:
+			waiting++;
+			// fall through
+		case lt_spawned:
+			LT_SendMove (lc, frametime);
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	if (lt_measuring)
+	{
+		if (++lt_frame >= lt_frames)
+		{
+			LT_Report ();
+			LT_Stop ();
+		}
+		return;
+	}
+
+	// start measuring once everybody is in the game
+	if (!waiting || realtime - lt_start > LT_WARMUP)
+	{
+		if (waiting)
+			Con_Printf ("%i load test clients didn't get into the game\n", waiting);
+
+		for (i = 0, lc = lt_clients; i < lt_numclients; i++, lc++)
+			lc->bytes_in = lc->bytes_out = 0;
+
+		SV_ResetFrameTimes ();
+		SV_ResetDeltaStats ();
+		lt_measuring = true;
+		lt_frame = 0;
+		lt_start = realtime;
+	}
+}
+
+/*
+================
+SV_LoadTest_f
+
+sv_loadtest <clients> <frames> [demo] | stop
+================
+*/
+static void SV_LoadTest_f (void)
+{
+	loadclient_t *lc;
+	int i, count;
+
+	if (Cmd_Argc () == 2 && !strcmp (Cmd_Argv (1), "stop"))
+	{
+		if (lt_numclients && !lt_stopping)
+		{
+			if (lt_measuring)
+				LT_Report ();
+			LT_Stop ();
+		}
+		return;
+	}
+
+	if (Cmd_Argc () < 3)
+	{
+		Con_Printf ("Usage: %s <clients> <frames> [demo] | stop\n", Cmd_Argv (0));
+		return;
+	}
+
+	if (sv.state != ss_active)
+	{
+		Con_Printf ("No map running\n");
+		return;
+	}
+
+	if (lt_numclients)
+	{
+		Con_Printf ("A load test is already running\n");
+		return;
+	}
+
+	count = Q_atoi (Cmd_Argv (1));
+	if (count < 1 || count > MAX_CLIENTS)
+	{
+		Con_Printf ("Between 1 and %i clients\n", MAX_CLIENTS);
+		return;
+	}
+
+	lt_frames = max (1, Q_atoi (Cmd_Argv (2)));
+
+	if (Cmd_Argc () > 3 && !LT_LoadDemo (Cmd_Argv (3)))
+		return;
+
+	lt_clients = (loadclient_t *) Q_calloc (count, sizeof(loadclient_t));
+	for (i = 0, lc = lt_clients; i < count; i++, lc++)
+	{
+		lc->state = lt_connecting;
+		lc->adr.type = NA_LOOPBACK;
+		lc->adr.port = i + 1;
+		lc->qport = LT_QPORT + i;
+		if (lc->qport == (int) qport.value)
+			lc->qport += MAX_CLIENTS;
+		lc->lastconnect = -999;
+		lc->seed = i + 1;
+		lc->parser = DemoParse_New (NULL, false);
+		lc->parser->userdata = lc;
+		lc->parser->OnServerData = LT_OnServerData;
+		lc->parser->OnStuffText = LT_OnStuffText;
+		lc->cmds[0].angles[YAW] = (360 / count) * i;
+		if (lt_numcmds)
+			lc->cmdnum = lt_numcmds / count * i;	// not all in step
+	}
+
+	lt_numclients = count;
+	lt_spawncount = svs.spawncount;
+	lt_measuring = false;
+	lt_start = realtime;
+	NET_SetLoopClients (count);
+
+	Con_Printf ("Connecting %i load test clients\n", count);
+}
+
+void SV_LoadTest_Init (void)
+{
+	Cmd_AddCommand ("sv_loadtest", SV_LoadTest_f);
+}
@@ -60,6 +60,8 @@ cvar_t	sys_select_timeout = {"sys_select_timeout",
 
 cvar_t	sys_restart_on_error = {"sys_restart_on_error", "0"};
 
+cvar_t	sv_batchio = {"sv_batchio", "1"};	// use recvmmsg/sendmmsg where available
+
 //cvar_t	developer = {"developer", "0"};		// show extra messages
 
 cvar_t	timeout = {"timeout", "65"};		// seconds without any message
@@ -236,6 +238,7 @@ void SV_Shutdown (char *finalmsg)
 	}
 	if (sv.mvdrecording)
 		SV_MVDStop_f();
+	SV_DemoWritersWait();
 
 //	NET_Shutdown ();
 
@@ -1886,6 +1889,48 @@ int		numpenfilters;
 
 cvar_t	filterban = {"filterban", "1"};
 
+// lookups go through tries, which are rebuilt when the lists change
+static iptrie_t	ipfilter_trie = {NULL, 4};	// ban filters only
+static iptrie_t	ipvip_trie = {NULL, 4};
+static iptrie_t	penfilter_trie = {NULL, 5};	// address and type
+static qbool	ipfilters_changed, ipvips_changed, penfilters_changed;
+
+static void SV_BuildFilterTries (void)
+{
+	byte	all[5] = {0xff, 0xff, 0xff, 0xff, 0xff};
+	byte	key[5];
+	int		i;
+
+	if (ipfilters_changed)
+	{
+		IPTrie_Clear (&ipfilter_trie);
+		for (i = 0; i < numipfilters; i++)
+			if (ipfilters[i].type == ipft_ban)
+				IPTrie_Insert (&ipfilter_trie, (byte *)&ipfilters[i].compare, (byte *)&ipfilters[i].mask, i);
+		ipfilters_changed = false;
+	}
+
+	if (ipvips_changed)
+	{
+		IPTrie_Clear (&ipvip_trie);
+		for (i = 0; i < numipvips; i++)
+			IPTrie_Insert (&ipvip_trie, (byte *)&ipvip[i].compare, (byte *)&ipvip[i].mask, i);
+		ipvips_changed = false;
+	}
+
+	if (penfilters_changed)
+	{
+		IPTrie_Clear (&penfilter_trie);
+		for (i = 0; i < numpenfilters; i++)
+		{
+			memcpy (key, penfilters[i].ip, 4);
+			key[4] = penfilters[i].type;
+			IPTrie_Insert (&penfilter_trie, key, all, i);
+		}
+		penfilters_changed = false;
+	}
+}
+
 /*
 =================
 StringToFilter
@@ -1969,6 +2014,7 @@ static void SV_AddIPVIP_f (void)
 
 	ipvip[i] = f;
 	ipvip[i].level = l;
+	ipvips_changed = true;
 }
 
 /*
@@ -1993,6 +2039,7 @@ static void SV_RemoveIPVIP_f (void)
 			for (j=i+1 ; j<numipvips ; j++)
 				ipvip[j-1] = ipvip[j];
 			numipvips--;
+			ipvips_changed = true;
 			Con_Printf ("Removed.\n");
 			return;
 		}
@@ -2108,6 +2155,7 @@ static void SV_AddIP_f (void)
 	}
 
 	ipfilters[i] = f;
+	ipfilters_changed = true;
 }
 
 /*
@@ -2133,6 +2181,7 @@ static void SV_RemoveIP_f (void)
 			for (j=i+1 ; j<numipfilters ; j++)
 				ipfilters[j-1] = ipfilters[j];
 			numipfilters--;
+			ipfilters_changed = true;
 			Con_Printf ("Removed.\n");
 			return;
 		}
@@ -2240,14 +2289,10 @@ SV_FilterPacket
 */
 qbool SV_FilterPacket (void)
 {
-	int		i;
-	unsigned	in;
+	SV_BuildFilterTries ();
 
-	in = *(unsigned *)net_from.ip;
-
-	for (i=0 ; i<numipfilters ; i++)
-		if ( ipfilters[i].type == ipft_ban && (in & ipfilters[i].mask) == ipfilters[i].compare )
-			return (int)filterban.value;
+	if (IPTrie_Match (&ipfilter_trie, net_from.ip) >= 0)
+		return (int)filterban.value;
 
 	return !(int)filterban.value;
 }
@@ -2338,6 +2383,7 @@ void SV_RemoveBansIPFilter (int i)
 		ipfilters[i] = ipfilters[i + 1];
 
 	numipfilters--;
+	ipfilters_changed = true;
 }
 
 void SV_CleanBansIPList (void)
@@ -2596,15 +2642,12 @@ SV_VIPbyIP
 int SV_VIPbyIP (netadr_t adr)
 {
 	int		i;
-	unsigned	in;
 
-	in = *(unsigned *)adr.ip;
+	SV_BuildFilterTries ();
 
-	for (i=0 ; i<numipvips ; i++)
-		if ( (in & ipvip[i].mask) == ipvip[i].compare)
-			return ipvip[i].level;
+	i = IPTrie_Match (&ipvip_trie, adr.ip);
 
-	return 0;
+	return i < 0 ? 0 : ipvip[i].level;
 }
 
 /*
@@ -2746,6 +2789,7 @@ void SV_RemoveIPFilter (int i)
 		penfilters[i] = penfilters[i + 1];
 
 	numpenfilters--;
+	penfilters_changed = true;
 }
 
 static void SV_CleanIPList (void)
@@ -2766,39 +2810,36 @@ static void SV_CleanIPList (void)
 	}
 }
 
-static qbool SV_IPCompare (byte *a, byte *b)
+static void SV_IPCopy (byte *dest, byte *src)
 {
 	int i;
 
 	for (i = 0; i < 1; i++)
-		if (((unsigned int *)a)[i] != ((unsigned int *)b)[i])
-			return false;
-
-	return true;
+		((unsigned int *)dest)[i] = ((unsigned int *)src)[i];
 }
 
-static void SV_IPCopy (byte *dest, byte *src)
+// index of the penalty filter of this type for the client's address, -1 if none
+static int SV_FindPenaltyFilter (client_t *cl, filtertype_t type)
 {
-	int i;
+	byte key[5];
 
-	for (i = 0; i < 1; i++)
-		((unsigned int *)dest)[i] = ((unsigned int *)src)[i];
+	SV_BuildFilterTries ();
+
+	memcpy (key, cl->realip.ip, 4);
+	key[4] = type;
+
+	return IPTrie_Match (&penfilter_trie, key);
 }
 
 void SV_SavePenaltyFilter (client_t *cl, filtertype_t type, double pentime)
 {
-	int i;
-
 	if (pentime < realtime)   // no point
 		return;
 
-	for (i = 0; i < numpenfilters; i++)
-		if (SV_IPCompare (penfilters[i].ip, cl->realip.ip)	&& penfilters[i].type == type)
-		{
-			return;
-		}
+	if (SV_FindPenaltyFilter (cl, type) >= 0)
+		return;
 
-	if (numpenfilters == MAX_IPFILTERS)
+	if (numpenfilters == MAX_PENFILTERS)
 	{
 		return;
 	}
@@ -2807,6 +2848,7 @@ void SV_SavePenaltyFilter (client_t *cl, filtertype_t type, double pentime)
 	penfilters[numpenfilters].time = pentime;
 	penfilters[numpenfilters].type = type;
 	numpenfilters++;
+	penfilters_changed = true;
 }
 
 double SV_RestorePenaltyFilter (client_t *cl, filtertype_t type)
@@ -2815,14 +2857,10 @@ double SV_RestorePenaltyFilter (client_t *cl, filtertype_t type)
 	double time1 = 0.0;
 
 	// search for existing penalty filter of same type
-	for (i = 0; i < numpenfilters; i++)
+	if ((i = SV_FindPenaltyFilter (cl, type)) >= 0)
 	{
-		if (type == penfilters[i].type && SV_IPCompare (cl->realip.ip, penfilters[i].ip))
-		{
-			time1 = penfilters[i].time;
-			SV_RemoveIPFilter (i);
-			return time1;
-		}
+		time1 = penfilters[i].time;
+		SV_RemoveIPFilter (i);
 	}
 	return time1;
 }
@@ -3134,10 +3172,12 @@ void SV_Frame (double time1)
 {
 	static double start, end;
 	double demo_start, demo_end;
+	double frame_start, phase_start;
 
 
 	start = Sys_DoubleTime ();
 	svs.stats.idle += start - end;
+	frame_start = SV_PhaseClock ();
 
 	// keep the random time dependent
 	rand ();
@@ -3166,29 +3206,42 @@ void SV_Frame (double time1)
 	// toggle the log buffer if full
 	SV_CheckLog ();
 
+	phase_start = SV_PhaseClock ();
 	SV_MVDStream_Poll();
+	SV_AddPhaseTime (SVPHASE_QTV, SV_PhaseClock () - phase_start);
 
 	// check for map change;
 	SV_Map(true);
 
 	SV_CheckVars ();
 
+	// synthetic clients of sv_loadtest
+	SV_LoadTestFrame (time1);
+
 	// get packets
+	phase_start = SV_PhaseClock ();
 	SV_ReadPackets ();
+	SV_AddPhaseTime (SVPHASE_READPACKETS, SV_PhaseClock () - phase_start);
 
 	// move autonomous things around if enough time has passed
+	phase_start = SV_PhaseClock ();
 	if (!sv.paused)
 		SV_Physics ();
 	else
 		PausedTic ();
+	SV_AddPhaseTime (SVPHASE_PHYSICS, SV_PhaseClock () - phase_start);
 
 	// send messages back to the clients that had packets read this frame
+	phase_start = SV_PhaseClock ();
 	SV_SendClientMessages ();
+	SV_AddPhaseTime (SVPHASE_SENDMESSAGES, SV_PhaseClock () - phase_start);
 
 	demo_start = Sys_DoubleTime ();
+	phase_start = SV_PhaseClock ();
 	
 	SV_SendDemoMessage();
 	
+	SV_AddPhaseTime (SVPHASE_DEMO, SV_PhaseClock () - phase_start);
 	demo_end = Sys_DoubleTime ();
 	svs.stats.demo += demo_end - demo_start;
 
@@ -3196,6 +3249,9 @@ void SV_Frame (double time1)
 	Master_Heartbeat ();
 
 	// collect timing statistics
+	SV_AddPhaseTime (SVPHASE_FRAME, SV_PhaseClock () - frame_start);
+	SV_FrameTimesFrame ();
+
 	end = Sys_DoubleTime ();
 	svs.stats.active += end-start;
 	if (++svs.stats.count == STATFRAMES)
@@ -3204,11 +3260,15 @@ void SV_Frame (double time1)
 		svs.stats.latched_idle = svs.stats.idle;
 		svs.stats.latched_packets = svs.stats.packets;
 		svs.stats.latched_demo = svs.stats.demo;
+		svs.stats.latched_multicasts = svs.stats.multicasts;
+		svs.stats.latched_multicast_recipients = svs.stats.multicast_recipients;
 		svs.stats.active = 0;
 		svs.stats.idle = 0;
 		svs.stats.packets = 0;
 		svs.stats.count = 0;
 		svs.stats.demo = 0;
+		svs.stats.multicasts = 0;
+		svs.stats.multicast_recipients = 0;
 	}
 }
 
@@ -3231,6 +3291,8 @@ void SV_InitLocal (void)
 	extern	cvar_t	sv_friction;
 	extern	cvar_t	sv_waterfriction;
 	extern	cvar_t	sv_nailhack;
+	extern	cvar_t	sv_snapshot_threads;
+	extern	cvar_t	sv_deltacache;
 
 	extern	cvar_t	pm_airstep;
 	extern	cvar_t	pm_pground;
@@ -3294,6 +3356,7 @@ void SV_InitLocal (void)
 	Cvar_Register (&sv_maxtic);
 	Cvar_Register (&sys_select_timeout);
 	Cvar_Register (&sys_restart_on_error);
+	Cvar_Register (&sv_batchio);
 
 	Cvar_Register (&skill);
 	Cvar_Register (&coop);
@@ -3379,11 +3442,19 @@ void SV_InitLocal (void)
 #endif
 
 	Cvar_Register (&sv_cullentities);
+	Cvar_Register (&sv_snapshot_threads);
+	Cvar_Register (&sv_deltacache);
+	Cvar_Register (&sv_worldgrid);
 
 // QW262 -->
 	Cmd_AddCommand ("svadmin", SV_Admin_f);
 // <-- QW262
 
+	Cmd_AddCommand ("sv_snapshotbench", SV_SnapshotBench_f);
+	Cmd_AddCommand ("sv_ipfilterbench", SV_IPFilterBench_f);
+	Cmd_AddCommand ("sv_deltastats", SV_DeltaStats_f);
+	Cmd_AddCommand ("sv_tracebench", SV_TraceBench_f);
+
 	Cmd_AddCommand ("addip", SV_AddIP_f);
 	Cmd_AddCommand ("removeip", SV_RemoveIP_f);
 	Cmd_AddCommand ("listip", SV_ListIP_f);
@@ -3719,6 +3790,9 @@ void SV_Init (/*quakeparms_t *parms */ void)
 
 	SV_MVDInit ();
 	Login_Init ();
+	SV_FrameTimes_Init ();
+	SV_LoadTest_Init ();
+	SV_Download_Init ();
 
 //	Hunk_AllocName (0, "-HOST_HUNKLEVEL-");
 //	host_hunklevel = Hunk_LowMark ();
@@ -41,6 +41,7 @@ redirect_t	sv_redirected;
 static int	sv_redirectbufcount;
 
 extern cvar_t sv_phs;
+extern cvar_t sv_cullentities;
 
 /*
 ==================
@@ -369,6 +370,87 @@ void SV_BroadcastCommand (char *fmt, ...)
 }
 
 
+/*
+=================
+Multicast target cache
+
+Keeps every spawned client's view origin and leaf, and groups the clients by
+leaf into bitmasks, so a multicast only tests one PVS/PHS bit per occupied
+leaf. A client's leaf is only looked up again when its view origin changed,
+which normally happens once per frame.
+=================
+*/
+typedef struct
+{
+	vec3_t		vieworg;
+	int			leafnum;
+	qbool		valid;
+} mcastclient_t;
+
+static mcastclient_t	mcast_clients[MAX_CLIENTS];
+static unsigned int		mcast_spawned;				// bit per spawned client
+static int				mcast_numleafs;
+static int				mcast_leafs[MAX_CLIENTS];
+static unsigned int		mcast_leafclients[MAX_CLIENTS];	// clients in mcast_leafs[i]
+
+static void SV_UpdateMulticastCache (void)
+{
+	unsigned int spawned = 0;
+	qbool changed = false;
+	mcastclient_t *mc;
+	client_t *client;
+	vec3_t vieworg;
+	int i, j, leafnum;
+
+	for (i = 0, client = svs.clients, mc = mcast_clients; i < MAX_CLIENTS; i++, client++, mc++)
+	{
+		if (client->state != cs_spawned)
+		{
+			mc->valid = false;
+			continue;
+		}
+
+		spawned |= 1u << i;
+
+		VectorAdd (client->edict->v.origin, client->edict->v.view_ofs, vieworg);
+		if (mc->valid && VectorCompare (vieworg, mc->vieworg))
+			continue;
+
+		leafnum = CM_Leafnum (CM_PointInLeaf (vieworg));
+		if (!mc->valid || leafnum != mc->leafnum)
+			changed = true;
+
+		VectorCopy (vieworg, mc->vieworg);
+		mc->leafnum = leafnum;
+		mc->valid = true;
+	}
+
+	if (!changed && spawned == mcast_spawned)
+		return;
+
+	// regroup the clients by leaf
+	mcast_spawned = spawned;
+	mcast_numleafs = 0;
+	for (i = 0, mc = mcast_clients; i < MAX_CLIENTS; i++, mc++)
+	{
+		if (!(spawned & (1u << i)))
+			continue;
+
+		for (j = 0; j < mcast_numleafs; j++)
+			if (mcast_leafs[j] == mc->leafnum)
+				break;
+
+		if (j == mcast_numleafs)
+		{
+			mcast_leafs[mcast_numleafs] = mc->leafnum;
+			mcast_leafclients[mcast_numleafs] = 0;
+			mcast_numleafs++;
+		}
+
+		mcast_leafclients[j] |= 1u << i;
+	}
+}
+
 /*
 =================
 SV_Multicast
@@ -388,7 +470,8 @@ void SV_Multicast (vec3_t origin, int to)
 	int		leafnum;
 	int		j;
 	qbool		reliable;
-	vec3_t		vieworg;
+	unsigned int	targets;
+	vec3_t		delta;
 
 	reliable = false;
 
@@ -417,38 +500,49 @@ void SV_Multicast (vec3_t origin, int to)
 		SV_Error ("SV_Multicast: bad to:%i", to);
 	}
 
-	// send the data to all relevent clients
-	for (j = 0, client = svs.clients; j < MAX_CLIENTS; j++, client++)
-	{
-		if (client->state != cs_spawned)
-			continue;
-
-		if (!mask)
-			goto inrange; // multicast to all
+	SV_UpdateMulticastCache ();
 
-		VectorAdd (client->edict->v.origin, client->edict->v.view_ofs, vieworg);
-
-		if (to == MULTICAST_PHS_R || to == MULTICAST_PHS)
+	if (!mask)
+	{
+		targets = mcast_spawned; // multicast to all
+	}
+	else
+	{
+		targets = 0;
+		for (j = 0; j < mcast_numleafs; j++)
 		{
-			vec3_t delta;
-			VectorSubtract(origin, vieworg, delta);
-			if (VectorLength(delta) <= 1024)
-				goto inrange;
+			leafnum = mcast_leafs[j];
+
+			// -1 is because pvs rows are 1 based, not 0 based like leafs
+			if (!leafnum || (mask[(leafnum - 1)>>3] & (1<<((leafnum - 1)&7))))
+				targets |= mcast_leafclients[j];
 		}
 
-		leafnum = CM_Leafnum(CM_PointInLeaf(vieworg));
-		if (leafnum)
+		// sounds are also heard by anyone close enough
+		if (to == MULTICAST_PHS_R || to == MULTICAST_PHS)
 		{
-			// -1 is because pvs rows are 1 based, not 0 based like leafs
-			leafnum = leafnum - 1;
-			if ( !(mask[leafnum>>3] & (1<<(leafnum&7)) ) )
+			for (j = 0; j < MAX_CLIENTS; j++)
 			{
-				// Con_Printf ("supressed multicast\n");
-				continue;
+				if (!(mcast_spawned & ~targets & (1u << j)))
+					continue;
+
+				VectorSubtract (origin, mcast_clients[j].vieworg, delta);
+				if (DotProduct (delta, delta) <= 1024 * 1024)
+					targets |= 1u << j;
 			}
 		}
+	}
+
+	svs.stats.multicasts++;
+
+	// send the data to all relevent clients
+	for (j = 0, client = svs.clients; j < MAX_CLIENTS; j++, client++)
+	{
+		if (!(targets & (1u << j)))
+			continue;
+
+		svs.stats.multicast_recipients++;
 
-inrange:
 		if (reliable)
 		{
 			ClientReliableCheckBlock(client, sv.multicast.cursize);
@@ -811,6 +905,55 @@ void SV_UpdateClientStats (client_t *client)
 		}
 }
 
+/*
+=======================
+SV_BeginClientDatagram
+
+Sets up the datagram and adds the client specific data to it
+=======================
+*/
+static void SV_BeginClientDatagram (client_t *client, sizebuf_t *msg, byte *buf, int bufsize)
+{
+	msg->data = buf;
+	msg->maxsize = bufsize;
+	msg->cursize = 0;
+	msg->allowoverflow = true;
+	msg->overflowed = false;
+
+	SV_WriteClientdataToMessage (client, msg);
+}
+
+/*
+=======================
+SV_FinishClientDatagram
+
+Appends the multicast datagram, sends stats and transmits the datagram
+=======================
+*/
+static void SV_FinishClientDatagram (client_t *client, sizebuf_t *msg)
+{
+	// copy the accumulated multicast datagram
+	// for this client out to the message
+	if (client->datagram.overflowed)
+		Con_Printf ("WARNING: datagram overflowed for %s\n", client->name);
+	else
+		SZ_Write (msg, client->datagram.data, client->datagram.cursize);
+	SZ_Clear (&client->datagram);
+
+	// send deltas over reliable stream
+	if (Netchan_CanReliable (&client->netchan))
+		SV_UpdateClientStats (client);
+
+	if (msg->overflowed)
+	{
+		Con_Printf ("WARNING: msg overflowed for %s\n", client->name);
+		SZ_Clear (msg);
+	}
+
+	// send the datagram
+	Netchan_Transmit (&client->netchan, msg->cursize, msg->data);
+}
+
 /*
 =======================
 SV_SendClientDatagram
@@ -822,12 +965,6 @@ void SV_SendClientDatagram (client_t *client, int client_num)
 	sizebuf_t	msg;
 	//	packet_t	*pack;
 
-	msg.data = buf;
-	msg.maxsize = sizeof(buf);
-	msg.cursize = 0;
-	msg.allowoverflow = true;
-	msg.overflowed = false;
-
 	// for faster downloading skip half the frames
 	/*if (client->download && client->netchan.outgoing_sequence & 1)
 	{
@@ -841,33 +978,259 @@ void SV_SendClientDatagram (client_t *client, int client_num)
 	*/
 
 	// add the client specific data to the datagram
-	SV_WriteClientdataToMessage (client, &msg);
+	SV_BeginClientDatagram (client, &msg, buf, sizeof(buf));
 
 	// send over all the objects that are in the PVS
 	// this will include clients, a packetentities, and
 	// possibly a nails update
 	SV_WriteEntitiesToClient (client, &msg, false);
 
-	// copy the accumulated multicast datagram
-	// for this client out to the message
-	if (client->datagram.overflowed)
-		Con_Printf ("WARNING: datagram overflowed for %s\n", client->name);
-	else
-		SZ_Write (&msg, client->datagram.data, client->datagram.cursize);
-	SZ_Clear (&client->datagram);
+	SV_FinishClientDatagram (client, &msg);
+}
 
-	// send deltas over reliable stream
-	if (Netchan_CanReliable (&client->netchan))
-		SV_UpdateClientStats (client);
+/*
+=============================================================================
 
-	if (msg.overflowed)
+PARALLEL SNAPSHOT BUILDING
+
+With sv_snapshot_threads set, the entity part of the client datagrams
+(SV_WriteEntitiesToClient) is built by a pool of worker threads together
+with the main thread. Client data, the multicast datagram, stats and
+Netchan_Transmit still run on the main thread, in client order.
+
+=============================================================================
+*/
+
+#define MAX_SNAPSHOT_THREADS 16
+
+cvar_t	sv_snapshot_threads = {"sv_snapshot_threads", "0"};	// worker threads in addition to the main one
+
+typedef struct
+{
+	client_t	*client;
+	sizebuf_t	msg;
+	byte		buf[MAX_DATAGRAM];
+} snapshot_job_t;
+
+static snapshot_job_t	snapshot_jobs[MAX_CLIENTS];
+
+static snapshot_job_t	*snapshot_joblist;
+static int				snapshot_jobcount;
+
+static int				snapshot_numthreads;
+static int				snapshot_wanted;
+static sem_t			snapshot_work[MAX_SNAPSHOT_THREADS];
+static sem_t			snapshot_done;
+static volatile qbool	snapshot_quit;
+
+// thread n of the pool (0 being the main thread) handles every (numthreads + 1)th job
+static void SV_SnapshotWork (int n)
+{
+	int i;
+
+	for (i = n; i < snapshot_jobcount; i += snapshot_numthreads + 1)
+		SV_WriteEntitiesToClient (snapshot_joblist[i].client, &snapshot_joblist[i].msg, false);
+}
+
+static DWORD WINAPI SV_SnapshotThread (void *param)
+{
+	int n = (int) (intptr_t) param;
+
+	while (1)
 	{
-		Con_Printf ("WARNING: msg overflowed for %s\n", client->name);
-		SZ_Clear (&msg);
+		Sys_SemWait (&snapshot_work[n - 1]);
+
+		if (snapshot_quit)
+			break;
+
+		SV_SnapshotWork (n);
+		Sys_SemPost (&snapshot_done);
 	}
 
-	// send the datagram
-	Netchan_Transmit (&client->netchan, msg.cursize, buf);
+	Sys_SemPost (&snapshot_done);
+	return 0;
+}
+
+static void SV_ShutdownSnapshotThreads (void)
+{
+	int i;
+
+	if (!snapshot_numthreads)
+		return;
+
+	snapshot_quit = true;
+	for (i = 0; i < snapshot_numthreads; i++)
+		Sys_SemPost (&snapshot_work[i]);
+	for (i = 0; i < snapshot_numthreads; i++)
+		Sys_SemWait (&snapshot_done);
+	snapshot_quit = false;
+
+	for (i = 0; i < snapshot_numthreads; i++)
+		Sys_SemDestroy (&snapshot_work[i]);
+	Sys_SemDestroy (&snapshot_done);
+	snapshot_numthreads = 0;
+}
+
+// (re)starts the worker pool when sv_snapshot_threads changes
+static void SV_CheckSnapshotThreads (void)
+{
+	int wanted = bound (0, sv_snapshot_threads.integer, MAX_SNAPSHOT_THREADS);
+
+	if (wanted == snapshot_wanted)
+		return;
+
+	SV_ShutdownSnapshotThreads ();
+	snapshot_wanted = wanted;
+
+	if (!wanted)
+		return;
+
+	if (Sys_SemInit (&snapshot_done, 0, wanted))
+	{
+		Con_Printf ("WARNING: failed to create snapshot thread semaphore\n");
+		return;
+	}
+
+	while (snapshot_numthreads < wanted)
+	{
+		if (Sys_SemInit (&snapshot_work[snapshot_numthreads], 0, 1))
+			break;
+
+		if (!Sys_CreateThread (SV_SnapshotThread, (void *) (intptr_t) (snapshot_numthreads + 1)))
+		{
+			Sys_SemDestroy (&snapshot_work[snapshot_numthreads]);
+			break;
+		}
+
+		snapshot_numthreads++;
+	}
+
+	if (snapshot_numthreads < wanted)
+		Con_Printf ("WARNING: created only %d of %d snapshot threads\n", snapshot_numthreads, wanted);
+
+	if (!snapshot_numthreads)
+		Sys_SemDestroy (&snapshot_done);
+}
+
+// entity culling traces and NQ muzzleflashes modify shared state
+static qbool SV_SnapshotThreadsActive (void)
+{
+	return snapshot_numthreads > 0 && !sv_cullentities.value && !pr_nqprogs;
+}
+
+// builds the entity part of all jobs, the main thread takes its share of the work
+static void SV_RunSnapshotJobs (snapshot_job_t *jobs, int count)
+{
+	int i;
+
+	snapshot_joblist = jobs;
+	snapshot_jobcount = count;
+
+	for (i = 0; i < snapshot_numthreads; i++)
+		Sys_SemPost (&snapshot_work[i]);
+
+	SV_SnapshotWork (0);
+
+	for (i = 0; i < snapshot_numthreads; i++)
+		Sys_SemWait (&snapshot_done);
+}
+
+/*
+=======================
+SV_SnapshotBench_f
+
+Times snapshot building for 8, 16 and 32 clients, serially and with the
+sv_snapshot_threads worker pool. Clients look from entities spread over the map.
+=======================
+*/
+void SV_SnapshotBench_f (void)
+{
+	static const int counts[] = { 8, 16, 32 };
+	edict_t *viewers[MAX_CLIENTS], *ent;
+	int numviewers, candidates, frames, c, e, f, k, pass;
+	double start, times[2];
+	client_t *fake;
+	snapshot_job_t *jobs;
+
+	if (sv.state != ss_active)
+	{
+		Con_Printf ("sv_snapshotbench: no active server\n");
+		return;
+	}
+
+	frames = Cmd_Argc () > 1 ? bound (1, atoi (Cmd_Argv (1)), 10000) : 200;
+
+	SV_CheckSnapshotThreads ();
+
+	// pick view points evenly from the entities with a model
+	for (candidates = 0, e = MAX_CLIENTS + 1; e < sv.num_edicts; e++)
+	{
+		ent = EDICT_NUM (e);
+		if (!ent->e->free && ent->v.modelindex)
+			candidates++;
+	}
+
+	for (numviewers = 0, k = 0, e = MAX_CLIENTS + 1; e < sv.num_edicts && numviewers < MAX_CLIENTS; e++)
+	{
+		ent = EDICT_NUM (e);
+		if (ent->e->free || !ent->v.modelindex)
+			continue;
+		if (k++ * MAX_CLIENTS >= numviewers * candidates)
+			viewers[numviewers++] = ent;
+	}
+
+	if (!numviewers)
+		viewers[numviewers++] = sv.edicts;
+
+	fake = (client_t *) Q_malloc (MAX_CLIENTS * sizeof(client_t));
+	jobs = (snapshot_job_t *) Q_malloc (MAX_CLIENTS * sizeof(snapshot_job_t));
+
+	Con_Printf ("%d frames, %d snapshot threads\n", frames, snapshot_numthreads);
+	Con_Printf ("clients serial ms/frame threaded ms/frame\n");
+
+	for (c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+	{
+		for (pass = 0; pass < 2; pass++)
+		{
+			memset (fake, 0, MAX_CLIENTS * sizeof(client_t));
+			for (k = 0; k < counts[c]; k++)
+			{
+				fake[k].state = cs_spawned;
+				fake[k].edict = viewers[k % numviewers];
+				jobs[k].client = &fake[k];
+			}
+
+			start = Sys_DoubleTime ();
+
+			for (f = 0; f < frames; f++)
+			{
+				for (k = 0; k < counts[c]; k++)
+				{
+					fake[k].netchan.incoming_sequence = f;
+					fake[k].delta_sequence = f - 1;
+
+					jobs[k].msg.data = jobs[k].buf;
+					jobs[k].msg.maxsize = sizeof(jobs[k].buf);
+					jobs[k].msg.cursize = 0;
+					jobs[k].msg.allowoverflow = true;
+					jobs[k].msg.overflowed = false;
+				}
+
+				if (pass && snapshot_numthreads)
+					SV_RunSnapshotJobs (jobs, counts[c]);
+				else
+					for (k = 0; k < counts[c]; k++)
+						SV_WriteEntitiesToClient (jobs[k].client, &jobs[k].msg, false);
+			}
+
+			times[pass] = 1000 * (Sys_DoubleTime () - start) / frames;
+		}
+
+		Con_Printf ("%7d %17.3f %19.3f\n", counts[c], times[0], times[1]);
+	}
+
+	Q_free (jobs);
+	Q_free (fake);
 }
 
 /*
@@ -998,15 +1361,26 @@ SV_SendClientMessages
 */
 void SV_SendClientMessages (void)
 {
-	int			i, j;
+	int			i, j, numjobs;
 	client_t	*c;
+	qbool		threaded;
 
 	if (sv.state != ss_active)
 		return;
 
+	SV_CheckSnapshotThreads ();
+	threaded = SV_SnapshotThreadsActive ();
+	numjobs = 0;
+
+	// entities moved since the last frame
+	SV_InvalidateEntityVisibility ();
+
 	// update frags, names, etc
 	SV_UpdateToReliableMessages ();
 
+	// collect the datagrams and push them out with as few syscalls as possible
+	NET_BeginSendBatch ();
+
 	// build individual updates
 	for (i=0, c = svs.clients ; i<MAX_CLIENTS ; i++, c++)
 	{
@@ -1017,6 +1391,7 @@ void SV_SendClientMessages (void)
 		{
 			SV_DropClient(c);
 			c->drop = false;
+			SV_InvalidateEntityVisibility (); // progs may have changed entities
 			continue;
 		}
 
@@ -1072,6 +1447,7 @@ void SV_SendClientMessages (void)
 			SV_BroadcastPrintf (PRINT_HIGH, "%s overflowed\n", c->name);
 			Con_Printf ("WARNING: reliable overflow for %s\n",c->name);
 			SV_DropClient (c);
+			SV_InvalidateEntityVisibility ();
 			c->send_message = true;
 			c->netchan.cleartime = 0;	// don't choke this message
 		}
@@ -1088,12 +1464,32 @@ void SV_SendClientMessages (void)
 		}
 
 		if (c->state == cs_spawned)
+			SV_PrepareClientVisibility (c);
+
+		if (c->state == cs_spawned && threaded)
+		{
+			// the entities are added below, for all clients at once
+			snapshot_jobs[numjobs].client = c;
+			SV_BeginClientDatagram (c, &snapshot_jobs[numjobs].msg, snapshot_jobs[numjobs].buf, sizeof(snapshot_jobs[numjobs].buf));
+			numjobs++;
+		}
+		else if (c->state == cs_spawned)
 			SV_SendClientDatagram (c, i);
 		else {
 			Netchan_Transmit (&c->netchan, c->datagram.cursize, c->datagram.data);	// just update reliable
 			c->datagram.cursize = 0;
 		}
 	}
+
+	if (numjobs)
+	{
+		SV_RunSnapshotJobs (snapshot_jobs, numjobs);
+
+		for (i = 0; i < numjobs; i++)
+			SV_FinishClientDatagram (snapshot_jobs[i].client, &snapshot_jobs[i].msg);
+	}
+
+	NET_FlushSendBatch ();
 }
 
 void SV_MVDPings (void)
@@ -1024,6 +1024,7 @@ void SV_NextChunkedDownload(int chunknum, int percent, int chunked_download_numb
 		MSG_WriteByte(msg, svc_download);
 		MSG_WriteLong(msg, chunknum);
 		SZ_Write(msg, buffer, CHUNKSIZE);
+		SV_DownloadServed(i);
 
 		if (sv_client->download_chunks_perframe)
 			Netchan_OutOfBand (NS_SERVER, sv_client->netchan.remote_address, msg->cursize, msg->data);
@@ -1094,6 +1095,7 @@ static void Cmd_NextDownload_f (void)
 	Con_DPrintf("; %d\n", percent);
 	ClientReliableWrite_Byte (sv_client, percent);
 	ClientReliableWrite_SZ (sv_client, buffer, r);
+	SV_DownloadServed(r);
 	sv_client->file_percent = percent; //bliP: file percent
 
 	if (sv_client->downloadcount == sv_client->downloadsize)
@@ -1372,7 +1374,7 @@ static void Cmd_Download_f(void)
 	else
 #endif
 	{
-		sv_client->download = FS_OpenVFS(name, "rb", FS_ANY);
+		sv_client->download = SV_OpenDownload(name);
 		if (sv_client->download)
 			sv_client->downloadsize = VFS_GETLEN(sv_client->download);
 
@@ -2932,6 +2934,80 @@ USER CMD EXECUTION
 ===========================================================================
 */
 
+static qbool AddEdictToPmove (edict_t *check, int pl, vec3_t pmove_mins, vec3_t pmove_maxs)
+{
+	int 		i;
+	physent_t	*pe;
+
+	if (check->v.owner == pl)
+		return true;		// player's own missile
+	if (check->v.solid == SOLID_BSP
+			|| check->v.solid == SOLID_BBOX
+			|| check->v.solid == SOLID_SLIDEBOX)
+	{
+		if (check == sv_player)
+			return true;
+
+		for (i=0 ; i<3 ; i++)
+			if (check->v.absmin[i] > pmove_maxs[i]
+			|| check->v.absmax[i] < pmove_mins[i])
+				break;
+		if (i != 3)
+			return true;
+		if (pmove.numphysent == MAX_PHYSENTS)
+			return false;
+		pe = &pmove.physents[pmove.numphysent];
+		pmove.numphysent++;
+
+		VectorCopy (check->v.origin, pe->origin);
+		pe->info = NUM_FOR_EDICT(check);
+		if (check->v.solid == SOLID_BSP) {
+			if ((unsigned)check->v.modelindex >= MAX_MODELS)
+				SV_Error ("AddLinksToPmove: check->v.modelindex >= MAX_MODELS");
+			pe->model = sv.models[(int)(check->v.modelindex)];
+			if (!pe->model)
+				SV_Error ("SOLID_BSP with a non-bsp model");
+		}
+		else
+		{
+			pe->model = NULL;
+			VectorCopy (check->v.mins, pe->mins);
+			VectorCopy (check->v.maxs, pe->maxs);
+		}
+	}
+
+	return true;
+}
+
+/*
+====================
+AddGridLinksToPmove
+
+Grid counterpart of AddLinksToPmove; kept out of the recursive walk so
+the touch list is only on the stack once.
+====================
+*/
+static void AddGridLinksToPmove (void)
+{
+	int 		pl;
+	int 		i, numtouch;
+	vec3_t		pmove_mins, pmove_maxs;
+	edict_t		*touchlist[MAX_EDICTS];
+
+	for (i=0 ; i<3 ; i++)
+	{
+		pmove_mins[i] = pmove.origin[i] - 256;
+		pmove_maxs[i] = pmove.origin[i] + 256;
+	}
+
+	pl = EDICT_TO_PROG(sv_player);
+
+	numtouch = SV_AreaEdicts (pmove_mins, pmove_maxs, touchlist, MAX_EDICTS, AREA_SOLID);
+	for (i = 0; i < numtouch; i++)
+		if (!AddEdictToPmove (touchlist[i], pl, pmove_mins, pmove_maxs))
+			return;
+}
+
 /*
 ====================
 AddLinksToPmove
@@ -2944,7 +3020,6 @@ static void AddLinksToPmove ( areanode_t *node )
 	edict_t		*check;
 	int 		pl;
 	int 		i;
-	physent_t	*pe;
 	vec3_t		pmove_mins, pmove_maxs;
 
 	for (i=0 ; i<3 ; i++)
@@ -2961,42 +3036,8 @@ static void AddLinksToPmove ( areanode_t *node )
 		next = l->next;
 		check = EDICT_FROM_AREA(l);
 
-		if (check->v.owner == pl)
-			continue;		// player's own missile
-		if (check->v.solid == SOLID_BSP
-				|| check->v.solid == SOLID_BBOX
-				|| check->v.solid == SOLID_SLIDEBOX)
-		{
-			if (check == sv_player)
-				continue;
-
-			for (i=0 ; i<3 ; i++)
-				if (check->v.absmin[i] > pmove_maxs[i]
-				|| check->v.absmax[i] < pmove_mins[i])
-					break;
-			if (i != 3)
-				continue;
-			if (pmove.numphysent == MAX_PHYSENTS)
-				return;
-			pe = &pmove.physents[pmove.numphysent];
-			pmove.numphysent++;
-
-			VectorCopy (check->v.origin, pe->origin);
-			pe->info = NUM_FOR_EDICT(check);
-			if (check->v.solid == SOLID_BSP) {
-				if ((unsigned)check->v.modelindex >= MAX_MODELS)
-					SV_Error ("AddLinksToPmove: check->v.modelindex >= MAX_MODELS");
-				pe->model = sv.models[(int)(check->v.modelindex)];
-				if (!pe->model)
-					SV_Error ("SOLID_BSP with a non-bsp model");
-			}
-			else
-			{
-				pe->model = NULL;
-				VectorCopy (check->v.mins, pe->mins);
-				VectorCopy (check->v.maxs, pe->maxs);
-			}
-		}
+		if (!AddEdictToPmove (check, pl, pmove_mins, pmove_maxs))
+			return;
 	}
 
 	// recurse down both sides
@@ -3213,7 +3254,10 @@ FIXME
 	// build physent list
 	pmove.numphysent = 1;
 	pmove.physents[0].model = sv.worldmodel;
-	AddLinksToPmove ( sv_areanodes );
+	if (SV_WorldGridActive ())
+		AddGridLinksToPmove ();
+	else
+		AddLinksToPmove ( sv_areanodes );
 
 	// fill in movevars
 	movevars.entgravity = sv_client->entgravity;
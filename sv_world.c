@@ -140,6 +140,147 @@ void InsertLinkAfter (link_t *l, link_t *after)
 areanode_t sv_areanodes[AREA_NODES];
 int sv_numareanodes;
 
+/*
+===============================================================================
+
+WORLD GRID
+
+An alternative to the areanode tree for large open maps. The world is split
+into a uniform grid of square cells on the x/y plane and every entity is
+linked into the cell holding the centre of its box. An entity is never larger
+than a cell, so a query only has to look at the cells within half a cell of
+its box. Entities wider than a cell go to a separate list that every query
+scans.
+
+Linking and unlinking stay O(1), and an entity is still linked through its
+single ent->e->area link. Selected with sv_worldgrid.
+
+===============================================================================
+*/
+
+#define	GRID_MAXCELLS	64		// per axis
+#define	GRID_MINSIZE	128		// smallest cell size
+
+typedef struct
+{
+	link_t	trigger_edicts;
+	link_t	solid_edicts;
+} worldcell_t;
+
+static worldcell_t	sv_gridcells[GRID_MAXCELLS * GRID_MAXCELLS];
+static worldcell_t	sv_gridlarge;		// entities wider than a cell
+static int			sv_gridsize[2];		// cells per axis
+static vec3_t		sv_gridorigin;
+static float		sv_gridcell;		// cell size
+static qbool		sv_worldgrid_active;
+
+static void OnChange_sv_worldgrid (cvar_t *var, char *value, qbool *cancel);
+cvar_t	sv_worldgrid = {"sv_worldgrid", "0", 0, OnChange_sv_worldgrid};
+
+static void SV_ClearWorldCell (worldcell_t *cell)
+{
+	ClearLink (&cell->trigger_edicts);
+	ClearLink (&cell->solid_edicts);
+}
+
+static void SV_CreateWorldGrid (vec3_t mins, vec3_t maxs)
+{
+	float size;
+	int i;
+
+	size = max (maxs[0] - mins[0], maxs[1] - mins[1]);
+	sv_gridcell = max (GRID_MINSIZE, ceil (size / GRID_MAXCELLS));
+
+	for (i = 0; i < 2; i++)
+		sv_gridsize[i] = bound (1, (int) ceil ((maxs[i] - mins[i]) / sv_gridcell), GRID_MAXCELLS);
+	VectorCopy (mins, sv_gridorigin);
+
+	for (i = 0; i < sv_gridsize[0] * sv_gridsize[1]; i++)
+		SV_ClearWorldCell (&sv_gridcells[i]);
+	SV_ClearWorldCell (&sv_gridlarge);
+}
+
+static int SV_GridCoord (float v, int axis)
+{
+	int c = (int) floor ((v - sv_gridorigin[axis]) / sv_gridcell);
+
+	return bound (0, c, sv_gridsize[axis] - 1);
+}
+
+static worldcell_t *SV_GridCellForEdict (edict_t *ent)
+{
+	int x, y;
+
+	if (ent->v.absmax[0] - ent->v.absmin[0] > sv_gridcell
+		|| ent->v.absmax[1] - ent->v.absmin[1] > sv_gridcell)
+		return &sv_gridlarge;
+
+	x = SV_GridCoord (0.5 * (ent->v.absmin[0] + ent->v.absmax[0]), 0);
+	y = SV_GridCoord (0.5 * (ent->v.absmin[1] + ent->v.absmax[1]), 1);
+
+	return &sv_gridcells[y * sv_gridsize[0] + x];
+}
+
+static int SV_AreaEdictsInList (link_t *start, vec3_t mins, vec3_t maxs, edict_t **edicts, int count, int max_edicts)
+{
+	link_t *l;
+	edict_t *touch;
+
+	for (l = start->next ; l != start ; l = l->next)
+	{
+		touch = EDICT_FROM_AREA(l);
+		if (touch->v.solid == SOLID_NOT)
+			continue;
+		if (mins[0] > touch->v.absmax[0]
+					 || mins[1] > touch->v.absmax[1]
+					 || mins[2] > touch->v.absmax[2]
+					 || maxs[0] < touch->v.absmin[0]
+					 || maxs[1] < touch->v.absmin[1]
+					 || maxs[2] < touch->v.absmin[2])
+			continue;
+
+		if (count == max_edicts)
+			return count;
+		edicts[count++] = touch;
+	}
+
+	return count;
+}
+
+static int SV_GridAreaEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts, int area)
+{
+	int x, y, x0, x1, y0, y1, count;
+	float half = 0.5 * sv_gridcell;
+	worldcell_t *cell;
+
+	cell = &sv_gridlarge;
+	count = SV_AreaEdictsInList (area == AREA_SOLID ? &cell->solid_edicts : &cell->trigger_edicts,
+				mins, maxs, edicts, 0, max_edicts);
+
+	x0 = SV_GridCoord (mins[0] - half, 0);
+	x1 = SV_GridCoord (maxs[0] + half, 0);
+	y0 = SV_GridCoord (mins[1] - half, 1);
+	y1 = SV_GridCoord (maxs[1] + half, 1);
+
+	for (y = y0; y <= y1; y++)
+	{
+		for (x = x0, cell = &sv_gridcells[y * sv_gridsize[0] + x0]; x <= x1; x++, cell++)
+		{
+			if (count == max_edicts)
+				return count;
+			count = SV_AreaEdictsInList (area == AREA_SOLID ? &cell->solid_edicts : &cell->trigger_edicts,
+						mins, maxs, edicts, count, max_edicts);
+		}
+	}
+
+	return count;
+}
+
+qbool SV_WorldGridActive (void)
+{
+	return sv_worldgrid_active;
+}
+
 /*
 ===============
 SV_CreateAreaNode
@@ -194,6 +335,9 @@ void SV_ClearWorld (void)
 	memset (sv_areanodes, 0, sizeof(sv_areanodes));
 	sv_numareanodes = 0;
 	SV_CreateAreaNode (0, sv.worldmodel->mins, sv.worldmodel->maxs);
+
+	SV_CreateWorldGrid (sv.worldmodel->mins, sv.worldmodel->maxs);
+	sv_worldgrid_active = !!(int)sv_worldgrid.value;
 }
 
 
@@ -222,6 +366,9 @@ int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts, i
 	int			stackdepth = 0, count = 0;
 	areanode_t	*localstack[AREA_NODES], *node = sv_areanodes;
 
+	if (sv_worldgrid_active)
+		return SV_GridAreaEdicts (mins, maxs, edicts, max_edicts, area);
+
 // touch linked edicts
 	while (1)
 	{
@@ -338,14 +485,93 @@ void SV_LinkToLeafs (edict_t *ent)
 
 /*
 ===============
-SV_LinkEdict
+SV_LinkToArea
 
+Links an entity with a valid abs box into the areanode tree or world grid
 ===============
 */
-void SV_LinkEdict (edict_t *ent, qbool touch_triggers)
+static void SV_LinkToArea (edict_t *ent)
 {
 	areanode_t	*node;
+	worldcell_t	*cell;
+
+	if (sv_worldgrid_active)
+	{
+		cell = SV_GridCellForEdict (ent);
+		if (ent->v.solid == SOLID_TRIGGER)
+			InsertLinkBefore (&ent->e->area, &cell->trigger_edicts);
+		else
+			InsertLinkBefore (&ent->e->area, &cell->solid_edicts);
+		return;
+	}
+
+// find the first node that the ent's box crosses
+	node = sv_areanodes;
+	while (1)
+	{
+		if (node->axis == -1)
+			break;
+		if (ent->v.absmin[node->axis] > node->dist)
+			node = node->children[0];
+		else if (ent->v.absmax[node->axis] < node->dist)
+			node = node->children[1];
+		else
+			break;		// crosses the node
+	}
 	
+// link it in	
+
+	if (ent->v.solid == SOLID_TRIGGER)
+		InsertLinkBefore (&ent->e->area, &node->trigger_edicts);
+	else
+		InsertLinkBefore (&ent->e->area, &node->solid_edicts);
+}
+
+/*
+===============
+SV_SetWorldGrid
+
+Moves every linked entity between the areanode tree and the world grid
+===============
+*/
+void SV_SetWorldGrid (qbool enable)
+{
+	edict_t *ent;
+	int e;
+
+	enable = !!enable;
+	if (enable == sv_worldgrid_active)
+		return;
+
+	sv_worldgrid_active = enable;
+
+	if (sv.state == ss_dead || !sv.worldmodel)
+		return;
+
+	for (e = 1; e < sv.num_edicts; e++)
+	{
+		ent = EDICT_NUM(e);
+		if (ent->e->free || !ent->e->area.prev)
+			continue;
+
+		RemoveLink (&ent->e->area);
+		SV_LinkToArea (ent);
+	}
+}
+
+static void OnChange_sv_worldgrid (cvar_t *var, char *value, qbool *cancel)
+{
+	SV_SetWorldGrid (!!atoi (value));
+}
+
+/*
+===============
+SV_LinkEdict
+
+===============
+*/
+void SV_LinkEdict (edict_t *ent, qbool touch_triggers)
+{
 	if (ent->e->area.prev)
 		SV_UnlinkEdict (ent);	// unlink from old position
 		
@@ -390,26 +616,7 @@ void SV_LinkEdict (edict_t *ent, qbool touch_triggers)
 	if (ent->v.solid == SOLID_NOT)
 		return;
 
-// find the first node that the ent's box crosses
-	node = sv_areanodes;
-	while (1)
-	{
-		if (node->axis == -1)
-			break;
-		if (ent->v.absmin[node->axis] > node->dist)
-			node = node->children[0];
-		else if (ent->v.absmax[node->axis] < node->dist)
-			node = node->children[1];
-		else
-			break;		// crosses the node
-	}
-	
-// link it in	
-
-	if (ent->v.solid == SOLID_TRIGGER)
-		InsertLinkBefore (&ent->e->area, &node->trigger_edicts);
-	else
-		InsertLinkBefore (&ent->e->area, &node->solid_edicts);
+	SV_LinkToArea (ent);
 	
 // if touch_triggers, touch all entities at this node and decend for more
 	if (touch_triggers)
@@ -637,3 +844,103 @@ trace_t SV_Trace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type,
 	return clip.trace;
 }
 
+
+/*
+==================
+SV_TraceBench_f
+
+sv_tracebench [traces]
+Runs the same set of entity-heavy traces through the areanode tree and the
+world grid and compares the time per trace and the results.
+==================
+*/
+static unsigned int tracebench_seed;
+
+static float SV_TraceBenchRandom (void)
+{
+	tracebench_seed = tracebench_seed * 1103515245 + 12345;
+	return ((tracebench_seed >> 8) & 0xffff) / 65535.0f;
+}
+
+void SV_TraceBench_f (void)
+{
+	static vec3_t pointsize = {0, 0, 0};
+	static vec3_t playermins = {-16, -16, -24}, playermaxs = {16, 16, 32};
+	edict_t *ent, **starts;
+	trace_t trace;
+	int numstarts, traces, mode, i, j, e, mismatches;
+	float *results[2];
+	double start, times[2];
+	vec3_t from, to;
+	qbool oldgrid;
+
+	if (sv.state != ss_active)
+	{
+		Con_Printf ("sv_tracebench: no active server\n");
+		return;
+	}
+
+	traces = Cmd_Argc () > 1 ? bound (1, atoi (Cmd_Argv (1)), 10000000) : 100000;
+
+	// start traces at the linked entities, like projectiles and players do
+	starts = (edict_t **) Q_malloc (sv.num_edicts * sizeof(edict_t *));
+	for (numstarts = 0, e = 1; e < sv.num_edicts; e++)
+	{
+		ent = EDICT_NUM(e);
+		if (!ent->e->free && ent->e->area.prev)
+			starts[numstarts++] = ent;
+	}
+
+	if (!numstarts)
+	{
+		Con_Printf ("sv_tracebench: no linked entities\n");
+		Q_free (starts);
+		return;
+	}
+
+	results[0] = (float *) Q_malloc (traces * sizeof(float));
+	results[1] = (float *) Q_malloc (traces * sizeof(float));
+	oldgrid = sv_worldgrid_active;
+
+	for (mode = 0; mode < 2; mode++)
+	{
+		SV_SetWorldGrid (mode);
+		tracebench_seed = 1;
+
+		start = Sys_DoubleTime ();
+		for (i = 0; i < traces; i++)
+		{
+			ent = starts[(int)(SV_TraceBenchRandom () * (numstarts - 1))];
+			for (j = 0; j < 3; j++)
+			{
+				from[j] = 0.5 * (ent->v.absmin[j] + ent->v.absmax[j]);
+				to[j] = from[j] + (SV_TraceBenchRandom () - 0.5) * 2048;
+			}
+
+			if (i & 1)
+				trace = SV_Trace (from, playermins, playermaxs, to, MOVE_NORMAL, ent);
+			else
+				trace = SV_Trace (from, pointsize, pointsize, to, MOVE_MISSILE, ent);
+
+			results[mode][i] = trace.fraction;
+		}
+		times[mode] = Sys_DoubleTime () - start;
+	}
+
+	SV_SetWorldGrid (oldgrid);
+
+	for (mismatches = 0, i = 0; i < traces; i++)
+		if (results[0][i] != results[1][i])
+			mismatches++;
+
+	Con_Printf ("%d traces from %d entities, grid %dx%d of %d units\n",
+				traces, numstarts, sv_gridsize[0], sv_gridsize[1], (int)sv_gridcell);
+	Con_Printf ("areanode tree: %8.3f us/trace\n", 1000000 * times[0] / traces);
+	Con_Printf ("world grid   : %8.3f us/trace\n", 1000000 * times[1] / traces);
+	if (mismatches)
+		Con_Printf ("%d traces gave different results\n", mismatches);
+
+	Q_free (results[0]);
+	Q_free (results[1]);
+	Q_free (starts);
+}
@@ -79,4 +79,12 @@ trace_t SV_Trace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type,
 
 int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts, int area);
 
+extern	cvar_t	sv_worldgrid;
+
+qbool SV_WorldGridActive (void);
+void SV_SetWorldGrid (qbool enable);
+// sv_worldgrid: link entities into a uniform grid instead of the areanode tree
+
+void SV_TraceBench_f (void);
+
 #endif /* !__WORLD_H__ */
@@ -114,6 +114,24 @@ int Sys_SemWait(sem_t *sem);
 int Sys_SemPost(sem_t *sem);
 int Sys_SemDestroy(sem_t *sem);
 
+// Atomic operations on ints shared between threads, SYS_ATOMICS is defined when
+// they are real; otherwise they are plain accesses, only good for one thread
+#if defined(_WIN32)
+#define SYS_ATOMICS
+#define Sys_AtomicLoad(p)			InterlockedCompareExchange ((volatile LONG *) (p), 0, 0)
+#define Sys_AtomicStore(p, v)		InterlockedExchange ((volatile LONG *) (p), (v))
+#define Sys_AtomicCAS(p, old, new)	(InterlockedCompareExchange ((volatile LONG *) (p), (new), (old)) == (old))
+#elif defined(__GNUC__)
+#define SYS_ATOMICS
+#define Sys_AtomicLoad(p)			__atomic_load_n ((p), __ATOMIC_ACQUIRE)
+#define Sys_AtomicStore(p, v)		__atomic_store_n ((p), (v), __ATOMIC_RELEASE)
+#define Sys_AtomicCAS(p, old, new)	__sync_bool_compare_and_swap ((p), (old), (new))
+#else
+#define Sys_AtomicLoad(p)			(*(p))
+#define Sys_AtomicStore(p, v)		(*(p) = (v))
+#define Sys_AtomicCAS(p, old, new)	(*(p) == (old) ? (*(p) = (new), true) : false)
+#endif
+
 // Timer Resolution
 // On windows to Sleep(1) really take only 1 ms it is necessary to explicitly request
 // such a high precision, otherwise the thread would sleep for much higher time (materials mention 18 ms or 50 ms)
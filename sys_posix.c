@@ -333,7 +333,13 @@ void Sys_MakeCodeWriteable (unsigned long startaddr, unsigned long length) {
 
 int  Sys_CreateThread(DWORD WINAPI (*func)(void *), void *param)
 {
-	SDL_CreateThread((SDL_ThreadFunction)func, NULL, param);
+	SDL_Thread *thread = SDL_CreateThread((SDL_ThreadFunction)func, NULL, param);
+
+	if (!thread)
+		return 0;
+
+	// Nobody waits for the threads, let them clean up after themselves.
+	SDL_DetachThread(thread);
 	return 1;
 }
 
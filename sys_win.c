@@ -1028,8 +1028,12 @@ int Sys_CreateThread(DWORD (WINAPI *func)(void *), void *param)
         CREATE_SUSPENDED,   // creation flags
         &threadid);         // pointer to receive thread ID
 
+    if (!thread)
+        return 0;
+
     SetThreadPriority(thread, THREAD_PRIORITY_HIGHEST);
     ResumeThread(thread);
+    CloseHandle(thread);    // nobody waits for it
 
     return 1;
 }
@@ -180,6 +180,10 @@ void VX_TrackerAddText(char *msg, tracktype_t tt)
 	if (!msg || !msg[0])
 		return;
 
+	// Messages seeked over would all show up at once.
+	if (cls.demoseeking)
+		return;
+
 
 	switch (tt) 
 	{